@@ -0,0 +1,131 @@
+#-----------------------------------------------------------------------------
+# Flash budget check and per-module size report for the Digital Bitbox
+# MIT License
+#
+# Run after linking with:
+#   cmake -DELF=<elf> -DSIZE=<arm-none-eabi-size> -DLINKER_SCRIPT=<ld>
+#         -DMARGIN=<bytes> -DOBJECT_DIR=<dir> -DHOT_SOURCES=<a.c,b.c>
+#         -P flash_budget.cmake
+#
+# Flash use is text + data, since initialized data is copied from rom.
+
+
+function(object_size file text data bss)
+    execute_process(COMMAND ${SIZE} -B ${file} OUTPUT_VARIABLE out RESULT_VARIABLE res)
+    if(NOT res EQUAL 0)
+        message(FATAL_ERROR "${SIZE} failed on ${file}")
+    endif()
+    string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" line "${out}")
+    set(${text} ${CMAKE_MATCH_1} PARENT_SCOPE)
+    set(${data} ${CMAKE_MATCH_2} PARENT_SCOPE)
+    set(${bss} ${CMAKE_MATCH_3} PARENT_SCOPE)
+endfunction()
+
+
+function(pad str width out)
+    string(LENGTH "${str}" len)
+    while(len LESS width)
+        set(str " ${str}")
+        math(EXPR len "${len} + 1")
+    endwhile()
+    set(${out} "${str}" PARENT_SCOPE)
+endfunction()
+
+
+function(region_length ld region out)
+    string(REGEX MATCH "${region}[ \t]*\\([^\n]*LENGTH[ \t]*=[ \t]*(0x[0-9A-Fa-f]+|[0-9]+)" match "${ld}")
+    if(NOT match)
+        set(${out} "" PARENT_SCOPE)
+        return()
+    endif()
+    set(length ${CMAKE_MATCH_1})
+    if(length MATCHES "^0x")
+        # math(EXPR) cannot parse hex in old CMake versions
+        string(SUBSTRING ${length} 2 -1 hex)
+        string(TOLOWER ${hex} hex)
+        set(length 0)
+        string(LENGTH ${hex} len)
+        set(i 0)
+        while(i LESS len)
+            string(SUBSTRING ${hex} ${i} 1 digit)
+            string(FIND "0123456789abcdef" ${digit} value)
+            math(EXPR length "${length} * 16 + ${value}")
+            math(EXPR i "${i} + 1")
+        endwhile()
+    endif()
+    set(${out} ${length} PARENT_SCOPE)
+endfunction()
+
+
+#-----------------------------------------------------------------------------
+# Per-module report
+
+string(REPLACE "," ";" HOT_SOURCES "${HOT_SOURCES}")
+file(GLOB_RECURSE OBJECTS ${OBJECT_DIR}/*.o ${OBJECT_DIR}/*.obj)
+list(SORT OBJECTS)
+
+message(STATUS "")
+message(STATUS "      text      data       bss  profile  module")
+foreach(obj ${OBJECTS})
+    file(RELATIVE_PATH module ${OBJECT_DIR} ${obj})
+    string(REGEX REPLACE "\\.(o|obj)$" "" module "${module}")
+    get_filename_component(source ${module} NAME)
+    list(FIND HOT_SOURCES ${source} hot)
+    if(hot LESS 0)
+        set(profile "size ")
+    else()
+        set(profile "speed")
+    endif()
+    object_size(${obj} text data bss)
+    pad("${text}" 10 text)
+    pad("${data}" 10 data)
+    pad("${bss}" 10 bss)
+    message(STATUS "${text}${data}${bss}  ${profile}    ${module}")
+endforeach()
+
+
+#-----------------------------------------------------------------------------
+# Budget
+
+file(READ ${LINKER_SCRIPT} ld)
+region_length("${ld}" rom rom_length)
+if(NOT rom_length)
+    message(FATAL_ERROR "No rom region in ${LINKER_SCRIPT}")
+endif()
+
+# The bootloader's shared crypto region (see crypto_table.h) is budgeted
+# separately. Everything placed there is flash that a firmware built with
+# BUILD_SHARED_CRYPTO does not carry.
+set(crypto_used 0)
+region_length("${ld}" crypto crypto_length)
+if(crypto_length)
+    execute_process(COMMAND ${SIZE} -A ${ELF} OUTPUT_VARIABLE out)
+    string(REGEX MATCH "\n\\.crypto[ \t]+([0-9]+)" match "${out}")
+    if(match)
+        set(crypto_used ${CMAKE_MATCH_1})
+    endif()
+    math(EXPR crypto_free "${crypto_length} - ${crypto_used}")
+endif()
+
+if(NOT MARGIN)
+    set(MARGIN 0)
+endif()
+object_size(${ELF} text data bss)
+math(EXPR used "${text} + ${data} - ${crypto_used}")
+math(EXPR budget "${rom_length} - ${MARGIN}")
+math(EXPR free "${budget} - ${used}")
+
+message(STATUS "")
+message(STATUS "Flash: ${used} of ${budget} bytes (rom ${rom_length}, margin ${MARGIN}), ${free} free")
+if(crypto_length)
+    message(STATUS "Crypto region: ${crypto_used} of ${crypto_length} bytes, ${crypto_free} free (reclaimed from the firmware)")
+endif()
+if(used GREATER budget)
+    math(EXPR over "${used} - ${budget}")
+    message(FATAL_ERROR "Flash budget exceeded by ${over} bytes")
+endif()
+if(crypto_length AND crypto_used GREATER crypto_length)
+    math(EXPR over "${crypto_used} - ${crypto_length}")
+    message(FATAL_ERROR "Crypto region exceeded by ${over} bytes")
+endif()
+
@@ -9,6 +9,7 @@ import pyaes
 import hid # hidapi (requires cython)
 import hashlib
 import struct
+import binascii
 
 
 # ----------------------------------------------------------------------------------
@@ -191,8 +192,8 @@ def sendPlainBoot(msg):
     return reply
 
 
-def sendChunk(chunknum, data):
-    b = bytearray(b"\x77\x00")
+def sendChunk(chunknum, data, op=b"\x77"):
+    b = bytearray(op + b"\x00")
     b[1] = chunknum % 0xFF
     b.extend(data)
     dbb_hid.write(b'\0' + b + b'\xFF'*(boot_buf_size_send-len(b)))
@@ -202,14 +203,50 @@ def sendChunk(chunknum, data):
     reply = bytearray(reply).rstrip(b' \t\r\n\0')
     reply = ''.join(chr(e) for e in reply)
     print("Loaded: {}  Code: {}".format(chunknum, reply))
+    return reply
+
+
+# Pipelined write ('p'): the bootloader replies once the chunk is buffered,
+# with the CRC32 of what it received, and programs it while the next chunk is
+# sent. Busy ('B') means both buffers are still being programmed. Any other
+# status is an error, e.g. a page of an earlier chunk failed to program ('W',
+# 'C'). Only an invalid command ('I') on the first chunk is returned, so that
+# the caller can fall back to 'w' on older bootloaders.
+def sendChunkPipelined(chunknum, data):
+    data = bytearray(data) + b'\xFF' * (chunksize - len(data))
+    while True:
+        reply = sendChunk(chunknum, data, b"\x70")
+        if reply[1] != 'B':
+            break
+    if reply[1] == 'I' and chunknum == 0:
+        return reply
+    if reply[1] != '0':
+        raise Exception('Write error {} in chunk {}'.format(reply[1], chunknum))
+    if int(reply[2:10], 16) != binascii.crc32(bytes(data)) & 0xffffffff:
+        raise Exception('CRC mismatch in chunk {}'.format(chunknum))
+    return reply
 
 
 def sendBin(filename):
     with open(filename, "rb") as f:
         cnt = 0
+        pipelined = True
         while True:
             data = f.read(chunksize)
             if len(data) == 0:
                 break
-            sendChunk(cnt, data)
+            if pipelined and sendChunkPipelined(cnt, data)[1] == 'I':
+                # Older bootloader: an invalid command clears the load flag
+                pipelined = False
+                sendPlainBoot("e")
+            if not pipelined:
+                sendChunk(cnt, data)
             cnt += 1
+    # Wait for the last chunks to be programmed. The reply carries the first
+    # write error of the pipelined chunks, if any.
+    while True:
+        reply = sendPlainBoot("v")
+        if reply[1] != 'B':
+            break
+    if pipelined and reply[1] not in ('\0', '0'):
+        raise Exception('Write error {} while programming the firmware'.format(reply[1]))
@@ -115,6 +115,8 @@ try:
         latest_version, = struct.unpack('>I', binascii.unhexlify(load_result[2+64:][:8]))
         app_version, = struct.unpack('>I', binascii.unhexlify(load_result[2+64+8:][:8]))
         print('ERROR: firmware downgrade not allowed. Got version %d, but must be equal or higher to %d' % (app_version, latest_version))
+    elif load_result[1] == 'K':
+        print('ERROR: firmware was built against a different bootloader crypto region\n\n')
     elif load_result[1] != '0':
         print('ERROR: invalid firmware signature\n\n')
     else:
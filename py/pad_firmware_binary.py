@@ -4,6 +4,8 @@ import sys
 import os
 import shutil
 import struct
+import hashlib
+import re
 
 binfile = sys.argv[1]
 padfile = sys.argv[2]
@@ -16,6 +18,25 @@ except:
     sys.exit(1)
 binsize = os.stat(binfile).st_size
 
+# Optional padded bootloader binary: pin the firmware to its crypto region.
+# The region is read from the bootloader linker script.
+def crypto_region():
+    ld = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'bootloader_crypto.ld')
+    with open(ld) as f:
+        m = re.search(r'^\s*crypto\s*\([^)]*\)\s*:\s*ORIGIN\s*=\s*(\w+)\s*,\s*LENGTH\s*=\s*(\w+)',
+                      f.read(), re.M)
+    if not m:
+        print '\nERROR: no crypto region in {}\n'.format(ld)
+        sys.exit(1)
+    return int(m.group(1), 0) - 0x00400000, int(m.group(2), 0)
+
+crypto_pin = b'\xff' * 32
+if len(sys.argv) > 4:
+    crypto_offset, crypto_len = crypto_region()
+    with open(sys.argv[4], 'rb') as f:
+        boot = f.read()
+    crypto_pin = hashlib.sha256(boot[crypto_offset:crypto_offset + crypto_len]).digest()
+
 max_binsize = 225280 # 220kB
 min_padsize = 512 # Reserved amount for metadata
 
@@ -27,6 +48,7 @@ else:
     # firmware monotonic version is a 4 byte big endian unsigned integer.
     version_bytes = struct.pack('>I', version_monotonic)
     with open(padfile, 'ab') as f:
-        f.write(b'\xff' * (max_binsize - binsize - len(version_bytes)))
+        f.write(b'\xff' * (max_binsize - binsize - len(crypto_pin) - len(version_bytes)))
+        f.write(crypto_pin)
         f.write(version_bytes)
         f.close()
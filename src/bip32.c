@@ -55,6 +55,20 @@ static uint32_t read_be(const uint8_t *data)
 }
 
 
+#ifdef TESTING
+// Child key derivations, i.e. EC multiplications
+static uint32_t hdnode_ckd_private = 0;
+static uint32_t hdnode_ckd_public = 0;
+
+
+void hdnode_ckd_count(uint32_t *private_ckd, uint32_t *public_ckd)
+{
+    *private_ckd = hdnode_ckd_private;
+    *public_ckd = hdnode_ckd_public;
+}
+#endif
+
+
 int hdnode_from_seed(const uint8_t *seed, int seed_len, HDNode *out)
 {
     uint8_t I[32 + 32];
@@ -84,6 +98,10 @@ int hdnode_private_ckd(HDNode *inout, uint32_t i)
     uint8_t fingerprint[32];
     uint8_t p[32], z[32];
 
+#ifdef TESTING
+    hdnode_ckd_private++;
+#endif
+
     if (i & 0x80000000) { // private derivation
         data[0] = 0;
         memcpy(data + 1, inout->private_key, 32);
@@ -128,6 +146,47 @@ int hdnode_private_ckd(HDNode *inout, uint32_t i)
 }
 
 
+// Non-hardened derivation from the public key only. Clears the private key.
+int hdnode_public_ckd(HDNode *inout, uint32_t i)
+{
+    uint8_t data[33 + 4];
+    uint8_t I[32 + 32];
+    uint8_t fingerprint[32];
+
+#ifdef TESTING
+    hdnode_ckd_public++;
+#endif
+
+    if (i & 0x80000000) {
+        return DBB_ERROR;
+    }
+    memcpy(data, inout->public_key, 33);
+    write_be(data + 33, i);
+
+    sha256_Raw(inout->public_key, 33, fingerprint);
+    ripemd160(fingerprint, 32, fingerprint);
+    inout->fingerprint = (fingerprint[0] << 24) + (fingerprint[1] << 16) +
+                         (fingerprint[2] << 8) + fingerprint[3];
+
+    hmac_sha512(inout->chain_code, 32, data, sizeof(data), I);
+    memcpy(inout->chain_code, I + 32, 32);
+    utils_zero(inout->private_key, 32);
+
+    if (!bitcoin_ecc.ecc_isValid(I, ECC_SECP256k1) ||
+            !bitcoin_ecc.ecc_generate_public_key(inout->public_key, inout->public_key, I,
+                    ECC_SECP256k1)) {
+        utils_zero(I, sizeof(I));
+        return DBB_ERROR;
+    }
+
+    inout->depth++;
+    inout->child_num = i;
+
+    utils_zero(I, sizeof(I));
+    return DBB_OK;
+}
+
+
 void hdnode_fill_public_key(HDNode *node)
 {
     bitcoin_ecc.ecc_get_public_key33(node->private_key, node->public_key, ECC_SECP256k1);
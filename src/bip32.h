@@ -45,9 +45,14 @@ typedef struct {
 
 int hdnode_from_seed(const uint8_t *seed, int seed_len, HDNode *out);
 int hdnode_private_ckd(HDNode *inout, uint32_t i);
+int hdnode_public_ckd(HDNode *inout, uint32_t i);
 void hdnode_fill_public_key(HDNode *node);
 void hdnode_serialize_public(const HDNode *node, char *str, int strsize);
 void hdnode_serialize_private(const HDNode *node, char *str, int strsize);
 int hdnode_deserialize(const char *str, HDNode *node);
 
+#ifdef TESTING
+void hdnode_ckd_count(uint32_t *private_ckd, uint32_t *public_ckd);
+#endif
+
 #endif
@@ -0,0 +1,126 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "boot_pipeline.h"
+#include "flags.h"
+#include "utils.h"
+
+
+// Call after erasing the firmware area
+void boot_pipeline_reset(BOOT_PIPELINE *p)
+{
+    p->pushed = 0;
+    p->done = 0;
+    p->page = 0;
+    p->failed = 0;
+    p->hashed = 0;
+    sha256_Init(&p->hash);
+}
+
+
+uint8_t boot_pipeline_pending(const BOOT_PIPELINE *p)
+{
+    return (uint8_t)(p->pushed - p->done);
+}
+
+
+// Interrupt side. Returns DBB_ERROR if both buffers are still being programmed.
+int boot_pipeline_push(BOOT_PIPELINE *p, uint8_t chunknum, const uint8_t *data,
+                       uint32_t *crc)
+{
+    uint8_t slot = p->pushed % BOOT_PIPELINE_DEPTH;
+
+    if (boot_pipeline_pending(p) >= BOOT_PIPELINE_DEPTH) {
+        return DBB_ERROR;
+    }
+    memcpy(p->buf[slot], data, FLASH_BOOT_CHUNK_LEN);
+    p->chunknum[slot] = chunknum;
+    *crc = utils_crc32(p->buf[slot], FLASH_BOOT_CHUNK_LEN);
+    p->pushed++;
+    return DBB_OK;
+}
+
+
+// Main loop side. Returns the next page to program and its offset in the
+// firmware area, or NULL if nothing is buffered.
+const uint8_t *boot_pipeline_page(const BOOT_PIPELINE *p, uint32_t *offset)
+{
+    uint8_t slot = p->done % BOOT_PIPELINE_DEPTH;
+
+    if (!boot_pipeline_pending(p)) {
+        return NULL;
+    }
+    *offset = p->chunknum[slot] * FLASH_BOOT_CHUNK_LEN + p->page * IFLASH0_PAGE_SIZE;
+    return p->buf[slot] + p->page * IFLASH0_PAGE_SIZE;
+}
+
+
+// Call once the page from boot_pipeline_page() is programmed; 'ok' if it
+// read back as written. A chunk with a failed page is left out of the
+// streamed hash, so that the hash always matches the flash.
+void boot_pipeline_page_done(BOOT_PIPELINE *p, uint8_t ok)
+{
+    uint8_t slot = p->done % BOOT_PIPELINE_DEPTH;
+
+    if (!ok) {
+        p->failed = 1;
+    }
+    if (++p->page < FLASH_BOOT_PAGES_PER_CHUNK) {
+        return;
+    }
+
+    if (p->chunknum[slot] == p->hashed && !p->failed) {
+        sha256_Update(&p->hash, p->buf[slot], FLASH_BOOT_CHUNK_LEN);
+        p->hashed++;
+    } else if (p->chunknum[slot] < p->hashed) {
+        // Rewrote a streamed chunk
+        sha256_Init(&p->hash);
+        p->hashed = 0;
+    }
+    p->page = 0;
+    p->failed = 0;
+    p->done++;
+}
+
+
+// SHA256 of the whole firmware area. Only valid with nothing pending.
+void boot_pipeline_hash(const BOOT_PIPELINE *p, const uint8_t *app,
+                        uint8_t hash[SHA256_DIGEST_LENGTH])
+{
+    SHA256_CTX ctx;
+    uint32_t streamed = p->hashed * FLASH_BOOT_CHUNK_LEN;
+
+    if (!p->hashed) {
+        sha256_Raw(app, FLASH_APP_LEN, hash);
+        return;
+    }
+    memcpy(&ctx, &p->hash, sizeof(ctx));
+    sha256_Update(&ctx, app + streamed, FLASH_APP_LEN - streamed);
+    sha256_Final(hash, &ctx);
+}
@@ -0,0 +1,75 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Double-buffered firmware write for the bootloader.
+//
+// The USB interrupt pushes a received chunk into a free buffer and replies at
+// once; the main loop programs the oldest buffered chunk one page at a time, so
+// that the next chunk is transferred while the previous one is programmed.
+// The interrupt is the only writer of 'pushed' and the main loop the only
+// writer of 'done', so no locking is needed.
+//
+// Programmed chunks that continue the firmware from chunk 0 are hashed as they
+// land. boot_pipeline_hash() only reads back the part of the flash that was
+// not streamed in order.
+
+
+#ifndef _BOOT_PIPELINE_H_
+#define _BOOT_PIPELINE_H_
+
+
+#include <stdint.h>
+#include "flash.h"
+#include "sha2.h"
+
+
+#define BOOT_PIPELINE_DEPTH     2
+
+
+typedef struct {
+    uint8_t buf[BOOT_PIPELINE_DEPTH][FLASH_BOOT_CHUNK_LEN];
+    uint8_t chunknum[BOOT_PIPELINE_DEPTH];
+    volatile uint8_t pushed;
+    volatile uint8_t done;
+    uint8_t page;// Next page of the oldest buffered chunk
+    uint8_t failed;// A page of the oldest buffered chunk did not program
+    uint8_t hashed;// Chunks [0, hashed) are in the streamed hash
+    SHA256_CTX hash;
+} BOOT_PIPELINE;
+
+
+void boot_pipeline_reset(BOOT_PIPELINE *p);
+uint8_t boot_pipeline_pending(const BOOT_PIPELINE *p);
+int boot_pipeline_push(BOOT_PIPELINE *p, uint8_t chunknum, const uint8_t *data,
+                       uint32_t *crc);
+const uint8_t *boot_pipeline_page(const BOOT_PIPELINE *p, uint32_t *offset);
+void boot_pipeline_page_done(BOOT_PIPELINE *p, uint8_t ok);
+void boot_pipeline_hash(const BOOT_PIPELINE *p, const uint8_t *app,
+                        uint8_t hash[SHA256_DIGEST_LENGTH]);
+
+
+#endif
@@ -38,11 +38,15 @@
 #include "utils.h"
 #include "touch.h"
 #include "version.h"
+#include "crypto_table.h"
 #include "bootloader.h"
+#include "boot_pipeline.h"
 
 
 static char report[UDI_HID_REPORT_IN_SIZE];
 static uint8_t bootloader_loading_ready = 0;
+static volatile uint8_t bootloader_write_status = OP_STATUS_OK;// First error of the pipelined writes
+static BOOT_PIPELINE pipeline;
 static const char *pubkeys[] = { // order is important
     "02a1137c6bdd497358537df77d1375a741ed75461b706a612a3717d32748e5acf1",
     "0256201125b958864de4bb00560a247ad246182866b6fe7ac29d7a12e7718ebb7d",
@@ -102,40 +106,65 @@ static void bootloader_report_status(BOOT_STATUS i)
 }
 
 
-static void bootloader_write_chunk(const char *buf, uint8_t chunknum)
+// Programs one buffered page. Interrupts are off while the flash is busy, so
+// the USB interrupt runs between pages.
+static BOOT_STATUS bootloader_program_page(void)
 {
-    bootloader_loading_ready = 0;
+    uint32_t offset;
+    BOOT_STATUS status = OP_STATUS_OK;
+    const uint8_t *page = boot_pipeline_page(&pipeline, &offset);
+
+    if (!page) {
+        return OP_STATUS_OK;
+    }
+
+    if (memcmp((uint8_t *)(FLASH_APP_START + offset), page, IFLASH0_PAGE_SIZE)) {
+        irqflags_t flags = cpu_irq_save();
+        if (flash_write(FLASH_APP_START + offset, page, IFLASH0_PAGE_SIZE, 0) != FLASH_RC_OK) {
+            status = OP_STATUS_ERR_WRITE;
+        } else if (memcmp((uint8_t *)(FLASH_APP_START + offset), page, IFLASH0_PAGE_SIZE)) {
+            status = OP_STATUS_ERR_CHECK;
+        }
+        cpu_irq_restore(flags);
+    }
 
+    boot_pipeline_page_done(&pipeline, status == OP_STATUS_OK);
+    return status;
+}
+
+
+static BOOT_STATUS bootloader_push_chunk(const char *buf, uint8_t chunknum, uint32_t *crc)
+{
     if (FLASH_BOOT_OP_LEN + FLASH_BOOT_CHUNK_LEN != UDI_HID_REPORT_OUT_SIZE) {
-        bootloader_report_status(OP_STATUS_ERR_MACRO);
-        return;
+        return OP_STATUS_ERR_MACRO;
     }
 
     if (chunknum > FLASH_BOOT_CHUNK_NUM - 1) {
-        bootloader_report_status(OP_STATUS_ERR_LEN);
-        return;
+        return OP_STATUS_ERR_LEN;
     }
 
-    if (!memcmp((uint32_t *)(FLASH_APP_START + (chunknum * FLASH_BOOT_CHUNK_LEN)), buf,
-                FLASH_BOOT_CHUNK_LEN)) {
-        bootloader_report_status(OP_STATUS_OK);
-        bootloader_loading_ready = 1;
-        return;
+    if (boot_pipeline_push(&pipeline, chunknum, (const uint8_t *)buf, crc) != DBB_OK) {
+        return OP_STATUS_BUSY;
     }
+    return OP_STATUS_OK;
+}
 
-    for (uint32_t i = 0; i < FLASH_BOOT_PAGES_PER_CHUNK; i++) {
-        if (flash_write(FLASH_APP_START + (chunknum * FLASH_BOOT_CHUNK_LEN) +
-                        (i * IFLASH0_PAGE_SIZE), buf + (i * IFLASH0_PAGE_SIZE), IFLASH0_PAGE_SIZE,
-                        0) != FLASH_RC_OK) {
-            bootloader_report_status(OP_STATUS_ERR_WRITE);
-            return;
-        }
 
-        if (memcmp((uint32_t *)(FLASH_APP_START + (chunknum * FLASH_BOOT_CHUNK_LEN) +
-                                (i * IFLASH0_PAGE_SIZE)), buf + (i * IFLASH0_PAGE_SIZE), IFLASH0_PAGE_SIZE)) {
-            bootloader_report_status(OP_STATUS_ERR_CHECK);
-            return;
-        }
+static void bootloader_write_chunk(const char *buf, uint8_t chunknum)
+{
+    uint32_t crc;
+    BOOT_STATUS status;
+
+    bootloader_loading_ready = 0;
+
+    status = bootloader_push_chunk(buf, chunknum, &crc);
+    while (status == OP_STATUS_OK && boot_pipeline_pending(&pipeline)) {
+        status = bootloader_program_page();
+    }
+    if (status != OP_STATUS_OK) {
+        boot_pipeline_reset(&pipeline);
+        bootloader_report_status(status);
+        return;
     }
 
     bootloader_report_status(OP_STATUS_OK);
@@ -143,9 +172,37 @@ static void bootloader_write_chunk(const char *buf, uint8_t chunknum)
 }
 
 
+// Replies as soon as the chunk is buffered, with the CRC32 of what was received
+// so that the host can stop early on a corrupted transfer. The chunk is
+// programmed from bootloader_idle().
+static void bootloader_write_chunk_pipelined(const char *buf, uint8_t chunknum)
+{
+    uint8_t crc_be[4];
+    uint32_t crc;
+    BOOT_STATUS status = bootloader_push_chunk(buf, chunknum, &crc);
+
+    if (status == OP_STATUS_OK && bootloader_write_status != OP_STATUS_OK) {
+        status = (BOOT_STATUS)bootloader_write_status;
+    }
+    if (status != OP_STATUS_OK && status != OP_STATUS_BUSY) {
+        bootloader_loading_ready = 0;
+    }
+    bootloader_report_status(status);
+    if (status == OP_STATUS_OK) {
+        crc_be[0] = crc >> 24;
+        crc_be[1] = crc >> 16;
+        crc_be[2] = crc >> 8;
+        crc_be[3] = crc;
+        memcpy(report + 2, utils_uint8_to_hex(crc_be, sizeof(crc_be)), 2 * sizeof(crc_be));
+    }
+}
+
+
 static void bootloader_firmware_erase(void)
 {
     bootloader_loading_ready = 0;
+    bootloader_write_status = OP_STATUS_OK;
+    boot_pipeline_reset(&pipeline);
     flash_unlock(FLASH_APP_START, FLASH_APP_START + FLASH_APP_LEN, NULL, NULL);
     for (uint32_t i = 0; i < FLASH_APP_PAGE_NUM; i += 8) {
         if (flash_erase_page(FLASH_APP_START + IFLASH0_PAGE_SIZE * i,
@@ -173,7 +230,7 @@ static uint8_t bootloader_firmware_verified(void)
     uint8_t cnt = 0, valid = 0, hash[32], sig[64], pubkey_64[64];
     const char **pubkey = pubkeys;
 
-    sha256_Raw((uint8_t *)(FLASH_APP_START), FLASH_APP_LEN, hash);
+    boot_pipeline_hash(&pipeline, (const uint8_t *)(FLASH_APP_START), hash);
     sha256_Raw(hash, 32, hash);
 
     while (*pubkey && valid < BOOT_SIG_M) {
@@ -191,6 +248,13 @@ static uint8_t bootloader_firmware_verified(void)
         return 0;
     }
 
+    // The pin is inside the signed app area
+    if (crypto_region_verify((const uint8_t *)FLASH_CRYPTO_START, FLASH_CRYPTO_LEN,
+                             (const uint8_t *)FLASH_APP_CRYPTO_PIN_START) != DBB_OK) {
+        bootloader_report_status(OP_STATUS_ERR_CRYPTO);
+        return 0;
+    }
+
     uint32_t app_version = bootloader_parse_app_version((uint8_t *)FLASH_APP_VERSION_START);
     uint32_t app_latest_version = bootloader_parse_app_version((uint8_t *)(
                                       FLASH_SIG_START + FLASH_BOOT_LATEST_APP_VERSION_BYTES));
@@ -231,11 +295,27 @@ static void bootloader_reboot(void)
     NVIC_SystemReset();
 }
 
+void bootloader_idle(void)
+{
+    BOOT_STATUS status = bootloader_program_page();
+    if (status != OP_STATUS_OK && bootloader_write_status == OP_STATUS_OK) {
+        bootloader_write_status = status;
+    }
+}
+
+
 void bootloader_command(const char *command)
 {
     memset(report, 0, sizeof(report));
     report[0] = command[0]; // OP_CODE
 
+    // Everything else waits for the buffered chunks to be programmed
+    if (boot_pipeline_pending(&pipeline) && command[0] != OP_WRITE_PIPELINED) {
+        bootloader_report_status(OP_STATUS_BUSY);
+        usb_reply((uint8_t *)report);
+        return;
+    }
+
     switch (command[0]) {
 
         case OP_LOCK: {
@@ -261,6 +341,10 @@ void bootloader_command(const char *command)
         case OP_VERSION: {
             char *r = report;
             memcpy(r + 2, DIGITAL_BITBOX_VERSION, sizeof(DIGITAL_BITBOX_VERSION));
+            // Final poll after a pipelined write: report a page that failed to program
+            if (bootloader_write_status != OP_STATUS_OK) {
+                bootloader_report_status((BOOT_STATUS)bootloader_write_status);
+            }
             break;
         }
 
@@ -284,10 +368,22 @@ void bootloader_command(const char *command)
             }
             break;
 
+        case OP_WRITE_PIPELINED:
+            if (!bootloader_loading_ready) {
+                bootloader_report_status(OP_STATUS_ERR_LOAD_FLAG);
+            } else {
+                bootloader_write_chunk_pipelined(command + FLASH_BOOT_OP_LEN, command[1]);
+            }
+            break;
+
         case OP_VERIFY: {
             uint8_t sig[FLASH_SIG_LEN];
             uint8_t cnt = 0;
             const char **pubkey = pubkeys;
+            if (bootloader_write_status != OP_STATUS_OK) {
+                bootloader_report_status((BOOT_STATUS)bootloader_write_status);
+                break;
+            }
             while (*pubkey) {
                 pubkey++;
                 cnt++;
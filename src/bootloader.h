@@ -37,6 +37,7 @@
 
 typedef enum BOOT_OP_CODES {
     OP_WRITE = 'w',/* 0x77 */
+    OP_WRITE_PIPELINED = 'p',/* 0x70 */
     OP_ERASE = 'e',/* 0x65 */
     OP_BLINK = 'b',/* 0x62 */
     OP_REBOOT = 'r',/* 0x72 */
@@ -56,11 +57,14 @@ typedef enum BOOT_STATUS {
     OP_STATUS_ERR_ERASE = 'E',
     OP_STATUS_ERR_LOAD_FLAG = 'L',
     OP_STATUS_ERR_INVALID_CMD = 'I',
+    OP_STATUS_ERR_CRYPTO = 'K',
+    OP_STATUS_BUSY = 'B',// Retry; previous chunks are still being programmed
     OP_STATUS_OK = '0'
 } BOOT_STATUS;
 
 
 void bootloader_jump(void);
+void bootloader_idle(void);
 void bootloader_command(const char *command);
 
 
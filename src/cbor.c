@@ -0,0 +1,287 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "cbor.h"
+#include "flags.h"
+
+
+static int cbor_read_depth(CBOR_READER *r, CBOR_ITEM *item, int depth);
+
+
+static int cbor_head(CBOR_READER *r, uint8_t *type, uint64_t *val)
+{
+    uint8_t info, n;
+
+    if (!r->len) {
+        return DBB_ERROR;
+    }
+    *type = r->p[0] >> 5;
+    info = r->p[0] & 0x1f;
+    r->p++;
+    r->len--;
+
+    if (info < 24) {
+        *val = info;
+        return DBB_OK;
+    }
+    if (info > 27) {
+        return DBB_ERROR;// Indefinite length or reserved
+    }
+    n = 1 << (info - 24);
+    if (r->len < n) {
+        return DBB_ERROR;
+    }
+    *val = 0;
+    while (n--) {
+        *val = (*val << 8) | *r->p++;
+        r->len--;
+    }
+    return DBB_OK;
+}
+
+
+static int cbor_skip(CBOR_READER *r, int depth)
+{
+    CBOR_ITEM item;
+    return cbor_read_depth(r, &item, depth);
+}
+
+
+static int cbor_read_depth(CBOR_READER *r, CBOR_ITEM *item, int depth)
+{
+    uint64_t i, n;
+
+    if (depth > CBOR_DEPTH_MAX || cbor_head(r, &item->type, &item->val) != DBB_OK) {
+        return DBB_ERROR;
+    }
+    item->p = r->p;
+
+    switch (item->type) {
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            if (item->val > r->len) {
+                return DBB_ERROR;
+            }
+            r->p += item->val;
+            r->len -= item->val;
+            break;
+        case CBOR_ARRAY:
+        case CBOR_MAP:
+            // Every element takes at least one byte
+            if (item->val > r->len) {
+                return DBB_ERROR;
+            }
+            n = item->type == CBOR_MAP ? item->val * 2 : item->val;
+            for (i = 0; i < n; i++) {
+                if (cbor_skip(r, depth + 1) != DBB_OK) {
+                    return DBB_ERROR;
+                }
+            }
+            break;
+        case CBOR_TAG:
+            if (cbor_skip(r, depth + 1) != DBB_OK) {
+                return DBB_ERROR;
+            }
+            break;
+        default:
+            break;
+    }
+    item->end = r->p;
+    return DBB_OK;
+}
+
+
+// Reads the next item, including everything nested in it
+int cbor_read(CBOR_READER *r, CBOR_ITEM *item)
+{
+    return cbor_read_depth(r, item, 0);
+}
+
+
+// Reader over the elements of an array or map item
+void cbor_item_reader(const CBOR_ITEM *item, CBOR_READER *r)
+{
+    r->p = item->p;
+    r->len = item->end - item->p;
+}
+
+
+int cbor_int(const CBOR_ITEM *item, int64_t *value)
+{
+    if ((item->type != CBOR_UINT && item->type != CBOR_NEGINT) || item->val > INT64_MAX) {
+        return DBB_ERROR;
+    }
+    *value = item->type == CBOR_UINT ? (int64_t)item->val : -1 - (int64_t)item->val;
+    return DBB_OK;
+}
+
+
+int cbor_text_eq(const CBOR_ITEM *item, const char *text)
+{
+    return item->type == CBOR_TEXT && item->val == strlen(text) &&
+           !memcmp(item->p, text, item->val);
+}
+
+
+static int cbor_map_find_key(const CBOR_ITEM *map, int64_t key, const char *text,
+                             CBOR_ITEM *value)
+{
+    CBOR_READER r;
+    CBOR_ITEM k;
+    int64_t i;
+    uint64_t n;
+
+    if (map->type != CBOR_MAP) {
+        return DBB_ERROR;
+    }
+    cbor_item_reader(map, &r);
+    for (n = 0; n < map->val; n++) {
+        if (cbor_read(&r, &k) != DBB_OK || cbor_read(&r, value) != DBB_OK) {
+            return DBB_ERROR;
+        }
+        if (text ? cbor_text_eq(&k, text) : (cbor_int(&k, &i) == DBB_OK && i == key)) {
+            return DBB_OK;
+        }
+    }
+    return DBB_ERROR;
+}
+
+
+// Value of an integer key, e.g. the parameters of a CTAP2 command
+int cbor_map_find(const CBOR_ITEM *map, int64_t key, CBOR_ITEM *value)
+{
+    return cbor_map_find_key(map, key, NULL, value);
+}
+
+
+// Value of a text key, e.g. the members of a WebAuthn dictionary
+int cbor_map_find_text(const CBOR_ITEM *map, const char *key, CBOR_ITEM *value)
+{
+    return cbor_map_find_key(map, 0, key, value);
+}
+
+
+void cbor_writer_init(CBOR_WRITER *w, uint8_t *buf, size_t size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->err = 0;
+}
+
+
+static void cbor_put_raw(CBOR_WRITER *w, const uint8_t *data, size_t len)
+{
+    if (w->err || len > w->size - w->len) {
+        w->err = 1;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+
+static void cbor_put_head(CBOR_WRITER *w, uint8_t type, uint64_t val)
+{
+    uint8_t head[9];
+    size_t i, n;
+
+    type <<= 5;
+    if (val < 24) {
+        head[0] = type | val;
+        cbor_put_raw(w, head, 1);
+        return;
+    }
+    if (val <= 0xff) {
+        head[0] = type | 24;
+        n = 1;
+    } else if (val <= 0xffff) {
+        head[0] = type | 25;
+        n = 2;
+    } else if (val <= 0xffffffff) {
+        head[0] = type | 26;
+        n = 4;
+    } else {
+        head[0] = type | 27;
+        n = 8;
+    }
+    for (i = 0; i < n; i++) {
+        head[n - i] = (val >> (8 * i)) & 0xff;
+    }
+    cbor_put_raw(w, head, n + 1);
+}
+
+
+void cbor_put_uint(CBOR_WRITER *w, uint64_t val)
+{
+    cbor_put_head(w, CBOR_UINT, val);
+}
+
+
+void cbor_put_int(CBOR_WRITER *w, int64_t val)
+{
+    if (val < 0) {
+        cbor_put_head(w, CBOR_NEGINT, -1 - val);
+    } else {
+        cbor_put_head(w, CBOR_UINT, val);
+    }
+}
+
+
+void cbor_put_bytes(CBOR_WRITER *w, const uint8_t *data, size_t len)
+{
+    cbor_put_head(w, CBOR_BYTES, len);
+    cbor_put_raw(w, data, len);
+}
+
+
+void cbor_put_text(CBOR_WRITER *w, const char *text)
+{
+    size_t len = strlen(text);
+    cbor_put_head(w, CBOR_TEXT, len);
+    cbor_put_raw(w, (const uint8_t *)text, len);
+}
+
+
+void cbor_put_array(CBOR_WRITER *w, size_t n)
+{
+    cbor_put_head(w, CBOR_ARRAY, n);
+}
+
+
+void cbor_put_map(CBOR_WRITER *w, size_t n)
+{
+    cbor_put_head(w, CBOR_MAP, n);
+}
+
+
+void cbor_put_bool(CBOR_WRITER *w, int val)
+{
+    cbor_put_head(w, CBOR_SIMPLE, val ? CBOR_TRUE : CBOR_FALSE);
+}
@@ -0,0 +1,102 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Minimal CBOR (RFC 7049) reader and writer for CTAP2 messages.
+//
+// Only definite lengths are supported, as CTAP2 requires canonical CBOR.
+// Floats and tags are skipped by the reader and never written. The writer
+// sets `err` instead of overrunning its buffer, so that a response is built
+// without checking every call and checked once at the end.
+
+
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define CBOR_UINT    0
+#define CBOR_NEGINT  1
+#define CBOR_BYTES   2
+#define CBOR_TEXT    3
+#define CBOR_ARRAY   4
+#define CBOR_MAP     5
+#define CBOR_TAG     6
+#define CBOR_SIMPLE  7
+
+#define CBOR_FALSE   20
+#define CBOR_TRUE    21
+#define CBOR_NULL    22
+
+#define CBOR_DEPTH_MAX 8
+
+
+typedef struct {
+    const uint8_t *p;
+    size_t len;
+} CBOR_READER;
+
+
+// A data item: its major type and argument. Strings also point to their
+// contents. Arrays and maps point to their first element, which is read
+// with a CBOR_READER started at `p` (see cbor_item_reader()).
+typedef struct {
+    uint8_t type;
+    uint64_t val;
+    const uint8_t *p;
+    const uint8_t *end;// End of the whole item, including nested items
+} CBOR_ITEM;
+
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    int err;
+} CBOR_WRITER;
+
+
+int cbor_read(CBOR_READER *r, CBOR_ITEM *item);
+void cbor_item_reader(const CBOR_ITEM *item, CBOR_READER *r);
+int cbor_map_find(const CBOR_ITEM *map, int64_t key, CBOR_ITEM *value);
+int cbor_map_find_text(const CBOR_ITEM *map, const char *key, CBOR_ITEM *value);
+int cbor_text_eq(const CBOR_ITEM *item, const char *text);
+int cbor_int(const CBOR_ITEM *item, int64_t *value);
+
+void cbor_writer_init(CBOR_WRITER *w, uint8_t *buf, size_t size);
+void cbor_put_uint(CBOR_WRITER *w, uint64_t val);
+void cbor_put_int(CBOR_WRITER *w, int64_t val);
+void cbor_put_bytes(CBOR_WRITER *w, const uint8_t *data, size_t len);
+void cbor_put_text(CBOR_WRITER *w, const char *text);
+void cbor_put_array(CBOR_WRITER *w, size_t n);
+void cbor_put_map(CBOR_WRITER *w, size_t n);
+void cbor_put_bool(CBOR_WRITER *w, int val);
+
+
+#endif
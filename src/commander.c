@@ -43,6 +43,9 @@
 #include "led.h"
 #include "ecc.h"
 #include "sd.h"
+#include "watermark.h"
+#include "power.h"
+#include "u2f_device.h"
 #ifndef TESTING
 #include "touch.h"
 #include "mcu.h"
@@ -63,6 +66,9 @@ __extension__ static char json_report[] = {[0 ... COMMANDER_REPORT_SIZE] = 0};
 __extension__ static char sign_command[] = {[0 ... COMMANDER_REPORT_SIZE] = 0};
 static char TFA_PIN[VERIFYPASS_LOCK_CODE_LEN * 2 + 1];
 static int TFA_VERIFY = 0;
+static int COMMAND_ID = CMD_input;// for per-command stack/heap peaks
+static uint32_t device_status_version = 1;
+static COMMANDER_DEVICE_STATUS device_status[2];// standard and hidden wallet
 
 // Must free() returned value (allocated inside base64() function)
 char *aes_cbc_b64_encrypt(const unsigned char *in, int inlen, int *out_b64len,
@@ -188,6 +194,7 @@ void commander_fill_report(const char *cmd, const char *msg, int flag)
     }
 
     if (flag > DBB_FLAG_ERROR_START) {
+        wallet_session_clear();
         if (strlens(msg)) {
             snprintf(p + strlens(json_report), COMMANDER_REPORT_SIZE - strlens(json_report),
                      "\"%s\":{\"message\":\"%s\",\"code\":%s,\"command\":\"%s\"}",
@@ -300,6 +307,7 @@ int commander_fill_signature_array(const uint8_t sig[64], uint8_t recid)
 void commander_force_reset(void)
 {
     memory_reset_hww();
+    commander_device_status_invalidate();
     commander_clear_report();
     commander_fill_report(cmd_str(CMD_reset), NULL, DBB_ERR_IO_RESET);
 }
@@ -343,18 +351,78 @@ static void commander_process_name(yajl_val json_node)
 
 static int commander_process_aes_key(const char *message, int msg_len, PASSWORD_ID id)
 {
-    return (memory_write_aeskey(message, msg_len, id));
+    int ret;
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    ret = memory_write_aeskey(message, msg_len, id);
+    power_enter(power);
+    return ret;
 }
 
 
-static int commander_process_backup_check(const char *key, const char *filename,
-        const char *source)
+static int commander_backup_u2f_match(const char *backup_hex)
+{
+    int ret;
+    uint8_t backup_u2f[MEM_PAGE_LEN];
+    const char *backup_u2f_hex = strchr(backup_hex, SD_PDF_DELIM2);
+
+    if (!strlens(backup_u2f_hex)) {
+        return DBB_ERROR;
+    }
+    memcpy(backup_u2f, utils_hex_to_uint8(backup_u2f_hex + strlens(SD_PDF_DELIM2_S)),
+           sizeof(backup_u2f));
+    ret = memcmp(backup_u2f, memory_master_u2f(NULL), MEM_PAGE_LEN) ? DBB_ERROR : DBB_OK;
+    utils_zero(backup_u2f, sizeof(backup_u2f));
+    return ret;
+}
+
+
+// Cheap check before deriving the wallet from the backup
+static int commander_backup_hww_entropy_match(const char *backup_hex)
+{
+    int ret;
+    uint8_t backup_hww[MEM_PAGE_LEN];
+
+    memcpy(backup_hww, utils_hex_to_uint8(backup_hex), sizeof(backup_hww));
+    if (!memcmp(backup_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN)) {
+        ret = DBB_ERROR;
+    } else if (memcmp(backup_hww, memory_master_hww_entropy(NULL), MEM_PAGE_LEN)) {
+        ret = DBB_ERROR;
+    } else {
+        ret = DBB_OK;
+    }
+    utils_zero(backup_hww, sizeof(backup_hww));
+    return ret;
+}
+
+
+// Entropy matches, check if derived master and chaincodes match
+static int commander_backup_hww_node_match(const char *key, const char *backup_hex)
 {
     int ret;
     HDNode node;
     uint8_t backup_hww[MEM_PAGE_LEN];
-    uint8_t backup_u2f[MEM_PAGE_LEN];
-    char *backup_u2f_hex;
+    char seed[MEM_PAGE_LEN * 2 + 1];
+
+    memcpy(backup_hww, utils_hex_to_uint8(backup_hex), sizeof(backup_hww));
+    snprintf(seed, sizeof(seed), "%s", utils_uint8_to_hex(backup_hww, sizeof(backup_hww)));
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    ret = wallet_generate_node(key, seed, &node);
+    power_enter(power);
+    if (ret == DBB_OK && (memcmp(node.private_key, wallet_get_master(), MEM_PAGE_LEN) ||
+                          memcmp(node.chain_code, wallet_get_chaincode(), MEM_PAGE_LEN))) {
+        ret = DBB_ERROR;
+    }
+    utils_zero(seed, sizeof(seed));
+    utils_zero(backup_hww, sizeof(backup_hww));
+    utils_zero(&node, sizeof(HDNode));
+    return ret;
+}
+
+
+static int commander_process_backup_check(const char *key, const char *filename,
+        const char *source)
+{
+    int ret;
     char *backup_hex;
 
     if (!strlens(source)) {
@@ -380,14 +448,7 @@ static int commander_process_backup_check(const char *key, const char *filename,
 
     // u2f | all
     if (STREQ(source, attr_str(ATTR_U2F)) || STREQ(source, attr_str(ATTR_all))) {
-        backup_u2f_hex = strchr(backup_hex, SD_PDF_DELIM2);
-        if (!strlens(backup_u2f_hex)) {
-            ret = DBB_ERROR;
-        } else {
-            memcpy(backup_u2f, utils_hex_to_uint8(backup_u2f_hex + strlens(SD_PDF_DELIM2_S)),
-                   sizeof(backup_u2f));
-            ret = memcmp(backup_u2f, memory_master_u2f(NULL), MEM_PAGE_LEN) ? DBB_ERROR : DBB_OK;
-        }
+        ret = commander_backup_u2f_match(backup_hex);
     } else {
         ret = DBB_OK;
     }
@@ -395,31 +456,13 @@ static int commander_process_backup_check(const char *key, const char *filename,
     // hww | all
     if ((ret == DBB_OK) && (STREQ(source, attr_str(ATTR_HWW)) ||
                             STREQ(source, attr_str(ATTR_all)))) {
-        memcpy(backup_hww, utils_hex_to_uint8(backup_hex), sizeof(backup_hww));
-        if (!memcmp(backup_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN)) {
-            ret = DBB_ERROR;
-        } else if (memcmp(backup_hww, memory_master_hww_entropy(NULL), MEM_PAGE_LEN)) {
-            ret = DBB_ERROR;
-        } else {
-            // entropy matches, check if derived master and chaincodes match
-            char seed[MEM_PAGE_LEN * 2 + 1];
-            snprintf(seed, sizeof(seed), "%s", utils_uint8_to_hex(backup_hww, MEM_PAGE_LEN));
-            if (wallet_generate_node(key, seed, &node) == DBB_ERROR) {
-                ret = DBB_ERROR;
-            } else if (memcmp(node.private_key, wallet_get_master(), MEM_PAGE_LEN) ||
-                       memcmp(node.chain_code, wallet_get_chaincode(), MEM_PAGE_LEN)) {
-                ret = DBB_ERROR;
-            } else {
-                ret = DBB_OK;
-            }
-            utils_zero(seed, sizeof(seed));
+        ret = commander_backup_hww_entropy_match(backup_hex);
+        if (ret == DBB_OK) {
+            ret = commander_backup_hww_node_match(key, backup_hex);
         }
     }
 
     utils_zero(backup_hex, strlens(backup_hex));
-    utils_zero(backup_hww, sizeof(backup_hww));
-    utils_zero(backup_u2f, sizeof(backup_u2f));
-    utils_zero(&node, sizeof(HDNode));
 
     if (ret == DBB_OK) {
         commander_fill_report(cmd_str(CMD_backup), attr_str(ATTR_success), DBB_OK);
@@ -430,6 +473,99 @@ static int commander_process_backup_check(const char *key, const char *filename,
 }
 
 
+typedef struct {
+    const char *key;
+    uint8_t u2f;
+    uint8_t hww;
+    int8_t hww_node;// -1 not derived yet
+    uint8_t truncated;
+    size_t len;
+    char report[SD_FILEBUF_LEN_MAX];
+} COMMANDER_BACKUP_AUDIT;
+
+
+static int commander_backup_audit_file(const char *fn, const char *backup_hex, void *arg)
+{
+    COMMANDER_BACKUP_AUDIT *audit = arg;
+    char entry[256];
+    int valid = strlens(backup_hex) >= MEM_PAGE_LEN * 2;
+    int u2f = 0, hww = 0;
+
+    if (valid && audit->u2f) {
+        u2f = (commander_backup_u2f_match(backup_hex) == DBB_OK);
+    }
+
+    if (valid && audit->hww && commander_backup_hww_entropy_match(backup_hex) == DBB_OK) {
+        // All candidates hold the same entropy, so derive the wallet only once
+        if (audit->hww_node < 0) {
+            audit->hww_node = (commander_backup_hww_node_match(audit->key, backup_hex) == DBB_OK);
+        }
+        hww = audit->hww_node;
+    }
+
+    snprintf(entry, sizeof(entry), "%s{\"%s\":\"%s\"", audit->len > 1 ? "," : "",
+             cmd_str(CMD_filename), fn);
+    if (audit->hww) {
+        snprintf(entry + strlens(entry), sizeof(entry) - strlens(entry), ",\"%s\":%s",
+                 attr_str(ATTR_HWW), attr_str(hww ? ATTR_true : ATTR_false));
+    }
+    if (audit->u2f) {
+        snprintf(entry + strlens(entry), sizeof(entry) - strlens(entry), ",\"%s\":%s",
+                 attr_str(ATTR_U2F), attr_str(u2f ? ATTR_true : ATTR_false));
+    }
+    strcat(entry, "}");
+
+    // Keep room for the closing bracket
+    if (audit->len + strlens(entry) + 1 >= sizeof(audit->report)) {
+        audit->truncated = 1;
+        return DBB_ERROR;
+    }
+    snprintf(audit->report + audit->len, sizeof(audit->report) - audit->len, "%s", entry);
+    audit->len += strlens(entry);
+    return DBB_OK;
+}
+
+
+// Checks every backup on the SD card in one pass
+static int commander_process_backup_audit(const char *key, const char *source)
+{
+    // Static to keep the report buffer off the stack
+    static COMMANDER_BACKUP_AUDIT audit;
+
+    memset(&audit, 0, sizeof(audit));
+    audit.key = key;
+    audit.hww_node = -1;
+    audit.u2f = STREQ(source, attr_str(ATTR_U2F)) || STREQ(source, attr_str(ATTR_all));
+    audit.hww = STREQ(source, attr_str(ATTR_HWW)) || STREQ(source, attr_str(ATTR_all));
+
+    if (!audit.u2f && !audit.hww) {
+        commander_fill_report(cmd_str(CMD_backup), NULL, DBB_ERR_IO_INVALID_CMD);
+        return DBB_ERROR;
+    }
+
+    // The U2F check only needs the U2F key
+    if (audit.hww && wallet_seeded() != DBB_OK) {
+        commander_fill_report(cmd_str(CMD_backup), NULL, DBB_ERR_KEY_MASTER);
+        return DBB_ERROR;
+    }
+
+    audit.report[audit.len++] = '[';
+    if (sd_load_all(CMD_backup, commander_backup_audit_file, &audit) != DBB_OK) {
+        /* error reported in sd_load_all() */
+        utils_zero(&audit, sizeof(audit));
+        return DBB_ERROR;
+    }
+    audit.report[audit.len++] = ']';
+
+    if (audit.truncated) {
+        commander_fill_report(cmd_str(CMD_warning), flag_msg(DBB_WARN_SD_NUM_FILES), DBB_OK);
+    }
+    commander_fill_report(cmd_str(CMD_backup), audit.report, DBB_JSON_ARRAY);
+    utils_zero(&audit, sizeof(audit));
+    return DBB_OK;
+}
+
+
 static int commander_process_backup_create(const char *key, const char *filename,
         const char *source)
 {
@@ -484,6 +620,7 @@ static void commander_process_backup(yajl_val json_node)
     const char *value_path[] = { cmd_str(CMD_backup), NULL };
     const char *erase_path[] = { cmd_str(CMD_backup), cmd_str(CMD_erase), NULL };
     const char *check_path[] = { cmd_str(CMD_backup), cmd_str(CMD_check), NULL };
+    const char *audit_path[] = { cmd_str(CMD_backup), cmd_str(CMD_audit), NULL };
     const char *key_path[] = { cmd_str(CMD_backup), cmd_str(CMD_key), NULL };
     const char *filename = YAJL_GET_STRING(yajl_tree_get(json_node, filename_path,
                                            yajl_t_string));
@@ -492,6 +629,7 @@ static void commander_process_backup(yajl_val json_node)
     const char *value = YAJL_GET_STRING(yajl_tree_get(json_node, value_path, yajl_t_string));
     const char *erase = YAJL_GET_STRING(yajl_tree_get(json_node, erase_path, yajl_t_string));
     const char *check = YAJL_GET_STRING(yajl_tree_get(json_node, check_path, yajl_t_string));
+    const char *audit = YAJL_GET_STRING(yajl_tree_get(json_node, audit_path, yajl_t_string));
     const char *key = YAJL_GET_STRING(yajl_tree_get(json_node, key_path, yajl_t_string));
     char source[MAX(MAX(strlens(attr_str(ATTR_U2F)), strlens(attr_str(ATTR_HWW))),
                                                          strlens(attr_str(ATTR_all))) + 1];
@@ -520,6 +658,16 @@ static void commander_process_backup(yajl_val json_node)
         return;
     }
 
+    if (audit) {
+        // Verify all backups on the SD card, {"audit":"HWW|U2F|all", "key":"..."}
+        if (!strlens(key) && !STREQ(audit, attr_str(ATTR_U2F))) {
+            commander_fill_report(cmd_str(CMD_backup), NULL, DBB_ERR_SD_KEY);
+            return;
+        }
+        commander_process_backup_audit(key, audit);
+        return;
+    }
+
     if (strlens(source_y)) {
         snprintf(source, sizeof(source), "%s", source_y);
     } else {
@@ -644,7 +792,9 @@ static void commander_process_seed(yajl_val json_node)
 
         snprintf(entropy_c, sizeof(entropy_c), "%s", utils_uint8_to_hex(entropy_b,
                  sizeof(entropy_b)));
+        POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
         ret = wallet_create(key, entropy_c);
+        power_enter(power);
         if (ret == DBB_OK) {
             if (commander_process_backup_create(key, filename, attr_str(ATTR_all)) != DBB_OK) {
                 memory_erase_hww_seed();
@@ -658,6 +808,7 @@ static void commander_process_seed(yajl_val json_node)
 
     else if (STREQ(source, attr_str(ATTR_U2F_create))) {
         memory_reset_u2f();
+        u2f_device_nonce_pool_clear();
         ret = commander_process_backup_create(key, filename, attr_str(ATTR_all));
         if (ret == DBB_OK && YAJL_IS_INTEGER(u2f_counter_data)) {
             memory_u2f_count_set(YAJL_GET_INTEGER(u2f_counter_data));
@@ -677,6 +828,7 @@ static void commander_process_seed(yajl_val json_node)
                 memcpy(backup_u2f, utils_hex_to_uint8(u2f + strlens(SD_PDF_DELIM2_S)),
                        sizeof(backup_u2f));
                 memory_master_u2f(backup_u2f);
+                u2f_device_nonce_pool_clear();
                 if (YAJL_IS_INTEGER(u2f_counter_data)) {
                     memory_u2f_count_set(YAJL_GET_INTEGER(u2f_counter_data));
                 }
@@ -698,7 +850,9 @@ static void commander_process_seed(yajl_val json_node)
                     memory_name(name + 1);
                 }
                 snprintf(entropy_c, sizeof(entropy_c), "%s", backup_hex);
+                POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
                 ret = wallet_create(key, entropy_c);
+                power_enter(power);
             }
         }
         utils_zero(backup_hex, strlens(backup_hex));
@@ -726,7 +880,10 @@ static void commander_process_seed(yajl_val json_node)
 static int commander_process_sign(yajl_val json_node)
 {
     size_t i;
-    int ret;
+    int ret = DBB_ERROR;
+    uint16_t count = 0;
+    const char *hashes[COMMANDER_SIGN_BATCH_MAX];
+    const char *keypaths[COMMANDER_SIGN_BATCH_MAX];
     const char *data_path[] = { cmd_str(CMD_sign), cmd_str(CMD_data), NULL };
     yajl_val data = yajl_tree_get(json_node, data_path, yajl_t_array);
 
@@ -749,10 +906,20 @@ static int commander_process_sign(yajl_val json_node)
             return DBB_ERROR;
         }
 
-        ret = wallet_sign(hash, keypath);
-        if (ret != DBB_OK) {
-            return ret;
-        };
+        hashes[count] = hash;
+        keypaths[count] = keypath;
+        count++;
+
+        // Sign in batches, which share the modular inversions
+        if (count == COMMANDER_SIGN_BATCH_MAX || i + 1 == data->u.array.len) {
+            POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+            ret = wallet_sign(hashes, keypaths, count);
+            power_enter(power);
+            if (ret != DBB_OK) {
+                return ret;
+            };
+            count = 0;
+        }
     }
     commander_fill_report(cmd_str(CMD_sign), json_array, DBB_JSON_ARRAY);
     memset(json_array, 0, COMMANDER_ARRAY_MAX);
@@ -827,7 +994,9 @@ static int commander_process_ecdh(int cmd, const uint8_t *pair_pubkey,
         return DBB_ERROR;
     }
 
-    // Use a 'second channel' LED blink code to avoid MITM
+    // Use a 'second channel' LED blink code to avoid MITM. The code plays
+    // from the SysTick, but the touch wait below still holds the USB interrupt
+    // for the whole pairing, as for any command that needs a touch.
     do {
         if (random_bytes(&rand_led, sizeof(rand_led), 0) == DBB_ERROR) {
             commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_MEM_ATAES);
@@ -973,7 +1142,9 @@ static void commander_process_xpub(yajl_val json_node)
         return;
     }
 
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
     wallet_report_xpub(value, xpub);
+    power_enter(power);
 
     if (xpub[0]) {
         commander_fill_report(cmd_str(CMD_xpub), xpub, DBB_OK);
@@ -1009,6 +1180,50 @@ static uint8_t commander_bootloader_unlocked(void)
 }
 
 
+// The status fields of `device info` that need EEPROM reads or key
+// derivations. Kept per wallet (standard, hidden) and recomputed when the
+// version changes, i.e. after a command that can change one of the fields.
+void commander_device_status_invalidate(void)
+{
+    device_status_version++;
+}
+
+
+const COMMANDER_DEVICE_STATUS *commander_device_status(void)
+{
+    COMMANDER_DEVICE_STATUS *status = &device_status[wallet_is_hidden() ? 1 : 0];
+    uint32_t ext_flags;
+
+    if (status->version == device_status_version) {
+        return status;
+    }
+
+    memset(status, 0, sizeof(COMMANDER_DEVICE_STATUS));
+    status->lock = wallet_is_locked() ? 1 : 0;
+    if (wallet_seeded() == DBB_OK) {
+        status->seeded = 1;
+        wallet_report_id(status->id);
+    }
+    status->bootlock = commander_bootloader_unlocked() ? 0 : 1;
+    ext_flags = memory_report_ext_flags();
+    status->u2f = (ext_flags & MEM_EXT_MASK_U2F) ? 1 : 0;// Bit is set == enabled
+    status->u2f_hijack = (ext_flags & MEM_EXT_MASK_U2F_HIJACK) ? 1 : 0;
+    status->version = device_status_version;
+    return status;
+}
+
+
+// The standard wallet status if it is cached, else NULL. Only reads RAM, so
+// it can be used outside commander(), e.g. for the U2FHID status command.
+const COMMANDER_DEVICE_STATUS *commander_device_status_cached(void)
+{
+    if (device_status[0].version != device_status_version) {
+        return NULL;
+    }
+    return &device_status[0];
+}
+
+
 static void commander_process_device(yajl_val json_node)
 {
     const char *path[] = { cmd_str(CMD_device), NULL };
@@ -1025,6 +1240,7 @@ static void commander_process_device(yajl_val json_node)
             if (status == DBB_TOUCHED) {
                 char msg[256];
                 memory_write_unlocked(0);
+                commander_device_status_invalidate();
                 snprintf(msg, sizeof(msg), "{\"%s\":%s}", attr_str(ATTR_lock), attr_str(ATTR_true));
                 commander_fill_report(cmd_str(CMD_device), msg, DBB_JSON_ARRAY);
             } else {
@@ -1045,42 +1261,22 @@ static void commander_process_device(yajl_val json_node)
         char bootlock[6] = {0};
         char u2f_enabled[6] = {0};
         char u2f_hijack_enabled[6] = {0};
+        char watermark[384] = {0};
         uint32_t serial[4] = {0};
 
-        flash_read_unique_id(serial, 4);
-
-        if (wallet_is_locked()) {
-            snprintf(lock, sizeof(lock), "%s", attr_str(ATTR_true));
-        } else {
-            snprintf(lock, sizeof(lock), "%s", attr_str(ATTR_false));
-        }
+        const COMMANDER_DEVICE_STATUS *status = commander_device_status();
 
-        if (wallet_seeded() == DBB_OK) {
-            snprintf(seeded, sizeof(seeded), "%s", attr_str(ATTR_true));
-            wallet_report_id(id);
-        } else {
-            snprintf(seeded, sizeof(seeded), "%s", attr_str(ATTR_false));
-        }
-
-        if (commander_bootloader_unlocked()) {
-            snprintf(bootlock, sizeof(bootlock), "%s", attr_str(ATTR_false));
-        } else {
-            snprintf(bootlock, sizeof(bootlock), "%s", attr_str(ATTR_true));
-        }
+        flash_read_unique_id(serial, 4);
 
-        uint32_t ext_flags = memory_report_ext_flags();
-        if (ext_flags & MEM_EXT_MASK_U2F) {
-            // Bit is set == enabled
-            snprintf(u2f_enabled, sizeof(u2f_enabled), "%s", attr_str(ATTR_true));
-        } else {
-            snprintf(u2f_enabled, sizeof(u2f_enabled), "%s", attr_str(ATTR_false));
-        }
-        if (ext_flags & MEM_EXT_MASK_U2F_HIJACK) {
-            // Bit is set == enabled
-            snprintf(u2f_hijack_enabled, sizeof(u2f_hijack_enabled), "%s", attr_str(ATTR_true));
-        } else {
-            snprintf(u2f_hijack_enabled, sizeof(u2f_hijack_enabled), "%s", attr_str(ATTR_false));
-        }
+        snprintf(id, sizeof(id), "%s", status->id);
+        snprintf(lock, sizeof(lock), "%s", attr_str(status->lock ? ATTR_true : ATTR_false));
+        snprintf(seeded, sizeof(seeded), "%s", attr_str(status->seeded ? ATTR_true : ATTR_false));
+        snprintf(bootlock, sizeof(bootlock), "%s",
+                 attr_str(status->bootlock ? ATTR_true : ATTR_false));
+        snprintf(u2f_enabled, sizeof(u2f_enabled), "%s",
+                 attr_str(status->u2f ? ATTR_true : ATTR_false));
+        snprintf(u2f_hijack_enabled, sizeof(u2f_hijack_enabled), "%s",
+                 attr_str(status->u2f_hijack ? ATTR_true : ATTR_false));
 
         if (sd_card_inserted() == DBB_OK) {
             snprintf(sdcard, sizeof(sdcard), "%s", attr_str(ATTR_true));
@@ -1088,6 +1284,8 @@ static void commander_process_device(yajl_val json_node)
             snprintf(sdcard, sizeof(sdcard), "%s", attr_str(ATTR_false));
         }
 
+        watermark_report(watermark, sizeof(watermark));
+
         int tfa_len;
         char *tfa = aes_cbc_b64_encrypt((const unsigned char *)VERIFYPASS_CRYPT_TEST,
                                         strlens(VERIFYPASS_CRYPT_TEST),
@@ -1100,7 +1298,7 @@ static void commander_process_device(yajl_val json_node)
         }
 
         snprintf(msg, sizeof(msg),
-                 "{\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":%s,\"%s\":%s,\"%s\":%s,\"%s\":%s,\"%s\":\"%s\",\"%s\":%s,\"%s\":%s}",
+                 "{\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":\"%s\",\"%s\":%s,\"%s\":%s,\"%s\":%s,\"%s\":%s,\"%s\":\"%s\",\"%s\":%s,\"%s\":%s,\"%s\":%s}",
                  attr_str(ATTR_serial), utils_uint8_to_hex((uint8_t *)serial, sizeof(serial)),
                  attr_str(ATTR_version), DIGITAL_BITBOX_VERSION,
                  attr_str(ATTR_name), (char *)memory_name(""),
@@ -1111,7 +1309,8 @@ static void commander_process_device(yajl_val json_node)
                  attr_str(ATTR_sdcard), sdcard,
                  attr_str(ATTR_TFA), tfa,
                  attr_str(ATTR_U2F), u2f_enabled,
-                 attr_str(ATTR_U2F_hijack), u2f_hijack_enabled);
+                 attr_str(ATTR_U2F_hijack), u2f_hijack_enabled,
+                 attr_str(ATTR_watermark), watermark);
 
         free(tfa);
         commander_fill_report(cmd_str(CMD_device), msg, DBB_JSON_ARRAY);
@@ -1156,10 +1355,14 @@ static void commander_process_feature_set(yajl_val json_node)
         uint32_t flags = memory_report_ext_flags();
         const char *u2f_path[] = { cmd_str(CMD_U2F), NULL };
         const char *u2f_hijack_path[] = { cmd_str(CMD_U2F_hijack), NULL };
+        const char *session_path[] = { cmd_str(CMD_session), NULL };
+        const char *u2f_precompute_path[] = { cmd_str(CMD_U2F_precompute), NULL };
         yajl_val u2f = yajl_tree_get(data, u2f_path, yajl_t_any);
         yajl_val u2f_hijack = yajl_tree_get(data, u2f_hijack_path, yajl_t_any);
+        yajl_val session = yajl_tree_get(data, session_path, yajl_t_any);
+        yajl_val u2f_precompute = yajl_tree_get(data, u2f_precompute_path, yajl_t_any);
 
-        if (!u2f && !u2f_hijack) {
+        if (!u2f && !u2f_hijack && !session && !u2f_precompute) {
             goto err;
         }
 
@@ -1185,7 +1388,30 @@ static void commander_process_feature_set(yajl_val json_node)
             }
         }
 
+        // Clear the bit == enabled (opt-in)
+        if (session) {
+            if (YAJL_IS_TRUE(session)) {
+                flags &= ~(MEM_EXT_MASK_SESSION);
+            } else if (YAJL_IS_FALSE(session)) {
+                flags |= MEM_EXT_MASK_SESSION;
+            } else {
+                goto err;
+            }
+        }
+
+        // Clear the bit == enabled (opt-in)
+        if (u2f_precompute) {
+            if (YAJL_IS_TRUE(u2f_precompute)) {
+                flags &= ~(MEM_EXT_MASK_U2F_PRECOMPUTE);
+            } else if (YAJL_IS_FALSE(u2f_precompute)) {
+                flags |= MEM_EXT_MASK_U2F_PRECOMPUTE;
+            } else {
+                goto err;
+            }
+        }
+
         memory_write_ext_flags(flags);
+        u2f_device_nonce_pool_clear();
         commander_fill_report(cmd_str(CMD_feature_set), attr_str(ATTR_success), DBB_OK);
         return;
     }
@@ -1297,7 +1523,10 @@ static void commander_process_hidden_password(yajl_val json_node)
 
     snprintf(seed, sizeof(seed), "%s", utils_uint8_to_hex(memory_master_hww_entropy(NULL),
              MEM_PAGE_LEN));
-    if (wallet_generate_node(key, seed, &node) == DBB_ERROR) {
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    ret = wallet_generate_node(key, seed, &node);
+    power_enter(power);
+    if (ret == DBB_ERROR) {
         commander_fill_report(cmd_str(CMD_hidden_password), NULL, DBB_ERR_MEM_ATAES);
         return;
     }
@@ -1331,19 +1560,251 @@ static void commander_process_password(yajl_val json_node)
 }
 
 
+static int commander_arg_type(yajl_val value)
+{
+    if (YAJL_IS_STRING(value)) {
+        return ARG_STRING;
+    } else if (YAJL_IS_OBJECT(value)) {
+        return ARG_OBJECT;
+    } else if (YAJL_IS_ARRAY(value)) {
+        return ARG_ARRAY;
+    } else if (YAJL_IS_TRUE(value) || YAJL_IS_FALSE(value)) {
+        return ARG_BOOL;
+    } else if (YAJL_IS_NUMBER(value)) {
+        return ARG_NUMBER;
+    }
+    return 0;
+}
+
+
+// Checks one argument against its CMD_ARGS entry. Returns DBB_OK, the
+// entry's flag, or DBB_ERR_IO_INVALID_CMD if missing or of the wrong type.
+static int commander_check_arg(const CMD_ARG *arg, yajl_val value)
+{
+    static const char *const chars[] = {
+        NULL,
+        "0123456789abcdefABCDEF",
+        ".-_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789",
+        "m/0123456789'phH"
+    };
+    size_t len;
+
+    if (!value || YAJL_IS_NULL(value)) {
+        return arg->required ? DBB_ERR_IO_INVALID_CMD : DBB_OK;
+    }
+    if (!(commander_arg_type(value) & arg->type)) {
+        return DBB_ERR_IO_INVALID_CMD;
+    }
+
+    if (YAJL_IS_STRING(value)) {
+        len = strlens(value->u.string);
+    } else if (YAJL_IS_ARRAY(value)) {
+        len = value->u.array.len;
+    } else if (YAJL_IS_OBJECT(value)) {
+        len = value->u.object.len;
+    } else {
+        return DBB_OK;
+    }
+
+    if (!len && arg->required) {
+        return DBB_ERR_IO_INVALID_CMD;
+    }
+    if (YAJL_IS_OBJECT(value)) {
+        return DBB_OK;
+    }
+    if (len < arg->min || (arg->max && len > arg->max)) {
+        return arg->flag;
+    }
+    if (len && chars[arg->chars] && YAJL_IS_STRING(value) &&
+            strspn(value->u.string, chars[arg->chars]) != len) {
+        return arg->flag;
+    }
+    return DBB_OK;
+}
+
+
+// Commands that refuse a locked device, which takes precedence over
+// argument errors
+static int commander_cmd_locked(int cmd)
+{
+    switch (cmd) {
+        case CMD_seed:
+        case CMD_backup:
+        case CMD_verifypass:
+        case CMD_hidden_password:
+            return wallet_is_locked();
+        default:
+            return 0;
+    }
+}
+
+
+// Checks the arguments of cmd in json_node ({"<cmd>":<value>}) against
+// ARG_TABLE, before any touch, EEPROM or key work is done for the command.
+// Fills the report and returns DBB_ERROR if malformed.
+static int commander_check_args(int cmd, yajl_val json_node)
+{
+    const char *path[] = { cmd_str(cmd), NULL };
+    yajl_val value = yajl_tree_get(json_node, path, yajl_t_any);
+    int i, ret = DBB_OK;
+    size_t j;
+
+    for (i = 0; i < CMD_ARGS_NUM && ret == DBB_OK; i++) {
+        const CMD_ARG *arg = &CMD_ARGS[i];
+        yajl_val a = value;
+
+        if (arg->cmd != cmd) {
+            continue;
+        }
+        if (arg->arg != CMD_NUM) {
+            const char *arg_path[] = { cmd_str(arg->arg), NULL };
+            if (!YAJL_IS_OBJECT(value)) {
+                continue;
+            }
+            a = yajl_tree_get(value, arg_path, yajl_t_any);
+        }
+
+        if (arg->item == CMD_NUM) {
+            ret = commander_check_arg(arg, a);
+        } else if (YAJL_IS_ARRAY(a)) {
+            const char *item_path[] = { cmd_str(arg->item), NULL };
+            for (j = 0; j < a->u.array.len && ret == DBB_OK; j++) {
+                yajl_val item = a->u.array.values[j];
+                if (!YAJL_IS_OBJECT(item)) {
+                    ret = DBB_ERR_IO_INVALID_CMD;
+                } else {
+                    ret = commander_check_arg(arg, yajl_tree_get(item, item_path, yajl_t_any));
+                }
+            }
+        }
+    }
+
+    if (ret != DBB_OK) {
+        if (commander_cmd_locked(cmd)) {
+            ret = DBB_ERR_IO_LOCKED;
+        }
+        commander_fill_report(cmd_str(cmd), NULL, ret);
+        return DBB_ERROR;
+    }
+    return DBB_OK;
+}
+
+
+// Parent command of a batch item, i.e. an object with a single command key.
+// CMD_NUM if the item is not a command.
+static int commander_batch_item_cmd(yajl_val item)
+{
+    int cmd;
+    if (!YAJL_IS_OBJECT(item) || item->u.object.len != 1) {
+        return CMD_NUM;
+    }
+    for (cmd = 0; cmd < CMD_source; cmd++) {
+        if (STREQ(item->u.object.keys[0], cmd_str(cmd))) {
+            return cmd;
+        }
+    }
+    return CMD_NUM;
+}
+
+
+// Commands that need neither the touch button nor a follow-up request
+static int commander_batch_item_allowed(int cmd, yajl_val item)
+{
+    const char *path[] = { cmd_str(cmd), NULL };
+    const char *erase_path[] = { cmd_str(CMD_backup), cmd_str(CMD_erase), NULL };
+    const char *value = YAJL_GET_STRING(yajl_tree_get(item, path, yajl_t_string));
+
+    switch (cmd) {
+        case CMD_led:
+        case CMD_xpub:
+        case CMD_name:
+        case CMD_random:
+        case CMD_feature_set:
+            return DBB_OK;
+        case CMD_device:
+            return (value && STREQ(value, attr_str(ATTR_lock))) ? DBB_ERROR : DBB_OK;
+        case CMD_backup:
+            if ((value && STREQ(value, attr_str(ATTR_erase))) ||
+                    yajl_tree_get(item, erase_path, yajl_t_any)) {
+                return DBB_ERROR;
+            }
+            return DBB_OK;
+        default:
+            return DBB_ERROR;
+    }
+}
+
+
+static int commander_process(int cmd, yajl_val json_node);
+
+// Runs the commands in {"batch":[{<command>}, ...]} in order and reports
+// {"batch":[{<report>}, ...]}, one report per command as if sent alone.
+// Touch-gated commands are rejected per item. The reports are collected in
+// json_array, which only signing uses otherwise.
+static void commander_process_batch(yajl_val json_node)
+{
+    const char *path[] = { cmd_str(CMD_batch), NULL };
+    yajl_val items = yajl_tree_get(json_node, path, yajl_t_array);
+    size_t i, len, report_len;
+    int cmd;
+
+    if (!items) {
+        commander_fill_report(cmd_str(CMD_batch), NULL, DBB_ERR_IO_INVALID_CMD);
+        return;
+    }
+
+    memset(json_array, 0, COMMANDER_ARRAY_MAX);
+    strcat(json_array, "[");
+    for (i = 0; i < items->u.array.len; i++) {
+        yajl_val item = items->u.array.values[i];
+        commander_clear_report();
+        cmd = commander_batch_item_cmd(item);
+        if (cmd == CMD_NUM) {
+            commander_fill_report(cmd_str(CMD_input), NULL, DBB_ERR_IO_INVALID_CMD);
+        } else if (commander_batch_item_allowed(cmd, item) != DBB_OK) {
+            commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_IO_BATCH_CMD);
+        } else if (commander_check_args(cmd, item) == DBB_OK) {
+            commander_process(cmd, item);
+        }
+
+        // Item, separator and closing bracket must fit; never truncate an item
+        len = strlens(json_array);
+        report_len = strlens(json_report);
+        if (report_len + 2 >= COMMANDER_ARRAY_MAX - len) {
+            memset(json_array, 0, COMMANDER_ARRAY_MAX);
+            commander_clear_report();
+            commander_fill_report(cmd_str(CMD_batch), NULL, DBB_ERR_IO_BATCH_SIZE);
+            return;
+        }
+        if (i) {
+            json_array[len++] = ',';
+        }
+        memcpy(json_array + len, json_report, report_len + 1);
+    }
+    strcat(json_array, "]");
+
+    commander_clear_report();
+    commander_fill_report(cmd_str(CMD_batch), json_array, DBB_JSON_ARRAY);
+    memset(json_array, 0, COMMANDER_ARRAY_MAX);
+}
+
+
 static int commander_process(int cmd, yajl_val json_node)
 {
     switch (cmd) {
         case CMD_reset:
             commander_process_reset(json_node);
+            commander_device_status_invalidate();
             return DBB_RESET;
 
         case CMD_hidden_password:
             commander_process_hidden_password(json_node);
+            commander_device_status_invalidate();
             break;
 
         case CMD_password:
             commander_process_password(json_node);
+            commander_device_status_invalidate();
             break;
 
         case CMD_verifypass:
@@ -1360,6 +1821,7 @@ static int commander_process(int cmd, yajl_val json_node)
 
         case CMD_seed:
             commander_process_seed(json_node);
+            commander_device_status_invalidate();
             break;
 
         case CMD_backup:
@@ -1380,10 +1842,16 @@ static int commander_process(int cmd, yajl_val json_node)
 
         case CMD_bootloader:
             commander_process_bootloader(json_node);
+            commander_device_status_invalidate();
             break;
 
         case CMD_feature_set:
             commander_process_feature_set(json_node);
+            commander_device_status_invalidate();
+            break;
+
+        case CMD_batch:
+            commander_process_batch(json_node);
             break;
 
         default: {
@@ -1485,7 +1953,9 @@ static int commander_echo_command(yajl_val json_node)
     }
 
     if (check) {
-        int ret;
+        const char *pubkeys[COMMANDER_CHECKPUB_MAX], *keypaths[COMMANDER_CHECKPUB_MAX];
+        uint8_t present[COMMANDER_CHECKPUB_MAX];
+        size_t count = 0;
         memset(json_array, 0, COMMANDER_ARRAY_MAX);
         for (size_t i = 0; i < check->u.array.len; i++) {
             const char *keypath_path[] = { cmd_str(CMD_keypath), NULL };
@@ -1501,20 +1971,29 @@ static int commander_echo_command(yajl_val json_node)
                 return DBB_ERROR;
             }
 
-            ret = wallet_check_pubkey(pubkey, keypath);
-            const char *status;
-            if (ret == DBB_KEY_PRESENT) {
-                status = attr_str(ATTR_true);
-            } else if (ret == DBB_KEY_ABSENT) {
-                status = attr_str(ATTR_false);
-            } else {
-                return DBB_ERROR;
+            pubkeys[count] = pubkey;
+            keypaths[count] = keypath;
+            count++;
+
+            // Check in batches, which derive shared parent keys once
+            if (count == COMMANDER_CHECKPUB_MAX || i + 1 == check->u.array.len) {
+                POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+                int ret = wallet_check_pubkeys(pubkeys, keypaths, count, present);
+                power_enter(power);
+                if (ret != DBB_OK) {
+                    return DBB_ERROR;
+                }
+                for (size_t j = 0; j < count; j++) {
+                    const char *key[] = {cmd_str(CMD_pubkey), cmd_str(CMD_present), 0};
+                    const char *value[] = {pubkeys[j],
+                                           present[j] == DBB_KEY_PRESENT ? attr_str(ATTR_true) : attr_str(ATTR_false),
+                                           0
+                                          };
+                    int t[] = {DBB_JSON_STRING, DBB_JSON_BOOL, DBB_JSON_NONE};
+                    commander_fill_json_array(key, value, t, CMD_checkpub);
+                }
+                count = 0;
             }
-
-            const char *key[] = {cmd_str(CMD_pubkey), cmd_str(CMD_present), 0};
-            const char *value[] = {pubkey, status, 0};
-            int t[] = {DBB_JSON_STRING, DBB_JSON_BOOL, DBB_JSON_NONE};
-            commander_fill_json_array(key, value, t, CMD_checkpub);
         }
         commander_fill_report(cmd_str(CMD_checkpub), json_array, DBB_JSON_ARRAY);
     }
@@ -1592,6 +2071,14 @@ static void commander_parse(char *command)
             found_cmd = cmd;
         }
     }
+    if (found == 1) {
+        COMMAND_ID = found_cmd;
+    }
+
+    // Only signing and xpub commands keep the signing session
+    if (found != 1 || (found_cmd != CMD_sign && found_cmd != CMD_xpub)) {
+        wallet_session_clear();
+    }
 
     // Process commands
     if (!found) {
@@ -1603,6 +2090,14 @@ static void commander_parse(char *command)
             memory_access_err_count(DBB_ACCESS_INITIALIZE);
         }
 
+        // The PIN reply of a signing request carries no arguments; the
+        // signing command itself was checked before its echo.
+        if (!(TFA_VERIFY && found_cmd == CMD_sign) &&
+                commander_check_args(found_cmd, json_node) != DBB_OK) {
+            TFA_VERIFY = 0;
+            goto exit;
+        }
+
         // Signing
         if (TFA_VERIFY) {
             TFA_VERIFY = 0;
@@ -1849,6 +2344,7 @@ static int commander_check_init(const char *encrypted_command)
                 int ret = commander_process_aes_key(pw, strlens(pw), PASSWORD_STAND);
                 if (ret == DBB_OK) {
                     memory_write_erased(0);
+                    commander_device_status_invalidate();
                     commander_fill_report(cmd_str(CMD_password), attr_str(ATTR_success), DBB_OK);
                 } else {
                     commander_fill_report(cmd_str(CMD_password), NULL, ret);
@@ -1870,6 +2366,8 @@ static int commander_check_init(const char *encrypted_command)
 //
 char *commander(const char *command)
 {
+    watermark_begin();
+    COMMAND_ID = CMD_input;
     commander_clear_report();
     if (commander_check_init(command) == DBB_OK) {
         char *command_dec = commander_decrypt(command);
@@ -1879,5 +2377,6 @@ char *commander(const char *command)
         }
     }
     memory_clear();
+    watermark_end(COMMAND_ID);
     return json_report;
 }
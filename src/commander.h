@@ -33,6 +33,18 @@
 #include "memory.h"
 
 
+// Device status, cached until commander_device_status_invalidate()
+typedef struct {
+    uint32_t version;
+    char id[65];
+    uint8_t seeded;
+    uint8_t lock;
+    uint8_t bootlock;
+    uint8_t u2f;
+    uint8_t u2f_hijack;
+} COMMANDER_DEVICE_STATUS;
+
+
 char *aes_cbc_b64_encrypt(const unsigned char *in, int inlen, int *out_b64len,
                           const uint8_t *key);
 char *aes_cbc_b64_decrypt(const unsigned char *in, int inlen, int *decrypt_len,
@@ -46,6 +58,9 @@ int commander_fill_signature_array(const uint8_t *sig, uint8_t recid);
 int commander_fill_json_array(const char **key, const char **value, int *type,
                               int cmd);
 void commander_force_reset(void);
+void commander_device_status_invalidate(void);
+const COMMANDER_DEVICE_STATUS *commander_device_status(void);
+const COMMANDER_DEVICE_STATUS *commander_device_status_cached(void);
 void commander_create_verifypass(void);
 char *commander(const char *command);
 
@@ -0,0 +1,84 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Firmware side of the shared crypto region: replaces sha2.c when the firmware
+// is built with BUILD_SHARED_CRYPTO. main() checks the table before any call.
+
+
+#include "crypto_table.h"
+#include "flash.h"
+
+
+#define CRYPTO_SHARED ((const CRYPTO_TABLE *)FLASH_CRYPTO_START)
+
+
+void sha256_Init(SHA256_CTX *context)
+{
+    CRYPTO_SHARED->sha256_Init(context);
+}
+
+
+void sha256_Update(SHA256_CTX *context, const uint8_t *data, size_t len)
+{
+    CRYPTO_SHARED->sha256_Update(context, data, len);
+}
+
+
+void sha256_Final(uint8_t digest[SHA256_DIGEST_LENGTH], SHA256_CTX *context)
+{
+    CRYPTO_SHARED->sha256_Final(digest, context);
+}
+
+
+void sha256_Raw(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    CRYPTO_SHARED->sha256_Raw(data, len, digest);
+}
+
+
+void sha512_Init(SHA512_CTX *context)
+{
+    CRYPTO_SHARED->sha512_Init(context);
+}
+
+
+void sha512_Update(SHA512_CTX *context, const uint8_t *data, size_t len)
+{
+    CRYPTO_SHARED->sha512_Update(context, data, len);
+}
+
+
+void sha512_Final(uint8_t digest[SHA512_DIGEST_LENGTH], SHA512_CTX *context)
+{
+    CRYPTO_SHARED->sha512_Final(digest, context);
+}
+
+
+void sha512_Raw(const uint8_t *data, size_t len, uint8_t digest[SHA512_DIGEST_LENGTH])
+{
+    CRYPTO_SHARED->sha512_Raw(data, len, digest);
+}
@@ -0,0 +1,90 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "crypto_table.h"
+#include "flags.h"
+
+
+// Linked into the bootloader's crypto region (see bootloader_crypto.ld)
+#if defined(BOOTLOADER) && defined(CRYPTO_REGION)
+__attribute__((section(".crypto_table"), used))
+#endif
+const CRYPTO_TABLE crypto_table = {
+    CRYPTO_TABLE_MAGIC,
+    CRYPTO_TABLE_VERSION,
+    sha256_Init,
+    sha256_Update,
+    sha256_Final,
+    sha256_Raw,
+    sha512_Init,
+    sha512_Update,
+    sha512_Final,
+    sha512_Raw,
+};
+
+
+// Returns the table at the start of the region, or NULL if the region does not
+// hold a table this build can call
+const CRYPTO_TABLE *crypto_table_get(const uint8_t *region)
+{
+    const CRYPTO_TABLE *table = (const CRYPTO_TABLE *)region;
+    if (table->magic != CRYPTO_TABLE_MAGIC || table->version != CRYPTO_TABLE_VERSION) {
+        return NULL;
+    }
+    return table;
+}
+
+
+// The region is inside the write-protected bootloader, so the pin is not a
+// defense against tampering with the region itself. It binds a firmware to the
+// exact region it was built against, so that a firmware is never booted on top
+// of a bootloader whose shared code differs from the one it was tested with.
+int crypto_region_verify(const uint8_t *region, uint32_t len,
+                         const uint8_t pin[CRYPTO_PIN_LEN])
+{
+    uint8_t hash[CRYPTO_PIN_LEN];
+    uint8_t erased = 0xff;
+    int i;
+
+    for (i = 0; i < CRYPTO_PIN_LEN; i++) {
+        erased &= pin[i];
+    }
+    if (erased == 0xff) {
+        return DBB_OK;// Firmware does not use the shared region
+    }
+
+    if (!crypto_table_get(region)) {
+        return DBB_ERROR;
+    }
+    sha256_Raw(region, len, hash);
+    if (memcmp(hash, pin, CRYPTO_PIN_LEN)) {
+        return DBB_ERROR;
+    }
+    return DBB_OK;
+}
@@ -0,0 +1,77 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Crypto routines shared between the bootloader and the firmware.
+//
+// A bootloader built with BUILD_SHARED_CRYPTO places a jump table at the
+// start of a fixed flash region (bootloader_crypto.ld) followed by the code
+// it points to. Without the option the bootloader keeps its full rom and has
+// no table there, so a pinned firmware fails the check. A firmware built with
+// BUILD_SHARED_CRYPTO calls through the table instead of linking its own
+// copy. The firmware binary carries the SHA256 of the region (the pin),
+// which the bootloader checks before booting. An erased (all 0xff) pin
+// marks a firmware that links its own copy and does not use the region.
+//
+// Only stateless code can be shared: the firmware and bootloader have
+// separate RAM layouts, so nothing in the region may own static data.
+
+
+#ifndef _CRYPTO_TABLE_H_
+#define _CRYPTO_TABLE_H_
+
+
+#include <stdint.h>
+#include "sha2.h"
+
+
+#define CRYPTO_TABLE_MAGIC      0x44424243u// "DBBC"
+#define CRYPTO_TABLE_VERSION    1// Bump on any change to the table or the context structs
+#define CRYPTO_PIN_LEN          SHA256_DIGEST_LENGTH
+
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    void (*sha256_Init)(SHA256_CTX *);
+    void (*sha256_Update)(SHA256_CTX *, const uint8_t *, size_t);
+    void (*sha256_Final)(uint8_t[SHA256_DIGEST_LENGTH], SHA256_CTX *);
+    void (*sha256_Raw)(const uint8_t *, size_t, uint8_t[SHA256_DIGEST_LENGTH]);
+    void (*sha512_Init)(SHA512_CTX *);
+    void (*sha512_Update)(SHA512_CTX *, const uint8_t *, size_t);
+    void (*sha512_Final)(uint8_t[SHA512_DIGEST_LENGTH], SHA512_CTX *);
+    void (*sha512_Raw)(const uint8_t *, size_t, uint8_t[SHA512_DIGEST_LENGTH]);
+} CRYPTO_TABLE;
+
+
+extern const CRYPTO_TABLE crypto_table;
+
+const CRYPTO_TABLE *crypto_table_get(const uint8_t *region);
+int crypto_region_verify(const uint8_t *region, uint32_t len,
+                         const uint8_t pin[CRYPTO_PIN_LEN]);
+
+
+#endif
@@ -34,19 +34,23 @@
 #include "utils.h"
 #include "random.h"
 #include "ecc.h"
+#include "p256.h"
+#include "rfc6979.h"
 
 #include "uECC.h"
 
-#ifndef ECC_USE_SECP256K1_LIB
+#if !defined(ECC_USE_SECP256K1_LIB) && !defined(ECC_STATIC_BINDING)
 /* link the bitcoin ECC wrapper to uECC if secp256k1 is not available */
 struct ecc_wrapper bitcoin_ecc = {
     ecc_context_init,
     ecc_context_destroy,
     ecc_sign_digest,
+    ecc_sign_digests_batch,
     ecc_sign,
     ecc_sign_double,
     ecc_verify,
     ecc_generate_private_key,
+    ecc_generate_public_key,
     ecc_isValid,
     ecc_get_public_key65,
     ecc_get_public_key33,
@@ -86,19 +90,103 @@ static uECC_Curve ecc_curve_from_id(ecc_curve_id curve)
 }
 
 
+#define ECC_NONCE_MAX_TRIES 64// As uECC_RNG_MAX_TRIES
+
+
+// First RFC6979 output that is a valid scalar, as uECC_generate_k_rfc6979()
+static int ecc_nonce(RFC6979_STATE *rng, uint8_t *k, uECC_Curve curve)
+{
+    int tries;
+    for (tries = 0; tries < ECC_NONCE_MAX_TRIES; tries++) {
+        rfc6979_next(rng, k);
+        if (uECC_isValid(k, curve)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Signs with the RFC6979 nonces that follow the first `skip` valid ones, moving on to the
+// next nonce while a signature comes out invalid
+static int ecc_sign_rfc6979(const uint8_t *private_key, const uint8_t *data, uint8_t *sig,
+                            int skip, uECC_Curve curve)
+{
+    RFC6979_STATE rng;
+    uint8_t k[32];
+    int tries, ret = 1;
+    rfc6979_init(&rng, private_key, data);
+    for (tries = 0; tries < ECC_NONCE_MAX_TRIES && ecc_nonce(&rng, k, curve); tries++) {
+        if (tries < skip) {
+            continue;
+        }
+        if (uECC_sign_with_nonce(private_key, data, SHA256_DIGEST_LENGTH, k, sig, curve)) {
+            uECC_normalize_signature(sig, curve);
+            ret = 0;
+            break;
+        }
+    }
+    rfc6979_clear(&rng);
+    utils_zero(k, sizeof(k));
+    return ret;
+}
+
+
 int ecc_sign_digest(const uint8_t *private_key, const uint8_t *data, uint8_t *sig,
                     uint8_t *recid, ecc_curve_id curve)
 {
     (void) recid; // not implemented in uECC
-    uint8_t tmp[32 + 32 + 64];
-    SHA256_HashContext ctx = {{&init_SHA256, &update_SHA256, &finish_SHA256, 64, 32, tmp}};
-    if (uECC_sign_deterministic(private_key, data, SHA256_DIGEST_LENGTH, &ctx.uECC, sig,
-                                ecc_curve_from_id(curve))) {
-        uECC_normalize_signature(sig, ecc_curve_from_id(curve));
+    if (curve == ECC_SECP256r1) {
+        return p256_sign_digest(private_key, data, sig);
+    }
+    return ecc_sign_rfc6979(private_key, data, sig, 0, ecc_curve_from_id(curve));
+}
+
+
+// Signs count 32-byte digests with the matching private keys. The signatures are the same
+// as from ecc_sign_digest(), but each batch of up to uECC_SIGN_BATCH_MAX shares its inversions.
+int ecc_sign_digests_batch(const uint8_t *private_keys, const uint8_t *data, uint8_t *sigs,
+                           uint8_t *recids, uint16_t count, ecc_curve_id curve)
+{
+    (void) recids; // not implemented in uECC
+    RFC6979_STATE rng;
+    uint8_t k[uECC_SIGN_BATCH_MAX * 32];
+    uint8_t failed[uECC_SIGN_BATCH_MAX];
+    uint16_t i, j, n;
+    int ret = 0;
+    if (curve == ECC_SECP256r1) {
+        for (i = 0; i < count; i++) {
+            if (p256_sign_digest(private_keys + 32 * i, data + 32 * i, sigs + 64 * i)) {
+                return 1; // error
+            }
+        }
         return 0;
-    } else {
-        return 1; // error
     }
+    for (i = 0; i < count && !ret; i += n) {
+        n = count - i < uECC_SIGN_BATCH_MAX ? count - i : uECC_SIGN_BATCH_MAX;
+        for (j = 0; j < n && !ret; j++) {
+            rfc6979_init(&rng, private_keys + 32 * (i + j), data + 32 * (i + j));
+            if (!ecc_nonce(&rng, k + 32 * j, ecc_curve_from_id(curve))) {
+                ret = 1; // error
+            }
+        }
+        if (!ret && !uECC_sign_batch(private_keys + 32 * i, data + 32 * i, SHA256_DIGEST_LENGTH,
+                                     k, n, sigs + 64 * i, failed, ecc_curve_from_id(curve))) {
+            ret = 1; // error
+        }
+        for (j = 0; j < n && !ret; j++) {
+            if (failed[j]) {
+                // The first nonce gave no valid signature; continue as ecc_sign_digest()
+                ret = ecc_sign_rfc6979(private_keys + 32 * (i + j), data + 32 * (i + j),
+                                       sigs + 64 * (i + j), 1, ecc_curve_from_id(curve));
+            } else {
+                uECC_normalize_signature(sigs + 64 * (i + j), ecc_curve_from_id(curve));
+            }
+        }
+    }
+    rfc6979_clear(&rng);
+    utils_zero(k, sizeof(k));
+    return ret;
 }
 
 
@@ -165,18 +253,48 @@ int ecc_generate_private_key(uint8_t *private_child, const uint8_t *private_mast
 }
 
 
+// Compressed public keys, child = master + z * G
+int ecc_generate_public_key(uint8_t *public_child, const uint8_t *public_master,
+                            const uint8_t *z, ecc_curve_id curve)
+{
+    uint8_t public_key[64];
+    int ret;
+    uECC_decompress(public_master, public_key, ecc_curve_from_id(curve));
+    ret = uECC_tweak_public_key(public_key, z, ecc_curve_from_id(curve));
+    if (ret) {
+        uECC_compress(public_key, public_child, ecc_curve_from_id(curve));
+    }
+    return ret;
+}
+
+
 int ecc_isValid(uint8_t *private_key, ecc_curve_id curve)
 {
+    if (curve == ECC_SECP256r1) {
+        return p256_is_valid(private_key);
+    }
     return uECC_isValid(private_key, ecc_curve_from_id(curve));
 }
 
 
+// secp256r1 (U2F) uses the dedicated P-256 implementation
+static void ecc_compute_public_key(const uint8_t *private_key, uint8_t *public_key_64,
+                                   ecc_curve_id curve)
+{
+    if (curve == ECC_SECP256r1) {
+        p256_get_public_key(private_key, public_key_64);
+    } else {
+        uECC_compute_public_key(private_key, public_key_64, ecc_curve_from_id(curve));
+    }
+}
+
+
 void ecc_get_public_key65(const uint8_t *private_key, uint8_t *public_key,
                           ecc_curve_id curve)
 {
     uint8_t *p = public_key;
     p[0] = 0x04;
-    uECC_compute_public_key(private_key, p + 1, ecc_curve_from_id(curve));
+    ecc_compute_public_key(private_key, p + 1, curve);
 }
 
 
@@ -184,7 +302,7 @@ void ecc_get_public_key33(const uint8_t *private_key, uint8_t *public_key,
                           ecc_curve_id curve)
 {
     uint8_t public_key_long[64];
-    uECC_compute_public_key(private_key, public_key_long, ecc_curve_from_id(curve));
+    ecc_compute_public_key(private_key, public_key_long, curve);
     uECC_compress(public_key_long, public_key, ecc_curve_from_id(curve));
 }
 
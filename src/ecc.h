@@ -44,6 +44,9 @@ struct ecc_wrapper {
     void (*ecc_context_destroy)(void);
     int (*ecc_sign_digest)(const uint8_t *private_key, const uint8_t *data, uint8_t *sig,
                            uint8_t *recid, ecc_curve_id curve);
+    int (*ecc_sign_digests_batch)(const uint8_t *private_keys, const uint8_t *data,
+                                  uint8_t *sigs, uint8_t *recids, uint16_t count,
+                                  ecc_curve_id curve);
     int (*ecc_sign)(const uint8_t *private_key, const uint8_t *msg, uint32_t msg_len,
                     uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
     int (*ecc_sign_double)(const uint8_t *privateKey, const uint8_t *msg, uint32_t msg_len,
@@ -52,6 +55,8 @@ struct ecc_wrapper {
                       uint32_t msg_len, ecc_curve_id curve);
     int (*ecc_generate_private_key)(uint8_t *private_child, const uint8_t *private_master,
                                     const uint8_t *z, ecc_curve_id curve);
+    int (*ecc_generate_public_key)(uint8_t *public_child, const uint8_t *public_master,
+                                   const uint8_t *z, ecc_curve_id curve);
     int (*ecc_isValid)(uint8_t *private_key, ecc_curve_id curve);
     void (*ecc_get_public_key65)(const uint8_t *private_key, uint8_t *public_key,
                                  ecc_curve_id curve);
@@ -69,6 +74,8 @@ void ecc_context_init(void);
 void ecc_context_destroy(void);
 int ecc_sign_digest(const uint8_t *private_key, const uint8_t *data, uint8_t *sig,
                     uint8_t *recid, ecc_curve_id curve);
+int ecc_sign_digests_batch(const uint8_t *private_keys, const uint8_t *data, uint8_t *sigs,
+                           uint8_t *recids, uint16_t count, ecc_curve_id curve);
 int ecc_sign(const uint8_t *private_key, const uint8_t *msg, uint32_t msg_len,
              uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
 int ecc_sign_double(const uint8_t *privateKey, const uint8_t *msg, uint32_t msg_len,
@@ -79,6 +86,8 @@ int ecc_verify(const uint8_t *public_key, const uint8_t *signature, const uint8_
                uint32_t msg_len, ecc_curve_id curve);
 int ecc_generate_private_key(uint8_t *private_child, const uint8_t *private_master,
                              const uint8_t *z, ecc_curve_id curve);
+int ecc_generate_public_key(uint8_t *public_child, const uint8_t *public_master,
+                            const uint8_t *z, ecc_curve_id curve);
 int ecc_isValid(uint8_t *private_key, ecc_curve_id curve);
 void ecc_get_public_key65(const uint8_t *private_key, uint8_t *public_key,
                           ecc_curve_id curve);
@@ -92,8 +101,76 @@ int ecc_recover_public_key(const uint8_t *sig, const uint8_t *msg, uint32_t msg_
                            uint8_t recid, uint8_t *pubkey_65, ecc_curve_id curve);
 
 
+#ifdef ECC_USE_SECP256K1_LIB
+/* libsecp256k1 wrapper */
+void libsecp256k1_ecc_context_init(void);
+void libsecp256k1_ecc_context_destroy(void);
+int libsecp256k1_ecc_sign_digest(const uint8_t *private_key, const uint8_t *data,
+                                 uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
+int libsecp256k1_ecc_sign_digests_batch(const uint8_t *private_keys, const uint8_t *data,
+                                        uint8_t *sigs, uint8_t *recids, uint16_t count, ecc_curve_id curve);
+int libsecp256k1_ecc_sign(const uint8_t *private_key, const uint8_t *msg,
+                          uint32_t msg_len, uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
+int libsecp256k1_ecc_sign_double(const uint8_t *privateKey, const uint8_t *msg,
+                                 uint32_t msg_len, uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
+int libsecp256k1_ecc_verify(const uint8_t *public_key, const uint8_t *signature,
+                            const uint8_t *msg, uint32_t msg_len, ecc_curve_id curve);
+int libsecp256k1_ecc_generate_private_key(uint8_t *private_child,
+        const uint8_t *private_master, const uint8_t *z, ecc_curve_id curve);
+int libsecp256k1_ecc_generate_public_key(uint8_t *public_child,
+        const uint8_t *public_master, const uint8_t *z, ecc_curve_id curve);
+int libsecp256k1_ecc_isValid(uint8_t *private_key, ecc_curve_id curve);
+void libsecp256k1_ecc_get_public_key65(const uint8_t *private_key, uint8_t *public_key,
+                                       ecc_curve_id curve);
+void libsecp256k1_ecc_get_public_key33(const uint8_t *private_key, uint8_t *public_key,
+                                       ecc_curve_id curve);
+int libsecp256k1_ecc_ecdh(const uint8_t *pair_pubkey, const uint8_t *rand_privkey,
+                          uint8_t *ecdh_secret, ecc_curve_id curve);
+int libsecp256k1_ecc_recover_public_key(const uint8_t *sig, const uint8_t *msg,
+                                        uint32_t msg_len, uint8_t recid, uint8_t *pubkey_65, ecc_curve_id curve);
+#endif
+
+
 /* bitcoin ecc wrapper that gets linked to secp256k1 if presen, otherwise to uECC */
+#ifdef ECC_STATIC_BINDING
+/* Constant table in every translation unit, so the compiler turns
+ * bitcoin_ecc.f(...) into a direct (inlinable) call. */
+static const struct ecc_wrapper bitcoin_ecc = {
+#ifdef ECC_USE_SECP256K1_LIB
+    libsecp256k1_ecc_context_init,
+    libsecp256k1_ecc_context_destroy,
+    libsecp256k1_ecc_sign_digest,
+    libsecp256k1_ecc_sign_digests_batch,
+    libsecp256k1_ecc_sign,
+    libsecp256k1_ecc_sign_double,
+    libsecp256k1_ecc_verify,
+    libsecp256k1_ecc_generate_private_key,
+    libsecp256k1_ecc_generate_public_key,
+    libsecp256k1_ecc_isValid,
+    libsecp256k1_ecc_get_public_key65,
+    libsecp256k1_ecc_get_public_key33,
+    libsecp256k1_ecc_ecdh,
+    libsecp256k1_ecc_recover_public_key
+#else
+    ecc_context_init,
+    ecc_context_destroy,
+    ecc_sign_digest,
+    ecc_sign_digests_batch,
+    ecc_sign,
+    ecc_sign_double,
+    ecc_verify,
+    ecc_generate_private_key,
+    ecc_generate_public_key,
+    ecc_isValid,
+    ecc_get_public_key65,
+    ecc_get_public_key33,
+    ecc_ecdh,
+    ecc_recover_public_key
+#endif
+};
+#else
 extern struct ecc_wrapper bitcoin_ecc;
+#endif
 
 
 #endif
@@ -38,47 +38,30 @@
 #include "secp256k1/include/secp256k1.h"
 #include "secp256k1/include/secp256k1_ecdh.h"
 #include "secp256k1/include/secp256k1_recovery.h"
+#include "secp256k1_batch.h"
+#include "rfc6979.h"
 
 
 static secp256k1_context *libsecp256k1_ctx = NULL;
 
-void libsecp256k1_ecc_context_init(void);
-void libsecp256k1_ecc_context_destroy(void);
-int libsecp256k1_ecc_sign_digest(const uint8_t *private_key, const uint8_t *data,
-                                 uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
-int libsecp256k1_ecc_sign(const uint8_t *private_key, const uint8_t *msg,
-                          uint32_t msg_len, uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
-int libsecp256k1_ecc_sign_double(const uint8_t *privateKey, const uint8_t *msg,
-                                 uint32_t msg_len, uint8_t *sig, uint8_t *recid, ecc_curve_id curve);
-int libsecp256k1_ecc_verify(const uint8_t *public_key, const uint8_t *signature,
-                            const uint8_t *msg, uint32_t msg_len, ecc_curve_id curve);
-int libsecp256k1_ecc_generate_private_key(uint8_t *private_child,
-        const uint8_t *private_master, const uint8_t *z, ecc_curve_id curve);
-int libsecp256k1_ecc_isValid(uint8_t *private_key, ecc_curve_id curve);
-void libsecp256k1_ecc_get_public_key65(const uint8_t *private_key, uint8_t *public_key,
-                                       ecc_curve_id curve);
-void libsecp256k1_ecc_get_public_key33(const uint8_t *private_key, uint8_t *public_key,
-                                       ecc_curve_id curve);
-int libsecp256k1_ecc_ecdh(const uint8_t *pair_pubkey, const uint8_t *rand_privkey,
-                          uint8_t *ecdh_secret, ecc_curve_id curve);
-int libsecp256k1_ecc_recover_public_key(const uint8_t *sig, const uint8_t *msg,
-                                        uint32_t msg_len, uint8_t recid, uint8_t *pubkey_65, ecc_curve_id curve);
-
-
+#ifndef ECC_STATIC_BINDING
 struct ecc_wrapper bitcoin_ecc = {
     libsecp256k1_ecc_context_init,
     libsecp256k1_ecc_context_destroy,
     libsecp256k1_ecc_sign_digest,
+    libsecp256k1_ecc_sign_digests_batch,
     libsecp256k1_ecc_sign,
     libsecp256k1_ecc_sign_double,
     libsecp256k1_ecc_verify,
     libsecp256k1_ecc_generate_private_key,
+    libsecp256k1_ecc_generate_public_key,
     libsecp256k1_ecc_isValid,
     libsecp256k1_ecc_get_public_key65,
     libsecp256k1_ecc_get_public_key33,
     libsecp256k1_ecc_ecdh,
     libsecp256k1_ecc_recover_public_key,
 };
+#endif
 
 
 void libsecp256k1_ecc_context_init(void)
@@ -109,14 +92,19 @@ int libsecp256k1_ecc_sign_digest(const uint8_t *private_key, const uint8_t *data
 {
     (void)(curve);
     secp256k1_ecdsa_recoverable_signature signature;
+    RFC6979_STATE rng;
+    int ret;
 
     if (!libsecp256k1_ctx) {
         libsecp256k1_ecc_context_init();
     }
 
-    if (secp256k1_ecdsa_sign_recoverable(libsecp256k1_ctx, &signature,
-                                         (const unsigned char *)data,
-                                         (const unsigned char *)private_key, secp256k1_nonce_function_rfc6979, NULL)) {
+    ret = secp256k1_ecdsa_sign_recoverable(libsecp256k1_ctx, &signature,
+                                           (const unsigned char *)data,
+                                           (const unsigned char *)private_key,
+                                           secp256k1_nonce_function_rfc6979_state, &rng);
+    rfc6979_clear(&rng);
+    if (ret) {
         int recid_ = 0xFF;
         secp256k1_ecdsa_recoverable_signature_serialize_compact(libsecp256k1_ctx, sig,
                 &recid_, &signature);
@@ -131,6 +119,37 @@ int libsecp256k1_ecc_sign_digest(const uint8_t *private_key, const uint8_t *data
 }
 
 
+int libsecp256k1_ecc_sign_digests_batch(const uint8_t *private_keys, const uint8_t *data,
+                                        uint8_t *sigs, uint8_t *recids, uint16_t count, ecc_curve_id curve)
+{
+    (void)(curve);
+    secp256k1_ecdsa_recoverable_signature signatures[SECP256K1_SIGN_BATCH_MAX];
+    uint16_t i, j, n;
+
+    if (!libsecp256k1_ctx) {
+        libsecp256k1_ecc_context_init();
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = count - i < SECP256K1_SIGN_BATCH_MAX ? count - i : SECP256K1_SIGN_BATCH_MAX;
+        if (!secp256k1_ecdsa_sign_recoverable_batch(libsecp256k1_ctx, signatures,
+                (const unsigned char *)data + 32 * i,
+                (const unsigned char *)private_keys + 32 * i, n)) {
+            return 1;
+        }
+        for (j = 0; j < n; j++) {
+            int recid_ = 0xFF;
+            secp256k1_ecdsa_recoverable_signature_serialize_compact(libsecp256k1_ctx,
+                    sigs + 64 * (i + j), &recid_, &signatures[j]);
+            if (recids) {
+                recids[i + j] = recid_;
+            }
+        }
+    }
+    return 0;
+}
+
+
 int libsecp256k1_ecc_sign(const uint8_t *private_key, const uint8_t *msg,
                           uint32_t msg_len, uint8_t *sig, uint8_t *recid, ecc_curve_id curve)
 {
@@ -211,6 +230,28 @@ int libsecp256k1_ecc_generate_private_key(uint8_t *private_child,
 }
 
 
+int libsecp256k1_ecc_generate_public_key(uint8_t *public_child,
+        const uint8_t *public_master, const uint8_t *z, ecc_curve_id curve)
+{
+    (void)(curve);
+    size_t public_key_len = 33;
+    secp256k1_pubkey pubkey;
+
+    if (!libsecp256k1_ctx) {
+        libsecp256k1_ecc_context_init();
+    }
+
+    if (!secp256k1_ec_pubkey_parse(libsecp256k1_ctx, &pubkey, public_master, 33)) {
+        return 0;
+    }
+    if (!secp256k1_ec_pubkey_tweak_add(libsecp256k1_ctx, &pubkey, z)) {
+        return 0;
+    }
+    return secp256k1_ec_pubkey_serialize(libsecp256k1_ctx, public_child, &public_key_len,
+                                         &pubkey, SECP256K1_EC_COMPRESSED);
+}
+
+
 int libsecp256k1_ecc_isValid(uint8_t *private_key, ecc_curve_id curve)
 {
     (void)(curve);
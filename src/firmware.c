@@ -36,10 +36,15 @@
 #include "flash.h"
 #include "touch.h"
 #include "memory.h"
+#include "power.h"
 #include "random.h"
 #include "systick.h"
 #include "commander.h"
 #include "board_com.h"
+#include "watermark.h"
+#include "u2f_device.h"
+#include "wallet.h"
+#include "crypto_table.h"
 
 
 uint32_t __stack_chk_guard = 0;
@@ -100,6 +105,7 @@ char usb_serial_number[USB_DEVICE_GET_SERIAL_NAME_LENGTH];
 
 int main (void)
 {
+    watermark_init();
     wdt_disable(WDT);
     enable_usersig_area();
     irq_initialize_vectors();
@@ -107,6 +113,15 @@ int main (void)
     sleepmgr_init();
     sysclk_init();
     flash_init(FLASH_ACCESS_MODE_128, 6);
+#ifdef SHARED_CRYPTO
+    // Halt before the first hash if the bootloader has no usable crypto region
+    if (!crypto_table_get((const uint8_t *)FLASH_CRYPTO_START)) {
+        while (1) {
+            led_toggle();
+            delay_ms(100);
+        }
+    }
+#endif
     board_com_init();
     __stack_chk_guard = random_uint32(0);
     pmc_enable_periph_clk(ID_PIOA);
@@ -137,7 +152,12 @@ int main (void)
     delay_ms(300);
     led_off();
 
+    // Commands raise the clock while they run, see u2f_device_run()
+    power_enter(POWER_STATE_IDLE);
+
     while (1) {
+        wallet_session_idle();
+        u2f_device_idle();
         sleepmgr_enter_sleep();
     }
 }
@@ -44,6 +44,13 @@ const char *const FLAG_CODE[] = { FLAG_TABLE };
 const char *const FLAG_MSG[] = { FLAG_TABLE };
 #undef X
 
+#define X(cmd, arg, item, type, required, min, max, chars, flag) \
+    { CMD_ ## cmd, CMD_ ## arg, CMD_ ## item, type, required, chars, min, max, DBB_ ## flag },
+const CMD_ARG CMD_ARGS[] = { ARG_TABLE };
+#undef X
+
+const int CMD_ARGS_NUM = sizeof(CMD_ARGS) / sizeof(CMD_ARGS[0]);
+
 const char *cmd_str(int cmd)
 {
     return CMD_STR[cmd];
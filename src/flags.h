@@ -29,9 +29,15 @@
 #define _FLAGS_H_
 
 
+#include <stdint.h>
+
+
 #define COMMANDER_REPORT_SIZE       3584
 #define COMMANDER_NUM_SIG_MIN       14// Must be >= desktop app's `MAX_INPUTS_PER_SIGN` !!
 #define COMMANDER_SIG_LEN           154// sig + recid + json formatting
+#define COMMANDER_SIGN_BATCH_MAX    16// hashes per wallet_sign() call, signed as one batch
+#define COMMANDER_CHECKPUB_MAX      32// pubkeys per wallet_check_pubkeys() call
+#define COMMANDER_BATCH_MAX         16// commands per batch command
 #define COMMANDER_ARRAY_MAX         (COMMANDER_REPORT_SIZE - (COMMANDER_SIG_LEN * 8))// Multiple is emperically found such that NUM_SIG_MIN is maximum
 #define COMMANDER_ARRAY_ELEMENT_MAX 1024
 #define COMMANDER_MAX_ATTEMPTS      15// max PASSWORD or LOCK PIN attempts before device reset
@@ -43,6 +49,8 @@
 #define SD_FILEBUF_LEN_MAX          (COMMANDER_REPORT_SIZE * 4 / 7)
 #define AES_DATA_LEN_MAX            (COMMANDER_REPORT_SIZE * 4 / 7)// base64 increases size by ~4/3; AES encryption by max 32 char
 #define PASSWORD_LEN_MIN            4
+#define WALLET_SESSION_TIMEOUT      300000// msec of inactivity before the signing session is wiped
+#define WALLET_SESSION_KEYPATH_LEN  64
 
 
 #define _STRINGIFY(S) #S
@@ -72,6 +80,7 @@ X(random)         \
 X(backup)         \
 X(ping)           \
 X(feature_set)    \
+X(batch)          \
 /*  child keys  */\
 X(source)         \
 X(entropy)        \
@@ -91,6 +100,7 @@ X(script)         \
 X(value)          \
 X(erase)          \
 X(check)          \
+X(audit)          \
 X(key)            \
 X(sig)            \
 X(recid)          \
@@ -98,6 +108,8 @@ X(pin)            \
 X(U2F)            \
 X(U2F_hijack)     \
 X(U2F_counter)    \
+X(session)        \
+X(U2F_precompute) \
 /*  reply keys  */\
 X(ciphertext)     \
 X(echo)           \
@@ -110,6 +122,60 @@ X(warning)        \
 X(NUM)             /* keep last */
 
 
+// Command arguments, checked in one pass before the command is processed
+//   arg       child key of the command's object value, NUM for the value itself
+//   item      key in each element of the array arg, NUM for the arg itself
+//   type      accepted JSON types; null counts as a missing argument
+//   required  must be present and not empty
+//   min, max  string length or number of array elements, max 0 is unbounded
+//   chars     allowed characters of a non-empty string
+//   flag      reported if outside min, max or chars; missing arguments and
+//             wrong types report ERR_IO_INVALID_CMD
+#define ARG_TABLE \
+/*cmd              arg             item     type                     req  min               max                  chars        flag */\
+X(sign,            NUM,            NUM,     ARG_OBJECT,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(sign,            data,           NUM,     ARG_ARRAY,               1,   1,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(sign,            data,           keypath, ARG_STRING,              1,   0,                0,                   ARG_KEYPATH, ERR_KEY_CHILD)\
+X(sign,            data,           hash,    ARG_STRING,              1,   64,               64,                  ARG_HEX,     ERR_SIGN_HASH_LEN)\
+X(sign,            checkpub,       NUM,     ARG_ARRAY,               0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(sign,            checkpub,       pubkey,  ARG_STRING,              1,   66,               66,                  ARG_ANY,     ERR_SIGN_PUBKEY_LEN)\
+X(sign,            checkpub,       keypath, ARG_STRING,              1,   0,                0,                   ARG_KEYPATH, ERR_KEY_CHILD)\
+X(sign,            meta,           NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            NUM,            NUM,     ARG_OBJECT,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            source,         NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            filename,       NUM,     ARG_STRING,              1,   0,                0,                   ARG_NAME,    ERR_SD_BAD_CHAR)\
+X(seed,            key,            NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            entropy,        NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            raw,            NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(seed,            U2F_counter,    NUM,     ARG_NUMBER,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(reset,           NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(password,        NUM,            NUM,     ARG_STRING,              0,   PASSWORD_LEN_MIN, 0,                   ARG_ANY,     ERR_IO_PASSWORD_LEN)\
+X(bootloader,      NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(hidden_password, NUM,            NUM,     ARG_OBJECT,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(hidden_password, password,       NUM,     ARG_STRING,              1,   PASSWORD_LEN_MIN, 0,                   ARG_ANY,     ERR_IO_PASSWORD_LEN)\
+X(hidden_password, key,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(verifypass,      NUM,            NUM,     ARG_STRING | ARG_OBJECT, 1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(verifypass,      ecdh,           NUM,     ARG_STRING,              0,   66,               66,                  ARG_ANY,     ERR_KEY_ECDH_LEN)\
+X(led,             NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(xpub,            NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_KEYPATH, ERR_KEY_CHILD)\
+X(name,            NUM,            NUM,     ARG_STRING,              0,   0,                0,                   ARG_NAME,    ERR_SD_BAD_CHAR)\
+X(device,          NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(random,          NUM,            NUM,     ARG_STRING,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(backup,          NUM,            NUM,     ARG_STRING | ARG_OBJECT, 0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(backup,          filename,       NUM,     ARG_STRING,              0,   0,                0,                   ARG_NAME,    ERR_SD_BAD_CHAR)\
+X(backup,          erase,          NUM,     ARG_STRING,              0,   0,                0,                   ARG_NAME,    ERR_SD_BAD_CHAR)\
+X(backup,          check,          NUM,     ARG_STRING,              0,   0,                0,                   ARG_NAME,    ERR_SD_BAD_CHAR)\
+X(backup,          key,            NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(backup,          source,         NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(backup,          audit,          NUM,     ARG_STRING,              0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(feature_set,     NUM,            NUM,     ARG_OBJECT,              1,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(feature_set,     U2F,            NUM,     ARG_BOOL,                0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(feature_set,     U2F_hijack,     NUM,     ARG_BOOL,                0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(feature_set,     session,        NUM,     ARG_BOOL,                0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(feature_set,     U2F_precompute, NUM,     ARG_BOOL,                0,   0,                0,                   ARG_ANY,     ERR_IO_INVALID_CMD)\
+X(batch,           NUM,            NUM,     ARG_ARRAY,               1,   1,                COMMANDER_BATCH_MAX, ARG_ANY,     ERR_IO_INVALID_CMD)
+
+
 // Attributes
 #define ATTR_TABLE \
 X(success)        \
@@ -149,6 +215,9 @@ X(U2F)            \
 X(U2F_load)       \
 X(U2F_create)     \
 X(U2F_hijack)     \
+X(watermark)      \
+X(stack)          \
+X(heap)           \
 X(__ERASE__)      \
 X(__FORCE__)      \
 X(NUM)             /* keep last */
@@ -197,6 +266,8 @@ X(ERR_IO_RESET,        110, "Too many failed access attempts. Device reset.")\
 X(ERR_IO_LOCKED,       111, "Device locked. Erase device to access this command.")\
 X(ERR_IO_PW_COLLIDE,   112, "Device password matches reset password. Disabling reset password.")\
 X(ERR_IO_TOUCH_BUTTON, 113, "Due to many login attempts, the next login requires holding the touch button for 3 seconds.")\
+X(ERR_IO_BATCH_CMD,    114, "Command not allowed in a batch.")\
+X(ERR_IO_BATCH_SIZE,   115, "Batch reply too large. Send fewer commands per batch.")\
 X(ERR_SEED_SD,         200, "Seed creation requires an SD card for automatic encrypted backup of the seed.")\
 X(ERR_SEED_SD_NUM,     201, "Too many backup files. Please remove one from the SD card.")\
 X(ERR_SEED_MEM,        202, "Could not allocate memory for seed.")\
@@ -248,6 +319,36 @@ enum CMD_ATTR_ENUM { ATTR_TABLE };
 enum FLAG_ENUM { FLAG_TABLE };
 #undef X
 
+enum ARG_TYPE {
+    ARG_STRING = 1,
+    ARG_OBJECT = 2,
+    ARG_ARRAY = 4,
+    ARG_BOOL = 8,
+    ARG_NUMBER = 16
+};
+
+enum ARG_CHARS {
+    ARG_ANY,
+    ARG_HEX,
+    ARG_NAME,// utils_limit_alphanumeric_hyphen_underscore_period()
+    ARG_KEYPATH
+};
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t arg;
+    uint8_t item;
+    uint8_t type;
+    uint8_t required;
+    uint8_t chars;
+    uint16_t min;
+    uint16_t max;
+    uint16_t flag;
+} CMD_ARG;
+
+extern const CMD_ARG CMD_ARGS[];
+extern const int CMD_ARGS_NUM;
+
 
 const char *cmd_str(int cmd);
 const char *attr_str(int attr);
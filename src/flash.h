@@ -35,11 +35,18 @@
 // Flash: 256kB = 512 pages * 512B per page
 // Memory map:
 //  bootloader area  [  32kB; last 2kB reserved for factory installed entropy ]
+//    crypto region  [   6kB; shared crypto jump table and code, ends before the factory entropy ]
 //  firmware memory  [   4kB; contains firmaware signatures (7*64B), version (4B) and flags (1B); remaining RFU ]
 //  firmware code    [ 220kB ]
 #ifndef IFLASH0_ADDR
 #define IFLASH0_ADDR                (0x00400000u)
 #endif
+#ifndef IFLASH0_SIZE
+#define IFLASH0_SIZE                (0x40000u)
+#endif
+#ifndef IFLASH0_PAGE_SIZE
+#define IFLASH0_PAGE_SIZE           (512u)
+#endif
 #define FLASH_PAGE_SIZE             (IFLASH0_PAGE_SIZE)
 #define FLASH_ERASE_SIZE            (FLASH_PAGE_SIZE * 8)// note: min flash erase size is 0x1000 (8 512-Byte pages)
 #define FLASH_BOOT_START            (IFLASH0_ADDR)
@@ -59,6 +66,10 @@
 #define FLASH_APP_PAGE_NUM          (FLASH_APP_LEN / FLASH_PAGE_SIZE)
 #define FLASH_APP_VERSION_LEN       (4)// 4 byte big endian unsigned int
 #define FLASH_APP_VERSION_START     (FLASH_APP_START + FLASH_APP_LEN - FLASH_APP_VERSION_LEN)
+#define FLASH_APP_CRYPTO_PIN_LEN    (32)// SHA256 of the crypto region; all 0xff if unused
+#define FLASH_APP_CRYPTO_PIN_START  (FLASH_APP_VERSION_START - FLASH_APP_CRYPTO_PIN_LEN)
+#define FLASH_CRYPTO_START          (FLASH_BOOT_START + 0x00006800u)// crypto region in bootloader_crypto.ld
+#define FLASH_CRYPTO_LEN            (0x000017E0u)
 #define FLASH_BOOT_LATEST_APP_VERSION_BYTES (FLASH_BOOT_LOCK_BYTE - FLASH_APP_VERSION_LEN)
 
 
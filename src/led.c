@@ -39,74 +39,162 @@
 #define IOPORT_PIN_LEVEL_HIGH   0
 
 
+static int led_level = IOPORT_PIN_LEVEL_HIGH;
+
+
 static void ioport_set_pin_level(int led, int level)
 {
     (void)led;
-    (void)level;
+    led_level = level;
 }
 
 
 static int ioport_get_pin_level(int led)
 {
     (void)led;
-    return 0;
+    return led_level;
 }
 
 
 #endif
 
 
+static const LED_STEP LED_PATTERN_BLINK[] = { {1, 300} };
+static const LED_STEP LED_PATTERN_ACCEPT[] = { {0, 300}, {1, 300} };
+static const LED_STEP LED_PATTERN_ABORT[] = { {0, 300}, {1, 100}, {0, 100}, {1, 100} };
+
+
+// Pattern being played back by led_tick(); the LED is off at the end
+static LED_STEP led_steps[LED_PATTERN_MAX_STEPS];
+static volatile uint8_t led_steps_len = 0;
+static volatile uint8_t led_step = 0;
+static volatile uint16_t led_step_ms = 0;
+
+
+static void led_set(uint8_t on)
+{
+    ioport_set_pin_level(LED_0_PIN, on ? IOPORT_PIN_LEVEL_LOW : IOPORT_PIN_LEVEL_HIGH);
+}
+
+
+static void led_stop(void)
+{
+    led_steps_len = 0;
+}
+
+
 void led_on(void)
 {
-    ioport_set_pin_level(LED_0_PIN, IOPORT_PIN_LEVEL_LOW);
+    led_stop();
+    led_set(1);
 }
 
 
 void led_off(void)
 {
-    ioport_set_pin_level(LED_0_PIN, IOPORT_PIN_LEVEL_HIGH);
-
+    led_stop();
+    led_set(0);
 }
 
 
 void led_toggle(void)
 {
+    led_stop();
     ioport_set_pin_level(LED_0_PIN, !ioport_get_pin_level(LED_0_PIN));
 }
 
 
+uint8_t led_is_on(void)
+{
+    return ioport_get_pin_level(LED_0_PIN) == IOPORT_PIN_LEVEL_LOW;
+}
+
+
+// Replaces the current pattern and returns immediately
+void led_pattern(const LED_STEP *steps, uint8_t len)
+{
+    uint8_t i;
+    led_stop();
+    if (len > LED_PATTERN_MAX_STEPS) {
+        len = LED_PATTERN_MAX_STEPS;
+    }
+    if (!len) {
+        led_set(0);
+        return;
+    }
+    for (i = 0; i < len; i++) {
+        led_steps[i] = steps[i];
+    }
+    led_step = 0;
+    led_step_ms = 0;
+    led_set(led_steps[0].on);
+    led_steps_len = len;// last, so that led_tick() sees a complete pattern
+}
+
+
+uint8_t led_busy(void)
+{
+    return led_steps_len != 0;
+}
+
+
+// Called from the SysTick interrupt
+void led_tick(uint16_t ms)
+{
+    if (!led_steps_len) {
+        return;
+    }
+    led_step_ms += ms;
+    while (led_steps_len && led_step_ms >= led_steps[led_step].ms) {
+        led_step_ms -= led_steps[led_step].ms;
+        led_step++;
+        if (led_step >= led_steps_len) {
+            led_steps_len = 0;
+            led_set(0);
+        } else {
+            led_set(led_steps[led_step].on);
+        }
+    }
+}
+
+
 void led_blink(void)
 {
-    led_on();
-    delay_ms(300);
-    led_off();
+    led_pattern(LED_PATTERN_BLINK, sizeof(LED_PATTERN_BLINK) / sizeof(LED_STEP));
+}
+
+
+void led_accept(void)
+{
+    led_pattern(LED_PATTERN_ACCEPT, sizeof(LED_PATTERN_ACCEPT) / sizeof(LED_STEP));
 }
 
 
 void led_abort(void)
 {
-    led_off();
-    delay_ms(300);
-    led_on();
-    delay_ms(100);
-    led_off();
-    delay_ms(100);
-    led_on();
-    delay_ms(100);
-    led_off();
+    led_pattern(LED_PATTERN_ABORT, sizeof(LED_PATTERN_ABORT) / sizeof(LED_STEP));
 }
 
+
+// Blinks code[i] times for each i, in groups separated by a pause
 void led_code(uint8_t *code, uint8_t len)
 {
-    uint8_t i, j;
-    delay_ms(500);
+    LED_STEP steps[LED_PATTERN_MAX_STEPS];
+    uint8_t i, j, n = 0;
+
+    steps[n].on = 0;
+    steps[n++].ms = 500;
     for (i = 0; i < len; i++) {
-        for (j = 0; j < code[i]; j++) {
-            led_toggle();
-            delay_ms(300);
-            led_toggle();
-            delay_ms(300);
+        for (j = 0; j < code[i] && n + 3 <= LED_PATTERN_MAX_STEPS; j++) {
+            steps[n].on = 1;
+            steps[n++].ms = 300;
+            steps[n].on = 0;
+            steps[n++].ms = 300;
+        }
+        if (n < LED_PATTERN_MAX_STEPS) {
+            steps[n].on = 0;
+            steps[n++].ms = 500;
         }
-        delay_ms(500);
     }
+    led_pattern(steps, n);
 }
@@ -32,14 +32,29 @@
 #include <stdint.h>
 
 
-#define LED_MAX_CODE_BLINKS 4
-#define LED_MAX_BLINK_SETS  6
+#define LED_MAX_CODE_BLINKS   4
+#define LED_MAX_BLINK_SETS    6
+#define LED_PATTERN_MAX_STEPS 32
+
+
+// LED patterns are played back from the SysTick interrupt (led_tick), so
+// led_blink(), led_accept(), led_abort() and led_code() return right away.
+// led_on(), led_off() and led_toggle() stop a pattern that is playing.
+typedef struct {
+    uint8_t on;
+    uint16_t ms;
+} LED_STEP;
 
 
 void led_on(void);
 void led_off(void);
 void led_toggle(void);
+uint8_t led_is_on(void);
+void led_pattern(const LED_STEP *steps, uint8_t len);
+uint8_t led_busy(void);
+void led_tick(uint16_t ms);
 void led_blink(void);
+void led_accept(void);
 void led_abort(void);
 void led_code(uint8_t *code, uint8_t len);
 
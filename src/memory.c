@@ -29,6 +29,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "aes.h"
 #include "commander.h"
 #include "memory.h"
 #include "random.h"
@@ -43,9 +44,16 @@
 #include <ioport.h>
 #include "ataes132.h"
 #include "mcu.h"
+#else
+#include "sham.h"
 #endif
 
 
+#define MEM_XPUB_CACHE_EPOCH_LEN  16
+#define MEM_XPUB_CACHE_TAG_LEN    16
+#define MEM_XPUB_CACHE_WRITES_MAX MEM_XPUB_CACHE_SLOTS// per power cycle, bounds EEPROM wear
+
+
 static uint8_t MEM_unlocked = DEFAULT_unlocked;
 static uint8_t MEM_erased = DEFAULT_erased;
 static uint8_t MEM_setup = DEFAULT_setup;
@@ -53,6 +61,12 @@ static uint32_t MEM_ext_flags = DEFAULT_ext_flags;
 static uint32_t MEM_u2f_count = DEFAULT_u2f_count;
 static uint16_t MEM_pin_err = DBB_ACCESS_INITIALIZE;
 static uint16_t MEM_access_err = DBB_ACCESS_INITIALIZE;
+static uint8_t MEM_aeskeys_read = 0;
+static uint8_t MEM_xpub_cache_next = 0;
+static uint8_t MEM_xpub_cache_loaded = 0;
+static uint8_t MEM_xpub_cache_writes = 0;
+static uint8_t MEM_xpub_cache_valid[MEM_XPUB_CACHE_SLOTS];
+static uint8_t MEM_xpub_cache[MEM_XPUB_CACHE_SLOTS][MEM_XPUB_CACHE_ENTRY_LEN];
 
 __extension__ static uint8_t MEM_active_key[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
 __extension__ static uint8_t MEM_user_entropy[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
@@ -65,12 +79,30 @@ __extension__ static uint8_t MEM_master_hww[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF
 __extension__ static uint8_t MEM_hidden_hww_chain[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
 __extension__ static uint8_t MEM_hidden_hww[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
 __extension__ static uint8_t MEM_master_u2f[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
+__extension__ static uint8_t MEM_generation[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
+__extension__ static uint8_t MEM_xpub_cache_epoch[] = {[0 ... MEM_XPUB_CACHE_EPOCH_LEN - 1] = 0xFF};
 __extension__ static uint8_t MEM_name[] = {[0 ... MEM_PAGE_LEN - 1] = '0'};
 
 __extension__ const uint8_t MEM_PAGE_ERASE[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFF};
 __extension__ const uint16_t MEM_PAGE_ERASE_2X[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFFFF};
 __extension__ const uint8_t MEM_PAGE_ERASE_FE[] = {[0 ... MEM_PAGE_LEN - 1] = 0xFE};
 
+#ifdef TESTING
+// Simulated EEPROM contents and traffic, i.e. the ataes_eeprom() calls the
+// device would make
+#define MEM_SHAM_EEPROM_SIZE 0x1000
+__extension__ static uint8_t MEM_sham_eeprom[] = {[0 ... MEM_SHAM_EEPROM_SIZE - 1] = 0xFF};
+static uint32_t MEM_io_reads = 0;
+static uint32_t MEM_io_writes = 0;
+
+
+void memory_eeprom_io_count(uint32_t *reads, uint32_t *writes)
+{
+    *reads = MEM_io_reads;
+    *writes = MEM_io_writes;
+}
+#endif
+
 
 static uint8_t memory_eeprom(uint8_t *write_b, uint8_t *read_b, const int32_t addr,
                              const uint16_t len)
@@ -81,6 +113,15 @@ static uint8_t memory_eeprom(uint8_t *write_b, uint8_t *read_b, const int32_t ad
         commander_fill_report(cmd_str(CMD_ataes), NULL, DBB_ERR_MEM_ATAES);
         return DBB_ERROR;
     }
+#else
+    if (addr < 0 || addr + len > MEM_SHAM_EEPROM_SIZE) {
+        return DBB_ERROR;
+    }
+    if (read_b) {
+        memcpy(read_b, MEM_sham_eeprom + addr, len);
+    }
+    MEM_io_reads++;
+    sham_latency(SHAM_LATENCY_EEPROM);
 #endif
     if (write_b) {
 #ifndef TESTING
@@ -106,8 +147,14 @@ static uint8_t memory_eeprom(uint8_t *write_b, uint8_t *read_b, const int32_t ad
             }
         }
 #else
-        memcpy(read_b, write_b, len);
-        (void) addr;
+        if (memcmp(MEM_sham_eeprom + addr, write_b, len)) {
+            MEM_io_writes++;
+            sham_latency(SHAM_LATENCY_EEPROM);
+        }
+        memcpy(MEM_sham_eeprom + addr, write_b, len);
+        if (read_b) {
+            memcpy(read_b, write_b, len);
+        }
         return DBB_OK;
 #endif
     }
@@ -115,17 +162,27 @@ static uint8_t memory_eeprom(uint8_t *write_b, uint8_t *read_b, const int32_t ad
 }
 
 
-// Encrypted storage
-static uint8_t memory_eeprom_crypt(const uint8_t *write_b, uint8_t *read_b,
-                                   const int32_t addr)
+// A decrypted record is the hex string of one page. Anything else was
+// encrypted under a previous generation key (or never written).
+static uint8_t memory_eeprom_crypt_valid(const char *dec, int dec_len)
 {
-    int enc_len, dec_len;
-    char *enc, *dec, enc_r[MEM_PAGE_LEN * 4 + 1] = {0};
-    static uint8_t mempass[MEM_PAGE_LEN];
+    int i;
+    if (!dec || dec_len != MEM_PAGE_LEN * 2 + 1) {
+        return 0;
+    }
+    for (i = 0; i < MEM_PAGE_LEN * 2; i++) {
+        if (!((dec[i] >= '0' && dec[i] <= '9') || (dec[i] >= 'a' && dec[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 
-    // Encrypt data saved to memory using an AES key obfuscated by the
-    // bootloader bytes.
-    memset(mempass, 0, sizeof(mempass));
+// Encrypt data saved to memory using an AES key obfuscated by the bootloader bytes
+static void memory_mempass(uint8_t *mempass)
+{
+    memset(mempass, 0, MEM_PAGE_LEN);
 #ifndef TESTING
     uint8_t rn[FLASH_USERSIG_RN_LEN] = {0};
     sha256_Raw((uint8_t *)(FLASH_BOOT_START), FLASH_BOOT_LEN, mempass);
@@ -138,6 +195,25 @@ static uint8_t memory_eeprom_crypt(const uint8_t *write_b, uint8_t *read_b,
     sha256_Raw((const uint8_t *)(utils_uint8_to_hex(mempass, MEM_PAGE_LEN)), MEM_PAGE_LEN * 2,
                mempass);
     sha256_Raw(mempass, MEM_PAGE_LEN, mempass);
+    if (memcmp(MEM_generation, MEM_PAGE_ERASE, MEM_PAGE_LEN)) {
+        // Unset on devices not reset since upgrading from older firmware
+        hmac_sha256(mempass, MEM_PAGE_LEN, MEM_generation, MEM_PAGE_LEN, mempass);
+    }
+}
+
+
+// Encrypted storage
+//
+// Reading a record that is not valid under the current generation key yields
+// `erased` if given, else an error and read_b is left unchanged.
+static uint8_t memory_eeprom_crypt(const uint8_t *write_b, uint8_t *read_b,
+                                   const int32_t addr, const uint8_t *erased)
+{
+    int enc_len, dec_len;
+    char *enc, *dec, enc_r[MEM_PAGE_LEN * 4 + 1] = {0};
+    static uint8_t mempass[MEM_PAGE_LEN];
+
+    memory_mempass(mempass);
 
     if (read_b) {
         enc = aes_cbc_b64_encrypt((unsigned char *)utils_uint8_to_hex(read_b, MEM_PAGE_LEN),
@@ -196,12 +272,20 @@ static uint8_t memory_eeprom_crypt(const uint8_t *write_b, uint8_t *read_b,
 
     dec = aes_cbc_b64_decrypt((unsigned char *)enc_r, MEM_PAGE_LEN * 4, &dec_len,
                               mempass);
-    if (!dec) {
-        goto err;
+    if (!memory_eeprom_crypt_valid(dec, dec_len)) {
+        if (dec) {
+            utils_zero(dec, dec_len);
+            free(dec);
+        }
+        if (!erased) {
+            goto err;
+        }
+        memcpy(read_b, erased, MEM_PAGE_LEN);
+    } else {
+        memcpy(read_b, utils_hex_to_uint8(dec), MEM_PAGE_LEN);
+        utils_zero(dec, dec_len);
+        free(dec);
     }
-    memcpy(read_b, utils_hex_to_uint8(dec), MEM_PAGE_LEN);
-    utils_zero(dec, dec_len);
-    free(dec);
 
     utils_zero(mempass, MEM_PAGE_LEN);
     utils_clear_buffers();
@@ -237,6 +321,30 @@ static void memory_scramble_default_aeskeys(void)
 }
 
 
+static void memory_scramble_aeskeys(void)
+{
+    random_bytes(MEM_aeskey_stand, MEM_PAGE_LEN, 0);
+    random_bytes(MEM_aeskey_hidden, MEM_PAGE_LEN, 0);
+    random_bytes(MEM_aeskey_verify, MEM_PAGE_LEN, 0);
+}
+
+
+// Replacing the generation key makes all encrypted records unreadable, so
+// that they read as erased without rewriting them.
+static uint8_t memory_scramble_generation(void)
+{
+    uint8_t number[MEM_PAGE_LEN] = {0};
+    uint8_t ret;
+    random_bytes(number, sizeof(number), 0);
+    ret = memory_eeprom(number, MEM_generation, MEM_GENERATION_ADDR, MEM_PAGE_LEN);
+    if (ret == DBB_OK && memcmp(MEM_generation, number, MEM_PAGE_LEN)) {
+        ret = DBB_ERROR;
+    }
+    utils_zero(number, sizeof(number));
+    return ret;
+}
+
+
 static void memory_scramble_rn(void)
 {
 #ifndef TESTING
@@ -256,6 +364,9 @@ static void memory_scramble_rn(void)
 
 uint8_t memory_setup(void)
 {
+    MEM_aeskeys_read = 0;
+    MEM_xpub_cache_loaded = 0;
+    MEM_xpub_cache_writes = 0;
     if (memory_read_setup()) {
         // One-time setup on factory install
 #ifndef TESTING
@@ -273,10 +384,16 @@ uint8_t memory_setup(void)
         memory_eeprom((uint8_t *)&c, (uint8_t *)&MEM_u2f_count, MEM_U2F_COUNT_ADDR, 4);
         memory_write_setup(0x00);
     } else {
+        memory_eeprom(NULL, MEM_generation, MEM_GENERATION_ADDR, MEM_PAGE_LEN);
+        memory_eeprom(NULL, MEM_xpub_cache_epoch, MEM_XPUB_CACHE_EPOCH_ADDR,
+                      MEM_XPUB_CACHE_EPOCH_LEN);
+        memory_eeprom(NULL, &MEM_xpub_cache_next, MEM_XPUB_CACHE_NEXT_ADDR, 1);
         memory_read_ext_flags();
         memory_eeprom(NULL, &MEM_erased, MEM_ERASED_ADDR, 1);
+        memory_read_unlocked();// Load cache
         memory_master_u2f(NULL);// Load cache so that U2F speed is fast enough
         memory_read_access_err_count();// Load cache
+        memory_read_pin_err_count();// Load cache
         memory_u2f_count_read();
     }
     memory_scramble_default_aeskeys();
@@ -300,11 +417,23 @@ void memory_reset_hww(void)
     uint8_t u2f[MEM_PAGE_LEN];
     memcpy(u2f, MEM_master_u2f, MEM_PAGE_LEN);
     memory_scramble_rn();
-    memory_master_u2f(u2f);
-    memory_random_password(PASSWORD_STAND);
-    memory_random_password(PASSWORD_VERIFY);
-    memory_random_password(PASSWORD_HIDDEN);
-    memory_erase_hww_seed();
+    memory_xpub_cache_clear();
+    if (memory_scramble_generation() == DBB_OK) {
+        // Crypto erase. The stale records are overwritten when next written.
+        memory_scramble_aeskeys();
+        memcpy(MEM_master_hww_entropy, MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        memcpy(MEM_master_hww_chain, MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        memcpy(MEM_master_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        memcpy(MEM_hidden_hww_chain, MEM_PAGE_ERASE_FE, MEM_PAGE_LEN);
+        memcpy(MEM_hidden_hww, MEM_PAGE_ERASE_FE, MEM_PAGE_LEN);
+        memory_master_u2f(u2f);
+    } else {
+        memory_master_u2f(u2f);
+        memory_random_password(PASSWORD_STAND);
+        memory_random_password(PASSWORD_VERIFY);
+        memory_random_password(PASSWORD_HIDDEN);
+        memory_erase_hww_seed();
+    }
     memory_name(DEVICE_DEFAULT_NAME);
     memory_write_erased(DEFAULT_erased);
     memory_write_unlocked(DEFAULT_unlocked);
@@ -336,20 +465,42 @@ void memory_random_password(PASSWORD_ID id)
 }
 
 
-void memory_clear(void)
+static void memory_clear_keys(void)
 {
-#ifndef TESTING
-    // Zero important variables in RAM on embedded MCU.
-    // Do not clear for testing routines (i.e. not embedded).
     memcpy(MEM_hidden_hww_chain, MEM_PAGE_ERASE, MEM_PAGE_LEN);
     memcpy(MEM_hidden_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN);
     memcpy(MEM_master_hww_chain, MEM_PAGE_ERASE, MEM_PAGE_LEN);
     memcpy(MEM_master_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN);
     memcpy(MEM_master_hww_entropy, MEM_PAGE_ERASE, MEM_PAGE_LEN);
+}
+
+
+void memory_clear(void)
+{
+#ifndef TESTING
+    // Zero important variables in RAM on embedded MCU.
+    // Do not clear for testing routines (i.e. not embedded).
+    memory_clear_keys();
 #endif
 }
 
 
+#ifdef TESTING
+// memory_clear() as on the device, for tests that check what a command
+// loads into RAM
+void memory_clear_test(void)
+{
+    memory_clear_keys();
+}
+
+
+uint8_t memory_master_hww_erased(void)
+{
+    return !memcmp(MEM_master_hww, MEM_PAGE_ERASE, MEM_PAGE_LEN);
+}
+#endif
+
+
 uint8_t *memory_name(const char *name)
 {
     uint8_t name_b[MEM_PAGE_LEN] = {0};
@@ -365,52 +516,68 @@ uint8_t *memory_name(const char *name)
 
 uint8_t *memory_hidden_hww(const uint8_t *master)
 {
-    memory_eeprom_crypt(NULL, MEM_hidden_hww, MEM_HIDDEN_BIP32_ADDR);
+    if (master) {
+        memory_xpub_cache_clear();
+    }
+    memory_eeprom_crypt(NULL, MEM_hidden_hww, MEM_HIDDEN_BIP32_ADDR, MEM_PAGE_ERASE_FE);
     if ((master == NULL) && !memcmp(MEM_hidden_hww, MEM_PAGE_ERASE, 32)) {
         // Backward compatible with firmware <=2.2.3
         return memory_master_hww_chaincode(NULL);
     }
-    memory_eeprom_crypt(master, MEM_hidden_hww, MEM_HIDDEN_BIP32_ADDR);
+    memory_eeprom_crypt(master, MEM_hidden_hww, MEM_HIDDEN_BIP32_ADDR, MEM_PAGE_ERASE_FE);
     return MEM_hidden_hww;
 }
 
 
 uint8_t *memory_hidden_hww_chaincode(const uint8_t *chain)
 {
-    memory_eeprom_crypt(NULL, MEM_hidden_hww_chain, MEM_HIDDEN_BIP32_CHAIN_ADDR);
+    if (chain) {
+        memory_xpub_cache_clear();
+    }
+    memory_eeprom_crypt(NULL, MEM_hidden_hww_chain, MEM_HIDDEN_BIP32_CHAIN_ADDR,
+                        MEM_PAGE_ERASE_FE);
     if ((chain == NULL) && !memcmp(MEM_hidden_hww_chain, MEM_PAGE_ERASE, 32)) {
         // Backward compatible with firmware <=2.2.3
         return memory_master_hww(NULL);
     }
-    memory_eeprom_crypt(chain, MEM_hidden_hww_chain, MEM_HIDDEN_BIP32_CHAIN_ADDR);
+    memory_eeprom_crypt(chain, MEM_hidden_hww_chain, MEM_HIDDEN_BIP32_CHAIN_ADDR,
+                        MEM_PAGE_ERASE_FE);
     return MEM_hidden_hww_chain;
 }
 
 
 uint8_t *memory_master_hww(const uint8_t *master)
 {
-    memory_eeprom_crypt(master, MEM_master_hww, MEM_MASTER_BIP32_ADDR);
+    if (master) {
+        memory_xpub_cache_clear();
+    }
+    memory_eeprom_crypt(master, MEM_master_hww, MEM_MASTER_BIP32_ADDR, MEM_PAGE_ERASE);
     return MEM_master_hww;
 }
 
 
 uint8_t *memory_master_hww_chaincode(const uint8_t *chain)
 {
-    memory_eeprom_crypt(chain, MEM_master_hww_chain, MEM_MASTER_BIP32_CHAIN_ADDR);
+    if (chain) {
+        memory_xpub_cache_clear();
+    }
+    memory_eeprom_crypt(chain, MEM_master_hww_chain, MEM_MASTER_BIP32_CHAIN_ADDR,
+                        MEM_PAGE_ERASE);
     return MEM_master_hww_chain;
 }
 
 
 uint8_t *memory_master_hww_entropy(const uint8_t *master_entropy)
 {
-    memory_eeprom_crypt(master_entropy, MEM_master_hww_entropy, MEM_MASTER_ENTROPY_ADDR);
+    memory_eeprom_crypt(master_entropy, MEM_master_hww_entropy, MEM_MASTER_ENTROPY_ADDR,
+                        MEM_PAGE_ERASE);
     return MEM_master_hww_entropy;
 }
 
 
 uint8_t *memory_master_u2f(const uint8_t *master_u2f)
 {
-    memory_eeprom_crypt(master_u2f, MEM_master_u2f, MEM_MASTER_U2F_ADDR);
+    memory_eeprom_crypt(master_u2f, MEM_master_u2f, MEM_MASTER_U2F_ADDR, NULL);
     return MEM_master_u2f;
 }
 
@@ -421,6 +588,191 @@ uint8_t *memory_report_master_u2f(void)
 }
 
 
+//
+//  Account xpub cache
+//
+//  Entries are encrypted and authenticated with keys derived from the storage
+//  key and a random epoch: tag = HMAC(entry) is the IV of the AES-CBC encrypted
+//  entry. Erasing the epoch drops all entries at once. The entries are
+//  decrypted once per power cycle.
+//
+
+static void memory_xpub_cache_keys(uint8_t *keys)
+{
+    uint8_t mempass[MEM_PAGE_LEN];
+    memory_mempass(mempass);
+    hmac_sha512(mempass, MEM_PAGE_LEN, MEM_xpub_cache_epoch, MEM_XPUB_CACHE_EPOCH_LEN, keys);
+    utils_zero(mempass, sizeof(mempass));
+    utils_clear_buffers();
+}
+
+
+static void memory_xpub_cache_tag(const uint8_t *keys, uint8_t slot, const uint8_t *entry,
+                                  uint8_t *tag)
+{
+    uint8_t msg[1 + MEM_XPUB_CACHE_ENTRY_LEN];
+    uint8_t mac[SHA256_DIGEST_LENGTH];
+    msg[0] = slot;
+    memcpy(msg + 1, entry, MEM_XPUB_CACHE_ENTRY_LEN);
+    hmac_sha256(keys + MEM_PAGE_LEN, MEM_PAGE_LEN, msg, sizeof(msg), mac);
+    memcpy(tag, mac, MEM_XPUB_CACHE_TAG_LEN);
+}
+
+
+static uint8_t memory_xpub_cache_slot(const uint8_t *keys, uint8_t slot,
+                                      const uint8_t *write_entry, uint8_t *read_entry)
+{
+    uint8_t stored[MEM_XPUB_CACHE_TAG_LEN + MEM_XPUB_CACHE_ENTRY_LEN];
+    uint8_t iv[MEM_XPUB_CACHE_TAG_LEN], tag[MEM_XPUB_CACHE_TAG_LEN];
+    uint8_t ret = DBB_OK;
+    int32_t addr = MEM_XPUB_CACHE_ADDR + slot * sizeof(stored);
+    size_t i;
+    aes_context ctx[1];
+
+    aes_set_key(keys, MEM_PAGE_LEN, ctx);
+    if (write_entry) {
+        memory_xpub_cache_tag(keys, slot, write_entry, tag);
+        memcpy(stored, tag, sizeof(tag));
+        memcpy(iv, tag, sizeof(iv));
+        aes_cbc_encrypt(write_entry, stored + MEM_XPUB_CACHE_TAG_LEN,
+                        MEM_XPUB_CACHE_ENTRY_LEN / N_BLOCK, iv, ctx);
+        for (i = 0; i < sizeof(stored) && ret == DBB_OK; i += MEM_PAGE_LEN) {
+            uint8_t page[MEM_PAGE_LEN];
+            ret = memory_eeprom(stored + i, page, addr + i, MEM_PAGE_LEN);
+        }
+    } else {
+        for (i = 0; i < sizeof(stored) && ret == DBB_OK; i += MEM_PAGE_LEN) {
+            ret = memory_eeprom(NULL, stored + i, addr + i, MEM_PAGE_LEN);
+        }
+        if (ret == DBB_OK) {
+            memcpy(iv, stored, sizeof(iv));
+            aes_cbc_decrypt(stored + MEM_XPUB_CACHE_TAG_LEN, read_entry,
+                            MEM_XPUB_CACHE_ENTRY_LEN / N_BLOCK, iv, ctx);
+            memory_xpub_cache_tag(keys, slot, read_entry, tag);
+            if (!utils_secure_equal(tag, stored, MEM_XPUB_CACHE_TAG_LEN)) {
+                ret = DBB_ERROR;
+            }
+        }
+    }
+    utils_zero(ctx, sizeof(ctx));
+    return ret;
+}
+
+
+static void memory_xpub_cache_load(void)
+{
+    uint8_t keys[MEM_PAGE_LEN * 2];
+    uint8_t slot;
+
+    if (MEM_xpub_cache_loaded) {
+        return;
+    }
+    MEM_xpub_cache_loaded = 1;
+    memset(MEM_xpub_cache_valid, 0, sizeof(MEM_xpub_cache_valid));
+    if (!memcmp(MEM_xpub_cache_epoch, MEM_PAGE_ERASE, MEM_XPUB_CACHE_EPOCH_LEN)) {
+        return;
+    }
+    memory_xpub_cache_keys(keys);
+    for (slot = 0; slot < MEM_XPUB_CACHE_SLOTS; slot++) {
+        MEM_xpub_cache_valid[slot] = memory_xpub_cache_slot(keys, slot, NULL,
+                                     MEM_xpub_cache[slot]) == DBB_OK;
+    }
+    utils_zero(keys, sizeof(keys));
+}
+
+
+// Fills in the entry with the ID in its first MEM_XPUB_CACHE_ID_LEN bytes
+uint8_t memory_xpub_cache_get(uint8_t *entry)
+{
+    uint8_t slot;
+    memory_xpub_cache_load();
+    for (slot = 0; slot < MEM_XPUB_CACHE_SLOTS; slot++) {
+        if (MEM_xpub_cache_valid[slot] &&
+                !memcmp(MEM_xpub_cache[slot], entry, MEM_XPUB_CACHE_ID_LEN)) {
+            memcpy(entry, MEM_xpub_cache[slot], MEM_XPUB_CACHE_ENTRY_LEN);
+            return DBB_OK;
+        }
+    }
+    return DBB_ERROR;
+}
+
+
+// Replaces the entry with the same ID, else a free slot, else the oldest entry.
+// An identical entry is not rewritten, and at most MEM_XPUB_CACHE_WRITES_MAX
+// entries are written per power cycle, so that a host cycling through more
+// accounts than there are slots does not rewrite the EEPROM on every request.
+uint8_t memory_xpub_cache_put(const uint8_t *entry)
+{
+    uint8_t keys[MEM_PAGE_LEN * 2];
+    uint8_t slot, next, ret;
+
+    memory_xpub_cache_load();
+    for (slot = 0; slot < MEM_XPUB_CACHE_SLOTS; slot++) {
+        if (MEM_xpub_cache_valid[slot] &&
+                !memcmp(MEM_xpub_cache[slot], entry, MEM_XPUB_CACHE_ENTRY_LEN)) {
+            return DBB_OK;
+        }
+    }
+    if (MEM_xpub_cache_writes >= MEM_XPUB_CACHE_WRITES_MAX) {
+        return DBB_ERROR;
+    }
+    MEM_xpub_cache_writes++;
+
+    if (!memcmp(MEM_xpub_cache_epoch, MEM_PAGE_ERASE, MEM_XPUB_CACHE_EPOCH_LEN)) {
+        uint8_t epoch[MEM_XPUB_CACHE_EPOCH_LEN];
+        random_bytes(epoch, sizeof(epoch), 0);
+        if (!memcmp(epoch, MEM_PAGE_ERASE, sizeof(epoch)) ||
+                memory_eeprom(epoch, MEM_xpub_cache_epoch, MEM_XPUB_CACHE_EPOCH_ADDR,
+                              sizeof(epoch)) != DBB_OK) {
+            return DBB_ERROR;
+        }
+    }
+
+    for (slot = 0; slot < MEM_XPUB_CACHE_SLOTS; slot++) {
+        if (MEM_xpub_cache_valid[slot] &&
+                !memcmp(MEM_xpub_cache[slot], entry, MEM_XPUB_CACHE_ID_LEN)) {
+            break;
+        }
+    }
+    for (next = 0; slot == MEM_XPUB_CACHE_SLOTS && next < MEM_XPUB_CACHE_SLOTS; next++) {
+        if (!MEM_xpub_cache_valid[next]) {
+            slot = next;
+        }
+    }
+    if (slot == MEM_XPUB_CACHE_SLOTS) {
+        slot = MEM_xpub_cache_next % MEM_XPUB_CACHE_SLOTS;
+    }
+
+    memory_xpub_cache_keys(keys);
+    MEM_xpub_cache_valid[slot] = 0;
+    ret = memory_xpub_cache_slot(keys, slot, entry, NULL);
+    utils_zero(keys, sizeof(keys));
+    if (ret != DBB_OK) {
+        return DBB_ERROR;
+    }
+    memcpy(MEM_xpub_cache[slot], entry, MEM_XPUB_CACHE_ENTRY_LEN);
+    MEM_xpub_cache_valid[slot] = 1;
+
+    next = (slot + 1) % MEM_XPUB_CACHE_SLOTS;
+    memory_eeprom(&next, &MEM_xpub_cache_next, MEM_XPUB_CACHE_NEXT_ADDR, 1);
+    return DBB_OK;
+}
+
+
+void memory_xpub_cache_clear(void)
+{
+    uint8_t erased[MEM_XPUB_CACHE_EPOCH_LEN];
+    MEM_xpub_cache_writes = 0;
+    memset(MEM_xpub_cache_valid, 0, sizeof(MEM_xpub_cache_valid));
+    utils_zero(MEM_xpub_cache, sizeof(MEM_xpub_cache));
+    if (!memcmp(MEM_xpub_cache_epoch, MEM_PAGE_ERASE, MEM_XPUB_CACHE_EPOCH_LEN)) {
+        return;
+    }
+    memset(erased, 0xFF, sizeof(erased));
+    memory_eeprom(erased, MEM_xpub_cache_epoch, MEM_XPUB_CACHE_EPOCH_ADDR, sizeof(erased));
+}
+
+
 void memory_active_key_set(uint8_t *key)
 {
     if (key) {
@@ -464,11 +816,11 @@ uint8_t memory_write_aeskey(const char *password, int len, PASSWORD_ID id)
     }
 
     ret |= memory_eeprom_crypt(MEM_aeskey_stand, MEM_aeskey_stand,
-                               MEM_AESKEY_STAND_ADDR) - DBB_OK;
+                               MEM_AESKEY_STAND_ADDR, NULL) - DBB_OK;
     ret |= memory_eeprom_crypt(MEM_aeskey_hidden, MEM_aeskey_hidden,
-                               MEM_AESKEY_HIDDEN_ADDR) - DBB_OK;
+                               MEM_AESKEY_HIDDEN_ADDR, NULL) - DBB_OK;
     ret |= memory_eeprom_crypt(MEM_aeskey_verify, MEM_aeskey_verify,
-                               MEM_AESKEY_VERIFY_ADDR) - DBB_OK;
+                               MEM_AESKEY_VERIFY_ADDR, NULL) - DBB_OK;
 
     utils_zero(password_b, MEM_PAGE_LEN);
 
@@ -482,13 +834,18 @@ uint8_t memory_write_aeskey(const char *password, int len, PASSWORD_ID id)
 
 void memory_read_aeskeys(void)
 {
-    static uint8_t read = 0;
-    if (!read) {
-        memory_eeprom_crypt(NULL, MEM_aeskey_stand, MEM_AESKEY_STAND_ADDR);
-        memory_eeprom_crypt(NULL, MEM_aeskey_hidden, MEM_AESKEY_HIDDEN_ADDR);
-        memory_eeprom_crypt(NULL, MEM_aeskey_verify, MEM_AESKEY_VERIFY_ADDR);
+    if (!MEM_aeskeys_read) {
+        // Keys erased by a reset read as random, i.e. unusable, keys
+        uint8_t number[MEM_PAGE_LEN * 3];
+        random_bytes(number, sizeof(number), 0);
+        memory_eeprom_crypt(NULL, MEM_aeskey_stand, MEM_AESKEY_STAND_ADDR, number);
+        memory_eeprom_crypt(NULL, MEM_aeskey_hidden, MEM_AESKEY_HIDDEN_ADDR,
+                            number + MEM_PAGE_LEN);
+        memory_eeprom_crypt(NULL, MEM_aeskey_verify, MEM_AESKEY_VERIFY_ADDR,
+                            number + MEM_PAGE_LEN * 2);
         sha256_Raw(MEM_aeskey_stand, MEM_PAGE_LEN, MEM_user_entropy);
-        read++;
+        utils_zero(number, sizeof(number));
+        MEM_aeskeys_read = 1;
     }
 }
 
@@ -529,6 +886,10 @@ uint8_t memory_read_unlocked(void)
     memory_eeprom(NULL, &MEM_unlocked, MEM_UNLOCKED_ADDR, 1);
     return MEM_unlocked;
 }
+uint8_t memory_report_unlocked(void)
+{
+    return MEM_unlocked;
+}
 
 
 void memory_write_erased(uint8_t erased)
@@ -602,6 +963,10 @@ uint16_t memory_read_pin_err_count(void)
     memory_eeprom(NULL, (uint8_t *)&MEM_pin_err, MEM_PIN_ERR_ADDR, 2);
     return MEM_pin_err;
 }
+uint16_t memory_report_pin_err_count(void)
+{
+    return MEM_pin_err;
+}
 
 
 uint32_t memory_u2f_count_iter(void)
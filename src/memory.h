@@ -42,24 +42,37 @@
 #define MEM_UNLOCKED_ADDR               0x0008
 #define MEM_EXT_FLAGS_ADDR              0x000A// (uint32_t) 32 possible extension flags
 #define MEM_U2F_COUNT_ADDR              0x0010// (uint32_t)
+#define MEM_XPUB_CACHE_NEXT_ADDR        0x0014// (uint8_t) Next xpub cache slot to replace
+#define MEM_XPUB_CACHE_EPOCH_ADDR       0x0020// (16 bytes) Mixed into the xpub cache key, erased to drop all entries
 #define MEM_NAME_ADDR                   0x0100// (32 bytes) Zone 1
 #define MEM_MASTER_BIP32_ADDR           0x0200
 #define MEM_MASTER_BIP32_CHAIN_ADDR     0x0300
 #define MEM_AESKEY_STAND_ADDR           0x0400
 #define MEM_AESKEY_VERIFY_ADDR          0x0500
 #define MEM_AESKEY_Z6_ADDR              0x0600// Zone 6 reserved first 32*4 bytes
-#define MEM_AESKEY_Z7_ADDR              0x0700// Zone 7 reserved
+#define MEM_XPUB_CACHE_ADDR             0x0680// (MEM_XPUB_CACHE_SLOTS * 128 bytes) Encrypted xpub cache
+#define MEM_AESKEY_Z7_ADDR              0x0700// Zone 7 reserved, holds the end of the xpub cache
 #define MEM_AESKEY_HIDDEN_ADDR          0x0800
 #define MEM_MASTER_ENTROPY_ADDR         0x0900
 #define MEM_MASTER_U2F_ADDR             0x0A00
 #define MEM_HIDDEN_BIP32_ADDR           0x0B00
 #define MEM_HIDDEN_BIP32_CHAIN_ADDR     0x0B80
+#define MEM_GENERATION_ADDR             0x0C00// (32 bytes) Key mixed into the encrypted storage key, replaced on reset
+
+
+// Account xpub cache entries. The first MEM_XPUB_CACHE_ID_LEN bytes identify
+// an entry, the rest is opaque. Stored with a 16-byte tag, i.e. in 4 pages.
+#define MEM_XPUB_CACHE_SLOTS      3
+#define MEM_XPUB_CACHE_ENTRY_LEN  112
+#define MEM_XPUB_CACHE_ID_LEN     32
 
 
 // Extension flags
 #define MEM_EXT_MASK_U2F         0x00000001// Mask of bit to enable (1) or disable (0) U2F functions 
 // Will override and disable U2F_HIJACK bit when disabled
 #define MEM_EXT_MASK_U2F_HIJACK  0x00000002// Mask of bit to enable (1) or disable (0) U2F_HIJACK interface
+#define MEM_EXT_MASK_SESSION     0x00000004// Mask of bit to disable (1) or enable (0) the signing session (opt-in)
+#define MEM_EXT_MASK_U2F_PRECOMPUTE 0x00000008// Mask of bit to disable (1) or enable (0) idle-time U2F nonce precomputation (opt-in)
 
 
 // Default settings
@@ -67,7 +80,7 @@
 #define DEFAULT_erased    0xFF
 #define DEFAULT_setup     0xFF
 #define DEFAULT_u2f_count 0xFFFFFFFF
-#define DEFAULT_ext_flags 0xFFFFFFFF// U2F and U2F_hijack enabled by default
+#define DEFAULT_ext_flags 0xFFFFFFFF// U2F and U2F_hijack enabled, signing session and U2F precompute disabled by default
 
 
 typedef enum PASSWORD_ID {
@@ -99,12 +112,16 @@ uint8_t *memory_master_hww_chaincode(const uint8_t *chain_code);
 uint8_t *memory_master_hww_entropy(const uint8_t *master_entropy);
 uint8_t *memory_master_u2f(const uint8_t *master_u2f);
 uint8_t *memory_report_master_u2f(void);
+uint8_t memory_xpub_cache_get(uint8_t *entry);
+uint8_t memory_xpub_cache_put(const uint8_t *entry);
+void memory_xpub_cache_clear(void);
 
 uint8_t *memory_read_memseed(void);
 uint8_t memory_read_erased(void);
 uint8_t memory_report_erased(void);
 uint8_t memory_report_setup(void);
 uint8_t memory_read_unlocked(void);
+uint8_t memory_report_unlocked(void);
 uint32_t memory_read_ext_flags(void);
 uint32_t memory_report_ext_flags(void);
 
@@ -118,10 +135,17 @@ uint16_t memory_read_access_err_count(void);
 uint16_t memory_report_access_err_count(void);
 uint16_t memory_pin_err_count(const uint8_t access);
 uint16_t memory_read_pin_err_count(void);
+uint16_t memory_report_pin_err_count(void);
 
 uint32_t memory_u2f_count_iter(void);
 void memory_u2f_count_set(uint32_t c);
 uint32_t memory_u2f_count_read(void);
 
+#ifdef TESTING
+void memory_eeprom_io_count(uint32_t *reads, uint32_t *writes);
+void memory_clear_test(void);
+uint8_t memory_master_hww_erased(void);
+#endif
+
 
 #endif  // _MEMORY_H_
@@ -0,0 +1,720 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "p256.h"
+#include "rfc6979.h"
+#include "utils.h"
+
+
+#define P256_LIMBS            8
+#define P256_SIGN_MAX_TRIES   64
+
+
+typedef uint32_t p256_fe[P256_LIMBS];// little-endian 32-bit limbs
+
+typedef struct {
+    p256_fe x, y, z;
+} p256_point;
+
+typedef struct {
+    p256_fe x, y;
+} p256_affine;
+
+
+static const p256_fe P256_P = {
+    0xffffffff, 0xffffffff, 0xffffffff, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0xffffffff
+};
+static const p256_fe P256_B = {
+    0x27d2604b, 0x3bce3c3e, 0xcc53b0f6, 0x651d06b0, 0x769886bc, 0xb3ebbd55, 0xaa3a93e7, 0x5ac635d8
+};
+static const p256_fe P256_N = {
+    0xfc632551, 0xf3b9cac2, 0xa7179e84, 0xbce6faad, 0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+};
+static const p256_fe P256_N_HALF = {
+    0x7e3192a8, 0x79dce561, 0xd38bcf42, 0xde737d56, 0xffffffff, 0x7fffffff, 0x80000000, 0x7fffffff
+};
+static const p256_fe P256_N_R = {// 2^256 mod n
+    0x039cdaaf, 0x0c46353d, 0x58e8617b, 0x43190552, 0x00000000, 0x00000000, 0xffffffff, 0x00000000
+};
+static const p256_fe P256_N_R2 = {// 2^512 mod n
+    0xbe79eea2, 0x83244c95, 0x49bd6fa6, 0x4699799c, 0x2b6bec59, 0x2845b239, 0xf3d95620, 0x66e12d94
+};
+#define P256_N0  0xee00bc4f// -n^-1 mod 2^32
+
+
+// Comb table: entry i - 1 is the sum of 2^(64 j) * G over the set bits j of i
+static const p256_affine P256_COMB[15] = {
+    {
+        { 0xd898c296, 0xf4a13945, 0x2deb33a0, 0x77037d81, 0x63a440f2, 0xf8bce6e5, 0xe12c4247, 0x6b17d1f2 },
+        { 0x37bf51f5, 0xcbb64068, 0x6b315ece, 0x2bce3357, 0x7c0f9e16, 0x8ee7eb4a, 0xfe1a7f9b, 0x4fe342e2 }
+    },
+    {
+        { 0x8e14db63, 0x90e75cb4, 0xad651f7e, 0x29493baa, 0x326e25de, 0x8492592e, 0x2811aaa5, 0x0fa822bc },
+        { 0x5f462ee7, 0xe4112454, 0x50fe82f5, 0x34b1a650, 0xb3df188b, 0x6f4ad4bc, 0xf5dba80d, 0xbff44ae8 }
+    },
+    {
+        { 0x097992af, 0x93391ce2, 0x0d35f1fa, 0xe96c98fd, 0x95e02789, 0xb257c0de, 0x89d6726f, 0x300a4bbc },
+        { 0xc08127a0, 0xaa54a291, 0xa9d806a5, 0x5bb1eead, 0xff1e3c6f, 0x7f1ddb25, 0xd09b4644, 0x72aac7e0 }
+    },
+    {
+        { 0xd789bd85, 0x57c84fc9, 0xc297eac3, 0xfc35ff7d, 0x88c6766e, 0xfb982fd5, 0xeedb5e67, 0x447d739b },
+        { 0x72e25b32, 0x0c7e33c9, 0xa7fae500, 0x3d349b95, 0x3a4aaff7, 0xe12e9d95, 0x834131ee, 0x2d4825ab }
+    },
+    {
+        { 0x2a1d367f, 0x13949c93, 0x1a0a11b7, 0xef7fbd2b, 0xb91dfc60, 0xddc6068b, 0x8a9c72ff, 0xef951932 },
+        { 0x7376d8a8, 0x196035a7, 0x95ca1740, 0x23183b08, 0x022c219c, 0xc1ee9807, 0x7dbb2c9b, 0x611e9fc3 }
+    },
+    {
+        { 0x0b57f4bc, 0xcae2b192, 0xc6c9bc36, 0x2936df5e, 0xe11238bf, 0x7dea6482, 0x7b51f5d8, 0x55066379 },
+        { 0x348a964c, 0x44ffe216, 0xdbdefbe1, 0x9fb3d576, 0x8d9d50e5, 0x0afa4001, 0x8aecb851, 0x15716484 }
+    },
+    {
+        { 0xfc5cde01, 0xe48ecaff, 0x0d715f26, 0x7ccd84e7, 0xf43e4391, 0xa2e8f483, 0xb21141ea, 0xeb5d7745 },
+        { 0x731a3479, 0xcac917e2, 0x2844b645, 0x85f22cfe, 0x58006cee, 0x0990e6a1, 0xdbecc17b, 0xeafd72eb }
+    },
+    {
+        { 0x313728be, 0x6cf20ffb, 0xa3c6b94a, 0x96439591, 0x44315fc5, 0x2736ff83, 0xa7849276, 0xa6d39677 },
+        { 0xc357f5f4, 0xf2bab833, 0x2284059b, 0x824a920c, 0x2d27ecdf, 0x66b8babd, 0x9b0b8816, 0x674f8474 }
+    },
+    {
+        { 0x677c8a3e, 0x2df48c04, 0x0203a56b, 0x74e02f08, 0xb8c7fedb, 0x31855f7d, 0x72c9ddad, 0x4e769e76 },
+        { 0xb824bbb0, 0xa4c36165, 0x3b9122a5, 0xfb9ae16f, 0x06947281, 0x1ec00572, 0xde830663, 0x42b99082 }
+    },
+    {
+        { 0xdda868b9, 0x6ef95150, 0x9c0ce131, 0xd1f89e79, 0x08a1c478, 0x7fdc1ca0, 0x1c6ce04d, 0x78878ef6 },
+        { 0x1fe0d976, 0x9c62b912, 0xbde08d4f, 0x6ace570e, 0x12309def, 0xde53142c, 0x7b72c321, 0xb6cb3f5d }
+    },
+    {
+        { 0xc31a3573, 0x7f991ed2, 0xd54fb496, 0x5b82dd5b, 0x812ffcae, 0x595c5220, 0x716b1287, 0x0c88bc4d },
+        { 0x5f48aca8, 0x3a57bf63, 0xdf2564f3, 0x7c8181f4, 0x9c04e6aa, 0x18d1b5b3, 0xf3901dc6, 0xdd5ddea3 }
+    },
+    {
+        { 0x3e72ad0c, 0xe96a79fb, 0x42ba792f, 0x43a0a28c, 0x083e49f3, 0xefe0a423, 0x6b317466, 0x68f344af },
+        { 0x3fb24d4a, 0xcdfe17db, 0x71f5c626, 0x668bfc22, 0x24d67ff3, 0x604ed93c, 0xf8540a20, 0x31b9c405 }
+    },
+    {
+        { 0xa2582e7f, 0xd36b4789, 0x4ec39c28, 0x0d1a1014, 0xedbad7a0, 0x663c62c3, 0x6f461db9, 0x4052bf4b },
+        { 0x188d25eb, 0x235a27c3, 0x99bfcc5b, 0xe724f339, 0x71d70cc8, 0x862be6bd, 0x90b0fc61, 0xfecf4d51 }
+    },
+    {
+        { 0xa1d4cfac, 0x74346c10, 0x8526a7a4, 0xafdf5cc0, 0xf62bff7a, 0x123202a8, 0xc802e41a, 0x1eddbae2 },
+        { 0xd603f844, 0x8fa0af2d, 0x4c701917, 0x36e06b7e, 0x73db33a0, 0x0c45f452, 0x560ebcfc, 0x43104d86 }
+    },
+    {
+        { 0x0d1d78e5, 0x9615b511, 0x25c4744b, 0x66b0de32, 0x6aaf363a, 0x0a4a46fb, 0x84f7a21c, 0xb48e26b4 },
+        { 0x21a01b2d, 0x06ebb0f6, 0x8b7b0f98, 0xc004e404, 0xfed6f668, 0x64131bcd, 0x4d4d3dab, 0xfac01540 }
+    },
+};
+
+
+//
+//  Limb helpers
+//
+static uint32_t p256_add_limbs(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint64_t c = 0;
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        c += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    return (uint32_t)c;
+}
+
+
+static uint32_t p256_sub_limbs(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint64_t d;
+    uint32_t borrow = 0;
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        d = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)d;
+        borrow = (uint32_t)(d >> 32) & 1;
+    }
+    return borrow;
+}
+
+
+// r = mask ? a : r, for mask 0 or 0xffffffff
+static void p256_cmov(uint32_t *r, const uint32_t *a, uint32_t mask)
+{
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        r[i] = (r[i] & ~mask) | (a[i] & mask);
+    }
+}
+
+
+static uint32_t p256_is_zero(const uint32_t *a)
+{
+    uint32_t acc = 0;
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        acc |= a[i];
+    }
+    return (uint32_t)(((uint64_t)acc - 1) >> 63);
+}
+
+
+static void p256_from_bytes(uint32_t *r, const uint8_t *in)
+{
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        const uint8_t *p = in + 28 - 4 * i;
+        r[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+}
+
+
+static void p256_to_bytes(uint8_t *out, const uint32_t *a)
+{
+    int i;
+    for (i = 0; i < P256_LIMBS; i++) {
+        uint8_t *p = out + 28 - 4 * i;
+        p[0] = a[i] >> 24;
+        p[1] = a[i] >> 16;
+        p[2] = a[i] >> 8;
+        p[3] = a[i];
+    }
+}
+
+
+// r = a + b mod m, for a, b < m
+static void p256_mod_add(uint32_t *r, const uint32_t *a, const uint32_t *b, const uint32_t *m)
+{
+    uint32_t t[P256_LIMBS];
+    uint32_t carry = p256_add_limbs(r, a, b);
+    uint32_t borrow = p256_sub_limbs(t, r, m);
+    p256_cmov(r, t, 0 - (carry | (borrow ^ 1)));
+}
+
+
+// r = a - b mod m, for a, b < m
+static void p256_mod_sub(uint32_t *r, const uint32_t *a, const uint32_t *b, const uint32_t *m)
+{
+    uint32_t t[P256_LIMBS];
+    uint32_t borrow = p256_sub_limbs(r, a, b);
+    p256_add_limbs(t, r, m);
+    p256_cmov(r, t, 0 - borrow);
+}
+
+
+//
+//  Field arithmetic mod p
+//
+#define p256_fe_add(r, a, b) p256_mod_add(r, a, b, P256_P)
+#define p256_fe_sub(r, a, b) p256_mod_sub(r, a, b, P256_P)
+
+
+// Solinas reduction of a 512-bit product (FIPS 186-4, D.2.3)
+static void p256_fe_reduce(uint32_t *r, const uint32_t *c)
+{
+    int64_t acc[P256_LIMBS], carry;
+    uint32_t t[P256_LIMBS], borrow;
+    int i, fold;
+
+    acc[0] = (int64_t)c[0] + c[8] + c[9] - c[11] - c[12] - c[13] - c[14];
+    acc[1] = (int64_t)c[1] + c[9] + c[10] - c[12] - c[13] - c[14] - c[15];
+    acc[2] = (int64_t)c[2] + c[10] + c[11] - c[13] - c[14] - c[15];
+    acc[3] = (int64_t)c[3] + 2 * (int64_t)c[11] + 2 * (int64_t)c[12] + c[13] - c[15] - c[8] - c[9];
+    acc[4] = (int64_t)c[4] + 2 * (int64_t)c[12] + 2 * (int64_t)c[13] + c[14] - c[9] - c[10];
+    acc[5] = (int64_t)c[5] + 2 * (int64_t)c[13] + 2 * (int64_t)c[14] + c[15] - c[10] - c[11];
+    acc[6] = (int64_t)c[6] + 3 * (int64_t)c[14] + 2 * (int64_t)c[15] + c[13] - c[8] - c[9];
+    acc[7] = (int64_t)c[7] + 3 * (int64_t)c[15] + c[8] - c[10] - c[11] - c[12] - c[13];
+
+    // Fold the signed carry out of the top limb back in with
+    // 2^256 = 2^224 - 2^192 - 2^96 + 1 (mod p). Two folds bring the
+    // value into [0, 2^256); the third pass only normalizes the limbs.
+    for (fold = 0; fold < 3; fold++) {
+        carry = 0;
+        for (i = 0; i < P256_LIMBS; i++) {
+            acc[i] += carry;
+            carry = acc[i] >> 32;
+            acc[i] &= 0xffffffff;
+        }
+        acc[0] += carry;
+        acc[3] -= carry;
+        acc[6] -= carry;
+        acc[7] += carry;
+    }
+    for (i = 0; i < P256_LIMBS; i++) {
+        r[i] = (uint32_t)acc[i];
+    }
+
+    // 2^256 < 2p
+    borrow = p256_sub_limbs(t, r, P256_P);
+    p256_cmov(r, t, 0 - (borrow ^ 1));
+}
+
+
+static void p256_fe_mul(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint32_t c[2 * P256_LIMBS];
+    uint64_t uv;
+    int i, j;
+
+    memset(c, 0, sizeof(c));
+    for (i = 0; i < P256_LIMBS; i++) {
+        uv = 0;
+        for (j = 0; j < P256_LIMBS; j++) {
+            uv += (uint64_t)a[i] * b[j] + c[i + j];
+            c[i + j] = (uint32_t)uv;
+            uv >>= 32;
+        }
+        c[i + P256_LIMBS] = (uint32_t)uv;
+    }
+    p256_fe_reduce(r, c);
+}
+
+
+// a^(p - 2); the exponent is public
+static void p256_fe_inv(uint32_t *r, const uint32_t *a)
+{
+    static const p256_fe e = {
+        0xfffffffd, 0xffffffff, 0xffffffff, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0xffffffff
+    };
+    p256_fe x;
+    int i;
+
+    memset(x, 0, sizeof(x));
+    x[0] = 1;
+    for (i = 255; i >= 0; i--) {
+        p256_fe_mul(x, x, x);
+        if ((e[i / 32] >> (i % 32)) & 1) {
+            p256_fe_mul(x, x, a);
+        }
+    }
+    memcpy(r, x, sizeof(x));
+}
+
+
+//
+//  Scalar arithmetic mod n (Montgomery)
+//
+static void p256_sc_mont_mul(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint32_t t[P256_LIMBS + 2], u[P256_LIMBS], m;
+    uint64_t c;
+    int i, j;
+
+    memset(t, 0, sizeof(t));
+    for (i = 0; i < P256_LIMBS; i++) {
+        c = 0;
+        for (j = 0; j < P256_LIMBS; j++) {
+            c += (uint64_t)a[j] * b[i] + t[j];
+            t[j] = (uint32_t)c;
+            c >>= 32;
+        }
+        c += t[P256_LIMBS];
+        t[P256_LIMBS] = (uint32_t)c;
+        t[P256_LIMBS + 1] = (uint32_t)(c >> 32);
+
+        m = t[0] * P256_N0;
+        c = ((uint64_t)m * P256_N[0] + t[0]) >> 32;
+        for (j = 1; j < P256_LIMBS; j++) {
+            c += (uint64_t)m * P256_N[j] + t[j];
+            t[j - 1] = (uint32_t)c;
+            c >>= 32;
+        }
+        c += t[P256_LIMBS];
+        t[P256_LIMBS - 1] = (uint32_t)c;
+        t[P256_LIMBS] = t[P256_LIMBS + 1] + (uint32_t)(c >> 32);
+    }
+
+    // t < 2n
+    m = p256_sub_limbs(u, t, P256_N);
+    memcpy(r, t, P256_LIMBS * sizeof(uint32_t));
+    p256_cmov(r, u, 0 - (t[P256_LIMBS] | (m ^ 1)));
+}
+
+
+static void p256_sc_mul(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    p256_fe t;
+    p256_sc_mont_mul(t, a, b);
+    p256_sc_mont_mul(r, t, P256_N_R2);
+}
+
+
+// a^(n - 2); the exponent is public
+static void p256_sc_inv(uint32_t *r, const uint32_t *a)
+{
+    static const p256_fe e = {
+        0xfc63254f, 0xf3b9cac2, 0xa7179e84, 0xbce6faad, 0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+    };
+    static const p256_fe one = { 1, 0, 0, 0, 0, 0, 0, 0 };
+    p256_fe x, am;
+    int i;
+
+    p256_sc_mont_mul(am, a, P256_N_R2);
+    memcpy(x, P256_N_R, sizeof(x));
+    for (i = 255; i >= 0; i--) {
+        p256_sc_mont_mul(x, x, x);
+        if ((e[i / 32] >> (i % 32)) & 1) {
+            p256_sc_mont_mul(x, x, am);
+        }
+    }
+    p256_sc_mont_mul(r, x, one);
+    utils_zero(am, sizeof(am));
+    utils_zero(x, sizeof(x));
+}
+
+
+// r = a mod n, for a < 2^256
+static void p256_sc_reduce(uint32_t *r)
+{
+    p256_fe t;
+    uint32_t borrow = p256_sub_limbs(t, r, P256_N);
+    p256_cmov(r, t, 0 - (borrow ^ 1));
+}
+
+
+// 0 < a < n
+static uint32_t p256_sc_is_valid(const uint32_t *a)
+{
+    p256_fe t;
+    return p256_sub_limbs(t, a, P256_N) & (p256_is_zero(a) ^ 1);
+}
+
+
+//
+//  Points
+//
+static void p256_point_infinity(p256_point *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->y[0] = 1;
+}
+
+
+// Complete addition for a = -3 (Renes, Costello, Batina, algorithm 4)
+static void p256_point_add(p256_point *r, const p256_point *p, const p256_point *q)
+{
+    p256_fe t0, t1, t2, t3, t4, x3, y3, z3;
+
+    p256_fe_mul(t0, p->x, q->x);
+    p256_fe_mul(t1, p->y, q->y);
+    p256_fe_mul(t2, p->z, q->z);
+    p256_fe_add(t3, p->x, p->y);
+    p256_fe_add(t4, q->x, q->y);
+    p256_fe_mul(t3, t3, t4);
+    p256_fe_add(t4, t0, t1);
+    p256_fe_sub(t3, t3, t4);
+    p256_fe_add(t4, p->y, p->z);
+    p256_fe_add(x3, q->y, q->z);
+    p256_fe_mul(t4, t4, x3);
+    p256_fe_add(x3, t1, t2);
+    p256_fe_sub(t4, t4, x3);
+    p256_fe_add(x3, p->x, p->z);
+    p256_fe_add(y3, q->x, q->z);
+    p256_fe_mul(x3, x3, y3);
+    p256_fe_add(y3, t0, t2);
+    p256_fe_sub(y3, x3, y3);
+    p256_fe_mul(z3, P256_B, t2);
+    p256_fe_sub(x3, y3, z3);
+    p256_fe_add(z3, x3, x3);
+    p256_fe_add(x3, x3, z3);
+    p256_fe_sub(z3, t1, x3);
+    p256_fe_add(x3, t1, x3);
+    p256_fe_mul(y3, P256_B, y3);
+    p256_fe_add(t1, t2, t2);
+    p256_fe_add(t2, t1, t2);
+    p256_fe_sub(y3, y3, t2);
+    p256_fe_sub(y3, y3, t0);
+    p256_fe_add(t1, y3, y3);
+    p256_fe_add(y3, t1, y3);
+    p256_fe_add(t1, t0, t0);
+    p256_fe_add(t0, t1, t0);
+    p256_fe_sub(t0, t0, t2);
+    p256_fe_mul(t1, t4, y3);
+    p256_fe_mul(t2, t0, y3);
+    p256_fe_mul(y3, x3, z3);
+    p256_fe_add(y3, y3, t2);
+    p256_fe_mul(x3, t3, x3);
+    p256_fe_sub(x3, x3, t1);
+    p256_fe_mul(z3, t4, z3);
+    p256_fe_mul(t1, t3, t0);
+    p256_fe_add(z3, z3, t1);
+
+    memcpy(r->x, x3, sizeof(x3));
+    memcpy(r->y, y3, sizeof(y3));
+    memcpy(r->z, z3, sizeof(z3));
+}
+
+
+// Complete doubling for a = -3 (Renes, Costello, Batina, algorithm 6)
+static void p256_point_double(p256_point *r, const p256_point *p)
+{
+    p256_fe t0, t1, t2, t3, x3, y3, z3;
+
+    p256_fe_mul(t0, p->x, p->x);
+    p256_fe_mul(t1, p->y, p->y);
+    p256_fe_mul(t2, p->z, p->z);
+    p256_fe_mul(t3, p->x, p->y);
+    p256_fe_add(t3, t3, t3);
+    p256_fe_mul(z3, p->x, p->z);
+    p256_fe_add(z3, z3, z3);
+    p256_fe_mul(y3, P256_B, t2);
+    p256_fe_sub(y3, y3, z3);
+    p256_fe_add(x3, y3, y3);
+    p256_fe_add(y3, x3, y3);
+    p256_fe_sub(x3, t1, y3);
+    p256_fe_add(y3, t1, y3);
+    p256_fe_mul(y3, x3, y3);
+    p256_fe_mul(x3, x3, t3);
+    p256_fe_add(t3, t2, t2);
+    p256_fe_add(t2, t2, t3);
+    p256_fe_mul(z3, P256_B, z3);
+    p256_fe_sub(z3, z3, t2);
+    p256_fe_sub(z3, z3, t0);
+    p256_fe_add(t3, z3, z3);
+    p256_fe_add(z3, z3, t3);
+    p256_fe_add(t3, t0, t0);
+    p256_fe_add(t0, t3, t0);
+    p256_fe_sub(t0, t0, t2);
+    p256_fe_mul(t0, t0, z3);
+    p256_fe_add(y3, y3, t0);
+    p256_fe_mul(t0, p->y, p->z);
+    p256_fe_add(t0, t0, t0);
+    p256_fe_mul(z3, t0, z3);
+    p256_fe_sub(x3, x3, z3);
+    p256_fe_mul(z3, t0, t1);
+    p256_fe_add(z3, z3, z3);
+    p256_fe_add(z3, z3, z3);
+
+    memcpy(r->x, x3, sizeof(x3));
+    memcpy(r->y, y3, sizeof(y3));
+    memcpy(r->z, z3, sizeof(z3));
+}
+
+
+// Reads every table entry so the access pattern does not depend on idx
+static void p256_comb_select(p256_point *r, uint32_t idx)
+{
+    uint32_t i, mask;
+
+    p256_point_infinity(r);
+    for (i = 1; i <= 15; i++) {
+        mask = (uint32_t)(((uint64_t)(i ^ idx) - 1) >> 32);
+        p256_cmov(r->x, P256_COMB[i - 1].x, mask);
+        p256_cmov(r->y, P256_COMB[i - 1].y, mask);
+        r->z[0] |= mask & 1;
+    }
+}
+
+
+// r = k * G
+static void p256_base_mult(p256_point *r, const uint32_t *k)
+{
+    p256_point t;
+    uint32_t idx;
+    int j, i;
+
+    p256_point_infinity(r);
+    for (j = 63; j >= 0; j--) {
+        p256_point_double(r, r);
+        idx = 0;
+        for (i = 0; i < 4; i++) {
+            idx |= ((k[j / 32 + 2 * i] >> (j % 32)) & 1) << i;
+        }
+        p256_comb_select(&t, idx);
+        p256_point_add(r, r, &t);
+    }
+    utils_zero(&t, sizeof(t));
+}
+
+
+static void p256_to_affine(uint32_t *x, uint32_t *y, const p256_point *p)
+{
+    p256_fe zinv;
+    p256_fe_inv(zinv, p->z);
+    p256_fe_mul(x, p->x, zinv);
+    if (y) {
+        p256_fe_mul(y, p->y, zinv);
+    }
+}
+
+
+//
+//  API
+//
+int p256_is_valid(const uint8_t *private_key)
+{
+    p256_fe d;
+    int ret;
+    p256_from_bytes(d, private_key);
+    ret = p256_sc_is_valid(d);
+    utils_zero(d, sizeof(d));
+    return ret;
+}
+
+
+// Returns 0 on success, 1 for an invalid private key
+int p256_get_public_key(const uint8_t *private_key, uint8_t *public_key_64)
+{
+    p256_point q;
+    p256_fe d, x, y;
+
+    p256_from_bytes(d, private_key);
+    if (!p256_sc_is_valid(d)) {
+        utils_zero(d, sizeof(d));
+        return 1;
+    }
+    p256_base_mult(&q, d);
+    p256_to_affine(x, y, &q);
+    p256_to_bytes(public_key_64, x);
+    p256_to_bytes(public_key_64 + 32, y);
+    utils_zero(d, sizeof(d));
+    utils_zero(&q, sizeof(q));
+    return 0;
+}
+
+
+// s = k^-1 (z + r d), normalized to low S. Returns 1 if r or s is zero.
+static int p256_sign_finish(const uint32_t *d, const uint32_t *z, const uint32_t *r,
+                            const uint32_t *k_inv, uint8_t *sig)
+{
+    p256_fe s, t;
+    uint32_t high;
+    int ret = 1;
+
+    p256_sc_mul(t, r, d);
+    p256_mod_add(t, t, z, P256_N);
+    p256_sc_mul(s, k_inv, t);
+
+    if (!p256_is_zero(r) && !p256_is_zero(s)) {
+        // Low S: s = n - s if s > n / 2
+        high = p256_sub_limbs(t, P256_N_HALF, s);
+        p256_sub_limbs(t, P256_N, s);
+        p256_cmov(s, t, 0 - high);
+        p256_to_bytes(sig, r);
+        p256_to_bytes(sig + 32, s);
+        ret = 0;
+    }
+
+    utils_zero(s, sizeof(s));
+    utils_zero(t, sizeof(t));
+    return ret;
+}
+
+
+// Deterministic (RFC6979) low-S signature r || s of a 32-byte digest.
+// Returns 0 on success, 1 on error.
+int p256_sign_digest(const uint8_t *private_key, const uint8_t *digest, uint8_t *sig)
+{
+    uint8_t kb[32];
+    p256_fe d, z, k, k_inv, r;
+    p256_point R;
+    RFC6979_STATE rng;
+    int tries, ret = 1;
+
+    p256_from_bytes(d, private_key);
+    if (!p256_sc_is_valid(d)) {
+        utils_zero(d, sizeof(d));
+        return 1;
+    }
+    p256_from_bytes(z, digest);
+    p256_sc_reduce(z);
+
+    // The nonce is seeded with the digest as given, not reduced mod n, as in
+    // uECC_generate_k_rfc6979(). This keeps the signatures identical to uECC
+    // also for digests >= n.
+    rfc6979_init(&rng, private_key, digest);
+
+    for (tries = 0; tries < P256_SIGN_MAX_TRIES; tries++) {
+        rfc6979_next(&rng, kb);
+        p256_from_bytes(k, kb);
+        if (p256_sc_is_valid(k)) {
+            p256_base_mult(&R, k);
+            p256_to_affine(r, NULL, &R);
+            p256_sc_reduce(r);
+            p256_sc_inv(k_inv, k);
+            if (p256_sign_finish(d, z, r, k_inv, sig) == 0) {
+                ret = 0;
+                break;
+            }
+        }
+    }
+
+    rfc6979_clear(&rng);
+    utils_zero(kb, sizeof(kb));
+    utils_zero(d, sizeof(d));
+    utils_zero(k, sizeof(k));
+    utils_zero(k_inv, sizeof(k_inv));
+    utils_zero(&R, sizeof(R));
+    return ret;
+}
+
+
+int p256_nonce_precompute(const uint8_t *k, p256_nonce *nonce)
+{
+    p256_fe kk, r;
+    p256_point R;
+    int ret = 1;
+
+    p256_from_bytes(kk, k);
+    if (p256_sc_is_valid(kk)) {
+        p256_base_mult(&R, kk);
+        p256_to_affine(r, NULL, &R);
+        p256_sc_reduce(r);
+        if (!p256_is_zero(r)) {
+            p256_to_bytes(nonce->r, r);
+            p256_sc_inv(kk, kk);
+            p256_to_bytes(nonce->k_inv, kk);
+            ret = 0;
+        }
+    }
+
+    utils_zero(kk, sizeof(kk));
+    utils_zero(&R, sizeof(R));
+    return ret;
+}
+
+
+int p256_sign_digest_nonce(const uint8_t *private_key, const uint8_t *digest,
+                           const p256_nonce *nonce, uint8_t *sig)
+{
+    p256_fe d, z, k_inv, r;
+    int ret = 1;
+
+    p256_from_bytes(d, private_key);
+    p256_from_bytes(k_inv, nonce->k_inv);
+    p256_from_bytes(r, nonce->r);
+    if (p256_sc_is_valid(d) && p256_sc_is_valid(k_inv)) {
+        p256_from_bytes(z, digest);
+        p256_sc_reduce(z);
+        ret = p256_sign_finish(d, z, r, k_inv, sig);
+    }
+
+    utils_zero(d, sizeof(d));
+    utils_zero(k_inv, sizeof(k_inv));
+    return ret;
+}
@@ -0,0 +1,64 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// NIST P-256 (secp256r1) signing backend for U2F.
+//
+// Field elements are 8 x 32-bit limbs reduced with the Solinas (NIST) fast
+// reduction. Points use projective coordinates with the complete addition
+// formulas of Renes, Costello and Batina (eprint 2015/1060), so there are
+// no special cases. k*G is a 4-tooth comb over a constant table: 64
+// doublings and 64 additions with a table scan per step, independent of k.
+// Nonces are derived with RFC6979 (HMAC-SHA256).
+//
+// p256_nonce_precompute() does the expensive part of a signature for a
+// given nonce k ahead of time; p256_sign_digest_nonce() then costs two
+// scalar multiplications mod n. Each precomputed nonce must be used for
+// one signature only.
+
+
+#ifndef _P256_H_
+#define _P256_H_
+
+
+#include <stdint.h>
+
+
+typedef struct {
+    uint8_t k_inv[32];
+    uint8_t r[32];
+} p256_nonce;
+
+
+int p256_is_valid(const uint8_t *private_key);
+int p256_get_public_key(const uint8_t *private_key, uint8_t *public_key_64);
+int p256_sign_digest(const uint8_t *private_key, const uint8_t *digest, uint8_t *sig);
+int p256_nonce_precompute(const uint8_t *k, p256_nonce *nonce);
+int p256_sign_digest_nonce(const uint8_t *private_key, const uint8_t *digest,
+                           const p256_nonce *nonce, uint8_t *sig);
+
+
+#endif
@@ -0,0 +1,188 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "power.h"
+
+#ifdef TESTING
+#include <time.h>
+#else
+#include "mcu.h"
+#include "systick.h"
+#endif
+
+
+// Master clock = PLLA / divider (conf_clock.h: PLLA 240 MHz, divider 2 at
+// reset). The low clock still leaves headroom for the USB interrupt handlers.
+#define POWER_PLLA_HZ       240000000u
+#define POWER_DIV_FULL      2// 120 MHz, CONFIG_SYSCLK_PRES
+#define POWER_DIV_LOW       8// 30 MHz
+
+
+// The QTouch button wait stays at full clock until its sensing has been
+// validated at the low clock; the state is still tracked on its own.
+static const uint8_t power_clock_div[POWER_STATE_NUM] = {
+    POWER_DIV_LOW,// POWER_STATE_IDLE
+    POWER_DIV_FULL,// POWER_STATE_ACTIVE
+    POWER_DIV_FULL,// POWER_STATE_WAIT
+    POWER_DIV_FULL,// POWER_STATE_CRYPTO
+};
+
+
+static POWER_STATE power_current = POWER_STATE_ACTIVE;// Full clock from reset
+static POWER_STATS power_data;
+static uint32_t power_mark_us = 0;
+
+
+#ifdef TESTING
+#define POWER_LOG_LEN 32
+static uint8_t power_log[POWER_LOG_LEN];
+static uint8_t power_log_len = 0;
+static uint32_t power_sim_us = 0;// Simulated waits, see power_tick()
+
+// Host CPU time for computation plus simulated device time for waits
+static uint32_t power_now_us(void)
+{
+    return (uint32_t)((uint64_t)clock() * 1000000u / CLOCKS_PER_SEC) + power_sim_us;
+}
+
+#define POWER_LOCK()
+#define POWER_UNLOCK()
+
+#else
+
+static uint32_t power_now_us(void)
+{
+    return systick_time_us();
+}
+
+static void power_set_clock(uint8_t div)
+{
+    pmc_mck_set_prescaler(div == POWER_DIV_FULL ? SYSCLK_PRES_2 : SYSCLK_PRES_8);
+    systick_set_cpu_hz(POWER_PLLA_HZ / div);
+}
+
+// Called from the USB and SysTick interrupts as well as the main loop
+#define POWER_LOCK()    irqflags_t power_irq = cpu_irq_save()
+#define POWER_UNLOCK()  cpu_irq_restore(power_irq)
+#endif
+
+
+static void power_account(void)
+{
+    uint32_t now = power_now_us();
+    power_data.time_us[power_current] += now - power_mark_us;
+    power_mark_us = now;
+}
+
+
+// Returns the previous state, to be restored with power_enter()
+POWER_STATE power_enter(POWER_STATE state)
+{
+    POWER_STATE prev;
+    POWER_LOCK();
+
+    prev = power_current;
+    if (state != prev) {
+        power_account();
+        power_current = state;
+        power_data.transitions++;
+#ifdef TESTING
+        if (power_log_len < POWER_LOG_LEN) {
+            power_log[power_log_len++] = state;
+        }
+#else
+        if (power_clock_div[state] != power_clock_div[prev]) {
+            power_set_clock(power_clock_div[state]);
+        }
+#endif
+    }
+
+    POWER_UNLOCK();
+    return prev;
+}
+
+
+POWER_STATE power_state(void)
+{
+    return power_current;
+}
+
+
+uint32_t power_cpu_hz(void)
+{
+    return POWER_PLLA_HZ / power_clock_div[power_current];
+}
+
+
+// Called every tick, so that accounting never spans a wrap of the time source.
+// The TESTING build advances its simulated clock instead of waiting.
+void power_tick(uint16_t elapsed_ms)
+{
+    POWER_LOCK();
+#ifdef TESTING
+    power_sim_us += elapsed_ms * 1000u;
+#else
+    (void)elapsed_ms;
+#endif
+    power_account();
+    POWER_UNLOCK();
+}
+
+
+void power_stats(POWER_STATS *stats)
+{
+    POWER_LOCK();
+    power_account();
+    memcpy(stats, &power_data, sizeof(power_data));
+    POWER_UNLOCK();
+}
+
+
+void power_stats_reset(void)
+{
+    POWER_LOCK();
+    power_account();
+    memset(&power_data, 0, sizeof(power_data));
+#ifdef TESTING
+    power_log_len = 0;
+#endif
+    POWER_UNLOCK();
+}
+
+
+#ifdef TESTING
+// Returns the states entered since the last read or reset, oldest first
+uint8_t power_log_read(uint8_t *states, uint8_t max)
+{
+    uint8_t len = power_log_len < max ? power_log_len : max;
+    memcpy(states, power_log, len);
+    power_log_len = 0;
+    return len;
+}
+#endif
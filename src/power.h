@@ -0,0 +1,74 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Clock policy: the CPU runs at full clock for command processing and crypto,
+// and at a low clock while idle. Waiting on the touch button is tracked as its
+// own state but keeps the full clock for now. Time spent in each state is
+// tracked.
+//
+// Usage, nestable:
+//
+//     POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+//     ... PBKDF2, key derivation or signing ...
+//     power_enter(power);
+
+
+#ifndef _POWER_H_
+#define _POWER_H_
+
+
+#include <stdint.h>
+
+
+typedef enum POWER_STATE {
+    POWER_STATE_IDLE,// Sleeping between interrupts
+    POWER_STATE_ACTIVE,// Processing a command
+    POWER_STATE_WAIT,// Waiting for the touch button
+    POWER_STATE_CRYPTO,// PBKDF2, key derivation, signing
+    POWER_STATE_NUM
+} POWER_STATE;
+
+
+typedef struct {
+    uint32_t time_us[POWER_STATE_NUM];
+    uint32_t transitions;
+} POWER_STATS;
+
+
+POWER_STATE power_enter(POWER_STATE state);
+POWER_STATE power_state(void);
+uint32_t power_cpu_hz(void);
+void power_tick(uint16_t elapsed_ms);
+void power_stats(POWER_STATS *stats);
+void power_stats_reset(void);
+
+#ifdef TESTING
+uint8_t power_log_read(uint8_t *states, uint8_t max);
+#endif
+
+
+#endif
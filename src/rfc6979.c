@@ -0,0 +1,131 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "rfc6979.h"
+#include "utils.h"
+
+
+static void rfc6979_set_key(RFC6979_STATE *state, const uint8_t *key)
+{
+    uint8_t pad[SHA256_BLOCK_LENGTH];
+    int i;
+
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        pad[i] = key[i] ^ 0x36;
+    }
+    memset(pad + SHA256_DIGEST_LENGTH, 0x36, SHA256_BLOCK_LENGTH - SHA256_DIGEST_LENGTH);
+    sha256_Init(&state->inner);
+    sha256_Update(&state->inner, pad, SHA256_BLOCK_LENGTH);
+
+    for (i = 0; i < SHA256_BLOCK_LENGTH; i++) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    sha256_Init(&state->outer);
+    sha256_Update(&state->outer, pad, SHA256_BLOCK_LENGTH);
+
+    utils_zero(pad, sizeof(pad));
+}
+
+
+// out = HMAC_K(V || sep || data), with sep and data optional. out may be V.
+static void rfc6979_hmac(const RFC6979_STATE *state, const uint8_t *sep,
+                         const uint8_t *data, uint8_t *out)
+{
+    SHA256_CTX ctx;
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+
+    memcpy(&ctx, &state->inner, sizeof(ctx));
+    sha256_Update(&ctx, state->v, sizeof(state->v));
+    if (sep) {
+        sha256_Update(&ctx, sep, 1);
+    }
+    if (data) {
+        sha256_Update(&ctx, data, 2 * SHA256_DIGEST_LENGTH);
+    }
+    sha256_Final(digest, &ctx);
+
+    memcpy(&ctx, &state->outer, sizeof(ctx));
+    sha256_Update(&ctx, digest, sizeof(digest));
+    sha256_Final(out, &ctx);
+
+    utils_zero(digest, sizeof(digest));
+    utils_zero(&ctx, sizeof(ctx));
+}
+
+
+// K = HMAC_K(V || sep || data), V = HMAC_K(V)
+static void rfc6979_update(RFC6979_STATE *state, uint8_t sep, const uint8_t *data)
+{
+    uint8_t key[SHA256_DIGEST_LENGTH];
+
+    rfc6979_hmac(state, &sep, data, key);
+    rfc6979_set_key(state, key);
+    rfc6979_hmac(state, NULL, NULL, state->v);
+
+    utils_zero(key, sizeof(key));
+}
+
+
+// RFC6979 3.2 b. - g. The digest is used as given; callers that need
+// bits2octets() reduce it first.
+void rfc6979_init(RFC6979_STATE *state, const uint8_t *private_key, const uint8_t *digest)
+{
+    uint8_t key[SHA256_DIGEST_LENGTH], data[2 * SHA256_DIGEST_LENGTH];
+
+    memset(key, 0x00, sizeof(key));
+    memset(state->v, 0x01, sizeof(state->v));
+    rfc6979_set_key(state, key);
+
+    memcpy(data, private_key, SHA256_DIGEST_LENGTH);
+    memcpy(data + SHA256_DIGEST_LENGTH, digest, SHA256_DIGEST_LENGTH);
+    rfc6979_update(state, 0x00, data);
+    rfc6979_update(state, 0x01, data);
+    state->retry = 0;
+
+    utils_zero(data, sizeof(data));
+}
+
+
+// RFC6979 3.2 h. Writes the next 32-byte candidate for k (big endian). Call
+// again if it is not a valid scalar for the curve.
+void rfc6979_next(RFC6979_STATE *state, uint8_t *k)
+{
+    if (state->retry) {
+        rfc6979_update(state, 0x00, NULL);
+    }
+    rfc6979_hmac(state, NULL, NULL, state->v);
+    memcpy(k, state->v, sizeof(state->v));
+    state->retry = 1;
+}
+
+
+void rfc6979_clear(RFC6979_STATE *state)
+{
+    utils_zero(state, sizeof(RFC6979_STATE));
+}
@@ -0,0 +1,65 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// RFC6979 deterministic nonces (HMAC-DRBG with HMAC-SHA256), shared by the
+// signing backends.
+//
+// An HMAC costs two extra SHA256 blocks to absorb the key pads. The key K
+// only changes on a K update, so the hash states after the ipad and opad
+// blocks are kept and every following HMAC starts from copies of them.
+//
+//     RFC6979_STATE rng;
+//     rfc6979_init(&rng, private_key, digest);
+//     do {
+//         rfc6979_next(&rng, k);
+//     } while (k is not in [1, n - 1]);
+//     rfc6979_clear(&rng);
+
+
+#ifndef _RFC6979_H_
+#define _RFC6979_H_
+
+
+#include <stdint.h>
+
+#include "sha2.h"
+
+
+typedef struct {
+    SHA256_CTX inner;// After the K ^ ipad block
+    SHA256_CTX outer;// After the K ^ opad block
+    uint8_t v[SHA256_DIGEST_LENGTH];
+    uint8_t retry;
+} RFC6979_STATE;
+
+
+void rfc6979_init(RFC6979_STATE *state, const uint8_t *private_key, const uint8_t *digest);
+void rfc6979_next(RFC6979_STATE *state, uint8_t *k);
+void rfc6979_clear(RFC6979_STATE *state);
+
+
+#endif
@@ -37,6 +37,7 @@
 
 #ifdef TESTING
 #include <dirent.h>
+#include "sham.h"
 
 
 #define f_close         fclose
@@ -48,7 +49,11 @@
 #define f_mkdir(...)    {}
 #define FRESULT         int
 #define FO(a)           (a)
+#define SD_FILE         FILE
 static char ROOTDIR[] = "tests/digitalbitbox";// If change, update tests/CMakeLists.txt
+// Simulated SD card traffic, i.e. the files the device would open or delete
+static uint32_t SD_io_reads = 0;
+static uint32_t SD_io_writes = 0;
 
 #else
 #include <limits.h>
@@ -57,6 +62,7 @@ static char ROOTDIR[] = "tests/digitalbitbox";// If change, update tests/CMakeLi
 
 #define f_printf3(a, b) f_printf((a), (b))
 #define FO(a)           (&a)
+#define SD_FILE         FIL
 uint32_t sd_update = 0;
 uint32_t sd_fs_found = 0;
 uint32_t sd_listing_pos = 0;
@@ -66,6 +72,15 @@ FATFS fs;
 #endif
 
 
+#ifdef TESTING
+void sd_io_count(uint32_t *reads, uint32_t *writes)
+{
+    *reads = SD_io_reads;
+    *writes = SD_io_writes;
+}
+#endif
+
+
 uint8_t sd_write(const char *fn, const char *wallet_backup, const char *wallet_name,
                  const char *u2f_backup, uint8_t replace, int cmd)
 {
@@ -91,6 +106,8 @@ uint8_t sd_write(const char *fn, const char *wallet_backup, const char *wallet_n
     if (file_object == NULL) {
         goto err;
     }
+    SD_io_writes++;
+    sham_latency(SHAM_LATENCY_SD);
 #else
 
     sd_mmc_init();
@@ -390,6 +407,39 @@ err:
 }
 
 
+// Extracts the backup text from an open backup PDF
+static uint8_t sd_read_backup(SD_FILE *file_object, char *text, size_t text_len)
+{
+    char line[SD_PDF_LINE_BUF_SIZE];
+    unsigned content_found = 0, text_p_index = 0;
+    while (1) {
+        if (0 == f_gets(line, sizeof(line), file_object)) {
+            return DBB_ERROR;
+        }
+
+        if (strstr(line, SD_PDF_BACKUP_END)) {
+            break;
+        }
+
+        if (content_found) {
+            char *t0 = strchr(line, '(');
+            char *t1 = strstr(line, ") Tj");
+            if (t0 && t1 && (t1 > t0) && (text_len > text_p_index)) {
+                snprintf(text + text_p_index, text_len - text_p_index, "%s", t0 + 1);
+                text_p_index += t1 - t0 - 1;
+                text[text_p_index] = '\0';
+            }
+            continue;
+        }
+
+        if (strstr(line, SD_PDF_BACKUP_START)) {
+            content_found = 1;
+        }
+    }
+    return DBB_OK;
+}
+
+
 char *sd_load(const char *fn, int cmd)
 {
     char file[256];
@@ -410,6 +460,8 @@ char *sd_load(const char *fn, int cmd)
     if (!file_object) {
         goto err;
     }
+    SD_io_reads++;
+    sham_latency(SHAM_LATENCY_SD);
 #else
 
     sd_mmc_init();
@@ -437,44 +489,126 @@ char *sd_load(const char *fn, int cmd)
         goto err;
     }
 #endif
-    char line[SD_PDF_LINE_BUF_SIZE];
-    char *text_p = text;
-    unsigned content_found = 0, text_p_index = 0;
-    while (1) {
-        if (0 == f_gets(line, sizeof(line), FO(file_object))) {
-            commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_READ_FILE);
-            f_close(FO(file_object));
-            f_mount(LUN_ID_SD_MMC_0_MEM, NULL);
-            goto err;
-        }
+    if (sd_read_backup(FO(file_object), text, sizeof(text)) != DBB_OK) {
+        commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_READ_FILE);
+        f_close(FO(file_object));
+        f_mount(LUN_ID_SD_MMC_0_MEM, NULL);
+        goto err;
+    }
 
-        if (strstr(line, SD_PDF_BACKUP_END)) {
+    f_close(FO(file_object));
+    f_mount(LUN_ID_SD_MMC_0_MEM, NULL);
+    utils_zero(file, sizeof(file));
+    return text;
+err:
+    utils_zero(file, sizeof(file));
+    return NULL;
+}
+
+
+// Reads every backup on the card within one mount and passes its content
+// to `backup_fn`. Stops early if `backup_fn` does not return DBB_OK.
+uint8_t sd_load_all(int cmd, SD_BACKUP_FN backup_fn, void *arg)
+{
+    char file[256 + sizeof(ROOTDIR) + 1];
+    char text[512];
+    char *pc_fn;
+
+#ifdef TESTING
+    struct dirent *p_dirent;
+    FILE *file_object;
+    DIR *dir = opendir(ROOTDIR);
+    if (!dir) {
+        commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_OPEN_DIR);
+        return DBB_ERROR;
+    }
+    sham_latency(SHAM_LATENCY_SD);
+#else
+    FILINFO fno;
+    DIR dir;
+    FIL file_object;
+    FRESULT res;
+#if _USE_LFN
+    char c_lfn[_MAX_LFN + 1];
+    fno.lfname = c_lfn;
+    fno.lfsize = sizeof(c_lfn);
+#endif
+
+    sd_mmc_init();
+    sd_listing_pos = 0;
+
+    if (CTRL_FAIL == sd_mmc_test_unit_ready(0)) {
+        commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_CARD);
+        return DBB_ERROR;
+    }
+
+    memset(&fs, 0, sizeof(FATFS));
+    res = f_mount(LUN_ID_SD_MMC_0_MEM, &fs);
+    if (FR_INVALID_DRIVE == res) {
+        commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_MOUNT);
+        return DBB_ERROR;
+    }
+
+    if (f_opendir(&dir, ROOTDIR) != FR_OK) {
+        commander_fill_report(cmd_str(cmd), NULL, DBB_ERR_SD_OPEN_DIR);
+        f_mount(LUN_ID_SD_MMC_0_MEM, NULL);
+        return DBB_ERROR;
+    }
+#endif
+
+    for (;;) {
+#ifdef TESTING
+        p_dirent = readdir(dir);
+        if (p_dirent == NULL) {
+            break;
+        }
+        pc_fn = p_dirent->d_name;
+#else
+        res = f_readdir(&dir, &fno);
+        if (res != FR_OK || fno.fname[0] == 0) {
             break;
         }
+#if _USE_LFN
+        pc_fn = *fno.lfname ? fno.lfname : fno.fname;
+#else
+        pc_fn = fno.fname;
+#endif
+#endif
+        // Also skips '.' and '..'
+        if (*pc_fn == '.' || utils_limit_alphanumeric_hyphen_underscore_period(pc_fn) != DBB_OK) {
+            continue;
+        }
 
-        if (content_found) {
-            char *t0 = strchr(line, '(');
-            char *t1 = strstr(line, ") Tj");
-            if (t0 && t1 && (t1 > t0) && (sizeof(text) > text_p_index)) {
-                snprintf(text_p + text_p_index, sizeof(text) - text_p_index, "%s", t0 + 1);
-                text_p_index += t1 - t0 - 1;
-                text[text_p_index] = '\0';
-            }
+        memset(text, 0, sizeof(text));
+        snprintf(file, sizeof(file), "%s/%s", ROOTDIR, pc_fn);
+#ifdef TESTING
+        file_object = fopen(file, "r");
+        if (!file_object) {
             continue;
         }
+        SD_io_reads++;
+#else
+        if (f_open(FO(file_object), (char const *)file, FA_OPEN_EXISTING | FA_READ) != FR_OK) {
+            continue;
+        }
+#endif
+        if (sd_read_backup(FO(file_object), text, sizeof(text)) != DBB_OK) {
+            memset(text, 0, sizeof(text));
+        }
+        f_close(FO(file_object));
 
-        if (strstr(line, SD_PDF_BACKUP_START)) {
-            content_found = 1;
+        if (backup_fn(pc_fn, text, arg) != DBB_OK) {
+            break;
         }
     }
 
-    f_close(FO(file_object));
+#ifdef TESTING
+    closedir(dir);
+#endif
     f_mount(LUN_ID_SD_MMC_0_MEM, NULL);
     utils_zero(file, sizeof(file));
-    return text;
-err:
-    utils_zero(file, sizeof(file));
-    return NULL;
+    utils_zero(text, sizeof(text));
+    return DBB_OK;
 }
 
 
@@ -489,6 +623,8 @@ uint8_t sd_list(int cmd)
     struct dirent *p_dirent;
     DIR *dir = opendir(ROOTDIR);
     if (dir) {
+        SD_io_reads++;
+        sham_latency(SHAM_LATENCY_SD);
 #else
     FILINFO fno;
     DIR dir;
@@ -609,6 +745,8 @@ uint8_t sd_file_exists(const char *fn)
     snprintf(file, sizeof(file), "%s/%s", ROOTDIR, fn);
 
 #ifdef TESTING
+    SD_io_reads++;
+    sham_latency(SHAM_LATENCY_SD);
     FILE *file_object = fopen(file, "r");
     if (file_object) {
         f_close(FO(file_object));
@@ -664,6 +802,8 @@ static uint8_t sd_delete_files(char *path)
             if (p_dirent->d_name[0] != '.') {
                 snprintf(file, sizeof(file), "%s/%s", ROOTDIR, p_dirent->d_name);
                 ret += remove(file);
+                SD_io_writes++;
+                sham_latency(SHAM_LATENCY_SD);
             }
         }
         closedir(p_dir);
@@ -743,6 +883,8 @@ static uint8_t sd_delete_file(const char *fn)
     memset(file, 0, sizeof(file));
     snprintf(file, sizeof(file), "%s/%s", ROOTDIR, fn);
 #ifdef TESTING
+    SD_io_writes++;
+    sham_latency(SHAM_LATENCY_SD);
     return remove(file);
 #else
     int failed = 0;
@@ -61,13 +61,20 @@
 #define SD_PDF_EOF        "%%%%EOF"
 
 
+typedef int (*SD_BACKUP_FN)(const char *fn, const char *backup, void *arg);
+
+
 uint8_t sd_list(int cmd);
 uint8_t sd_card_inserted(void);
 uint8_t sd_file_exists(const char *fn);
 uint8_t sd_erase(int cmd, const char *fn);
 char *sd_load(const char *fn, int cmd);
+uint8_t sd_load_all(int cmd, SD_BACKUP_FN backup_fn, void *arg);
 uint8_t sd_write(const char *fn, const char *wallet_backup, const char *wallet_name,
                  const char *u2f_backup, uint8_t replace, int cmd);
+#ifdef TESTING
+void sd_io_count(uint32_t *reads, uint32_t *writes);
+#endif
 
 
 #endif
@@ -47,6 +47,8 @@
 
 #include "secp256k1/src/basic-config.h"
 #include "secp256k1/src/secp256k1.c"
+#include "secp256k1_batch.h"
+#include "rfc6979.h"
 
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
@@ -54,3 +56,129 @@
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
+
+
+// As nonce_function_rfc6979(), seed the generator with the message reduced mod n
+static void secp256k1_rfc6979_init(RFC6979_STATE *rng, const unsigned char *key32,
+                                   const unsigned char *msg32)
+{
+    secp256k1_scalar msg;
+    unsigned char msgmod32[32];
+    secp256k1_scalar_set_b32(&msg, msg32, NULL);
+    secp256k1_scalar_get_b32(msgmod32, &msg);
+    rfc6979_init(rng, key32, msgmod32);
+}
+
+
+int secp256k1_nonce_function_rfc6979_state(unsigned char *nonce32, const unsigned char *msg32,
+        const unsigned char *key32, const unsigned char *algo16, void *data,
+        unsigned int attempt)
+{
+    RFC6979_STATE *rng = (RFC6979_STATE *)data;
+    (void)algo16;
+    if (attempt == 0) {
+        secp256k1_rfc6979_init(rng, key32, msg32);
+    }
+    rfc6979_next(rng, nonce32);
+    return 1;
+}
+
+
+int secp256k1_ecdsa_sign_recoverable_batch(const secp256k1_context *ctx,
+        secp256k1_ecdsa_recoverable_signature *signatures,
+        const unsigned char *msgs32, const unsigned char *seckeys, size_t count)
+{
+    secp256k1_gej rj[SECP256K1_SIGN_BATCH_MAX];
+    secp256k1_fe acc_z[SECP256K1_SIGN_BATCH_MAX];
+    secp256k1_scalar nonce[SECP256K1_SIGN_BATCH_MAX];
+    secp256k1_scalar acc_n[SECP256K1_SIGN_BATCH_MAX];
+    secp256k1_scalar sec, msg, sigr, sigs, n_inv;
+    secp256k1_fe z_inv, zi;
+    secp256k1_ge r;
+    unsigned char nonce32[32], b[32];
+    RFC6979_STATE rng;
+    int overflow, recid, ret = 0;
+    size_t i;
+
+    if (count == 0 || count > SECP256K1_SIGN_BATCH_MAX ||
+            !secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx)) {
+        return 0;
+    }
+
+    // Same nonces as secp256k1_ecdsa_sign_recoverable(): the first valid RFC6979 output
+    for (i = 0; i < count; i++) {
+        secp256k1_scalar_set_b32(&sec, seckeys + 32 * i, &overflow);
+        if (overflow || secp256k1_scalar_is_zero(&sec)) {
+            goto cleanup;
+        }
+        secp256k1_rfc6979_init(&rng, seckeys + 32 * i, msgs32 + 32 * i);
+        for (;;) {
+            rfc6979_next(&rng, nonce32);
+            secp256k1_scalar_set_b32(&nonce[i], nonce32, &overflow);
+            if (!overflow && !secp256k1_scalar_is_zero(&nonce[i])) {
+                break;
+            }
+        }
+        secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &rj[i], &nonce[i]);
+        acc_n[i] = nonce[i];
+        acc_z[i] = rj[i].z;
+        if (i) {
+            secp256k1_scalar_mul(&acc_n[i], &acc_n[i - 1], &nonce[i]);
+            secp256k1_fe_mul(&acc_z[i], &acc_z[i - 1], &rj[i].z);
+        }
+    }
+
+    // Montgomery's trick: one inversion each for the z coordinates and for the nonces
+    secp256k1_fe_inv(&z_inv, &acc_z[count - 1]);
+    secp256k1_scalar_inverse(&n_inv, &acc_n[count - 1]);
+
+    for (i = count; i-- > 0;) {
+        if (i) {
+            secp256k1_fe_mul(&zi, &z_inv, &acc_z[i - 1]);
+            secp256k1_fe_mul(&z_inv, &z_inv, &rj[i].z);
+            secp256k1_scalar_mul(&acc_n[i], &n_inv, &acc_n[i - 1]);
+            secp256k1_scalar_mul(&n_inv, &n_inv, &nonce[i]);
+        } else {
+            zi = z_inv;
+            acc_n[0] = n_inv;
+        }
+
+        // From here on as secp256k1_ecdsa_sig_sign(), with acc_n[i] = 1 / nonce[i]
+        secp256k1_ge_set_gej_zinv(&r, &rj[i], &zi);
+        secp256k1_fe_normalize(&r.x);
+        secp256k1_fe_normalize(&r.y);
+        secp256k1_fe_get_b32(b, &r.x);
+        secp256k1_scalar_set_b32(&sigr, b, &overflow);
+        recid = (overflow ? 2 : 0) | (secp256k1_fe_is_odd(&r.y) ? 1 : 0);
+        secp256k1_scalar_set_b32(&sec, seckeys + 32 * i, NULL);
+        secp256k1_scalar_set_b32(&msg, msgs32 + 32 * i, NULL);
+        secp256k1_scalar_mul(&sigs, &sigr, &sec);
+        secp256k1_scalar_add(&sigs, &sigs, &msg);
+        secp256k1_scalar_mul(&sigs, &sigs, &acc_n[i]);
+        if (overflow || secp256k1_scalar_is_zero(&sigr) || secp256k1_scalar_is_zero(&sigs)) {
+            // Cryptographically unreachable; let the library retry with the next nonce.
+            if (!secp256k1_ecdsa_sign_recoverable(ctx, &signatures[i], msgs32 + 32 * i,
+                                                  seckeys + 32 * i, NULL, NULL)) {
+                goto cleanup;
+            }
+            continue;
+        }
+        if (secp256k1_scalar_is_high(&sigs)) {
+            secp256k1_scalar_negate(&sigs, &sigs);
+            recid ^= 1;
+        }
+        secp256k1_ecdsa_recoverable_signature_save(&signatures[i], &sigr, &sigs, recid);
+    }
+    ret = 1;
+
+cleanup:
+    for (i = 0; i < SECP256K1_SIGN_BATCH_MAX; i++) {
+        secp256k1_scalar_clear(&nonce[i]);
+        secp256k1_scalar_clear(&acc_n[i]);
+    }
+    secp256k1_scalar_clear(&sec);
+    secp256k1_scalar_clear(&n_inv);
+    memset(nonce32, 0, sizeof(nonce32));
+    rfc6979_clear(&rng);
+    return ret;
+}
@@ -0,0 +1,57 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2016 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#ifndef _SECP256K1_BATCH_H_
+#define _SECP256K1_BATCH_H_
+
+
+#include <stddef.h>
+
+#include "secp256k1/include/secp256k1.h"
+#include "secp256k1/include/secp256k1_recovery.h"
+
+
+#define SECP256K1_SIGN_BATCH_MAX 8
+
+
+// Same nonces as secp256k1_nonce_function_rfc6979() without extra data, from the shared
+// generator in rfc6979.h. data must point to an RFC6979_STATE, which is set up on the
+// first attempt and stepped on each following one; clear it after signing.
+int secp256k1_nonce_function_rfc6979_state(unsigned char *nonce32, const unsigned char *msg32,
+        const unsigned char *key32, const unsigned char *algo16, void *data,
+        unsigned int attempt);
+
+
+// Same as secp256k1_ecdsa_sign_recoverable() with the RFC6979 nonce function, for count
+// (at most SECP256K1_SIGN_BATCH_MAX) keys and 32-byte messages at once. The R points share
+// one field inversion and the nonces one scalar inversion. Returns 1 on success.
+int secp256k1_ecdsa_sign_recoverable_batch(const secp256k1_context *ctx,
+        secp256k1_ecdsa_recoverable_signature *signatures,
+        const unsigned char *msgs32, const unsigned char *seckeys, size_t count);
+
+
+#endif
@@ -27,10 +27,36 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "sham.h"
+#include "led.h"
 #include "flags.h"
 #include "commander.h"
+#include "touch_state.h"
+#include "power.h"
+
+
+static uint32_t sham_latency_us[SHAM_LATENCY_NUM] = {0};
+
+
+void sham_set_latency(SHAM_LATENCY peripheral, uint32_t us)
+{
+    if (peripheral < SHAM_LATENCY_NUM) {
+        sham_latency_us[peripheral] = us;
+    }
+}
+
+
+void sham_latency(SHAM_LATENCY peripheral)
+{
+    if (peripheral < SHAM_LATENCY_NUM && sham_latency_us[peripheral]) {
+        struct timespec t;
+        t.tv_sec = sham_latency_us[peripheral] / 1000000;
+        t.tv_nsec = (sham_latency_us[peripheral] % 1000000) * 1000;
+        nanosleep(&t, NULL);
+    }
+}
 
 
 void delay_ms(int delay)
@@ -39,22 +65,104 @@ void delay_ms(int delay)
 }
 
 
+// Scripted touch sensor: each touch_button_press() call consumes one
+// script entry and runs the touch state machine in simulated time
+#define SHAM_TOUCH_TICK_MS      25
+#define SHAM_TOUCH_SCRIPT_MAX   16
+#define SHAM_TOUCH_DELTA        100
+
+
+static SHAM_TOUCH sham_touch_script_entries[SHAM_TOUCH_SCRIPT_MAX];
+static uint8_t sham_touch_script_len = 0;
+static uint8_t sham_touch_script_pos = 0;
+static uint32_t sham_touch_time_ms = 0;
 uint8_t touch_short_count = 0;
 
-uint8_t touch_button_press(uint8_t touch_type)
+
+void sham_touch_script(const SHAM_TOUCH *presses, uint8_t len)
+{
+    if (len > SHAM_TOUCH_SCRIPT_MAX) {
+        len = SHAM_TOUCH_SCRIPT_MAX;
+    }
+    memcpy(sham_touch_script_entries, presses, len * sizeof(SHAM_TOUCH));
+    sham_touch_script_len = len;
+    sham_touch_script_pos = 0;
+}
+
+
+uint8_t sham_touch_script_remaining(void)
+{
+    return sham_touch_script_len - sham_touch_script_pos;
+}
+
+
+uint32_t sham_touch_time(void)
 {
-    if (touch_type == DBB_TOUCH_REJECT_TIMEOUT) {
-        // Simulate touch sequence for ecdh led blink coding
+    return sham_touch_time_ms;
+}
+
+
+// Without a script, touch so that the request is accepted. For the ECDH
+// blink code (DBB_TOUCH_REJECT_TIMEOUT) alternate a timeout and an abort.
+static void sham_touch_default(uint8_t touch_type, SHAM_TOUCH *t)
+{
+    t->start_ms = 0;
+    t->duration_ms = 0;
+    if (touch_type == DBB_TOUCH_LONG || touch_type == DBB_TOUCH_LONG_BLINK) {
+        t->duration_ms = QTOUCH_TOUCH_TIMEOUT + 200;
+    } else if (touch_type == DBB_TOUCH_REJECT_TIMEOUT) {
         if (!touch_short_count) {
             touch_short_count++;
-            return DBB_ERR_TOUCH_TIMEOUT;
         } else {
             touch_short_count = 0;
-            return DBB_ERR_TOUCH_ABORT;
+            t->duration_ms = 100;
         }
+    } else {
+        t->duration_ms = 100;
+    }
+}
+
+
+uint8_t touch_button_press(uint8_t touch_type)
+{
+    TOUCH_STATE state;
+    SHAM_TOUCH t;
+    uint32_t now = 0;
+    int16_t delta;
+    POWER_STATE power;
+
+    sham_latency(SHAM_LATENCY_TOUCH);
+
+    if (touch_state_start(&state, touch_type, QTOUCH_TOUCH_THRESH) != DBB_OK) {
+        return DBB_ERROR;
+    }
+
+    power = power_enter(POWER_STATE_WAIT);
+
+    if (sham_touch_script_pos < sham_touch_script_len) {
+        t = sham_touch_script_entries[sham_touch_script_pos++];
+    } else {
+        sham_touch_default(touch_type, &t);
+    }
+
+    // The first sample is taken at time 0
+    delta = (t.duration_ms && t.start_ms == 0) ? SHAM_TOUCH_DELTA : 0;
+    touch_state_step(&state, 0, delta);
+    while (state.state != TOUCH_STATE_DONE) {
+        now += SHAM_TOUCH_TICK_MS;
+        led_tick(SHAM_TOUCH_TICK_MS);
+        power_tick(SHAM_TOUCH_TICK_MS);
+        delta = (t.duration_ms && now >= t.start_ms &&
+                 now < (uint32_t)t.start_ms + t.duration_ms) ? SHAM_TOUCH_DELTA : 0;
+        touch_state_step(&state, SHAM_TOUCH_TICK_MS, delta);
+    }
+    sham_touch_time_ms = now;
+    power_enter(power);
+
+    if (state.result == DBB_TOUCHED) {
+        commander_fill_report(cmd_str(CMD_touchbutton), flag_msg(DBB_WARN_NO_MCU), DBB_OK);
     }
-    commander_fill_report(cmd_str(CMD_touchbutton), flag_msg(DBB_WARN_NO_MCU), DBB_OK);
-    return DBB_TOUCHED;
+    return state.result;
 }
 
 
@@ -30,10 +30,32 @@
 
 
 #include <stdint.h>
+#include "touch.h"
 
 
+// Simulated peripheral latencies (zero by default), e.g. for the virtual device
+typedef enum SHAM_LATENCY {
+    SHAM_LATENCY_TOUCH,
+    SHAM_LATENCY_EEPROM,
+    SHAM_LATENCY_SD,
+    SHAM_LATENCY_NUM
+} SHAM_LATENCY;
+
+
+// One touch: pressed from start_ms for duration_ms after the touch request
+// (duration_ms 0 == not touched)
+typedef struct {
+    uint16_t start_ms;
+    uint16_t duration_ms;
+} SHAM_TOUCH;
+
+
+void sham_set_latency(SHAM_LATENCY peripheral, uint32_t us);
+void sham_latency(SHAM_LATENCY peripheral);
 void delay_ms(int delay);
-uint8_t touch_button_press(uint8_t touch_type);
+void sham_touch_script(const SHAM_TOUCH *presses, uint8_t len);
+uint8_t sham_touch_script_remaining(void);
+uint32_t sham_touch_time(void);
 uint8_t flash_read_unique_id(uint32_t *serial, uint32_t len);
 
 
@@ -133,7 +133,9 @@ int main(void)
     mpu_init();
     bootloader_jump();
 
-    while (1) { }
+    while (1) {
+        bootloader_idle();
+    }
 
     return 0;
 }
@@ -28,24 +28,72 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "systick.h"
+#include "led.h"
+#include "touch.h"
+#include "power.h"
 #include "mcu.h"
 
 volatile uint16_t systick_current_time_ms   = 0u;
 volatile uint8_t systick_time_updated       = 0u;
 uint16_t systick_measurement_period_msec    = 25u;
 
+static volatile uint32_t systick_base_us    = 0u;// Time at the last tick
+static volatile uint32_t systick_cpu_hz     = 0u;
+static volatile uint8_t systick_reload      = 0u;// Period shortened by a clock change
+
 
 void systick_update_time(void)
 {
+    if (systick_reload) {
+        // Back to the full period after the phase-preserving one
+        SysTick->LOAD = (systick_cpu_hz / 1000) * systick_measurement_period_msec - 1;
+        SysTick->VAL = 0;
+        systick_reload = 0u;
+    }
+    systick_base_us += systick_measurement_period_msec * 1000u;
     systick_time_updated = 1u;
     systick_current_time_ms += systick_measurement_period_msec;
+    led_tick(systick_measurement_period_msec);
+    touch_tick(systick_measurement_period_msec);
+#ifndef BOOTLOADER
+    power_tick(systick_measurement_period_msec);
+#endif
 }
 
 
 // Configure timer ISR to fire regularly
 void systick_init(void)
 {
-    SysTick_Config((sysclk_get_cpu_hz() / 1000) * systick_measurement_period_msec);
+    systick_cpu_hz = sysclk_get_cpu_hz();
+    SysTick_Config((systick_cpu_hz / 1000) * systick_measurement_period_msec);
+}
+
+
+// Keeps the tick period (and phase) across a change of the CPU clock: the rest
+// of the current period is counted at the new clock. Call with interrupts off.
+void systick_set_cpu_hz(uint32_t hz)
+{
+    uint32_t remaining = (uint64_t)SysTick->VAL * hz / systick_cpu_hz;
+
+    systick_cpu_hz = hz;
+    SysTick->LOAD = remaining ? remaining : 1;
+    SysTick->VAL = 0;
+    systick_reload = 1u;
+}
+
+
+// Microseconds since boot, wrapping every ~71 minutes. Call with interrupts off.
+uint32_t systick_time_us(void)
+{
+    uint32_t period_us = systick_measurement_period_msec * 1000u;
+    uint32_t base = systick_base_us;
+    uint32_t remaining;
+
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+        base += period_us;// Wrapped, tick not handled yet
+    }
+    remaining = (uint64_t)SysTick->VAL * 1000000u / systick_cpu_hz;
+    return base + period_us - (remaining < period_us ? remaining : period_us);
 }
 
 
@@ -29,8 +29,13 @@
 #define _SYSTICK_H_
 
 
+#include <stdint.h>
+
+
 void systick_update_time(void);
 void systick_init(void);
+void systick_set_cpu_hz(uint32_t hz);
+uint32_t systick_time_us(void);
 
 
 #endif
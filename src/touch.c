@@ -29,9 +29,13 @@
 #include "led.h"
 #include "flags.h"
 #include "touch.h"
+#include "touch_state.h"
 #include "hw_version.h"
 #include "systick.h"
 #include "commander.h"
+#ifndef BOOTLOADER
+#include "power.h"
+#endif
 
 
 extern volatile uint16_t systick_current_time_ms;
@@ -64,120 +68,64 @@ void touch_init(void)
 #endif
 
 
-uint8_t touch_button_press(uint8_t touch_type)
+static TOUCH_STATE touch_state;
+static volatile uint8_t touch_active = 0;
+
+
+// Called from the SysTick interrupt: one sensor sample per tick
+void touch_tick(uint16_t elapsed_ms)
 {
-    int pushed = DBB_NOT_TOUCHED;
     int16_t touch_snks;
     int16_t touch_sns;
-    uint16_t exit_time_ms;
-    uint16_t qt_led_toggle_ms;
+
+    if (!touch_active) {
+        return;
+    }
+
+    do {
+        status_flag = qt_measure_sensors(systick_current_time_ms);
+        burst_flag = status_flag & QTLIB_BURST_AGAIN;
+    } while (burst_flag);
+
+    touch_snks = qt_measure_data.channel_references[QTOUCH_TOUCH_CHANNEL];
+    touch_sns = qt_measure_data.channel_signals[QTOUCH_TOUCH_CHANNEL];
+
+    if (touch_state_step(&touch_state, elapsed_ms, touch_snks - touch_sns) != TOUCH_EVENT_NONE) {
+        touch_active = 0;
+    }
+}
+
+
+uint8_t touch_button_press(uint8_t touch_type)
+{
     uint16_t touch_thresh = QTOUCH_TOUCH_THRESH;
     if (report_hw_version() == HW_VERSION_V1_2) {
         touch_thresh = QTOUCH_TOUCH_THRESH_HW_V1_2;
     }
 
-
-    if (touch_type != DBB_TOUCH_LONG &&
-            touch_type != DBB_TOUCH_SHORT &&
-            touch_type != DBB_TOUCH_LONG_BLINK &&
-            touch_type != DBB_TOUCH_REJECT_TIMEOUT &&
-            touch_type != DBB_TOUCH_TIMEOUT) {
+    if (touch_state_start(&touch_state, touch_type, touch_thresh) != DBB_OK) {
         return DBB_ERROR;
     }
 
-    if (touch_type != DBB_TOUCH_REJECT_TIMEOUT) {
-        led_on();
-    }
+#ifndef BOOTLOADER
+    // Tracked separately; see power_clock_div[]
+    POWER_STATE power = power_enter(POWER_STATE_WAIT);
+#endif
 
-    // Make higher priority so that we can timeout
+    // Make higher priority so that the tick preempts the caller
     NVIC_SetPriority(SysTick_IRQn, 4);
 
-    qt_led_toggle_ms = QTOUCH_TOUCH_BLINK_OFF;
-    systick_current_time_ms = 0;
-    while (systick_current_time_ms < QTOUCH_TOUCH_TIMEOUT ||
-            touch_type == DBB_TOUCH_SHORT ||
-            touch_type == DBB_TOUCH_LONG_BLINK ||
-            touch_type == DBB_TOUCH_LONG) {
-
-        if (systick_current_time_ms > QTOUCH_TOUCH_TIMEOUT_HARD) {
-            break;
-        }
-
-        if (touch_type == DBB_TOUCH_LONG_BLINK && systick_current_time_ms > qt_led_toggle_ms) {
-            led_off();
-            if (systick_current_time_ms > qt_led_toggle_ms + QTOUCH_TOUCH_BLINK_OFF) {
-                qt_led_toggle_ms += QTOUCH_TOUCH_BLINK_ON + QTOUCH_TOUCH_BLINK_OFF;
-                led_on();
-            }
-        }
-
-        do {
-            status_flag = qt_measure_sensors(systick_current_time_ms);
-            burst_flag = status_flag & QTLIB_BURST_AGAIN;
-        } while (burst_flag);
-
-        touch_snks = qt_measure_data.channel_references[QTOUCH_TOUCH_CHANNEL];
-        touch_sns = qt_measure_data.channel_signals[QTOUCH_TOUCH_CHANNEL];
-
-        if ((touch_snks - touch_sns ) > touch_thresh) {
-            // Touched
-            led_off();
-            exit_time_ms = systick_current_time_ms + QTOUCH_TOUCH_TIMEOUT;
-            while (systick_current_time_ms < exit_time_ms) {
-                do {
-                    status_flag = qt_measure_sensors(systick_current_time_ms);
-                    burst_flag = status_flag & QTLIB_BURST_AGAIN;
-                } while (burst_flag);
-
-                touch_snks = qt_measure_data.channel_references[QTOUCH_TOUCH_CHANNEL];
-                touch_sns = qt_measure_data.channel_signals[QTOUCH_TOUCH_CHANNEL];
-
-                if ((touch_snks - touch_sns) < (touch_thresh / 2)) {
-                    // If released before exit_time_ms for:
-                    //     - DBB_TOUCH_LONG_BLINK, answer is 'reject'
-                    //     - DBB_TOUCH_LONG, answer is 'reject'
-                    //     - DBB_TOUCH_SHORT, answer is 'accept'
-                    if (touch_type == DBB_TOUCH_LONG_BLINK || touch_type == DBB_TOUCH_LONG) {
-                        pushed = DBB_TOUCHED_ABORT;
-                        break;
-                    } else if (touch_type == DBB_TOUCH_SHORT) {
-                        pushed = DBB_TOUCHED;
-                        break;
-                    }
-                } else if (touch_type == DBB_TOUCH_LONG_BLINK || touch_type == DBB_TOUCH_LONG) {
-                    pushed = DBB_TOUCHED;
-                } else if (touch_type == DBB_TOUCH_SHORT) {
-                    pushed = DBB_TOUCHED_ABORT;
-                } else if (touch_type == DBB_TOUCH_REJECT_TIMEOUT) {
-                    pushed = DBB_TOUCHED_ABORT;
-                    break;
-                } else if (touch_type == DBB_TOUCH_TIMEOUT) {
-                    // If touched before exit_time_ms for:
-                    //     - DBB_TOUCH_TIMEOUT, answer is 'accept'
-                    pushed = DBB_TOUCHED;
-                    break;
-                }
-            }
-            break;
-        }
+    touch_active = 1;
+    while (touch_active) {
+        // Wait for the tick-driven state machine to produce an event
     }
 
     // Reset lower priority
     NVIC_SetPriority(SysTick_IRQn, 15);
 
-    if (pushed == DBB_TOUCHED) {
-        if (touch_type == DBB_TOUCH_LONG_BLINK || touch_type == DBB_TOUCH_LONG) {
-            led_off();
-            delay_ms(300);
-            led_blink();
-        }
-        led_off();
-        return DBB_TOUCHED;
-    } else if (pushed == DBB_TOUCHED_ABORT) {
-        led_abort();
-        return DBB_ERR_TOUCH_ABORT;
-    } else {
-        led_off();
-        return DBB_ERR_TOUCH_TIMEOUT;
-    }
+#ifndef BOOTLOADER
+    power_enter(power);
+#endif
+
+    return touch_state.result;
 }
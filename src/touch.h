@@ -52,6 +52,7 @@
 
 
 void touch_init(void);
+void touch_tick(uint16_t elapsed_ms);
 uint8_t touch_button_press(uint8_t touch_type);
 
 
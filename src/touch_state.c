@@ -0,0 +1,141 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "touch_state.h"
+#include "touch.h"
+#include "flags.h"
+#include "led.h"
+
+
+static uint8_t touch_state_is_long(const TOUCH_STATE *s)
+{
+    return s->type == DBB_TOUCH_LONG || s->type == DBB_TOUCH_LONG_BLINK;
+}
+
+
+static uint8_t touch_state_finish(TOUCH_STATE *s, uint8_t event, uint8_t result)
+{
+    s->state = TOUCH_STATE_DONE;
+    s->event = event;
+    s->result = result;
+
+    if (result == DBB_TOUCHED && touch_state_is_long(s)) {
+        led_accept();
+    } else if (result == DBB_ERR_TOUCH_ABORT) {
+        led_abort();
+    } else {
+        led_off();
+    }
+    return event;
+}
+
+
+int touch_state_start(TOUCH_STATE *s, uint8_t touch_type, uint16_t thresh)
+{
+    if (touch_type != DBB_TOUCH_LONG &&
+            touch_type != DBB_TOUCH_SHORT &&
+            touch_type != DBB_TOUCH_LONG_BLINK &&
+            touch_type != DBB_TOUCH_REJECT_TIMEOUT &&
+            touch_type != DBB_TOUCH_TIMEOUT) {
+        s->state = TOUCH_STATE_IDLE;
+        return DBB_ERROR;
+    }
+
+    s->type = touch_type;
+    s->state = TOUCH_STATE_WAIT;
+    s->event = TOUCH_EVENT_NONE;
+    s->result = DBB_ERR_TOUCH_TIMEOUT;
+    s->thresh = thresh;
+    s->now_ms = 0;
+    s->timeout_ms = QTOUCH_TOUCH_TIMEOUT;
+    s->press_ms = 0;
+    s->blink_ms = QTOUCH_TOUCH_BLINK_OFF;
+
+    if (touch_type != DBB_TOUCH_REJECT_TIMEOUT) {
+        led_on();
+    }
+    return DBB_OK;
+}
+
+
+uint8_t touch_state_step(TOUCH_STATE *s, uint16_t elapsed_ms, int16_t delta)
+{
+    s->now_ms += elapsed_ms;
+
+    switch (s->state) {
+        case TOUCH_STATE_WAIT:
+            if (delta > (int16_t)s->thresh) {
+                led_off();
+                if (s->type == DBB_TOUCH_TIMEOUT) {
+                    return touch_state_finish(s, TOUCH_EVENT_PRESS, DBB_TOUCHED);
+                }
+                if (s->type == DBB_TOUCH_REJECT_TIMEOUT) {
+                    return touch_state_finish(s, TOUCH_EVENT_PRESS, DBB_ERR_TOUCH_ABORT);
+                }
+                s->state = TOUCH_STATE_PRESSED;
+                s->press_ms = s->now_ms;
+                return TOUCH_EVENT_NONE;
+            }
+
+            if (s->now_ms > QTOUCH_TOUCH_TIMEOUT_HARD) {
+                return touch_state_finish(s, TOUCH_EVENT_TIMEOUT, DBB_ERR_TOUCH_TIMEOUT);
+            }
+
+            if (s->type == DBB_TOUCH_TIMEOUT || s->type == DBB_TOUCH_REJECT_TIMEOUT) {
+                // The timeout starts after a queued LED pattern, e.g. a pairing code
+                if (led_busy()) {
+                    s->timeout_ms = s->now_ms + QTOUCH_TOUCH_TIMEOUT;
+                } else if (s->now_ms >= s->timeout_ms) {
+                    return touch_state_finish(s, TOUCH_EVENT_TIMEOUT, DBB_ERR_TOUCH_TIMEOUT);
+                }
+            }
+
+            if (s->type == DBB_TOUCH_LONG_BLINK && s->now_ms > s->blink_ms) {
+                led_off();
+                if (s->now_ms > s->blink_ms + QTOUCH_TOUCH_BLINK_OFF) {
+                    s->blink_ms += QTOUCH_TOUCH_BLINK_ON + QTOUCH_TOUCH_BLINK_OFF;
+                    led_on();
+                }
+            }
+            return TOUCH_EVENT_NONE;
+
+        case TOUCH_STATE_PRESSED:
+            if (delta < (int16_t)(s->thresh / 2)) {
+                // Released: accepts a short touch, rejects a long one
+                return touch_state_finish(s, TOUCH_EVENT_PRESS,
+                                          touch_state_is_long(s) ? DBB_ERR_TOUCH_ABORT : DBB_TOUCHED);
+            }
+            if (s->now_ms >= s->press_ms + QTOUCH_TOUCH_TIMEOUT) {
+                return touch_state_finish(s, TOUCH_EVENT_LONG_PRESS,
+                                          touch_state_is_long(s) ? DBB_TOUCHED : DBB_ERR_TOUCH_ABORT);
+            }
+            return TOUCH_EVENT_NONE;
+
+        default:
+            return s->event;
+    }
+}
@@ -0,0 +1,85 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Touch button state machine, shared by the QTouch driver (touch.c) and the
+// scripted sensor in the TESTING build (sham.c).
+//
+// touch_state_step() is called once per sensor sample with the time since
+// the previous sample and the sensor delta (reference - signal). It returns
+// an event once the touch is decided:
+//
+//   TOUCH_EVENT_PRESS       touched and released within QTOUCH_TOUCH_TIMEOUT
+//                           (or touched at all for the *_TIMEOUT types)
+//   TOUCH_EVENT_LONG_PRESS  held for QTOUCH_TOUCH_TIMEOUT
+//   TOUCH_EVENT_TIMEOUT     not touched in time
+//
+// The result (DBB_TOUCHED, DBB_ERR_TOUCH_ABORT or DBB_ERR_TOUCH_TIMEOUT)
+// depends on the touch type, e.g. a press accepts DBB_TOUCH_SHORT but
+// aborts DBB_TOUCH_LONG.
+
+
+#ifndef _TOUCH_STATE_H_
+#define _TOUCH_STATE_H_
+
+
+#include <stdint.h>
+
+
+typedef enum TOUCH_EVENT {
+    TOUCH_EVENT_NONE,
+    TOUCH_EVENT_PRESS,
+    TOUCH_EVENT_LONG_PRESS,
+    TOUCH_EVENT_TIMEOUT
+} TOUCH_EVENT;
+
+
+typedef enum TOUCH_STATE_ID {
+    TOUCH_STATE_IDLE,
+    TOUCH_STATE_WAIT,
+    TOUCH_STATE_PRESSED,
+    TOUCH_STATE_DONE
+} TOUCH_STATE_ID;
+
+
+typedef struct {
+    uint8_t type;
+    uint8_t state;
+    uint8_t event;
+    uint8_t result;
+    uint16_t thresh;
+    uint16_t now_ms;
+    uint16_t timeout_ms;
+    uint16_t press_ms;
+    uint16_t blink_ms;
+} TOUCH_STATE;
+
+
+int touch_state_start(TOUCH_STATE *s, uint8_t touch_type, uint16_t thresh);
+uint8_t touch_state_step(TOUCH_STATE *s, uint16_t elapsed_ms, int16_t delta);
+
+
+#endif
@@ -0,0 +1,95 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// CTAP2 (FIDO2) command and status codes, carried by U2FHID_CBOR. The
+// request is the command byte followed by a CBOR map of parameters, the
+// response the status byte followed by a CBOR map.
+
+
+#ifndef __CTAP2_H_INCLUDED__
+#define __CTAP2_H_INCLUDED__
+
+
+// Commands
+#define CTAP2_MAKE_CREDENTIAL       0x01
+#define CTAP2_GET_ASSERTION         0x02
+#define CTAP2_GET_INFO              0x04
+
+// authenticatorMakeCredential parameters
+#define CTAP2_MC_CLIENT_DATA_HASH   0x01
+#define CTAP2_MC_RP                 0x02
+#define CTAP2_MC_USER               0x03
+#define CTAP2_MC_PUB_KEY_PARAMS     0x04
+#define CTAP2_MC_EXCLUDE_LIST       0x05
+#define CTAP2_MC_OPTIONS            0x07
+#define CTAP2_MC_PIN_AUTH           0x08
+
+// authenticatorGetAssertion parameters
+#define CTAP2_GA_RP_ID              0x01
+#define CTAP2_GA_CLIENT_DATA_HASH   0x02
+#define CTAP2_GA_ALLOW_LIST         0x03
+#define CTAP2_GA_OPTIONS            0x05
+#define CTAP2_GA_PIN_AUTH           0x06
+
+// Response keys
+#define CTAP2_GET_INFO_VERSIONS     0x01
+#define CTAP2_GET_INFO_AAGUID       0x03
+#define CTAP2_GET_INFO_OPTIONS      0x04
+#define CTAP2_GET_INFO_MAX_MSG_SIZE 0x05
+#define CTAP2_MC_RESP_FMT           0x01
+#define CTAP2_MC_RESP_AUTH_DATA     0x02
+#define CTAP2_MC_RESP_ATT_STMT      0x03
+#define CTAP2_GA_RESP_CREDENTIAL    0x01
+#define CTAP2_GA_RESP_AUTH_DATA     0x02
+#define CTAP2_GA_RESP_SIGNATURE     0x03
+
+// Authenticator data
+#define CTAP2_AAGUID_SIZE           16
+#define CTAP2_FLAG_UP               0x01// User present
+#define CTAP2_FLAG_AT               0x40// Attested credential data included
+#define CTAP2_COSE_ALG_ES256        -7
+#define CTAP2_COSE_KTY_EC2          2
+#define CTAP2_COSE_CRV_P256         1
+
+// Status codes
+#define CTAP2_OK                        0x00
+#define CTAP1_ERR_INVALID_COMMAND       0x01
+#define CTAP1_ERR_INVALID_PARAMETER     0x02
+#define CTAP1_ERR_INVALID_LENGTH        0x03
+#define CTAP2_ERR_CBOR_UNEXPECTED_TYPE  0x11
+#define CTAP2_ERR_INVALID_CBOR          0x12
+#define CTAP2_ERR_MISSING_PARAMETER     0x14
+#define CTAP2_ERR_CREDENTIAL_EXCLUDED   0x19
+#define CTAP2_ERR_UNSUPPORTED_ALGORITHM 0x26
+#define CTAP2_ERR_OPERATION_DENIED      0x27
+#define CTAP2_ERR_UNSUPPORTED_OPTION    0x2b
+#define CTAP2_ERR_NO_CREDENTIALS        0x2e
+#define CTAP2_ERR_PIN_AUTH_INVALID      0x33
+#define CTAP1_ERR_OTHER                 0x7f
+
+
+#endif
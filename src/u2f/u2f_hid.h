@@ -35,6 +35,7 @@
 #define U2FHID_LOCK         (U2FHID_TYPE_INIT | 0x04)// Send lock channel command
 #define U2FHID_INIT         (U2FHID_TYPE_INIT | 0x06)// Channel initialization
 #define U2FHID_WINK         (U2FHID_TYPE_INIT | 0x08)// Send device identification wink
+#define U2FHID_CBOR         (U2FHID_TYPE_INIT | 0x10)// Send CTAP2 command (see ctap2.h)
 #define U2FHID_SYNC         (U2FHID_TYPE_INIT | 0x3c)// Send sync command
 #define U2FHID_ERROR        (U2FHID_TYPE_INIT | 0x3f)// Error response
 #define U2FHID_VENDOR_FIRST (U2FHID_TYPE_INIT | 0x40)// First vendor defined command
@@ -42,11 +43,13 @@
 
 // U2FHID vendor defined commands
 #define U2FHID_HWW (U2FHID_VENDOR_FIRST + 0x01)// Hardware wallet command
+#define U2FHID_STATUS (U2FHID_VENDOR_FIRST + 0x02)// Binary device status (ping)
 
 // U2FHID_INIT command defines
 #define U2FHID_INIT_NONCE_SIZE 8
 #define U2FHID_CAPFLAG_WINK 0x01// Device supports WINK command
 #define U2FHID_CAPFLAG_LOCK 0x02// Device supports LOCK command
+#define U2FHID_CAPFLAG_CBOR 0x04// Device supports CBOR command
 
 // Error codes; return as negatives
 #define U2FHID_ERR_NONE          0x00
@@ -79,4 +82,28 @@ typedef struct {
 #define U2FHID_INIT_RESP_SIZE 17
 
 
+// U2FHID_STATUS command defines
+#define U2FHID_STATUS_VERSION       1
+#define U2FHID_STATUS_FLAG_ERASED   0x01// No password set
+#define U2FHID_STATUS_FLAG_SETUP    0x02// Factory setup done
+#define U2FHID_STATUS_FLAG_LOCKED   0x04
+#define U2FHID_STATUS_FLAG_SEEDED   0x08
+#define U2FHID_STATUS_FLAG_U2F      0x10
+#define U2FHID_STATUS_FLAG_BOOTLOCK 0x20
+#define U2FHID_STATUS_FLAG_UNKNOWN  0x40// Seeded and bootlock not known
+
+
+typedef struct {
+    uint8_t versionRecord;
+    uint8_t versionMajor;
+    uint8_t versionMinor;
+    uint8_t versionBuild;
+    uint8_t flags;
+    uint8_t accessErrCount[2];// Big endian
+    uint8_t pinErrCount[2];// Big endian
+} U2FHID_STATUS_RESP;
+
+#define U2FHID_STATUS_RESP_SIZE 9
+
+
 #endif
@@ -28,8 +28,10 @@
 #include <string.h>
 
 #include "bip32.h"
+#include "cbor.h"
 #include "touch.h"
 #include "ecc.h"
+#include "p256.h"
 #include "usb.h"
 #include "led.h"
 #include "sha2.h"
@@ -37,6 +39,7 @@
 #include "flags.h"
 #include "utils.h"
 #include "memory.h"
+#include "power.h"
 #include "wallet.h"
 #include "random.h"
 #include "version.h"
@@ -44,17 +47,25 @@
 #include "commander.h"
 
 #include "u2f/u2f.h"
+#include "u2f/ctap2.h"
 #include "u2f/u2f_hid.h"
 #include "u2f/u2f_keys.h"
 #include "u2f_device.h"
+#ifndef TESTING
+#include "mcu.h"
+#endif
 
 
 #define APDU_LEN(A)              (uint32_t)(((A).lc1 << 16) + ((A).lc2 << 8) + ((A).lc3))
 #define U2F_TIMEOUT              500// [msec]
 #define U2F_KEYHANDLE_LEN        (U2F_NONCE_LENGTH + SHA256_DIGEST_LENGTH)
+#define U2F_NONCE_POOL_SIZE      4
 #define U2F_READBUF_MAX_LEN      COMMANDER_REPORT_SIZE// Max allowed by U2F specification = (57 + 128 * 59) = 7609. 
 // In practice, U2F commands do not need this much space.
 // Therefore, reduce to save MCU memory.
+#define CTAP2_RESP_MAX_LEN       (sizeof(U2F_ATT_CERT) + 384)// status | attestation | cert
+#define CTAP2_AUTH_DATA_MAX_LEN  (U2F_APPID_SIZE + 1 + U2F_CTR_SIZE + CTAP2_AAGUID_SIZE + 2 + \
+                                  U2F_KEYHANDLE_LEN + 80)// 80 >= COSE P-256 key
 
 
 #if (U2F_EC_KEY_SIZE != SHA256_DIGEST_LENGTH) || (U2F_EC_KEY_SIZE != U2F_NONCE_LENGTH)
@@ -117,6 +128,108 @@ typedef struct {
 static U2F_ReadBuffer reader;
 
 
+// Nonces precomputed while idle (opt-in). Entries are added by the main
+// loop and taken by the USB interrupt, so adding one is a critical section.
+// The nonces k are HMAC-SHA256(seed, counter), so that the idle path does
+// not need the ATAES132 random number generator.
+static p256_nonce u2f_nonce_pool[U2F_NONCE_POOL_SIZE];
+static volatile uint8_t u2f_nonce_pool_count = 0;
+static volatile uint32_t u2f_nonce_pool_generation = 0;
+static volatile bool u2f_nonce_seeded = false;
+static uint8_t u2f_nonce_seed[SHA256_DIGEST_LENGTH];
+static uint32_t u2f_nonce_counter = 0;
+
+
+static bool u2f_nonce_pool_enabled(void)
+{
+    uint32_t flags = memory_report_ext_flags();
+    return (flags & MEM_EXT_MASK_U2F) && !(flags & MEM_EXT_MASK_U2F_PRECOMPUTE);
+}
+
+
+static void u2f_nonce_pool_seed(void)
+{
+    if (u2f_nonce_seeded || !u2f_nonce_pool_enabled()) {
+        return;
+    }
+    if (random_bytes(u2f_nonce_seed, sizeof(u2f_nonce_seed), 0) == DBB_ERROR) {
+        return;
+    }
+    u2f_nonce_counter = 0;
+    u2f_nonce_seeded = true;
+}
+
+
+static int u2f_nonce_pool_take(p256_nonce *nonce)
+{
+    if (!u2f_nonce_pool_count || !u2f_nonce_pool_enabled()) {
+        return DBB_ERROR;
+    }
+    u2f_nonce_pool_count--;
+    memcpy(nonce, &u2f_nonce_pool[u2f_nonce_pool_count], sizeof(p256_nonce));
+    utils_zero(&u2f_nonce_pool[u2f_nonce_pool_count], sizeof(p256_nonce));
+    return DBB_OK;
+}
+
+
+void u2f_device_nonce_pool_clear(void)
+{
+    u2f_nonce_pool_generation++;
+    u2f_nonce_pool_count = 0;
+    u2f_nonce_seeded = false;
+    u2f_nonce_counter = 0;
+    utils_zero(u2f_nonce_pool, sizeof(u2f_nonce_pool));
+    utils_zero(u2f_nonce_seed, sizeof(u2f_nonce_seed));
+}
+
+
+uint8_t u2f_device_nonce_pool_count(void)
+{
+    return u2f_nonce_pool_count;
+}
+
+
+// Called from the main loop. Precomputes at most one nonce per call.
+void u2f_device_idle(void)
+{
+    uint8_t k[SHA256_DIGEST_LENGTH], counter[4];
+    uint32_t generation = u2f_nonce_pool_generation;
+    p256_nonce nonce;
+    int ret;
+
+    if (!u2f_nonce_seeded || u2f_nonce_pool_count >= U2F_NONCE_POOL_SIZE ||
+            !u2f_nonce_pool_enabled()) {
+        return;
+    }
+
+    do {
+        u2f_nonce_counter++;
+        counter[0] = (u2f_nonce_counter >> 24) & 0xff;
+        counter[1] = (u2f_nonce_counter >> 16) & 0xff;
+        counter[2] = (u2f_nonce_counter >> 8) & 0xff;
+        counter[3] = u2f_nonce_counter & 0xff;
+        hmac_sha256(u2f_nonce_seed, sizeof(u2f_nonce_seed), counter, sizeof(counter), k);
+        ret = p256_nonce_precompute(k, &nonce);
+    } while (ret != 0 && generation == u2f_nonce_pool_generation);
+
+#ifndef TESTING
+    irqflags_t irq = cpu_irq_save();
+#endif
+    // Discard the nonce if the pool was cleared in the meantime
+    if (ret == 0 && generation == u2f_nonce_pool_generation &&
+            u2f_nonce_pool_count < U2F_NONCE_POOL_SIZE) {
+        memcpy(&u2f_nonce_pool[u2f_nonce_pool_count], &nonce, sizeof(nonce));
+        u2f_nonce_pool_count++;
+    }
+#ifndef TESTING
+    cpu_irq_restore(irq);
+#endif
+
+    utils_zero(k, sizeof(k));
+    utils_zero(&nonce, sizeof(nonce));
+}
+
+
 static uint32_t next_cid(void)
 {
     do {
@@ -166,14 +279,30 @@ static void u2f_device_version(const USB_APDU *a)
 }
 
 
+// Key handles are mac | nonce, where the private key is HMAC(appkey, nonce)
+// and mac is HMAC(appkey, private key). The app key depends only on the
+// appId, so checking a list of key handles derives it once.
+static void u2f_keyhandle_appkey(const uint8_t *appId, uint8_t *appkey)
+{
+    hmac_sha256(appId, U2F_APPID_SIZE, memory_report_master_u2f(), 32, appkey);
+}
+
+
+static void u2f_keyhandle_derive(const uint8_t *appkey, const uint8_t *nonce,
+                                 uint8_t *privkey, uint8_t *mac)
+{
+    hmac_sha256(appkey, SHA256_DIGEST_LENGTH, nonce, U2F_NONCE_LENGTH, privkey);
+    hmac_sha256(appkey, SHA256_DIGEST_LENGTH, privkey, U2F_EC_KEY_SIZE, mac);
+}
+
+
 static void u2f_keyhandle_gen(const uint8_t *appId, uint8_t *nonce, uint8_t *privkey,
                               uint8_t *mac)
 {
-    uint8_t hash[SHA256_DIGEST_LENGTH];
+    uint8_t appkey[SHA256_DIGEST_LENGTH];
+    u2f_keyhandle_appkey(appId, appkey);
     for (;;) {
-        hmac_sha256(appId, U2F_APPID_SIZE, memory_report_master_u2f(), 32, hash);
-        hmac_sha256(hash, SHA256_DIGEST_LENGTH, nonce, U2F_NONCE_LENGTH, privkey);
-        hmac_sha256(hash, SHA256_DIGEST_LENGTH, privkey, U2F_EC_KEY_SIZE, mac);
+        u2f_keyhandle_derive(appkey, nonce, privkey, mac);
 
         if (ecc_isValid(privkey, ECC_SECP256r1)) {
             break;
@@ -181,6 +310,42 @@ static void u2f_keyhandle_gen(const uint8_t *appId, uint8_t *nonce, uint8_t *pri
 
         memcpy(nonce, mac, U2F_NONCE_LENGTH);
     }
+    utils_zero(appkey, sizeof(appkey));
+}
+
+
+// DBB_OK and the private key if this device generated key_handle for the app
+static int u2f_keyhandle_check(const uint8_t *appkey, const uint8_t *key_handle,
+                               uint8_t *privkey)
+{
+    uint8_t mac[SHA256_DIGEST_LENGTH];
+    u2f_keyhandle_derive(appkey, key_handle + sizeof(mac), privkey, mac);
+    if (memcmp(key_handle, mac, sizeof(mac)) != 0) {
+        utils_zero(privkey, U2F_EC_KEY_SIZE);
+        return DBB_ERROR;
+    }
+    return DBB_OK;
+}
+
+
+// Signs msg, with an idle-time precomputed nonce if one is available
+static int u2f_sign(const uint8_t *privkey, const uint8_t *msg, uint32_t msg_len,
+                    uint8_t *sig)
+{
+    int ret;
+    p256_nonce k;
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    if (u2f_nonce_pool_take(&k) == DBB_OK) {
+        uint8_t hash[SHA256_DIGEST_LENGTH];
+        sha256_Raw(msg, msg_len, hash);
+        ret = p256_sign_digest_nonce(privkey, hash, &k, sig);
+        utils_zero(&k, sizeof(k));
+    } else {
+        ret = ecc_sign(privkey, msg, msg_len, sig, NULL, ECC_SECP256r1);
+    }
+    u2f_nonce_pool_seed();
+    power_enter(power);
+    return ret;
 }
 
 
@@ -211,6 +376,8 @@ static void u2f_device_register(const USB_APDU *a)
             return;
         }
 
+        POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+
         u2f_keyhandle_gen(req->appId, nonce, privkey, mac);
 
         ecc_get_public_key65(privkey, (uint8_t *)&resp->pubKey, ECC_SECP256r1);
@@ -229,8 +396,11 @@ static void u2f_device_register(const USB_APDU *a)
         memcpy(sig_base.keyHandle, &resp->keyHandleCertSig, U2F_KEYHANDLE_LEN);
         memcpy(sig_base.pubKey, &resp->pubKey, U2F_EC_POINT_SIZE);
 
-        if (ecc_sign(U2F_ATT_PRIV_KEY, (uint8_t *)&sig_base, sizeof(sig_base), sig,
-                     NULL, ECC_SECP256r1)) {
+        int ret = ecc_sign(U2F_ATT_PRIV_KEY, (uint8_t *)&sig_base, sizeof(sig_base), sig,
+                           NULL, ECC_SECP256r1);
+        power_enter(power);
+
+        if (ret) {
             u2f_send_error(U2F_SW_WRONG_DATA);
             return;
         }
@@ -300,8 +470,9 @@ static void u2f_device_hijack(const U2F_AUTHENTICATE_REQ *req)
 
 static void u2f_device_authenticate(const USB_APDU *a)
 {
-    uint8_t privkey[U2F_EC_KEY_SIZE], nonce[U2F_NONCE_LENGTH], mac[SHA256_DIGEST_LENGTH],
-            sig[64], i;
+    uint8_t privkey[U2F_EC_KEY_SIZE], appkey[SHA256_DIGEST_LENGTH], sig[64], i;
+    int ret;
+    POWER_STATE power;
     const U2F_AUTHENTICATE_REQ *req = (const U2F_AUTHENTICATE_REQ *)a->data;
     U2F_AUTHENTICATE_SIG_STR sig_base;
 
@@ -329,11 +500,13 @@ static void u2f_device_authenticate(const USB_APDU *a)
         return;
     }
 
-    memcpy(nonce, req->keyHandle + sizeof(mac), sizeof(nonce));
+    power = power_enter(POWER_STATE_CRYPTO);
+    u2f_keyhandle_appkey(req->appId, appkey);
+    ret = u2f_keyhandle_check(appkey, req->keyHandle, privkey);
+    utils_zero(appkey, sizeof(appkey));
+    power_enter(power);
 
-    u2f_keyhandle_gen(req->appId, nonce, privkey, mac);
-
-    if (memcmp(req->keyHandle, mac, SHA256_DIGEST_LENGTH) != 0) {
+    if (ret != DBB_OK) {
         u2f_send_error(U2F_SW_WRONG_DATA);
         return;
     }
@@ -370,7 +543,10 @@ static void u2f_device_authenticate(const USB_APDU *a)
         memcpy(sig_base.ctr, resp->ctr, 4);
         memcpy(sig_base.challenge, req->challenge, U2F_NONCE_LENGTH);
 
-        if (ecc_sign(privkey, (uint8_t *)&sig_base, sizeof(sig_base), sig, NULL, ECC_SECP256r1)) {
+        ret = u2f_sign(privkey, (uint8_t *)&sig_base, sizeof(sig_base), sig);
+        utils_zero(privkey, sizeof(privkey));
+
+        if (ret) {
             u2f_send_error(U2F_SW_WRONG_DATA);
             return;
         }
@@ -386,6 +562,457 @@ static void u2f_device_authenticate(const USB_APDU *a)
 }
 
 
+// CTAP2 over U2FHID_CBOR: authenticatorGetInfo, MakeCredential and
+// GetAssertion, without resident keys, PINs or extensions. Credential IDs
+// are U2F key handles with the SHA256 of the RP ID as appId, i.e. the same
+// credential works over both protocols. The attestation is in the fido-u2f
+// format, signed with the U2F attestation key, so the AAGUID is zero.
+
+static const uint8_t CTAP2_AAGUID[CTAP2_AAGUID_SIZE] = {0};
+
+
+static void ctap2_send(const uint8_t *data, uint32_t len)
+{
+    usb_reply_queue_load_msg(U2FHID_CBOR, data, len, cid);
+}
+
+
+static void ctap2_send_status(uint8_t status)
+{
+    ctap2_send(&status, 1);
+}
+
+
+// Sends the status byte and the CBOR built after it in buf
+static void ctap2_send_response(uint8_t *buf, const CBOR_WRITER *w)
+{
+    if (w->err) {
+        ctap2_send_status(CTAP1_ERR_OTHER);
+        return;
+    }
+    buf[0] = CTAP2_OK;
+    ctap2_send(buf, w->len + 1);
+}
+
+
+static uint8_t ctap2_get(const CBOR_ITEM *params, int64_t key, uint8_t type,
+                         CBOR_ITEM *value)
+{
+    if (cbor_map_find(params, key, value) != DBB_OK) {
+        return CTAP2_ERR_MISSING_PARAMETER;
+    }
+    return value->type == type ? CTAP2_OK : CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+}
+
+
+static uint8_t ctap2_get_hash(const CBOR_ITEM *params, int64_t key, uint8_t type,
+                              uint8_t *hash)
+{
+    CBOR_ITEM value;
+    uint8_t status = ctap2_get(params, key, type, &value);
+    if (status != CTAP2_OK) {
+        return status;
+    }
+    if (type == CBOR_BYTES) {
+        if (value.val != SHA256_DIGEST_LENGTH) {
+            return CTAP1_ERR_INVALID_LENGTH;
+        }
+        memcpy(hash, value.p, SHA256_DIGEST_LENGTH);
+    } else {
+        sha256_Raw(value.p, value.val, hash);
+    }
+    return CTAP2_OK;
+}
+
+
+static int ctap2_bool(const CBOR_ITEM *item)
+{
+    return item->type == CBOR_SIMPLE && (item->val == CBOR_TRUE || item->val == CBOR_FALSE);
+}
+
+
+// Reads the options map. Resident keys and user verification are not
+// supported. up is NULL for commands without the "up" option.
+static uint8_t ctap2_options(const CBOR_ITEM *params, int64_t key, uint8_t *up)
+{
+    static const char *const unsupported[] = { "rk", "uv" };
+    CBOR_ITEM options, value;
+    size_t i;
+
+    if (up) {
+        *up = 1;
+    }
+    if (cbor_map_find(params, key, &options) != DBB_OK) {
+        return CTAP2_OK;
+    }
+    if (options.type != CBOR_MAP) {
+        return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+    }
+    for (i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++) {
+        if (cbor_map_find_text(&options, unsupported[i], &value) == DBB_OK) {
+            if (!ctap2_bool(&value)) {
+                return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+            }
+            if (value.val == CBOR_TRUE) {
+                return CTAP2_ERR_UNSUPPORTED_OPTION;
+            }
+        }
+    }
+    if (up && cbor_map_find_text(&options, "up", &value) == DBB_OK) {
+        if (!ctap2_bool(&value)) {
+            return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+        }
+        *up = value.val == CBOR_TRUE;
+    }
+    return CTAP2_OK;
+}
+
+
+// Evaluates a whole allowList or excludeList in one pass: finds the first
+// credential that this device issued for the RP. The app key is derived
+// once, after which each credential costs two HMACs.
+static uint8_t ctap2_find_credential(const CBOR_ITEM *list, const uint8_t *rp_id_hash,
+                                     const uint8_t **cred_id, uint8_t *privkey)
+{
+    uint8_t appkey[SHA256_DIGEST_LENGTH];
+    CBOR_READER r;
+    CBOR_ITEM cred, value;
+    uint64_t i;
+    uint8_t status = CTAP2_ERR_NO_CREDENTIALS;
+
+    if (list->type != CBOR_ARRAY) {
+        return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+    }
+
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    u2f_keyhandle_appkey(rp_id_hash, appkey);
+    cbor_item_reader(list, &r);
+    for (i = 0; i < list->val && status == CTAP2_ERR_NO_CREDENTIALS; i++) {
+        if (cbor_read(&r, &cred) != DBB_OK || cred.type != CBOR_MAP) {
+            status = CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+            break;
+        }
+        if (cbor_map_find_text(&cred, "type", &value) != DBB_OK ||
+                !cbor_text_eq(&value, "public-key")) {
+            continue;
+        }
+        if (cbor_map_find_text(&cred, "id", &value) != DBB_OK || value.type != CBOR_BYTES ||
+                value.val != U2F_KEYHANDLE_LEN) {
+            continue;
+        }
+        if (u2f_keyhandle_check(appkey, value.p, privkey) == DBB_OK) {
+            *cred_id = value.p;
+            status = CTAP2_OK;
+        }
+    }
+    utils_zero(appkey, sizeof(appkey));
+    power_enter(power);
+    return status;
+}
+
+
+static void ctap2_get_info(void)
+{
+    uint8_t buf[128];
+    CBOR_WRITER w;
+
+    cbor_writer_init(&w, buf + 1, sizeof(buf) - 1);
+    cbor_put_map(&w, 4);
+    cbor_put_uint(&w, CTAP2_GET_INFO_VERSIONS);
+    cbor_put_array(&w, 2);
+    cbor_put_text(&w, "U2F_V2");
+    cbor_put_text(&w, "FIDO_2_0");
+    cbor_put_uint(&w, CTAP2_GET_INFO_AAGUID);
+    cbor_put_bytes(&w, CTAP2_AAGUID, sizeof(CTAP2_AAGUID));
+    cbor_put_uint(&w, CTAP2_GET_INFO_OPTIONS);
+    cbor_put_map(&w, 3);
+    cbor_put_text(&w, "rk");
+    cbor_put_bool(&w, 0);
+    cbor_put_text(&w, "up");
+    cbor_put_bool(&w, 1);
+    cbor_put_text(&w, "plat");
+    cbor_put_bool(&w, 0);
+    cbor_put_uint(&w, CTAP2_GET_INFO_MAX_MSG_SIZE);
+    cbor_put_uint(&w, U2F_READBUF_MAX_LEN);
+    ctap2_send_response(buf, &w);
+}
+
+
+static uint8_t ctap2_check_algorithms(const CBOR_ITEM *params)
+{
+    CBOR_READER r;
+    CBOR_ITEM param, value;
+    int64_t alg;
+    uint64_t i;
+
+    if (params->type != CBOR_ARRAY) {
+        return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+    }
+    cbor_item_reader(params, &r);
+    for (i = 0; i < params->val; i++) {
+        if (cbor_read(&r, &param) != DBB_OK || param.type != CBOR_MAP) {
+            return CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+        }
+        if (cbor_map_find_text(&param, "type", &value) == DBB_OK &&
+                cbor_text_eq(&value, "public-key") &&
+                cbor_map_find_text(&param, "alg", &value) == DBB_OK &&
+                cbor_int(&value, &alg) == DBB_OK && alg == CTAP2_COSE_ALG_ES256) {
+            return CTAP2_OK;
+        }
+    }
+    return CTAP2_ERR_UNSUPPORTED_ALGORITHM;
+}
+
+
+static void ctap2_make_credential(const CBOR_ITEM *params)
+{
+    uint8_t client_data_hash[SHA256_DIGEST_LENGTH], privkey[U2F_EC_KEY_SIZE];
+    uint8_t nonce[U2F_NONCE_LENGTH], mac[SHA256_DIGEST_LENGTH], sig[64];
+    uint8_t der[U2F_MAX_EC_SIG_SIZE], auth_data[CTAP2_AUTH_DATA_MAX_LEN];
+    uint8_t buf[CTAP2_RESP_MAX_LEN];
+    const uint8_t *cred_id;
+    U2F_REGISTER_SIG_STR sig_base;
+    CBOR_ITEM rp, user, value;
+    CBOR_WRITER w;
+    uint8_t status;
+    size_t len;
+    int ret;
+
+    status = ctap2_get_hash(params, CTAP2_MC_CLIENT_DATA_HASH, CBOR_BYTES, client_data_hash);
+    if (status == CTAP2_OK) {
+        status = ctap2_get(params, CTAP2_MC_RP, CBOR_MAP, &rp);
+    }
+    if (status == CTAP2_OK) {
+        status = ctap2_get(params, CTAP2_MC_USER, CBOR_MAP, &user);
+    }
+    if (status == CTAP2_OK) {
+        if (cbor_map_find_text(&rp, "id", &value) != DBB_OK) {
+            status = CTAP2_ERR_MISSING_PARAMETER;
+        } else if (value.type != CBOR_TEXT) {
+            status = CTAP2_ERR_CBOR_UNEXPECTED_TYPE;
+        } else {
+            sha256_Raw(value.p, value.val, sig_base.appId);
+        }
+    }
+    if (status == CTAP2_OK) {
+        status = ctap2_get(params, CTAP2_MC_PUB_KEY_PARAMS, CBOR_ARRAY, &value);
+    }
+    if (status == CTAP2_OK) {
+        status = ctap2_check_algorithms(&value);
+    }
+    if (status == CTAP2_OK) {
+        status = ctap2_options(params, CTAP2_MC_OPTIONS, NULL);
+    }
+    if (status == CTAP2_OK && cbor_map_find(params, CTAP2_MC_PIN_AUTH, &value) == DBB_OK) {
+        status = CTAP2_ERR_PIN_AUTH_INVALID;// No client PIN
+    }
+    if (status != CTAP2_OK) {
+        ctap2_send_status(status);
+        return;
+    }
+
+    if (cbor_map_find(params, CTAP2_MC_EXCLUDE_LIST, &value) == DBB_OK) {
+        status = ctap2_find_credential(&value, sig_base.appId, &cred_id, privkey);
+        utils_zero(privkey, sizeof(privkey));
+        if (status == CTAP2_OK) {
+            touch_button_press(DBB_TOUCH_TIMEOUT);
+            ctap2_send_status(CTAP2_ERR_CREDENTIAL_EXCLUDED);
+            return;
+        }
+        if (status != CTAP2_ERR_NO_CREDENTIALS) {
+            ctap2_send_status(status);
+            return;
+        }
+    }
+
+    if (touch_button_press(DBB_TOUCH_TIMEOUT) != DBB_TOUCHED) {
+        ctap2_send_status(CTAP2_ERR_OPERATION_DENIED);
+        return;
+    }
+
+    if (random_bytes(nonce, sizeof(nonce), 0) == DBB_ERROR) {
+        ctap2_send_status(CTAP1_ERR_OTHER);
+        return;
+    }
+
+    // Same key handle and attestation signature as U2F registration
+    POWER_STATE power = power_enter(POWER_STATE_CRYPTO);
+    u2f_keyhandle_gen(sig_base.appId, nonce, privkey, mac);
+    sig_base.reserved = 0;
+    memcpy(sig_base.challenge, client_data_hash, U2F_NONCE_LENGTH);
+    memcpy(sig_base.keyHandle, mac, sizeof(mac));
+    memcpy(sig_base.keyHandle + sizeof(mac), nonce, sizeof(nonce));
+    ecc_get_public_key65(privkey, sig_base.pubKey, ECC_SECP256r1);
+    utils_zero(privkey, sizeof(privkey));
+    ret = ecc_sign(U2F_ATT_PRIV_KEY, (uint8_t *)&sig_base, sizeof(sig_base), sig, NULL,
+                   ECC_SECP256r1);
+    power_enter(power);
+
+    if (ret) {
+        ctap2_send_status(CTAP1_ERR_OTHER);
+        return;
+    }
+
+    // rpIdHash | flags | signCount | AAGUID | credentialId | COSE public key
+    len = 0;
+    memcpy(auth_data, sig_base.appId, U2F_APPID_SIZE);
+    len += U2F_APPID_SIZE;
+    auth_data[len++] = CTAP2_FLAG_UP | CTAP2_FLAG_AT;
+    memset(auth_data + len, 0, U2F_CTR_SIZE);
+    len += U2F_CTR_SIZE;
+    memcpy(auth_data + len, CTAP2_AAGUID, sizeof(CTAP2_AAGUID));
+    len += sizeof(CTAP2_AAGUID);
+    auth_data[len++] = 0;
+    auth_data[len++] = U2F_KEYHANDLE_LEN;
+    memcpy(auth_data + len, sig_base.keyHandle, U2F_KEYHANDLE_LEN);
+    len += U2F_KEYHANDLE_LEN;
+    cbor_writer_init(&w, auth_data + len, sizeof(auth_data) - len);
+    cbor_put_map(&w, 5);
+    cbor_put_int(&w, 1);
+    cbor_put_int(&w, CTAP2_COSE_KTY_EC2);
+    cbor_put_int(&w, 3);
+    cbor_put_int(&w, CTAP2_COSE_ALG_ES256);
+    cbor_put_int(&w, -1);
+    cbor_put_int(&w, CTAP2_COSE_CRV_P256);
+    cbor_put_int(&w, -2);
+    cbor_put_bytes(&w, sig_base.pubKey + 1, U2F_EC_KEY_SIZE);
+    cbor_put_int(&w, -3);
+    cbor_put_bytes(&w, sig_base.pubKey + 1 + U2F_EC_KEY_SIZE, U2F_EC_KEY_SIZE);
+    if (w.err) {
+        ctap2_send_status(CTAP1_ERR_OTHER);
+        return;
+    }
+    len += w.len;
+
+    cbor_writer_init(&w, buf + 1, sizeof(buf) - 1);
+    cbor_put_map(&w, 3);
+    cbor_put_uint(&w, CTAP2_MC_RESP_FMT);
+    cbor_put_text(&w, "fido-u2f");
+    cbor_put_uint(&w, CTAP2_MC_RESP_AUTH_DATA);
+    cbor_put_bytes(&w, auth_data, len);
+    cbor_put_uint(&w, CTAP2_MC_RESP_ATT_STMT);
+    cbor_put_map(&w, 2);
+    cbor_put_text(&w, "sig");
+    cbor_put_bytes(&w, der, ecc_sig_to_der(sig, der));
+    cbor_put_text(&w, "x5c");
+    cbor_put_array(&w, 1);
+    cbor_put_bytes(&w, U2F_ATT_CERT, sizeof(U2F_ATT_CERT));
+    ctap2_send_response(buf, &w);
+}
+
+
+static void ctap2_get_assertion(const CBOR_ITEM *params)
+{
+    uint8_t client_data_hash[SHA256_DIGEST_LENGTH], privkey[U2F_EC_KEY_SIZE], sig[64];
+    uint8_t msg[U2F_APPID_SIZE + 1 + U2F_CTR_SIZE + SHA256_DIGEST_LENGTH];
+    uint8_t der[U2F_MAX_EC_SIG_SIZE], buf[256], up;
+    const uint8_t *cred_id = NULL;
+    CBOR_ITEM allow_list, value;
+    CBOR_WRITER w;
+    uint8_t status;
+    uint32_t ctr;
+    int ret;
+
+    status = ctap2_get_hash(params, CTAP2_GA_RP_ID, CBOR_TEXT, msg);
+    if (status == CTAP2_OK) {
+        status = ctap2_get_hash(params, CTAP2_GA_CLIENT_DATA_HASH, CBOR_BYTES, client_data_hash);
+    }
+    if (status == CTAP2_OK) {
+        status = ctap2_options(params, CTAP2_GA_OPTIONS, &up);
+    }
+    if (status == CTAP2_OK && cbor_map_find(params, CTAP2_GA_PIN_AUTH, &value) == DBB_OK) {
+        status = CTAP2_ERR_PIN_AUTH_INVALID;// No client PIN
+    }
+    if (status == CTAP2_OK) {
+        // Without resident keys, only listed credentials can be found
+        if (cbor_map_find(params, CTAP2_GA_ALLOW_LIST, &allow_list) != DBB_OK) {
+            status = CTAP2_ERR_NO_CREDENTIALS;
+        } else {
+            status = ctap2_find_credential(&allow_list, msg, &cred_id, privkey);
+        }
+    }
+    if (status != CTAP2_OK) {
+        ctap2_send_status(status);
+        return;
+    }
+
+    if (up && touch_button_press(DBB_TOUCH_TIMEOUT) != DBB_TOUCHED) {
+        utils_zero(privkey, sizeof(privkey));
+        ctap2_send_status(CTAP2_ERR_OPERATION_DENIED);
+        return;
+    }
+
+    // authData (rpIdHash | flags | signCount) | clientDataHash
+    ctr = memory_u2f_count_iter();
+    msg[U2F_APPID_SIZE] = up ? CTAP2_FLAG_UP : 0;
+    msg[U2F_APPID_SIZE + 1] = (ctr >> 24) & 0xff;
+    msg[U2F_APPID_SIZE + 2] = (ctr >> 16) & 0xff;
+    msg[U2F_APPID_SIZE + 3] = (ctr >> 8) & 0xff;
+    msg[U2F_APPID_SIZE + 4] = ctr & 0xff;
+    memcpy(msg + U2F_APPID_SIZE + 1 + U2F_CTR_SIZE, client_data_hash, SHA256_DIGEST_LENGTH);
+
+    ret = u2f_sign(privkey, msg, sizeof(msg), sig);
+    utils_zero(privkey, sizeof(privkey));
+    if (ret) {
+        ctap2_send_status(CTAP1_ERR_OTHER);
+        return;
+    }
+
+    cbor_writer_init(&w, buf + 1, sizeof(buf) - 1);
+    cbor_put_map(&w, 3);
+    cbor_put_uint(&w, CTAP2_GA_RESP_CREDENTIAL);
+    cbor_put_map(&w, 2);
+    cbor_put_text(&w, "id");
+    cbor_put_bytes(&w, cred_id, U2F_KEYHANDLE_LEN);
+    cbor_put_text(&w, "type");
+    cbor_put_text(&w, "public-key");
+    cbor_put_uint(&w, CTAP2_GA_RESP_AUTH_DATA);
+    cbor_put_bytes(&w, msg, U2F_APPID_SIZE + 1 + U2F_CTR_SIZE);
+    cbor_put_uint(&w, CTAP2_GA_RESP_SIGNATURE);
+    cbor_put_bytes(&w, der, ecc_sig_to_der(sig, der));
+    ctap2_send_response(buf, &w);
+}
+
+
+static void u2f_device_cbor(const uint8_t *buf, uint32_t len)
+{
+    CBOR_READER r;
+    CBOR_ITEM params;
+
+    if (len < 1) {
+        ctap2_send_status(CTAP1_ERR_INVALID_LENGTH);
+        return;
+    }
+
+    if (buf[0] == CTAP2_GET_INFO) {
+        ctap2_get_info();
+        return;
+    }
+    if (buf[0] != CTAP2_MAKE_CREDENTIAL && buf[0] != CTAP2_GET_ASSERTION) {
+        ctap2_send_status(CTAP1_ERR_INVALID_COMMAND);
+        return;
+    }
+
+    // Parameters: one map, read in full so that lookups stay in bounds
+    r.p = buf + 1;
+    r.len = len - 1;
+    if (cbor_read(&r, &params) != DBB_OK || r.len != 0) {
+        ctap2_send_status(CTAP2_ERR_INVALID_CBOR);
+        return;
+    }
+    if (params.type != CBOR_MAP) {
+        ctap2_send_status(CTAP2_ERR_CBOR_UNEXPECTED_TYPE);
+        return;
+    }
+
+    if (buf[0] == CTAP2_MAKE_CREDENTIAL) {
+        ctap2_make_credential(&params);
+    } else {
+        ctap2_get_assertion(&params);
+    }
+}
+
+
 static void u2f_device_reset_state(void)
 {
     memset(&reader, 0, sizeof(reader));
@@ -419,6 +1046,55 @@ static void u2f_device_wink(const uint8_t *buf, uint32_t len)
 }
 
 
+// Liveness and status check answered without the commander, i.e. no JSON
+// parsing, encryption or heap use. Only state already in RAM is reported;
+// seeded and bootlock come from the `device info` cache and are flagged
+// unknown while it is cold, as deriving them would load the seed.
+static void u2f_device_status(const uint8_t *buf, uint32_t len)
+{
+    (void)buf;
+
+    if (len > 0) {
+        u2f_send_err_hid(cid, U2FHID_ERR_INVALID_LEN);
+        return;
+    }
+
+    const COMMANDER_DEVICE_STATUS *status = commander_device_status_cached();
+    uint16_t access_err = memory_report_access_err_count();
+    uint16_t pin_err = memory_report_pin_err_count();
+    U2FHID_STATUS_RESP resp;
+
+    resp.versionRecord = U2FHID_STATUS_VERSION;
+    resp.versionMajor = DIGITAL_BITBOX_VERSION_MAJOR;
+    resp.versionMinor = DIGITAL_BITBOX_VERSION_MINOR;
+    resp.versionBuild = DIGITAL_BITBOX_VERSION_PATCH;
+    resp.flags = 0;
+    resp.flags |= memory_report_erased() ? U2FHID_STATUS_FLAG_ERASED : 0;
+    resp.flags |= memory_report_setup() ? 0 : U2FHID_STATUS_FLAG_SETUP;
+    resp.flags |= memory_report_unlocked() ? 0 : U2FHID_STATUS_FLAG_LOCKED;
+    resp.flags |= (memory_report_ext_flags() & MEM_EXT_MASK_U2F) ? U2FHID_STATUS_FLAG_U2F : 0;
+    if (status) {
+        resp.flags |= status->seeded ? U2FHID_STATUS_FLAG_SEEDED : 0;
+        resp.flags |= status->bootlock ? U2FHID_STATUS_FLAG_BOOTLOCK : 0;
+    } else {
+        resp.flags |= U2FHID_STATUS_FLAG_UNKNOWN;
+    }
+    resp.accessErrCount[0] = access_err >> 8;
+    resp.accessErrCount[1] = access_err & 0xff;
+    resp.pinErrCount[0] = pin_err >> 8;
+    resp.pinErrCount[1] = pin_err & 0xff;
+
+    USB_FRAME f;
+    utils_zero(&f, sizeof(f));
+    f.cid = cid;
+    f.init.cmd = U2FHID_STATUS;
+    f.init.bcnth = 0;
+    f.init.bcntl = U2FHID_STATUS_RESP_SIZE;
+    memcpy(&f.init.data, &resp, sizeof(resp));
+    usb_reply_queue_add(&f);
+}
+
+
 static void u2f_device_sync(const uint8_t *buf, uint32_t len)
 {
     // TODO - implement
@@ -458,9 +1134,11 @@ static void u2f_device_init(const USB_FRAME *in)
     resp.versionMajor = DIGITAL_BITBOX_VERSION_MAJOR;
     resp.versionMinor = DIGITAL_BITBOX_VERSION_MINOR;
     resp.versionBuild = DIGITAL_BITBOX_VERSION_PATCH;
-    resp.capFlags = U2FHID_CAPFLAG_WINK;
+    resp.capFlags = U2FHID_CAPFLAG_WINK | U2FHID_CAPFLAG_CBOR;
     memcpy(&f.init.data, &resp, sizeof(resp));
     usb_reply_queue_add(&f);
+
+    u2f_nonce_pool_seed();
 }
 
 
@@ -502,6 +1180,9 @@ static void u2f_device_cmd_cont(const USB_FRAME *f)
 
     u2f_state_continue = false;
 
+    // Full clock once per assembled command, not per frame
+    POWER_STATE power = power_enter(POWER_STATE_ACTIVE);
+
     if ( (reader.cmd < U2FHID_VENDOR_FIRST) &&
             !(memory_report_ext_flags() & MEM_EXT_MASK_U2F) ) {
         // Abort U2F commands if the U2F bit is not set (==U2F disabled).
@@ -519,6 +1200,9 @@ static void u2f_device_cmd_cont(const USB_FRAME *f)
             case U2FHID_WINK:
                 u2f_device_wink(reader.buf, reader.len);
                 break;
+            case U2FHID_CBOR:
+                u2f_device_cbor(reader.buf, reader.len);
+                break;
             case U2FHID_HWW: {
                 char *report;
                 reader.buf[MIN(reader.len, sizeof(reader.buf) - 1)] = '\0';// NULL terminate
@@ -526,12 +1210,17 @@ static void u2f_device_cmd_cont(const USB_FRAME *f)
                 usb_reply_queue_load_msg(U2FHID_HWW, (const uint8_t *)report, strlens(report), cid);
                 break;
             }
+            case U2FHID_STATUS:
+                u2f_device_status(reader.buf, reader.len);
+                break;
             default:
                 u2f_send_err_hid(cid, U2FHID_ERR_INVALID_CMD);
                 break;
         }
     }
 
+    power_enter(power);
+
     // Finished
     u2f_device_reset_state();
     cid = 0;
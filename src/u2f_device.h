@@ -45,6 +45,9 @@ void u2f_send_message(const uint8_t *data, const uint32_t len);
 void u2f_send_err_hid(uint32_t fcid, uint8_t err);
 void u2f_device_run(const USB_FRAME *f);
 void u2f_device_timeout(void);
+void u2f_device_idle(void);
+void u2f_device_nonce_pool_clear(void);
+uint8_t u2f_device_nonce_pool_count(void);
 
 
 #endif
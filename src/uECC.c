@@ -137,6 +137,12 @@
 #define BITS_TO_WORDS(num_bits) ((num_bits + ((uECC_WORD_SIZE * 8) - 1)) / (uECC_WORD_SIZE * 8))
 #define BITS_TO_BYTES(num_bits) ((num_bits + 7) / 8)
 
+#define uECC_SAFEGCD (uECC_SAFEGCD_INVERSE_secp256r1 || uECC_SAFEGCD_INVERSE_secp256k1)
+
+#if uECC_SAFEGCD
+struct uECC_ModInv_t;
+#endif
+
 struct uECC_Curve_t {
     wordcount_t num_words;
     wordcount_t num_bytes;
@@ -157,6 +163,10 @@ struct uECC_Curve_t {
 #if (uECC_OPTIMIZATION_LEVEL > 0)
     void (*mmod_fast)(uECC_word_t *result, uECC_word_t *product);
 #endif
+#if uECC_SAFEGCD
+    const struct uECC_ModInv_t *modinv_p; /* 0 to use uECC_vli_modInv() */
+    const struct uECC_ModInv_t *modinv_n;
+#endif
 };
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
@@ -773,10 +783,252 @@ uECC_VLI_API void uECC_vli_modInv(uECC_word_t *result,
     uECC_vli_set(result, u, num_words);
 }
 
+#if uECC_SAFEGCD
+/* Constant-time modular inversion using the "safegcd" divsteps of Bernstein and Yang,
+   https://gcd.cr.yp.to/safegcd-20190413.pdf. This follows the 32-bit variant in libsecp256k1
+   (modinv32): numbers are kept in 9 signed limbs of 30 bits, and 20 batches of 30 divsteps
+   are always executed, which is enough for any modulus up to 256 bits. */
+typedef struct {
+    int32_t v[9];
+} uECC_signed30;
+
+struct uECC_ModInv_t {
+    uECC_signed30 modulus; /* The modulus in signed30 notation. */
+    uint32_t modulus_inv30; /* modulus^-1 mod 2^30 */
+};
+
+typedef struct {
+    int32_t u, v, q, r;
+} uECC_trans2x2;
+
+#define M30 ((int32_t)(UINT32_MAX >> 2))
+
+/* Perform 30 divsteps on the low bits of f and g, and return the updated zeta.
+   The transition matrix, scaled by 2^30, is stored in t. */
+static int32_t modinv_divsteps_30(int32_t zeta, uint32_t f0, uint32_t g0, uECC_trans2x2 *t)
+{
+    uint32_t u = 1, v = 0, q = 0, r = 1;
+    uint32_t c1, c2, f = f0, g = g0, x, y, z;
+    int i;
+
+    for (i = 0; i < 30; ++i) {
+        /* c1 = -1 if zeta < 0 (delta > 0), c2 = -1 if g is odd. */
+        c1 = (uint32_t)(zeta >> 31);
+        c2 = -(g & 1);
+        /* Conditionally negate f, u and v (if zeta < 0) and add them to g, q and r (if g
+           is odd). */
+        x = (f ^ c1) - c1;
+        y = (u ^ c1) - c1;
+        z = (v ^ c1) - c1;
+        g += x & c2;
+        q += y & c2;
+        r += z & c2;
+        /* In the swap case, negate zeta, and add the new g to f (undoing the negation). */
+        c1 &= c2;
+        zeta = (int32_t)(((uint32_t)zeta ^ c1) - 1);
+        f += g & c1;
+        u += q & c1;
+        v += r & c1;
+        g >>= 1;
+        u <<= 1;
+        v <<= 1;
+    }
+    t->u = (int32_t)u;
+    t->v = (int32_t)v;
+    t->q = (int32_t)q;
+    t->r = (int32_t)r;
+    return zeta;
+}
+
+/* Compute (t/2^30) * [d, e] mod modulus. The inputs and outputs are in (-2 * modulus,
+   modulus). */
+static void modinv_update_de_30(uECC_signed30 *d, uECC_signed30 *e, const uECC_trans2x2 *t,
+                                const struct uECC_ModInv_t *modinfo)
+{
+    const int32_t u = t->u, v = t->v, q = t->q, r = t->r;
+    int32_t di, ei, md, me, sd, se;
+    int64_t cd, ce;
+    int i;
+
+    /* Start with md = u*[d<0] + v*[e<0], so the result is not negative. */
+    sd = d->v[8] >> 31;
+    se = e->v[8] >> 31;
+    md = (u & sd) + (v & se);
+    me = (q & sd) + (r & se);
+    di = d->v[0];
+    ei = e->v[0];
+    cd = (int64_t)u * di + (int64_t)v * ei;
+    ce = (int64_t)q * di + (int64_t)r * ei;
+    /* Correct md and me so that the bottom 30 bits of t*[d, e] + modulus*[md, me] are zero. */
+    md -= (int32_t)((modinfo->modulus_inv30 * (uint32_t)cd + (uint32_t)md) & M30);
+    me -= (int32_t)((modinfo->modulus_inv30 * (uint32_t)ce + (uint32_t)me) & M30);
+    cd += (int64_t)modinfo->modulus.v[0] * md;
+    ce += (int64_t)modinfo->modulus.v[0] * me;
+    cd >>= 30;
+    ce >>= 30;
+    for (i = 1; i < 9; ++i) {
+        di = d->v[i];
+        ei = e->v[i];
+        cd += (int64_t)u * di + (int64_t)v * ei;
+        ce += (int64_t)q * di + (int64_t)r * ei;
+        cd += (int64_t)modinfo->modulus.v[i] * md;
+        ce += (int64_t)modinfo->modulus.v[i] * me;
+        d->v[i - 1] = (int32_t)cd & M30;
+        cd >>= 30;
+        e->v[i - 1] = (int32_t)ce & M30;
+        ce >>= 30;
+    }
+    d->v[8] = (int32_t)cd;
+    e->v[8] = (int32_t)ce;
+}
+
+/* Compute (t/2^30) * [f, g]. The divsteps guarantee the division is exact. */
+static void modinv_update_fg_30(uECC_signed30 *f, uECC_signed30 *g, const uECC_trans2x2 *t)
+{
+    const int32_t u = t->u, v = t->v, q = t->q, r = t->r;
+    int32_t fi, gi;
+    int64_t cf, cg;
+    int i;
+
+    fi = f->v[0];
+    gi = g->v[0];
+    cf = (int64_t)u * fi + (int64_t)v * gi;
+    cg = (int64_t)q * fi + (int64_t)r * gi;
+    cf >>= 30;
+    cg >>= 30;
+    for (i = 1; i < 9; ++i) {
+        fi = f->v[i];
+        gi = g->v[i];
+        cf += (int64_t)u * fi + (int64_t)v * gi;
+        cg += (int64_t)q * fi + (int64_t)r * gi;
+        f->v[i - 1] = (int32_t)cf & M30;
+        cf >>= 30;
+        g->v[i - 1] = (int32_t)cg & M30;
+        cg >>= 30;
+    }
+    f->v[8] = (int32_t)cf;
+    g->v[8] = (int32_t)cg;
+}
+
+/* Bring r from (-2 * modulus, modulus) into [0, modulus), negating it first if sign < 0.
+   The result has all limbs in [0, 2^30). */
+static void modinv_normalize_30(uECC_signed30 *r, int32_t sign,
+                                const struct uECC_ModInv_t *modinfo)
+{
+    volatile int32_t cond_add, cond_negate;
+    int i;
+
+    /* In a first step, add the modulus if r is negative, and then negate if requested.
+       This brings r from range (-2 * modulus, modulus) to range (-modulus, modulus). */
+    cond_add = r->v[8] >> 31;
+    for (i = 0; i < 9; ++i) {
+        r->v[i] += modinfo->modulus.v[i] & cond_add;
+    }
+    cond_negate = sign >> 31;
+    for (i = 0; i < 9; ++i) {
+        r->v[i] = (r->v[i] ^ cond_negate) - cond_negate;
+    }
+    for (i = 0; i < 8; ++i) {
+        r->v[i + 1] += r->v[i] >> 30;
+        r->v[i] &= M30;
+    }
+
+    /* In a second step, add the modulus again if the result is still negative. */
+    cond_add = r->v[8] >> 31;
+    for (i = 0; i < 9; ++i) {
+        r->v[i] += modinfo->modulus.v[i] & cond_add;
+    }
+    for (i = 0; i < 8; ++i) {
+        r->v[i + 1] += r->v[i] >> 30;
+        r->v[i] &= M30;
+    }
+}
+
+static void vli_to_signed30(uECC_signed30 *r, const uECC_word_t *vli, wordcount_t num_words)
+{
+    bitcount_t num_bits = (bitcount_t)num_words * uECC_WORD_BITS;
+    bitcount_t i;
+
+    memset(r, 0, sizeof(*r));
+    for (i = 0; i < num_bits && i < 9 * 30; ++i) {
+        r->v[i / 30] |= (int32_t)((vli[i >> uECC_WORD_BITS_SHIFT] >>
+                                   (i & uECC_WORD_BITS_MASK)) & 1) << (i % 30);
+    }
+}
+
+static void signed30_to_vli(uECC_word_t *vli, const uECC_signed30 *a, wordcount_t num_words)
+{
+    bitcount_t num_bits = (bitcount_t)num_words * uECC_WORD_BITS;
+    bitcount_t i;
+
+    uECC_vli_clear(vli, num_words);
+    for (i = 0; i < num_bits && i < 9 * 30; ++i) {
+        vli[i >> uECC_WORD_BITS_SHIFT] |=
+            (uECC_word_t)((a->v[i / 30] >> (i % 30)) & 1) << (i & uECC_WORD_BITS_MASK);
+    }
+}
+
+/* Computes result = (1 / input) % modulus in constant time. input must be < modulus.
+   result may overlap input. */
+static void vli_modInv_safegcd(uECC_word_t *result,
+                               const uECC_word_t *input,
+                               const struct uECC_ModInv_t *modinfo,
+                               wordcount_t num_words)
+{
+    uECC_signed30 d = {{0}};
+    uECC_signed30 e = {{1}};
+    uECC_signed30 f = modinfo->modulus;
+    uECC_signed30 g;
+    uECC_trans2x2 t;
+    int32_t zeta = -1; /* zeta = -(delta + 1/2); delta starts at 1/2. */
+    int i;
+
+    vli_to_signed30(&g, input, num_words);
+    for (i = 0; i < 20; ++i) {
+        zeta = modinv_divsteps_30(zeta, (uint32_t)f.v[0], (uint32_t)g.v[0], &t);
+        modinv_update_de_30(&d, &e, &t, modinfo);
+        modinv_update_fg_30(&f, &g, &t);
+    }
+    /* f is now +1 or -1; the inverse is d * f. */
+    modinv_normalize_30(&d, f.v[8], modinfo);
+    signed30_to_vli(result, &d, num_words);
+
+    memset(&d, 0, sizeof(d));
+    memset(&e, 0, sizeof(e));
+    memset(&g, 0, sizeof(g));
+}
+
+#undef M30
+#endif /* uECC_SAFEGCD */
+
 /* ------ Point operations ------ */
 
 #include "curve-specific.inc"
 
+/* Computes result = (1 / input) % p, using the constant-time inversion if the curve has it. */
+static void vli_modInv_p(uECC_word_t *result, const uECC_word_t *input, uECC_Curve curve)
+{
+#if uECC_SAFEGCD
+    if (curve->modinv_p) {
+        vli_modInv_safegcd(result, input, curve->modinv_p, curve->num_words);
+        return;
+    }
+#endif
+    uECC_vli_modInv(result, input, curve->p, curve->num_words);
+}
+
+/* Computes result = (1 / input) % n, using the constant-time inversion if the curve has it. */
+static void vli_modInv_n(uECC_word_t *result, const uECC_word_t *input, uECC_Curve curve)
+{
+#if uECC_SAFEGCD
+    if (curve->modinv_n) {
+        vli_modInv_safegcd(result, input, curve->modinv_n, BITS_TO_WORDS(curve->num_n_bits));
+        return;
+    }
+#endif
+    uECC_vli_modInv(result, input, curve->n, BITS_TO_WORDS(curve->num_n_bits));
+}
+
 /* Returns 1 if 'point' is the point at infinity, 0 otherwise. */
 #define EccPoint_isZero(point, curve) uECC_vli_isZero((point), (curve)->num_words * 2)
 
@@ -897,18 +1149,21 @@ static void XYcZ_addC(uECC_word_t *X1,
     uECC_vli_set(X1, t7, num_words);
 }
 
-/* result may overlap point. */
-static void EccPoint_mult(uECC_word_t *result,
-                          const uECC_word_t *point,
-                          const uECC_word_t *scalar,
-                          const uECC_word_t *initial_Z,
-                          bitcount_t num_bits,
-                          uECC_Curve curve)
+/* Runs the Montgomery ladder of EccPoint_mult() without the final inversion. The affine
+   result is apply_z(result, result + num_words, z_num / z_den), so several results can share
+   one inversion. result may overlap point. */
+static void EccPoint_mult_ladder(uECC_word_t *result,
+                                 uECC_word_t *z_num,
+                                 uECC_word_t *z_den,
+                                 const uECC_word_t *point,
+                                 const uECC_word_t *scalar,
+                                 const uECC_word_t *initial_Z,
+                                 bitcount_t num_bits,
+                                 uECC_Curve curve)
 {
     /* R0 and R1 */
     uECC_word_t Rx[2][uECC_MAX_WORDS];
     uECC_word_t Ry[2][uECC_MAX_WORDS];
-    uECC_word_t z[uECC_MAX_WORDS];
     bitcount_t i;
     uECC_word_t nb;
     wordcount_t num_words = curve->num_words;
@@ -927,23 +1182,35 @@ static void EccPoint_mult(uECC_word_t *result,
     nb = !uECC_vli_testBit(scalar, 0);
     XYcZ_addC(Rx[1 - nb], Ry[1 - nb], Rx[nb], Ry[nb], curve);
 
-    /* Find final 1/Z value. */
-    uECC_vli_modSub(z, Rx[1], Rx[0], curve->p, num_words); /* X1 - X0 */
-    uECC_vli_modMult_fast(z, z, Ry[1 - nb], curve);               /* Yb * (X1 - X0) */
-    uECC_vli_modMult_fast(z, z, point, curve);                    /* xP * Yb * (X1 - X0) */
-    uECC_vli_modInv(z, z, curve->p, num_words);            /* 1 / (xP * Yb * (X1 - X0)) */
-    /* yP / (xP * Yb * (X1 - X0)) */
-    uECC_vli_modMult_fast(z, z, point + num_words, curve);
-    uECC_vli_modMult_fast(z, z, Rx[1 - nb], curve); /* Xb * yP / (xP * Yb * (X1 - X0)) */
-    /* End 1/Z calculation */
+    /* Find final 1/Z value as z_num / z_den. */
+    uECC_vli_modSub(z_den, Rx[1], Rx[0], curve->p, num_words); /* X1 - X0 */
+    uECC_vli_modMult_fast(z_den, z_den, Ry[1 - nb], curve);       /* Yb * (X1 - X0) */
+    uECC_vli_modMult_fast(z_den, z_den, point, curve);            /* xP * Yb * (X1 - X0) */
+    uECC_vli_modMult_fast(z_num, point + num_words, Rx[1 - nb], curve); /* Xb * yP */
 
     XYcZ_add(Rx[nb], Ry[nb], Rx[1 - nb], Ry[1 - nb], curve);
-    apply_z(Rx[0], Ry[0], z, curve);
 
     uECC_vli_set(result, Rx[0], num_words);
     uECC_vli_set(result + num_words, Ry[0], num_words);
 }
 
+/* result may overlap point. */
+static void EccPoint_mult(uECC_word_t *result,
+                          const uECC_word_t *point,
+                          const uECC_word_t *scalar,
+                          const uECC_word_t *initial_Z,
+                          bitcount_t num_bits,
+                          uECC_Curve curve)
+{
+    uECC_word_t z_num[uECC_MAX_WORDS];
+    uECC_word_t z[uECC_MAX_WORDS];
+
+    EccPoint_mult_ladder(result, z_num, z, point, scalar, initial_Z, num_bits, curve);
+    vli_modInv_p(z, z, curve);                 /* 1 / (xP * Yb * (X1 - X0)) */
+    uECC_vli_modMult_fast(z, z, z_num, curve); /* Xb * yP / (xP * Yb * (X1 - X0)) */
+    apply_z(result, result + curve->num_words, z, curve);
+}
+
 static uECC_word_t regularize_k(const uECC_word_t *const k,
                                 uECC_word_t *k0,
                                 uECC_word_t *k1,
@@ -1291,37 +1558,19 @@ static void bits2int(uECC_word_t *native,
     }
 }
 
-static int uECC_sign_with_k(const uint8_t *private_key,
-                            const uint8_t *message_hash,
-                            unsigned hash_size,
-                            uECC_word_t *k,
-                            uint8_t *signature,
-                            uECC_Curve curve)
+/* Computes k = 1 / k (mod n) for a secret k. Returns 0 if k could not be blinded. */
+static int vli_modInv_n_secret(uECC_word_t *k, uECC_Curve curve)
 {
-
     uECC_word_t tmp[uECC_MAX_WORDS];
-    uECC_word_t s[uECC_MAX_WORDS];
-    uECC_word_t *k2[2] = {tmp, s};
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    uECC_word_t *p = (uECC_word_t *)signature;
-#else
-    uECC_word_t p[uECC_MAX_WORDS * 2];
-#endif
-    uECC_word_t carry;
-    wordcount_t num_words = curve->num_words;
     wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
-    bitcount_t num_n_bits = curve->num_n_bits;
 
-    /* Make sure 0 < k < curve_n */
-    if (uECC_vli_isZero(k, num_words) || uECC_vli_cmp(curve->n, k, num_n_words) != 1) {
-        return 0;
-    }
-
-    carry = regularize_k(k, tmp, s, curve);
-    EccPoint_mult(p, curve->G, k2[!carry], 0, num_n_bits + 1, curve);
-    if (uECC_vli_isZero(p, num_words)) {
-        return 0;
+#if uECC_SAFEGCD
+    if (curve->modinv_n) {
+        /* The safegcd inversion runs in constant time, so k needs no blinding. */
+        vli_modInv_safegcd(k, k, curve->modinv_n, num_n_words); /* k = 1 / k */
+        return 1;
     }
+#endif
 
     /* If an RNG function was specified, get a random number
        to prevent side channel analysis of k. */
@@ -1337,8 +1586,75 @@ static int uECC_sign_with_k(const uint8_t *private_key,
     uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k' = rand * k */
     uECC_vli_modInv(k, k, curve->n, num_n_words);       /* k = 1 / k' */
     uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k = 1 / k */
+    return 1;
+}
 
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
+/* Replaces each of the count values by its inverse mod p, or mod n if mod_n is set, with a
+   single inversion (Montgomery's trick). acc receives the running products
+   acc[i] = values[0] * ... * values[i]. None of the values may be zero. Returns 0 if the
+   inversion mod n could not be blinded. */
+static int vli_modInv_batch(uECC_word_t values[][uECC_MAX_WORDS],
+                            uECC_word_t acc[][uECC_MAX_WORDS],
+                            unsigned count,
+                            int mod_n,
+                            uECC_Curve curve)
+{
+    uECC_word_t inv[uECC_MAX_WORDS];
+    uECC_word_t t[uECC_MAX_WORDS];
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    unsigned i;
+
+    uECC_vli_set(acc[0], values[0], curve->num_words);
+    for (i = 1; i < count; ++i) {
+        if (mod_n) {
+            uECC_vli_modMult(acc[i], acc[i - 1], values[i], curve->n, num_n_words);
+        } else {
+            uECC_vli_modMult_fast(acc[i], acc[i - 1], values[i], curve);
+        }
+    }
+
+    uECC_vli_set(inv, acc[count - 1], curve->num_words);
+    if (mod_n) {
+        if (!vli_modInv_n_secret(inv, curve)) {
+            return 0;
+        }
+    } else {
+        vli_modInv_p(inv, inv, curve);
+    }
+
+    for (i = count - 1; i > 0; --i) {
+        if (mod_n) {
+            uECC_vli_modMult(t, inv, acc[i - 1], curve->n, num_n_words);     /* t = 1 / values[i] */
+            uECC_vli_modMult(inv, inv, values[i], curve->n, num_n_words);    /* inv = 1 / acc[i - 1] */
+        } else {
+            uECC_vli_modMult_fast(t, inv, acc[i - 1], curve);
+            uECC_vli_modMult_fast(inv, inv, values[i], curve);
+        }
+        uECC_vli_set(values[i], t, curve->num_words);
+    }
+    uECC_vli_set(values[0], inv, curve->num_words);
+    return 1;
+}
+
+/* Computes the signature from the affine point p = k * G and k_inv = 1 / k. */
+static int uECC_sign_finish(const uint8_t *private_key,
+                            const uint8_t *message_hash,
+                            unsigned hash_size,
+                            const uECC_word_t *p,
+                            const uECC_word_t *k_inv,
+                            uint8_t *signature,
+                            uECC_Curve curve)
+{
+    uECC_word_t tmp[uECC_MAX_WORDS];
+    uECC_word_t s[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    if ((const uint8_t *) p != signature) {
+        bcopy(signature, (const uint8_t *) p, curve->num_bytes); /* store r */
+    }
+#else
     uECC_vli_nativeToBytes(signature, curve->num_bytes, p); /* store r */
 #endif
 
@@ -1353,9 +1669,10 @@ static int uECC_sign_with_k(const uint8_t *private_key,
     uECC_vli_modMult(s, tmp, s, curve->n, num_n_words); /* s = r*d */
 
     bits2int(tmp, message_hash, hash_size, curve);
-    uECC_vli_modAdd(s, tmp, s, curve->n, num_n_words); /* s = e + r*d */
-    uECC_vli_modMult(s, s, k, curve->n, num_n_words);  /* s = (e + r*d) / k */
-    if (uECC_vli_numBits(s, num_n_words) > (bitcount_t)curve->num_bytes * 8) {
+    uECC_vli_modAdd(s, tmp, s, curve->n, num_n_words);   /* s = e + r*d */
+    uECC_vli_modMult(s, s, k_inv, curve->n, num_n_words); /* s = (e + r*d) / k */
+    if (uECC_vli_isZero(s, num_n_words) ||
+            uECC_vli_numBits(s, num_n_words) > (bitcount_t)curve->num_bytes * 8) {
         return 0;
     }
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
@@ -1366,6 +1683,46 @@ static int uECC_sign_with_k(const uint8_t *private_key,
     return 1;
 }
 
+static int uECC_sign_with_k(const uint8_t *private_key,
+                            const uint8_t *message_hash,
+                            unsigned hash_size,
+                            uECC_word_t *k,
+                            uint8_t *signature,
+                            uECC_Curve curve)
+{
+
+    uECC_word_t tmp[uECC_MAX_WORDS];
+    uECC_word_t s[uECC_MAX_WORDS];
+    uECC_word_t *k2[2] = {tmp, s};
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    uECC_word_t *p = (uECC_word_t *)signature;
+#else
+    uECC_word_t p[uECC_MAX_WORDS * 2];
+#endif
+    uECC_word_t carry;
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    bitcount_t num_n_bits = curve->num_n_bits;
+
+    /* Make sure 0 < k < curve_n */
+    if (uECC_vli_isZero(k, num_words) || uECC_vli_cmp(curve->n, k, num_n_words) != 1) {
+        return 0;
+    }
+
+    carry = regularize_k(k, tmp, s, curve);
+    EccPoint_mult(p, curve->G, k2[!carry], 0, num_n_bits + 1, curve);
+    uECC_vli_clear(tmp, num_words);
+    uECC_vli_clear(s, num_words);
+    if (uECC_vli_isZero(p, num_words)) {
+        return 0;
+    }
+
+    if (!vli_modInv_n_secret(k, curve)) {
+        return 0;
+    }
+    return uECC_sign_finish(private_key, message_hash, hash_size, p, k, signature, curve);
+}
+
 int uECC_sign(const uint8_t *private_key,
               const uint8_t *message_hash,
               unsigned hash_size,
@@ -1469,6 +1826,108 @@ int uECC_sign_deterministic(const uint8_t *private_key,
     return 0;
 }
 
+int uECC_sign_with_nonce(const uint8_t *private_key,
+                         const uint8_t *message_hash,
+                         unsigned hash_size,
+                         const uint8_t *nonce,
+                         uint8_t *signature,
+                         uECC_Curve curve)
+{
+    uECC_word_t k[uECC_MAX_WORDS];
+    int ret;
+
+    uECC_vli_bytesToNative(k, nonce, curve->num_bytes);
+    ret = uECC_sign_with_k(private_key, message_hash, hash_size, k, signature, curve);
+    uECC_vli_clear(k, curve->num_words);
+    return ret;
+}
+
+int uECC_sign_batch(const uint8_t *private_keys,
+                    const uint8_t *message_hashes,
+                    unsigned hash_size,
+                    const uint8_t *nonces,
+                    unsigned count,
+                    uint8_t *signatures,
+                    uint8_t *failed,
+                    uECC_Curve curve)
+{
+    uECC_word_t R[uECC_SIGN_BATCH_MAX][uECC_MAX_WORDS * 2];
+    uECC_word_t z_num[uECC_SIGN_BATCH_MAX][uECC_MAX_WORDS];
+    uECC_word_t z[uECC_SIGN_BATCH_MAX][uECC_MAX_WORDS];
+    uECC_word_t k[uECC_SIGN_BATCH_MAX][uECC_MAX_WORDS];
+    uECC_word_t acc[uECC_SIGN_BATCH_MAX][uECC_MAX_WORDS];
+    uECC_word_t tmp[uECC_MAX_WORDS];
+    uECC_word_t s[uECC_MAX_WORDS];
+    uECC_word_t *k2[2] = {tmp, s};
+    uECC_word_t carry;
+    uint8_t item[uECC_SIGN_BATCH_MAX];
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    bitcount_t num_n_bits = curve->num_n_bits;
+    unsigned key_size = BITS_TO_BYTES(curve->num_n_bits);
+    unsigned i, n = 0;
+    int ret = 0;
+
+    if (count == 0 || count > uECC_SIGN_BATCH_MAX) {
+        return 0;
+    }
+
+    /* R = k * G as in uECC_sign_with_nonce(), but with the z inversion left out. Items
+       with an unusable nonce are flagged and left out of the shared inversions. */
+    for (i = 0; i < count; ++i) {
+        failed[i] = 1;
+        uECC_vli_bytesToNative(k[n], nonces + i * curve->num_bytes, curve->num_bytes);
+
+        /* Make sure 0 < k < curve_n */
+        if (uECC_vli_isZero(k[n], num_words) || uECC_vli_cmp(curve->n, k[n], num_n_words) != 1) {
+            continue;
+        }
+
+        carry = regularize_k(k[n], tmp, s, curve);
+        EccPoint_mult_ladder(R[n], z_num[n], z[n], curve->G, k2[!carry], 0, num_n_bits + 1, curve);
+        if (uECC_vli_isZero(z[n], num_words)) {
+            continue; /* R is the point at infinity */
+        }
+        item[n++] = i;
+    }
+    if (n == 0) {
+        ret = 1;
+        goto cleanup;
+    }
+
+    /* One inversion mod p for all the R points, and one mod n for all the nonces. */
+    vli_modInv_batch(z, acc, n, 0, curve);
+    if (!vli_modInv_batch(k, acc, n, 1, curve)) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; ++i) {
+        uECC_vli_modMult_fast(z[i], z[i], z_num[i], curve);
+        apply_z(R[i], R[i] + num_words, z[i], curve);
+        if (uECC_vli_isZero(R[i], num_words)) {
+            continue;
+        }
+        if (uECC_sign_finish(private_keys + item[i] * key_size,
+                             message_hashes + item[i] * hash_size, hash_size, R[i], k[i],
+                             signatures + item[i] * curve->num_bytes * 2, curve)) {
+            failed[item[i]] = 0;
+        }
+    }
+    ret = 1;
+
+cleanup:
+    for (i = 0; i < uECC_SIGN_BATCH_MAX; ++i) {
+        uECC_vli_clear(R[i], num_words * 2);
+        uECC_vli_clear(z_num[i], num_words);
+        uECC_vli_clear(z[i], num_words);
+        uECC_vli_clear(k[i], num_words);
+        uECC_vli_clear(acc[i], num_words);
+    }
+    uECC_vli_clear(tmp, num_words);
+    uECC_vli_clear(s, num_words);
+    return ret;
+}
+
 int uECC_normalize_signature(uint8_t *signature,
                              uECC_Curve curve)
 {
@@ -1576,6 +2035,288 @@ static bitcount_t smax(bitcount_t a, bitcount_t b)
     return (a > b ? a : b);
 }
 
+#if (uECC_GLV_VERIFY && uECC_SUPPORTS_secp256k1)
+
+#if (uECC_GLV_WINDOW_G < 2 || uECC_GLV_WINDOW_G > 7)
+#error "uECC_GLV_WINDOW_G must be between 2 and 7"
+#endif
+#if (uECC_GLV_WINDOW_Q < 2 || uECC_GLV_WINDOW_Q > 6)
+#error "uECC_GLV_WINDOW_Q must be between 2 and 6"
+#endif
+
+#define GLV_TABLE_Q_SIZE (1 << (uECC_GLV_WINDOW_Q - 2))
+#define GLV_WNAF_BITS 129 /* The split scalars have at most 128 bits, plus one for the carry. */
+
+/* Add the affine point (x2, y2) to the Jacobian point (X1, Y1, Z1), where Z1 = 0 is the point
+   at infinity. The curve constant b is not used, so this also works on isomorphic curves. */
+static void glv_add_affine(uECC_word_t *X1,
+                           uECC_word_t *Y1,
+                           uECC_word_t *Z1,
+                           const uECC_word_t *x2,
+                           const uECC_word_t *y2,
+                           uECC_Curve curve)
+{
+    uECC_word_t t1[uECC_MAX_WORDS];
+    uECC_word_t t2[uECC_MAX_WORDS];
+    uECC_word_t t3[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+
+    if (uECC_vli_isZero(Z1, num_words)) {
+        uECC_vli_set(X1, x2, num_words);
+        uECC_vli_set(Y1, y2, num_words);
+        uECC_vli_clear(Z1, num_words);
+        Z1[0] = 1;
+        return;
+    }
+
+    uECC_vli_modSquare_fast(t1, Z1, curve);                /* t1 = z1^2 */
+    uECC_vli_modMult_fast(t2, t1, Z1, curve);              /* t2 = z1^3 */
+    uECC_vli_modMult_fast(t1, t1, x2, curve);              /* t1 = x2*z1^2 = U2 */
+    uECC_vli_modMult_fast(t2, t2, y2, curve);              /* t2 = y2*z1^3 = S2 */
+    uECC_vli_modSub(t1, t1, X1, curve->p, num_words);      /* t1 = U2 - x1 = H */
+    uECC_vli_modSub(t2, t2, Y1, curve->p, num_words);      /* t2 = S2 - y1 = R */
+
+    if (uECC_vli_isZero(t1, num_words)) {
+        if (uECC_vli_isZero(t2, num_words)) {
+            curve->double_jacobian(X1, Y1, Z1, curve);     /* P + P */
+        } else {
+            uECC_vli_clear(Z1, num_words);                 /* P + (-P) */
+        }
+        return;
+    }
+
+    uECC_vli_modMult_fast(Z1, Z1, t1, curve);              /* z3 = z1*H */
+    uECC_vli_modSquare_fast(t3, t1, curve);                /* t3 = H^2 */
+    uECC_vli_modMult_fast(t1, t1, t3, curve);              /* t1 = H^3 */
+    uECC_vli_modMult_fast(t3, t3, X1, curve);              /* t3 = x1*H^2 = V */
+    uECC_vli_modSquare_fast(X1, t2, curve);                /* x3 = R^2 */
+    uECC_vli_modSub(X1, X1, t1, curve->p, num_words);      /* x3 = R^2 - H^3 */
+    uECC_vli_modSub(X1, X1, t3, curve->p, num_words);
+    uECC_vli_modSub(X1, X1, t3, curve->p, num_words);      /* x3 = R^2 - H^3 - 2V */
+    uECC_vli_modSub(t3, t3, X1, curve->p, num_words);      /* t3 = V - x3 */
+    uECC_vli_modMult_fast(t3, t3, t2, curve);              /* t3 = R*(V - x3) */
+    uECC_vli_modMult_fast(t1, t1, Y1, curve);              /* t1 = y1*H^3 */
+    uECC_vli_modSub(Y1, t3, t1, curve->p, num_words);      /* y3 = R*(V - x3) - y1*H^3 */
+}
+
+/* Computes result = round((a * b) / 2^384). */
+static void glv_mul_shift_384(uECC_word_t *result,
+                              const uECC_word_t *a,
+                              const uECC_word_t *b,
+                              wordcount_t num_words)
+{
+    uECC_word_t product[2 * uECC_MAX_WORDS];
+    uECC_word_t round[uECC_MAX_WORDS];
+    wordcount_t shift = 384 / uECC_WORD_BITS;
+
+    uECC_vli_mult(product, a, b, num_words);
+    uECC_vli_clear(result, num_words);
+    uECC_vli_set(result, product + shift, 2 * num_words - shift);
+    uECC_vli_clear(round, num_words);
+    round[0] = !!uECC_vli_testBit(product, 383);
+    uECC_vli_add(result, result, round, num_words);
+}
+
+/* Splits k into k1 + k2 * lambda (mod n), where the absolute values of k1 and k2 have at most
+   128 bits. k1 and k2 are returned as absolute values; bit 0 of the return value is set if k1
+   is negative, bit 1 if k2 is negative. */
+static uECC_word_t glv_split(uECC_word_t *k1,
+                             uECC_word_t *k2,
+                             const uECC_word_t *k,
+                             uECC_Curve curve)
+{
+    uECC_word_t c1[uECC_MAX_WORDS];
+    uECC_word_t c2[uECC_MAX_WORDS];
+    uECC_word_t negative = 0;
+    wordcount_t num_words = curve->num_words;
+
+    glv_mul_shift_384(c1, k, glv_g1_secp256k1, num_words);
+    glv_mul_shift_384(c2, k, glv_g2_secp256k1, num_words);
+    uECC_vli_modMult(c1, c1, glv_minus_b1_secp256k1, curve->n, num_words);
+    uECC_vli_modMult(c2, c2, glv_minus_b2_secp256k1, curve->n, num_words);
+    uECC_vli_modAdd(k2, c1, c2, curve->n, num_words);  /* k2 = c1*(-b1) + c2*(-b2) */
+    uECC_vli_modMult(k1, k2, glv_lambda_secp256k1, curve->n, num_words);
+    uECC_vli_modSub(k1, k, k1, curve->n, num_words);   /* k1 = k - k2*lambda */
+
+    if (uECC_vli_cmp_unsafe(k1, curve->half_n, num_words) > 0) {
+        uECC_vli_sub(k1, curve->n, k1, num_words);
+        negative |= 1;
+    }
+    if (uECC_vli_cmp_unsafe(k2, curve->half_n, num_words) > 0) {
+        uECC_vli_sub(k2, curve->n, k2, num_words);
+        negative |= 2;
+    }
+    return negative;
+}
+
+/* Converts s (at most 128 bits) to width-w NAF: every nonzero digit is odd, smaller than 2^(w-1)
+   in absolute value, and followed by at least w - 1 zero digits.
+   Returns the number of digits. */
+static bitcount_t glv_wnaf(int8_t *wnaf, const uECC_word_t *s, int w)
+{
+    bitcount_t bit = 0;
+    bitcount_t length = 0;
+    int carry = 0;
+    int digit;
+    int i;
+
+    memset(wnaf, 0, GLV_WNAF_BITS);
+    while (bit < GLV_WNAF_BITS) {
+        if (!!uECC_vli_testBit(s, bit) == carry) {
+            ++bit;
+            continue;
+        }
+        digit = carry;
+        for (i = 0; i < w && bit + i < GLV_WNAF_BITS; ++i) {
+            digit += (!!uECC_vli_testBit(s, bit + i)) << i;
+        }
+        carry = (digit >> (w - 1)) & 1;
+        digit -= carry << w;
+        wnaf[bit] = (int8_t)digit;
+        bit += i;
+        length = bit;
+    }
+    return length;
+}
+
+/* Fills table with the odd multiples 1P, 3P, 5P, ... of point in affine coordinates, using a
+   single inversion. The multiples are computed on the isomorphic curve on which 2P has z = 1. */
+static void glv_odd_multiples(uECC_word_t table[][uECC_MAX_WORDS * 2],
+                              const uECC_word_t *point,
+                              uECC_Curve curve)
+{
+    uECC_word_t z[GLV_TABLE_Q_SIZE][uECC_MAX_WORDS];
+    uECC_word_t acc[GLV_TABLE_Q_SIZE][uECC_MAX_WORDS];
+    uECC_word_t dx[uECC_MAX_WORDS];
+    uECC_word_t dy[uECC_MAX_WORDS];
+    uECC_word_t dz[uECC_MAX_WORDS];
+    uECC_word_t t[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+    int i;
+
+    /* (dx, dy, dz) = 2P */
+    uECC_vli_set(dx, point, num_words);
+    uECC_vli_set(dy, point + num_words, num_words);
+    uECC_vli_clear(dz, num_words);
+    dz[0] = 1;
+    curve->double_jacobian(dx, dy, dz, curve);
+
+    /* On the isomorphic curve, 2P is (dx, dy) and P is (x * dz^2, y * dz^3). */
+    uECC_vli_set(table[0], point, num_words);
+    uECC_vli_set(table[0] + num_words, point + num_words, num_words);
+    apply_z(table[0], table[0] + num_words, dz, curve);
+    uECC_vli_clear(z[0], num_words);
+    z[0][0] = 1;
+    for (i = 1; i < GLV_TABLE_Q_SIZE; ++i) {
+        uECC_vli_set(table[i], table[i - 1], num_words * 2);
+        uECC_vli_set(z[i], z[i - 1], num_words);
+        glv_add_affine(table[i], table[i] + num_words, z[i], dx, dy, curve);
+    }
+
+    /* The z coordinates on the original curve are z[i] * dz. Invert all of them with a single
+       inversion (Montgomery's trick), using the running products acc[i] = z[0] * ... * z[i]. */
+    for (i = 0; i < GLV_TABLE_Q_SIZE; ++i) {
+        uECC_vli_modMult_fast(z[i], z[i], dz, curve);
+        if (i) {
+            uECC_vli_modMult_fast(acc[i], acc[i - 1], z[i], curve);
+        } else {
+            uECC_vli_set(acc[0], z[0], num_words);
+        }
+    }
+    vli_modInv_p(t, acc[GLV_TABLE_Q_SIZE - 1], curve);  /* t = 1 / acc[i] */
+    for (i = GLV_TABLE_Q_SIZE - 1; i > 0; --i) {
+        uECC_vli_modMult_fast(dx, t, acc[i - 1], curve);  /* dx = 1 / z[i] */
+        uECC_vli_modMult_fast(t, t, z[i], curve);         /* t = 1 / acc[i - 1] */
+        apply_z(table[i], table[i] + num_words, dx, curve);
+    }
+    apply_z(table[0], table[0] + num_words, t, curve);
+}
+
+/* Checks that the x coordinate of u1 * G + u2 * Q equals r (mod n), using the GLV endomorphism
+   and width-w NAFs. */
+static int glv_verify(const uECC_word_t *_public,
+                      const uECC_word_t *u1,
+                      const uECC_word_t *u2,
+                      const uECC_word_t *r,
+                      uECC_Curve curve)
+{
+    uECC_word_t table_Q[GLV_TABLE_Q_SIZE][uECC_MAX_WORDS * 2];
+    uECC_word_t beta_x_Q[GLV_TABLE_Q_SIZE][uECC_MAX_WORDS];
+    uECC_word_t k[4][uECC_MAX_WORDS];
+    int8_t wnaf[4][GLV_WNAF_BITS];
+    uECC_word_t rx[uECC_MAX_WORDS];
+    uECC_word_t ry[uECC_MAX_WORDS];
+    uECC_word_t z[uECC_MAX_WORDS];
+    uECC_word_t tx[uECC_MAX_WORDS];
+    uECC_word_t ty[uECC_MAX_WORDS];
+    const uECC_word_t *point;
+    const uECC_word_t *x;
+    const uECC_word_t *y;
+    uECC_word_t negative;
+    bitcount_t num_bits = 0;
+    bitcount_t i;
+    int j, digit, index;
+    wordcount_t num_words = curve->num_words;
+
+    /* u1 * G + u2 * Q = k0 * G + k1 * lambda(G) + k2 * Q + k3 * lambda(Q) */
+    negative = glv_split(k[0], k[1], u1, curve);
+    negative |= glv_split(k[2], k[3], u2, curve) << 2;
+    for (j = 0; j < 4; ++j) {
+        num_bits = smax(num_bits,
+                        glv_wnaf(wnaf[j], k[j], j < 2 ? uECC_GLV_WINDOW_G : uECC_GLV_WINDOW_Q));
+    }
+
+    glv_odd_multiples(table_Q, _public, curve);
+    for (j = 0; j < GLV_TABLE_Q_SIZE; ++j) {
+        uECC_vli_modMult_fast(beta_x_Q[j], table_Q[j], glv_beta_secp256k1, curve);
+    }
+
+    uECC_vli_clear(rx, num_words);
+    uECC_vli_clear(ry, num_words);
+    uECC_vli_clear(z, num_words); /* Start at infinity. */
+    for (i = num_bits - 1; i >= 0; --i) {
+        curve->double_jacobian(rx, ry, z, curve);
+        for (j = 0; j < 4; ++j) {
+            digit = wnaf[j][i];
+            if (!digit) {
+                continue;
+            }
+            index = (digit < 0 ? -digit : digit) >> 1;
+            point = j < 2 ? glv_table_G_secp256k1[index] : table_Q[index];
+            x = point;
+            y = point + num_words;
+            if (j == 1) {
+                uECC_vli_modMult_fast(tx, point, glv_beta_secp256k1, curve);
+                x = tx;
+            } else if (j == 3) {
+                x = beta_x_Q[index];
+            }
+            if ((digit < 0) != ((negative >> j) & 1)) {
+                uECC_vli_sub(ty, curve->p, y, num_words); /* -(x, y) = (x, p - y) */
+                y = ty;
+            }
+            glv_add_affine(rx, ry, z, x, y, curve);
+        }
+    }
+
+    if (uECC_vli_isZero(z, num_words)) {
+        return 0;
+    }
+    vli_modInv_p(z, z, curve);
+    uECC_vli_modSquare_fast(z, z, curve);
+    uECC_vli_modMult_fast(rx, rx, z, curve); /* x = X / Z^2 */
+
+    /* v = x1 (mod n) */
+    if (uECC_vli_cmp_unsafe(curve->n, rx, num_words) != 1) {
+        uECC_vli_sub(rx, rx, curve->n, num_words);
+    }
+
+    /* Accept only if v == r. */
+    return (int)(uECC_vli_equal(rx, r, num_words));
+}
+
+#endif /* (uECC_GLV_VERIFY && uECC_SUPPORTS_secp256k1) */
+
 int uECC_verify(const uint8_t *public_key,
                 const uint8_t *message_hash,
                 unsigned hash_size,
@@ -1630,12 +2371,18 @@ int uECC_verify(const uint8_t *public_key,
     }
 
     /* Calculate u1 and u2. */
-    uECC_vli_modInv(z, s, curve->n, num_n_words); /* z = 1/s */
+    vli_modInv_n(z, s, curve); /* z = 1/s */
     u1[num_n_words - 1] = 0;
     bits2int(u1, message_hash, hash_size, curve);
     uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
     uECC_vli_modMult(u2, r, z, curve->n, num_n_words); /* u2 = r/s */
 
+#if (uECC_GLV_VERIFY && uECC_SUPPORTS_secp256k1)
+    if (curve == &curve_secp256k1) {
+        return glv_verify(_public, u1, u2, r, curve);
+    }
+#endif
+
     /* Calculate sum = G + Q. */
     uECC_vli_set(sum, _public, num_words);
     uECC_vli_set(sum + num_words, _public + num_words, num_words);
@@ -1643,7 +2390,7 @@ int uECC_verify(const uint8_t *public_key,
     uECC_vli_set(ty, curve->G + num_words, num_words);
     uECC_vli_modSub(z, sum, tx, curve->p, num_words); /* z = x2 - x1 */
     XYcZ_add(tx, ty, sum, sum + num_words, curve);
-    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
+    vli_modInv_p(z, z, curve); /* z = 1/z */
     apply_z(sum, sum + num_words, z, curve);
 
     /* Use Shamir's trick to calculate u1*G + u2*Q */
@@ -1677,7 +2424,7 @@ int uECC_verify(const uint8_t *public_key,
         }
     }
 
-    uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
+    vli_modInv_p(z, z, curve); /* Z = 1/Z */
     apply_z(rx, ry, z, curve);
 
     /* v = x1 (mod n) */
@@ -1772,6 +2519,41 @@ void uECC_point_mult(uECC_word_t *result,
 
 #endif /* uECC_ENABLE_VLI_API */
 
+static void uECC_inverse_mod(uint8_t *result, const uint8_t *input, int mod_n,
+                             uECC_Curve curve)
+{
+    uECC_word_t _result[uECC_MAX_WORDS];
+    uECC_word_t _input[uECC_MAX_WORDS];
+    wordcount_t num_bytes = mod_n ? BITS_TO_BYTES(curve->num_n_bits) : curve->num_bytes;
+
+    uECC_vli_clear(_input, uECC_MAX_WORDS);
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    bcopy((uint8_t *) _input, input, num_bytes);
+#else
+    uECC_vli_bytesToNative(_input, input, num_bytes);
+#endif
+    if (mod_n) {
+        vli_modInv_n(_result, _input, curve);
+    } else {
+        vli_modInv_p(_result, _input, curve);
+    }
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    bcopy(result, (uint8_t *) _result, num_bytes);
+#else
+    uECC_vli_nativeToBytes(result, num_bytes, _result);
+#endif
+}
+
+void uECC_inverse_mod_p(uint8_t *result, const uint8_t *input, uECC_Curve curve)
+{
+    uECC_inverse_mod(result, input, 0, curve);
+}
+
+void uECC_inverse_mod_n(uint8_t *result, const uint8_t *input, uECC_Curve curve)
+{
+    uECC_inverse_mod(result, input, 1, curve);
+}
+
 void uECC_generate_private_key(uint8_t *private_child, const uint8_t *private_master,
                                const uint8_t *z, uECC_Curve curve)
 {
@@ -1811,3 +2593,41 @@ int uECC_isValid(uint8_t *private_key, uECC_Curve curve)
             uECC_vli_cmp(curve->n, _private, BITS_TO_WORDS(curve->num_n_bits)) == 1);
 }
 
+
+int uECC_tweak_public_key(uint8_t *public_key, const uint8_t *z, uECC_Curve curve)
+{
+    uECC_word_t _z[uECC_MAX_WORDS];
+    uECC_word_t point[uECC_MAX_WORDS * 2];
+    uECC_word_t tweak[uECC_MAX_WORDS * 2];
+    uECC_word_t dx[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+
+    uECC_vli_bytesToNative(_z, z, BITS_TO_BYTES(curve->num_n_bits));
+    uECC_vli_bytesToNative(point, public_key, curve->num_bytes);
+    uECC_vli_bytesToNative(point + num_words, public_key + curve->num_bytes,
+                           curve->num_bytes);
+
+    if (uECC_vli_isZero(_z, BITS_TO_WORDS(curve->num_n_bits)) ||
+            uECC_vli_cmp(curve->n, _z, BITS_TO_WORDS(curve->num_n_bits)) != 1) {
+        return 0;
+    }
+    if (!uECC_valid_point(point, curve) ||
+            !EccPoint_compute_public_key(tweak, _z, curve)) {
+        return 0;
+    }
+
+    /* Both points are affine, i.e. share Z = 1. The sum comes out with
+       Z = x2 - x1, which is 0 if the points are equal or opposite. */
+    uECC_vli_modSub(dx, tweak, point, curve->p, num_words);
+    if (uECC_vli_isZero(dx, num_words)) {
+        return 0;
+    }
+    XYcZ_add(point, point + num_words, tweak, tweak + num_words, curve);
+    vli_modInv_p(dx, dx, curve);
+    apply_z(tweak, tweak + num_words, dx, curve);
+
+    uECC_vli_nativeToBytes(public_key, curve->num_bytes, tweak);
+    uECC_vli_nativeToBytes(public_key + curve->num_bytes, curve->num_bytes,
+                           tweak + num_words);
+    return 1;
+}
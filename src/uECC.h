@@ -69,6 +69,46 @@ If enable another curve, must add `half_n` (half the order n) constant to curve-
 #define uECC_SUPPORTS_secp256k1 1
 #endif
 
+/* uECC_SAFEGCD_INVERSE - If enabled (defined as nonzero), modular inversions (mod p and mod n)
+use the constant-time "safegcd" divsteps algorithm of Bernstein and Yang instead of the binary
+extended Euclidean algorithm. The running time no longer depends on the value being inverted,
+and it is usually faster as well.
+The setting can be overridden per curve with uECC_SAFEGCD_INVERSE_<curve>; curves without
+precomputed constants (secp160r1, secp192r1, secp224r1) always use the Euclidean algorithm. */
+#ifndef uECC_SAFEGCD_INVERSE
+#define uECC_SAFEGCD_INVERSE 1
+#endif
+#ifndef uECC_SAFEGCD_INVERSE_secp256r1
+#define uECC_SAFEGCD_INVERSE_secp256r1 (uECC_SAFEGCD_INVERSE && uECC_SUPPORTS_secp256r1)
+#endif
+#ifndef uECC_SAFEGCD_INVERSE_secp256k1
+#define uECC_SAFEGCD_INVERSE_secp256k1 (uECC_SAFEGCD_INVERSE && uECC_SUPPORTS_secp256k1)
+#endif
+
+/* uECC_GLV_VERIFY - If enabled (defined as nonzero), uECC_verify() on secp256k1 splits both
+scalars in half with the GLV endomorphism and evaluates the four halves as width-w NAFs. This
+roughly halves the number of point doublings and additions.
+uECC_GLV_WINDOW_G sets the window for the generator; its table of 2^(w - 2) points (64 bytes
+each) is stored in flash. Valid values are 2 - 7.
+uECC_GLV_WINDOW_Q sets the window for the public key; its table of 2^(w - 2) points (96 bytes
+each, plus 64 bytes each while it is built) is computed on the stack. Valid values are 2 - 6. */
+#ifndef uECC_GLV_VERIFY
+#define uECC_GLV_VERIFY 1
+#endif
+#ifndef uECC_GLV_WINDOW_G
+#define uECC_GLV_WINDOW_G 6
+#endif
+#ifndef uECC_GLV_WINDOW_Q
+#define uECC_GLV_WINDOW_Q 4
+#endif
+
+/* uECC_SIGN_BATCH_MAX - The maximum number of signatures uECC_sign_batch()
+creates at once. Its working space is about 7 * uECC_MAX_WORDS words per signature, on the
+stack. */
+#ifndef uECC_SIGN_BATCH_MAX
+#define uECC_SIGN_BATCH_MAX 8
+#endif
+
 /* Specifies whether compressed point format is supported.
    Set to 0 to disable point compression/decompression functions. */
 #ifndef uECC_SUPPORT_COMPRESSED_POINT
@@ -365,6 +405,57 @@ int uECC_sign_deterministic(const uint8_t *private_key,
                             uint8_t *signature,
                             uECC_Curve curve);
 
+/* uECC_sign_with_nonce() function.
+Generate an ECDSA signature for a given hash value, using a nonce k chosen by the caller,
+for example with RFC 6979. The nonce must never be reused for another hash value.
+
+Inputs:
+    private_key  - Your private key.
+    message_hash - The hash of the message to sign.
+    hash_size    - The size of message_hash in bytes.
+    nonce        - The nonce k (curve->num_bytes, big endian), 0 < k < n.
+
+Outputs:
+    signature - Will be filled in with the signature value.
+
+Returns 1 if the signature generated successfully, 0 if an error occurred.
+*/
+int uECC_sign_with_nonce(const uint8_t *private_key,
+                         const uint8_t *message_hash,
+                         unsigned hash_size,
+                         const uint8_t *nonce,
+                         uint8_t *signature,
+                         uECC_Curve curve);
+
+/* uECC_sign_batch() function.
+Generate ECDSA signatures for several hash values. The signatures are identical to those
+from calling uECC_sign_with_nonce() for each hash value and nonce, but the batch shares one
+inversion mod p (for the R points) and one inversion mod n (for the nonces).
+An item whose nonce does not give a valid signature is left out of the shared inversions and
+flagged in failed; sign it again with the next nonce.
+
+Inputs:
+    private_keys   - count private keys, one after another.
+    message_hashes - count hash values of hash_size bytes each, one after another.
+    hash_size      - The size of each message hash in bytes.
+    nonces         - count nonces as for uECC_sign_with_nonce(), one after another.
+    count          - The number of signatures, at most uECC_SIGN_BATCH_MAX.
+
+Outputs:
+    signatures - Will be filled in with count signature values, one after another.
+    failed     - count flags, set to 1 for each item that was not signed.
+
+Returns 1 if the batch was processed, 0 if an error occurred.
+*/
+int uECC_sign_batch(const uint8_t *private_keys,
+                    const uint8_t *message_hashes,
+                    unsigned hash_size,
+                    const uint8_t *nonces,
+                    unsigned count,
+                    uint8_t *signatures,
+                    uint8_t *failed,
+                    uECC_Curve curve);
+
 /* uECC_normalize_signature() function.
 Convert a signature to a normalized lower-S form. Refer to
 https://github.com/bitcoin-core/secp256k1/blob/master/include/secp256k1.h for
@@ -411,6 +502,19 @@ int uECC_verify(const uint8_t *public_key,
                 const uint8_t *signature,
                 uECC_Curve curve);
 
+/* uECC_inverse_mod_p() and uECC_inverse_mod_n() functions.
+Compute result = (1 / input) mod p, or mod n, with the same inversion routine that is used
+internally when signing and verifying.
+
+Inputs:
+    input - The value to invert. Must be smaller than the modulus.
+
+Outputs:
+    result - Will be filled in with the inverse, or with 0 if input is 0. May overlap input.
+*/
+void uECC_inverse_mod_p(uint8_t *result, const uint8_t *input, uECC_Curve curve);
+void uECC_inverse_mod_n(uint8_t *result, const uint8_t *input, uECC_Curve curve);
+
 /* uECC_generate_private_key() function
 Get a child private key:
 child = (master + z) % order
@@ -428,6 +532,17 @@ Returns 1 if the private key is valid, 0 if it is invalid.
 int uECC_isValid(uint8_t *private_key,
                  uECC_Curve curve);
 
+/* uECC_tweak_public_key() function
+Get a child public key:
+public_key = public_key + z * G
+
+Returns 1 if the child key is valid, 0 if z is out of range, the public key is
+invalid or the result is the point at infinity.
+*/
+int uECC_tweak_public_key(uint8_t *public_key,
+                          const uint8_t *z,
+                          uECC_Curve curve);
+
 
 #ifdef __cplusplus
 } /* end of extern "C" */
@@ -36,6 +36,9 @@
 #include "usb.h"
 #include "u2f_device.h"
 #include "u2f/u2f_hid.h"
+#ifndef BOOTLOADER
+#include "wallet.h"
+#endif
 
 
 #define USB_QUEUE_NUM_PACKETS 128
@@ -181,7 +184,13 @@ void usb_set_feature(uint8_t *report)
 }
 
 
-void usb_suspend_action(void) {}
+void usb_suspend_action(void)
+{
+#ifndef BOOTLOADER
+    wallet_session_expire();
+    u2f_device_nonce_pool_clear();
+#endif
+}
 
 
 void usb_resume_action(void) {}
@@ -232,7 +241,12 @@ void usb_process(uint16_t framenumber)
     }
     cpt_sof = 0;
 
-    u2f_device_timeout();
+    if (usb_u2f_enabled) {
+        u2f_device_timeout();
+    }
+#ifndef BOOTLOADER
+    wallet_session_timeout(40);
+#endif
 
     (void)framenumber;
 }
@@ -241,9 +255,6 @@ void usb_process(uint16_t framenumber)
 void usb_sof_action(void)
 {
 #if !defined(BOOTLOADER) && !defined(TESTING)
-    if (!usb_u2f_enabled) {
-        return;
-    }
     usb_process(udd_get_frame_number());
 #endif
 }
@@ -225,3 +225,33 @@ int utils_varint_to_uint64(const char *vi, uint64_t *i)
 
     return len;
 }
+
+
+// CRC-32 (IEEE 802.3, as zlib and python's binascii.crc32). Bitwise to keep the
+// bootloader small.
+uint32_t utils_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    int bit;
+
+    while (len--) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+
+// Returns 1 if a and b are equal. Runs in time independent of the contents.
+int utils_secure_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
@@ -52,6 +52,8 @@ void utils_reverse_hex(char *h, int len);
 void utils_reverse_bin(uint8_t *b, int len);
 void utils_uint64_to_varint(char *vi, int *l, uint64_t i);
 int utils_varint_to_uint64(const char *vi, uint64_t *i);
+uint32_t utils_crc32(const uint8_t *data, size_t len);
+int utils_secure_equal(const uint8_t *a, const uint8_t *b, size_t len);
 
 
 #endif
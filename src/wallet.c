@@ -39,6 +39,9 @@
 #include "flags.h"
 #include "sha2.h"
 #include "ecc.h"
+#ifndef TESTING
+#include "mcu.h"
+#endif
 
 
 extern const uint8_t MEM_PAGE_ERASE[MEM_PAGE_LEN];
@@ -135,39 +138,16 @@ exit:
 }
 
 
-int wallet_generate_key(HDNode *node, const char *keypath, const uint8_t *privkeymaster,
-                        const uint8_t *chaincode)
+// Derives the path elements in kp (destroyed by strtok) from node, from its
+// public key only if public_only
+static int wallet_derive(HDNode *node, char *kp, int *has_prm, int public_only)
 {
     static char delim[] = "/";
     static char prime[] = "phH\'";
     static char digits[] = "0123456789";
     uint64_t idx = 0;
 
-    char *kp = strdup(keypath);
-    if (!kp) {
-        return DBB_ERROR_MEM;
-    }
-
-    if (strlens(keypath) < strlens("m/")) {
-        goto err;
-    }
-
-    if (kp[0] != 'm' || kp[1] != '/') {
-        goto err;
-    }
-
-    node->depth = 0;
-    node->child_num = 0;
-    node->fingerprint = 0;
-    memcpy(node->chain_code, chaincode, 32);
-    memcpy(node->private_key, privkeymaster, 32);
-    hdnode_fill_public_key(node);
-
-    char *pch = strtok(kp + 2, delim);
-    if (pch == NULL) {
-        goto err;
-    }
-    int has_prm = 0;
+    char *pch = strtok(kp, delim);
     while (pch != NULL) {
         size_t i = 0;
         int prm = 0;
@@ -175,33 +155,72 @@ int wallet_generate_key(HDNode *node, const char *keypath, const uint8_t *privke
         for ( ; i < pch_len; i++) {
             if (strchr(prime, pch[i])) {
                 if (i != pch_len - 1) {
-                    goto err;
+                    return DBB_ERROR;
                 }
                 prm = 1;
-                has_prm = 1;
+                *has_prm = 1;
             } else if (!strchr(digits, pch[i])) {
-                goto err;
+                return DBB_ERROR;
             }
         }
         if (prm && pch_len == 1) {
-            goto err;
+            return DBB_ERROR;
         }
         idx = strtoull(pch, NULL, 10);
         if (idx > UINT32_MAX) {
-            goto err;
+            return DBB_ERROR;
         }
 
         if (prm) {
-            if (hdnode_private_ckd_prime(node, idx) != DBB_OK) {
-                goto err;
+            if (public_only || hdnode_private_ckd_prime(node, idx) != DBB_OK) {
+                return DBB_ERROR;
+            }
+        } else if (public_only) {
+            if (hdnode_public_ckd(node, idx) != DBB_OK) {
+                return DBB_ERROR;
             }
         } else {
             if (hdnode_private_ckd(node, idx) != DBB_OK) {
-                goto err;
+                return DBB_ERROR;
             }
         }
         pch = strtok(NULL, delim);
     }
+    return DBB_OK;
+}
+
+
+int wallet_generate_key(HDNode *node, const char *keypath, const uint8_t *privkeymaster,
+                        const uint8_t *chaincode)
+{
+    int has_prm = 0;
+
+    char *kp = strdup(keypath);
+    if (!kp) {
+        return DBB_ERROR_MEM;
+    }
+
+    if (strlens(keypath) < strlens("m/")) {
+        goto err;
+    }
+
+    if (kp[0] != 'm' || kp[1] != '/') {
+        goto err;
+    }
+
+    node->depth = 0;
+    node->child_num = 0;
+    node->fingerprint = 0;
+    memcpy(node->chain_code, chaincode, 32);
+    memcpy(node->private_key, privkeymaster, 32);
+    hdnode_fill_public_key(node);
+
+    if (strspn(kp + 2, "/") == strlens(kp + 2)) {
+        goto err;
+    }
+    if (wallet_derive(node, kp + 2, &has_prm, 0) != DBB_OK) {
+        goto err;
+    }
     if (!has_prm) {
         goto err;
     }
@@ -214,6 +233,310 @@ err:
 }
 
 
+//
+//  Signing session
+//
+//  Opt-in (feature_set). Keeps the account node, i.e. the node at the last
+//  hardened level of the most recent keypath, so that following sign, xpub and
+//  checkpub commands only derive the non-hardened levels and do not read the
+//  master key from the EEPROM. Never holds the master key. Wiped by any other
+//  command, on errors, on USB suspend, and after WALLET_SESSION_TIMEOUT msec
+//  of inactivity.
+//
+//  The timeout and suspend run in the USB interrupt and only mark the session
+//  expired. The wipe itself happens in the main loop (wallet_session_idle())
+//  or before the next use, never while a command reads the session.
+//
+
+static struct {
+    HDNode node;
+    char keypath[WALLET_SESSION_KEYPATH_LEN];
+    uint8_t hidden;
+    volatile uint8_t valid;
+    volatile uint8_t expired;
+    volatile uint32_t idle_ms;
+} SESSION;
+
+
+int wallet_session_enabled(void)
+{
+    // Opt-in: the bit is set (disabled) in the erased EEPROM default
+    return !(memory_report_ext_flags() & MEM_EXT_MASK_SESSION);
+}
+
+
+int wallet_session_active(void)
+{
+    return SESSION.valid && !SESSION.expired;
+}
+
+
+void wallet_session_clear(void)
+{
+    SESSION.valid = 0;
+    utils_zero(&SESSION, sizeof(SESSION));
+}
+
+
+// Interrupt safe: marks the session to be wiped
+void wallet_session_expire(void)
+{
+    if (SESSION.valid) {
+        SESSION.expired = 1;
+    }
+}
+
+
+// Called periodically with the elapsed time, from the USB interrupt
+void wallet_session_timeout(uint32_t elapsed_ms)
+{
+    if (!SESSION.valid || SESSION.expired) {
+        return;
+    }
+    SESSION.idle_ms += elapsed_ms;
+    if (SESSION.idle_ms >= WALLET_SESSION_TIMEOUT) {
+        wallet_session_expire();
+    }
+}
+
+
+// Called from the main loop. Wipes an expired session.
+void wallet_session_idle(void)
+{
+    if (!SESSION.expired) {
+        return;
+    }
+#ifndef TESTING
+    irqflags_t irq = cpu_irq_save();
+#endif
+    wallet_session_clear();
+#ifndef TESTING
+    cpu_irq_restore(irq);
+#endif
+}
+
+
+static int wallet_session_seeded(void)
+{
+    if (SESSION.expired) {
+        wallet_session_clear();
+    }
+    if (SESSION.valid && SESSION.hidden == HIDDEN) {
+        return DBB_OK;
+    }
+    return wallet_seeded();
+}
+
+
+// Length of the keypath up to and including its last hardened level
+static size_t wallet_session_prefix_len(const char *keypath)
+{
+    size_t i, len = 0;
+    for (i = 0; keypath[i]; i++) {
+        if (strchr("phH\'", keypath[i])) {
+            len = i + 1;
+        }
+    }
+    return len;
+}
+
+
+// Same as wallet_generate_key() from the current master, using and updating the
+// session account node when the session is enabled.
+static int wallet_session_generate_key(HDNode *node, const char *keypath)
+{
+    int has_prm = 0;
+    size_t prefix_len;
+    char *kp;
+
+    if (!wallet_session_enabled()) {
+        return wallet_generate_key(node, keypath, wallet_get_master(), wallet_get_chaincode());
+    }
+
+    prefix_len = wallet_session_prefix_len(keypath);
+    if (!prefix_len || prefix_len >= WALLET_SESSION_KEYPATH_LEN) {
+        wallet_session_clear();
+        return wallet_generate_key(node, keypath, wallet_get_master(), wallet_get_chaincode());
+    }
+
+    if (SESSION.expired) {
+        wallet_session_clear();
+    }
+    memcpy(node, &SESSION.node, sizeof(HDNode));
+    if (!SESSION.valid || SESSION.hidden != HIDDEN ||
+            strlens(SESSION.keypath) != prefix_len ||
+            strncmp(SESSION.keypath, keypath, prefix_len)) {
+        // Miss: derive the account node from the master and keep it
+        wallet_session_clear();
+        kp = strdup(keypath);
+        if (!kp) {
+            return DBB_ERROR_MEM;
+        }
+        kp[prefix_len] = '\0';
+        if (wallet_generate_key(node, kp, wallet_get_master(),
+                                wallet_get_chaincode()) != DBB_OK) {
+            free(kp);
+            return DBB_ERROR;
+        }
+        memcpy(&SESSION.node, node, sizeof(HDNode));
+        snprintf(SESSION.keypath, sizeof(SESSION.keypath), "%s", kp);
+        SESSION.hidden = HIDDEN;
+        SESSION.valid = 1;
+        free(kp);
+    }
+    SESSION.idle_ms = 0;
+
+    // Remaining non-hardened levels
+    kp = strdup(keypath + prefix_len);
+    if (!kp) {
+        return DBB_ERROR_MEM;
+    }
+    if (kp[0] && kp[0] != '/') {
+        goto err;
+    }
+    if (wallet_derive(node, kp, &has_prm, 0) != DBB_OK || has_prm) {
+        goto err;
+    }
+    free(kp);
+    return DBB_OK;
+
+err:
+    free(kp);
+    return DBB_ERROR;
+}
+
+
+//
+//  Account xpub cache
+//
+//  Public account nodes, i.e. at the last hardened level of a keypath, kept in
+//  the EEPROM across power cycles (see memory_xpub_cache_get()). The xpub,
+//  checkpub and device ID of a keypath below a cached account node are derived
+//  from its public key, without reading the master key. The memory layer drops
+//  all entries whenever a master or hidden key is written.
+//
+//  Entry: hidden (1) | keypath (31) | depth (1) | fingerprint (4) |
+//         child_num (4) | chain_code (32) | public_key (33) | zero padding
+//
+
+#define WALLET_XPUB_CACHE_KEYPATH_LEN (MEM_XPUB_CACHE_ID_LEN - 1)
+
+
+static void wallet_xpub_cache_id(uint8_t *entry, const char *keypath, size_t prefix_len)
+{
+    memset(entry, 0, MEM_XPUB_CACHE_ENTRY_LEN);
+    entry[0] = HIDDEN ? 1 : 0;
+    memcpy(entry + 1, keypath, prefix_len);
+}
+
+
+static int wallet_xpub_cache_get(HDNode *node, const char *keypath, size_t prefix_len)
+{
+    uint8_t entry[MEM_XPUB_CACHE_ENTRY_LEN];
+    const uint8_t *p = entry + MEM_XPUB_CACHE_ID_LEN;
+
+    wallet_xpub_cache_id(entry, keypath, prefix_len);
+    if (memory_xpub_cache_get(entry) != DBB_OK) {
+        return DBB_ERROR;
+    }
+    memset(node, 0, sizeof(HDNode));
+    node->depth = p[0];
+    node->fingerprint = ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) |
+                        ((uint32_t)p[3] << 8) | p[4];
+    node->child_num = ((uint32_t)p[5] << 24) | ((uint32_t)p[6] << 16) |
+                      ((uint32_t)p[7] << 8) | p[8];
+    memcpy(node->chain_code, p + 9, 32);
+    memcpy(node->public_key, p + 41, 33);
+    return DBB_OK;
+}
+
+
+static void wallet_xpub_cache_put(const HDNode *node, const char *keypath,
+                                  size_t prefix_len)
+{
+    uint8_t entry[MEM_XPUB_CACHE_ENTRY_LEN];
+    uint8_t *p = entry + MEM_XPUB_CACHE_ID_LEN;
+
+    wallet_xpub_cache_id(entry, keypath, prefix_len);
+    p[0] = node->depth;
+    p[1] = node->fingerprint >> 24;
+    p[2] = node->fingerprint >> 16;
+    p[3] = node->fingerprint >> 8;
+    p[4] = node->fingerprint;
+    p[5] = node->child_num >> 24;
+    p[6] = node->child_num >> 16;
+    p[7] = node->child_num >> 8;
+    p[8] = node->child_num;
+    memcpy(p + 9, node->chain_code, 32);
+    memcpy(p + 41, node->public_key, 33);
+    memory_xpub_cache_put(entry);
+}
+
+
+// Node at keypath from the master key, through the signing session if use_session
+static int wallet_master_key(HDNode *node, const char *keypath, int use_session)
+{
+    if (use_session) {
+        if (wallet_session_seeded() != DBB_OK) {
+            return DBB_ERROR;
+        }
+        return wallet_session_generate_key(node, keypath);
+    }
+    if (wallet_seeded() != DBB_OK) {
+        return DBB_ERROR;
+    }
+    return wallet_generate_key(node, keypath, wallet_get_master(), wallet_get_chaincode());
+}
+
+
+// Public node at keypath (private key cleared). On a cache miss the account
+// node is derived from the master key and cached. Keypaths with an unmarked
+// hardened index below the account level are derived from the master key.
+static int wallet_public_key(HDNode *node, const char *keypath, int use_session)
+{
+    size_t prefix_len = wallet_session_prefix_len(keypath);
+    int has_prm = 0, ret = DBB_ERROR;
+    char *kp;
+
+    if (!prefix_len || prefix_len > WALLET_XPUB_CACHE_KEYPATH_LEN) {
+        goto master;
+    }
+
+    // An enabled signing session keeps the account node in RAM instead
+    if ((use_session && wallet_session_enabled()) ||
+            wallet_xpub_cache_get(node, keypath, prefix_len) != DBB_OK) {
+        kp = strdup(keypath);
+        if (!kp) {
+            return DBB_ERROR_MEM;
+        }
+        kp[prefix_len] = '\0';
+        ret = wallet_master_key(node, kp, use_session);
+        free(kp);
+        utils_zero(node->private_key, 32);
+        if (ret != DBB_OK) {
+            return ret;
+        }
+        wallet_xpub_cache_put(node, keypath, prefix_len);
+    }
+
+    // Remaining non-hardened levels
+    kp = strdup(keypath + prefix_len);
+    if (!kp) {
+        return DBB_ERROR_MEM;
+    }
+    ret = (kp[0] && kp[0] != '/') ? DBB_ERROR : wallet_derive(node, kp, &has_prm, 1);
+    free(kp);
+    if (ret == DBB_OK) {
+        return DBB_OK;
+    }
+
+master:
+    ret = wallet_master_key(node, keypath, use_session);
+    utils_zero(node->private_key, 32);
+    return ret;
+}
+
+
 int wallet_generate_node(const char *passphrase, const char *entropy, HDNode *node)
 {
     int ret;
@@ -243,11 +566,8 @@ int wallet_generate_node(const char *passphrase, const char *entropy, HDNode *no
 void wallet_report_xpub(const char *keypath, char *xpub)
 {
     HDNode node;
-    if (wallet_seeded() == DBB_OK) {
-        if (wallet_generate_key(&node, keypath, wallet_get_master(),
-                                wallet_get_chaincode()) == DBB_OK) {
-            hdnode_serialize_public(&node, xpub, 112);
-        }
+    if (wallet_public_key(&node, keypath, 1) == DBB_OK) {
+        hdnode_serialize_public(&node, xpub, 112);
     }
     utils_zero(&node, sizeof(HDNode));
 }
@@ -257,7 +577,12 @@ void wallet_report_id(char *id)
 {
     uint8_t h[32];
     char xpub[112] = {0};
-    wallet_report_xpub("m/151'/144'", xpub);// ascii 'i' / 'd'
+    HDNode node;
+    // Not through the signing session, which is reserved for sign/xpub commands
+    if (wallet_public_key(&node, "m/151'/144'", 0) == DBB_OK) {// ascii 'i' / 'd'
+        hdnode_serialize_public(&node, xpub, 112);
+    }
+    utils_zero(&node, sizeof(HDNode));
     if (xpub[0]) {
         sha256_Raw((uint8_t *)xpub, 112, h);
         sha256_Raw(h, 32, h);
@@ -266,85 +591,220 @@ void wallet_report_id(char *id)
 }
 
 
-int wallet_check_pubkey(const char *pubkey, const char *keypath)
+// Decodes a 33-byte pubkey given in lowercase hex, as reported by the device
+static int wallet_pubkey_from_hex(const char *hex, uint8_t *pub_key)
 {
-    uint8_t pub_key[33];
-    HDNode node;
+    static const char digits[] = "0123456789abcdef";
+    const char *c;
+    int i;
+
+    for (i = 0; i < 2 * 33; i++) {
+        c = strchr(digits, hex[i]);
+        if (!c || !*c) {
+            return DBB_ERROR;
+        }
+        if (i % 2) {
+            pub_key[i / 2] |= c - digits;
+        } else {
+            pub_key[i / 2] = (c - digits) << 4;
+        }
+    }
+    return DBB_OK;
+}
 
-    if (strlens(pubkey) != 66) {
-        commander_clear_report();
-        commander_fill_report(cmd_str(CMD_checkpub), NULL, DBB_ERR_SIGN_PUBKEY_LEN);
-        goto err;
+
+// Length of the parent path of a keypath ending in a non-hardened level below a
+// hardened one, with the last index in child. 0 if the keypath has another form.
+static size_t wallet_parent_len(const char *keypath, uint32_t *child)
+{
+    const char *leaf = strrchr(keypath, '/');
+    uint64_t idx;
+
+    if (!leaf || !leaf[1] || strspn(leaf + 1, "0123456789") != strlens(leaf + 1)) {
+        return 0;
+    }
+    if (wallet_session_prefix_len(keypath) == 0) {
+        return 0;
     }
+    idx = strtoull(leaf + 1, NULL, 10);
+    if (idx >= 0x80000000) {
+        return 0;// Hardened, not derivable from the parent public key
+    }
+    *child = idx;
+    return leaf - keypath;
+}
 
-    if (wallet_seeded() != DBB_OK) {
+
+// Checks count (at most COMMANDER_CHECKPUB_MAX) pubkeys against the keys at the
+// matching keypaths, and sets present[i] to DBB_KEY_PRESENT or DBB_KEY_ABSENT.
+// Keypaths are grouped by parent so that each parent is derived once, e.g. once
+// for all change outputs, children are derived from the parent public key, and
+// pubkeys are compared in binary.
+int wallet_check_pubkeys(const char **pubkeys, const char **keypaths, uint16_t count,
+                         uint8_t *present)
+{
+    uint8_t pub_keys[COMMANDER_CHECKPUB_MAX][33];
+    uint8_t decoded[COMMANDER_CHECKPUB_MAX];
+    uint16_t order[COMMANDER_CHECKPUB_MAX];
+    size_t parent_len[COMMANDER_CHECKPUB_MAX];
+    uint32_t child[COMMANDER_CHECKPUB_MAX];
+    uint16_t i, j, parent = COMMANDER_CHECKPUB_MAX;
+    int ret = DBB_ERROR;
+    HDNode node, parent_node;
+    char *kp;
+
+    memset(&node, 0, sizeof(HDNode));
+    memset(&parent_node, 0, sizeof(HDNode));
+
+    if (count == 0 || count > COMMANDER_CHECKPUB_MAX) {
         commander_clear_report();
-        commander_fill_report(cmd_str(CMD_checkpub), NULL, DBB_ERR_KEY_MASTER);
+        commander_fill_report(cmd_str(CMD_checkpub), NULL, DBB_ERR_IO_INVALID_CMD);
         goto err;
     }
 
-    if (wallet_generate_key(&node, keypath, wallet_get_master(),
-                            wallet_get_chaincode()) != DBB_OK) {
-        commander_clear_report();
-        commander_fill_report(cmd_str(CMD_checkpub), NULL, DBB_ERR_KEY_CHILD);
-        goto err;
+    for (i = 0; i < count; i++) {
+        if (strlens(pubkeys[i]) != 66) {
+            commander_clear_report();
+            commander_fill_report(cmd_str(CMD_checkpub), NULL, DBB_ERR_SIGN_PUBKEY_LEN);
+            goto err;
+        }
+        // Anything else than lowercase hex cannot match
+        decoded[i] = wallet_pubkey_from_hex(pubkeys[i], pub_keys[i]) == DBB_OK;
     }
 
-    bitcoin_ecc.ecc_get_public_key33(node.private_key, pub_key, ECC_SECP256k1);
+    // Sort by parent path, so that equal parents are adjacent
+    for (i = 0; i < count; i++) {
+        parent_len[i] = wallet_parent_len(keypaths[i], &child[i]);
+        for (j = i; j > 0; j--) {
+            uint16_t a = order[j - 1];
+            size_t len = parent_len[a] < parent_len[i] ? parent_len[a] : parent_len[i];
+            int cmp = strncmp(keypaths[a], keypaths[i], len);
+            if (cmp < 0 || (cmp == 0 && parent_len[a] <= parent_len[i])) {
+                break;
+            }
+            order[j] = a;
+        }
+        order[j] = i;
+    }
 
-    utils_zero(&node, sizeof(HDNode));
-    if (!STREQ(pubkey, utils_uint8_to_hex(pub_key, 33))) {
-        return DBB_KEY_ABSENT;
-    } else {
-        return DBB_KEY_PRESENT;
+    for (j = 0; j < count; j++) {
+        i = order[j];
+        if (!parent_len[i]) {
+            ret = wallet_public_key(&node, keypaths[i], 1);
+        } else {
+            if (parent == COMMANDER_CHECKPUB_MAX || parent_len[parent] != parent_len[i] ||
+                    strncmp(keypaths[parent], keypaths[i], parent_len[i])) {
+                parent = COMMANDER_CHECKPUB_MAX;
+                kp = strdup(keypaths[i]);
+                if (!kp) {
+                    ret = DBB_ERROR_MEM;
+                    goto err;
+                }
+                kp[parent_len[i]] = '\0';
+                ret = wallet_public_key(&parent_node, kp, 1);
+                free(kp);
+                if (ret == DBB_OK) {
+                    parent = i;
+                }
+            }
+            memcpy(&node, &parent_node, sizeof(HDNode));
+            if (ret == DBB_OK) {
+                ret = hdnode_public_ckd(&node, child[i]);
+            }
+        }
+        if (ret != DBB_OK) {
+            commander_clear_report();
+            commander_fill_report(cmd_str(CMD_checkpub), NULL,
+                                  wallet_session_seeded() != DBB_OK ? DBB_ERR_KEY_MASTER :
+                                  DBB_ERR_KEY_CHILD);
+            ret = DBB_ERROR;
+            goto err;
+        }
+        present[i] = (decoded[i] && utils_secure_equal(node.public_key, pub_keys[i], 33)) ?
+                     DBB_KEY_PRESENT : DBB_KEY_ABSENT;
     }
+    ret = DBB_OK;
 
 err:
     utils_zero(&node, sizeof(HDNode));
-    return DBB_ERROR;
+    utils_zero(&parent_node, sizeof(HDNode));
+    return ret;
 }
 
 
-int wallet_sign(const char *message, const char *keypath)
+// Kept off the stack: a full batch is about 2 kB
+static struct {
+    uint8_t data[COMMANDER_SIGN_BATCH_MAX][32];
+    uint8_t private_keys[COMMANDER_SIGN_BATCH_MAX][32];
+    uint8_t sigs[COMMANDER_SIGN_BATCH_MAX][64];
+    uint8_t recids[COMMANDER_SIGN_BATCH_MAX];
+} SIGN_BATCH;
+
+
+// Signs count (at most COMMANDER_SIGN_BATCH_MAX) hashes as one batch, sharing the
+// nonce inversions, and appends the signatures to the signature array in order.
+int wallet_sign(const char **messages, const char **keypaths, uint16_t count)
 {
-    uint8_t data[32];
-    uint8_t sig[64];
-    uint8_t recid = 0xEE;// Set default value to give an error when trying to recover
+    uint8_t (*data)[32] = SIGN_BATCH.data;
+    uint8_t (*private_keys)[32] = SIGN_BATCH.private_keys;
+    uint8_t (*sigs)[64] = SIGN_BATCH.sigs;
+    uint8_t *recids = SIGN_BATCH.recids;
+    uint16_t i;
+    int ret = DBB_ERROR;
     HDNode node;
 
-    if (strlens(message) != (32 * 2)) {
+    memset(&node, 0, sizeof(HDNode));
+    // Set default value to give an error when trying to recover
+    memset(recids, 0xEE, sizeof(SIGN_BATCH.recids));
+
+    if (count == 0 || count > COMMANDER_SIGN_BATCH_MAX) {
         commander_clear_report();
-        commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_SIGN_HASH_LEN);
+        commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_IO_INVALID_CMD);
         goto err;
     }
 
-    if (wallet_seeded() != DBB_OK) {
-        commander_clear_report();
-        commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_KEY_MASTER);
-        goto err;
+    for (i = 0; i < count; i++) {
+        if (strlens(messages[i]) != (32 * 2)) {
+            commander_clear_report();
+            commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_SIGN_HASH_LEN);
+            goto err;
+        }
     }
 
-    if (wallet_generate_key(&node, keypath, wallet_get_master(),
-                            wallet_get_chaincode()) != DBB_OK) {
+    if (wallet_session_seeded() != DBB_OK) {
         commander_clear_report();
-        commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_KEY_CHILD);
+        commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_KEY_MASTER);
         goto err;
     }
 
-    memcpy(data, utils_hex_to_uint8(message), 32);
+    for (i = 0; i < count; i++) {
+        if (wallet_session_generate_key(&node, keypaths[i]) != DBB_OK) {
+            commander_clear_report();
+            commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_KEY_CHILD);
+            goto err;
+        }
+        memcpy(private_keys[i], node.private_key, 32);
+        memcpy(data[i], utils_hex_to_uint8(messages[i]), 32);
+    }
 
-    if (bitcoin_ecc.ecc_sign_digest(node.private_key, data, sig, &recid, ECC_SECP256k1)) {
+    if (bitcoin_ecc.ecc_sign_digests_batch(private_keys[0], data[0], sigs[0], recids, count,
+                                           ECC_SECP256k1)) {
         commander_clear_report();
         commander_fill_report(cmd_str(CMD_sign), NULL, DBB_ERR_SIGN_ECCLIB);
         goto err;
     }
 
-    utils_zero(&node, sizeof(HDNode));
-    return commander_fill_signature_array(sig, recid);
+    for (i = 0; i < count; i++) {
+        ret = commander_fill_signature_array(sigs[i], recids[i]);
+        if (ret != DBB_OK) {
+            break;
+        }
+    }
 
 err:
     utils_zero(&node, sizeof(HDNode));
-    return DBB_ERROR;
+    utils_zero(&SIGN_BATCH, sizeof(SIGN_BATCH));
+    return ret;
 }
 
 
@@ -43,13 +43,22 @@ int wallet_split_seed(char **seed_words, const char *message);
 int wallet_seeded(void);
 int wallet_erased(void);
 int wallet_create(const char *passphrase, const char *entropy_in);
-int wallet_check_pubkey(const char *pubkey, const char *keypath);
-int wallet_sign(const char *message, const char *keypath);
+int wallet_check_pubkeys(const char **pubkeys, const char **keypaths, uint16_t count,
+                         uint8_t *present);
+int wallet_sign(const char **messages, const char **keypaths, uint16_t count);
 void wallet_report_xpub(const char *keypath, char *xpub);
 void wallet_report_id(char *id);
 int wallet_generate_key(HDNode *node, const char *keypath, const uint8_t *privkeymaster,
                         const uint8_t *chaincode);
 
+/* Signing session */
+int wallet_session_enabled(void);
+int wallet_session_active(void);
+void wallet_session_clear(void);
+void wallet_session_expire(void);
+void wallet_session_timeout(uint32_t elapsed_ms);
+void wallet_session_idle(void);
+
 /* BIP39 */
 int wallet_generate_node(const char *passphrase, const char *entropy, HDNode *node);
 
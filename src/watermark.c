@@ -0,0 +1,358 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "watermark.h"
+#include "flags.h"
+#include "utils.h"
+
+
+static uint16_t stack_peaks[CMD_NUM];
+static uint16_t heap_peaks[CMD_NUM];
+static uint32_t stack_max = 0;
+static uint32_t heap_max = 0;
+
+
+//
+//  Stack
+//
+#ifdef TESTING
+// Called on entry of every function compiled with -finstrument-functions
+void __cyg_profile_func_enter(void *fn, void *site) __attribute__((no_instrument_function));
+void __cyg_profile_func_exit(void *fn, void *site) __attribute__((no_instrument_function));
+
+static uintptr_t stack_base = 0;
+static uintptr_t stack_low = 0;// zero outside of commands: nothing is tracked
+
+
+void __cyg_profile_func_enter(void *fn, void *site)
+{
+    void *frame = __builtin_frame_address(0);
+    (void) fn;
+    (void) site;
+    if ((uintptr_t)frame < stack_low) {
+        stack_low = (uintptr_t)frame;
+    }
+}
+
+
+void __cyg_profile_func_exit(void *fn, void *site)
+{
+    (void) fn;
+    (void) site;
+}
+
+
+static void __attribute__((noinline)) watermark_stack_paint(void)
+{
+    void *frame = __builtin_frame_address(0);
+    stack_base = (uintptr_t)frame;
+    stack_low = stack_base;
+}
+
+
+// Depth below the caller of watermark_begin()
+static uint32_t watermark_stack_scan(void)
+{
+    uint32_t depth = stack_low ? stack_base - stack_low : 0;
+    stack_low = 0;
+    return depth;
+}
+#else
+#define WATERMARK_PATTERN  0xC5C5C5C5
+#define WATERMARK_MARGIN   16// words left unpainted below the current frame
+
+// Stack region from the linker script
+extern uint32_t _sstack;
+extern uint32_t _estack;
+
+
+static void __attribute__((noinline)) watermark_stack_paint(void)
+{
+    volatile uint32_t here = 0;
+    volatile uint32_t *p = &_sstack;
+    volatile uint32_t *end = &here - WATERMARK_MARGIN;
+    while (p < end) {
+        *p++ = WATERMARK_PATTERN;
+    }
+}
+
+
+// Depth from the top of the stack, including main() and interrupt frames
+static uint32_t watermark_stack_scan(void)
+{
+    const volatile uint32_t *p = &_sstack;
+    while (p < &_estack && *p == WATERMARK_PATTERN) {
+        p++;
+    }
+    return (uint32_t)((uintptr_t)&_estack - (uintptr_t)p);
+}
+#endif
+
+
+//
+//  Heap
+//
+#ifdef WATERMARK_HEAP
+#include <malloc.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void __wrap_free(void *ptr);
+char *__wrap_strdup(const char *s);
+
+static size_t heap_in_use = 0;
+static size_t heap_peak = 0;
+static size_t heap_cmd_base = 0;
+static size_t heap_cmd_peak = 0;
+
+
+static void heap_add(void *ptr)
+{
+    if (ptr) {
+        heap_in_use += malloc_usable_size(ptr);
+        heap_peak = MAX(heap_peak, heap_in_use);
+        heap_cmd_peak = MAX(heap_cmd_peak, heap_in_use);
+    }
+}
+
+
+static void heap_remove(void *ptr)
+{
+    if (ptr) {
+        // Blocks allocated inside libc are not tracked
+        size_t size = malloc_usable_size(ptr);
+        heap_in_use = size < heap_in_use ? heap_in_use - size : 0;
+    }
+}
+
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __real_calloc(nmemb, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr) {
+        heap_in_use = old_size < heap_in_use ? heap_in_use - old_size : 0;
+        heap_add(new_ptr);
+    }
+    return new_ptr;
+}
+
+
+void __wrap_free(void *ptr)
+{
+    heap_remove(ptr);
+    __real_free(ptr);
+}
+
+
+char *__wrap_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *d = __wrap_malloc(len);
+    if (d) {
+        memcpy(d, s, len);
+    }
+    return d;
+}
+
+
+void watermark_heap_reset(void)
+{
+    heap_peak = heap_in_use;
+}
+
+
+size_t watermark_heap_in_use(void)
+{
+    return heap_in_use;
+}
+
+
+size_t watermark_heap_window_peak(void)
+{
+    return heap_peak;
+}
+
+
+static void watermark_heap_begin(void)
+{
+    heap_cmd_base = heap_in_use;
+    heap_cmd_peak = heap_in_use;
+}
+
+
+static uint32_t watermark_heap_end(void)
+{
+    return heap_cmd_peak - heap_cmd_base;
+}
+#else
+void watermark_heap_reset(void)
+{
+}
+
+
+size_t watermark_heap_in_use(void)
+{
+    return 0;
+}
+
+
+size_t watermark_heap_window_peak(void)
+{
+    return 0;
+}
+
+
+static void watermark_heap_begin(void)
+{
+}
+
+
+static uint32_t watermark_heap_end(void)
+{
+    return 0;
+}
+#endif
+
+
+//
+//  Per-command peaks
+//
+void watermark_init(void)
+{
+    memset(stack_peaks, 0, sizeof(stack_peaks));
+    memset(heap_peaks, 0, sizeof(heap_peaks));
+    stack_max = 0;
+    heap_max = 0;
+    watermark_stack_paint();
+}
+
+
+void watermark_begin(void)
+{
+#ifndef TESTING
+    // Usage since the last command, e.g. by interrupts
+    stack_max = MAX(stack_max, watermark_stack_scan());
+#endif
+    watermark_stack_paint();
+    watermark_heap_begin();
+}
+
+
+void watermark_end(int cmd)
+{
+    uint32_t stack = watermark_stack_scan();
+    uint32_t heap = watermark_heap_end();
+
+    if (cmd < 0 || cmd >= CMD_NUM) {
+        cmd = CMD_input;
+    }
+    stack_peaks[cmd] = MAX(stack_peaks[cmd], MIN(stack, UINT16_MAX));
+    heap_peaks[cmd] = MAX(heap_peaks[cmd], MIN(heap, UINT16_MAX));
+    stack_max = MAX(stack_max, stack);
+    heap_max = MAX(heap_max, heap);
+}
+
+
+uint32_t watermark_stack_peak(int cmd)
+{
+    return (cmd >= 0 && cmd < CMD_NUM) ? stack_peaks[cmd] : 0;
+}
+
+
+uint32_t watermark_heap_peak(int cmd)
+{
+    return (cmd >= 0 && cmd < CMD_NUM) ? heap_peaks[cmd] : 0;
+}
+
+
+uint32_t watermark_stack_max(void)
+{
+    return stack_max;
+}
+
+
+uint32_t watermark_heap_max(void)
+{
+    return heap_max;
+}
+
+
+// JSON object with the overall peaks and [stack, heap] for each command
+// run since boot. Commands that do not fit in buf are left out.
+int watermark_report(char *buf, size_t len)
+{
+    int cmd, n, ret = DBB_OK;
+    size_t used;
+
+    n = snprintf(buf, len, "{\"%s\":%u,\"%s\":%u",
+                 attr_str(ATTR_stack), (unsigned)stack_max,
+                 attr_str(ATTR_heap), (unsigned)heap_max);
+    if (n < 0 || (size_t)n + 2 > len) {
+        return DBB_ERROR;
+    }
+    used = n;
+
+    for (cmd = 0; cmd < CMD_NUM; cmd++) {
+        if (!stack_peaks[cmd] && !heap_peaks[cmd]) {
+            continue;
+        }
+        n = snprintf(buf + used, len - used, ",\"%s\":[%u,%u]", cmd_str(cmd),
+                     (unsigned)stack_peaks[cmd], (unsigned)heap_peaks[cmd]);
+        if (n < 0 || used + n + 2 > len) {
+            ret = DBB_ERROR;
+            break;
+        }
+        used += n;
+    }
+    snprintf(buf + used, len - used, "}");
+    return ret;
+}
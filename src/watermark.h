@@ -0,0 +1,62 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Stack and heap high-water marks, recorded per command.
+//
+// Device: the free stack is painted with a pattern at boot and before each
+// command; the first overwritten word found afterwards marks the peak.
+// Host test build: the bitbox_watermark library is compiled with
+// -finstrument-functions and the lowest frame address seen on function entry
+// during a command marks the peak. The host peak therefore misses stack taken
+// after a function's entry hook, i.e. VLAs and alloca(), and stack used by
+// uninstrumented code such as libc. The painted device stack has no such gap.
+// Heap: the allocator is wrapped with the linker's --wrap option when
+// WATERMARK_HEAP is defined (see CMakeLists.txt).
+
+
+#ifndef _WATERMARK_H_
+#define _WATERMARK_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+void watermark_init(void);
+void watermark_begin(void);
+void watermark_end(int cmd);
+uint32_t watermark_stack_peak(int cmd);
+uint32_t watermark_heap_peak(int cmd);
+uint32_t watermark_stack_max(void);
+uint32_t watermark_heap_max(void);
+int watermark_report(char *buf, size_t len);
+void watermark_heap_reset(void);
+size_t watermark_heap_in_use(void);
+size_t watermark_heap_window_peak(void);
+
+
+#endif
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "sd.h"
 #include "ecc.h"
@@ -37,6 +38,11 @@
 #include "flags.h"
 #include "random.h"
 #include "commander.h"
+#include "wallet.h"
+#include "watermark.h"
+#include "sham.h"
+#include "power.h"
+#include "version.h"
 #include "yajl/src/api/yajl_tree.h"
 #include "secp256k1/include/secp256k1.h"
 #include "secp256k1/include/secp256k1_recovery.h"
@@ -44,6 +50,9 @@
 #include "api.h"
 
 
+extern const uint8_t MEM_PAGE_ERASE[MEM_PAGE_LEN];
+extern const uint8_t MEM_PAGE_ERASE_FE[MEM_PAGE_LEN];
+
 int U_TESTS_RUN = 0;
 int U_TESTS_FAIL = 0;
 
@@ -564,6 +573,13 @@ static void tests_u2f(void)
     api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F\":\"true\"}", KEY_STANDARD);
     ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
 
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F_precompute\":\"true\"}",
+                        KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F_precompute\":false}", KEY_STANDARD);
+    ASSERT_SUCCESS;
+
 
     //
     // U2F counter updating tested in tests_u2f_standard.c
@@ -1807,6 +1823,116 @@ static void tests_password(void)
 }
 
 
+static void api_u2fhid_status(U2FHID_STATUS_RESP *status)
+{
+    uint32_t cid = 7;
+    int len;
+
+    memset(status, 0, sizeof(U2FHID_STATUS_RESP));
+    api_hid_send_frames(cid, U2FHID_STATUS, NULL, 0);
+    len = api_hid_read_frames(cid, U2FHID_STATUS, status, sizeof(U2FHID_STATUS_RESP));
+    u_assert_int_eq(len, U2FHID_STATUS_RESP_SIZE);
+    u_assert_int_eq(status->versionRecord, U2FHID_STATUS_VERSION);
+    u_assert_int_eq(status->versionMajor, DIGITAL_BITBOX_VERSION_MAJOR);
+    u_assert_int_eq(status->versionMinor, DIGITAL_BITBOX_VERSION_MINOR);
+    u_assert_int_eq(status->versionBuild, DIGITAL_BITBOX_VERSION_PATCH);
+}
+
+
+static void tests_u2fhid_status(void)
+{
+    U2FHID_STATUS_RESP status;
+    uint8_t payload[4] = {0};
+    int i, n = 200;
+    int test_u2fauth_hijack = TEST_U2FAUTH_HIJACK;
+
+    api_reset_device();
+    api_u2fhid_status(&status);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_ERASED, U2FHID_STATUS_FLAG_ERASED);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_SETUP, U2FHID_STATUS_FLAG_SETUP);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_SEEDED, 0);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_LOCKED, 0);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_U2F, U2FHID_STATUS_FLAG_U2F);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_UNKNOWN, U2FHID_STATUS_FLAG_UNKNOWN);
+
+    // Payload not allowed
+    api_hid_send_frames(7, U2FHID_STATUS, payload, sizeof(payload));
+    u_assert_int_eq(api_hid_read_frames(7, U2FHID_STATUS, &status, sizeof(status)),
+                    -U2FHID_ERR_INVALID_LEN);
+
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\", \"filename\":\"status.pdf\", \"key\":\"password\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_u2fhid_status(&status);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_ERASED, 0);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_SEEDED, 0);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_UNKNOWN, U2FHID_STATUS_FLAG_UNKNOWN);
+
+    // A cold cache is reported as unknown, without loading the seed or using the heap
+    if (!TEST_LIVE_DEVICE) {
+        size_t heap_base;
+        memory_clear_test();
+        heap_base = watermark_heap_in_use();
+        watermark_heap_reset();
+        api_u2fhid_status(&status);
+        u_assert_int_eq(watermark_heap_window_peak() - heap_base, 0);
+        u_assert_int_eq(memory_master_hww_erased(), 1);
+        u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_UNKNOWN, U2FHID_STATUS_FLAG_UNKNOWN);
+    }
+
+    // `device info` fills the cache
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    api_u2fhid_status(&status);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_SEEDED, U2FHID_STATUS_FLAG_SEEDED);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_UNKNOWN, 0);
+
+    // Error counters
+    api_send_cmd("{\"name\": \"name\"}", NULL);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+    api_u2fhid_status(&status);
+    u_assert_int_eq((status.accessErrCount[0] << 8) + status.accessErrCount[1], 1);
+    u_assert_int_eq((status.pinErrCount[0] << 8) + status.pinErrCount[1], 0);
+
+    // Vendor commands pass through when U2F is disabled
+    TEST_U2FAUTH_HIJACK = 0;
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F\":false}", KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_u2fhid_status(&status);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_U2F, 0);
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F\":true}", KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_lock), KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    api_u2fhid_status(&status);
+    u_assert_int_eq(status.flags & U2FHID_STATUS_FLAG_LOCKED, U2FHID_STATUS_FLAG_LOCKED);
+    u_assert_int_eq((status.accessErrCount[0] << 8) + status.accessErrCount[1], 0);
+
+    // Status vs. JSON ping
+    if (!TEST_LIVE_DEVICE) {
+        clock_t t = clock();
+        for (i = 0; i < n; i++) {
+            api_u2fhid_status(&status);
+        }
+        float t_status = (float)(clock() - t) / CLOCKS_PER_SEC;
+        t = clock();
+        for (i = 0; i < n; i++) {
+            api_format_send_cmd(cmd_str(CMD_ping), "", NULL);
+        }
+        float t_ping = (float)(clock() - t) / CLOCKS_PER_SEC;
+        u_print_info("U2FHID status: %0.4f ms  JSON ping: %0.4f ms\n",
+                     t_status * 1000 / n, t_ping * 1000 / n);
+    }
+
+    TEST_U2FAUTH_HIJACK = test_u2fauth_hijack;
+    api_reset_device();
+}
+
+
 static void tests_echo_tfa(void)
 {
     char *echo;
@@ -1878,12 +2004,13 @@ static void tests_echo_tfa(void)
     ASSERT_REPORT_HAS(cmd_str(CMD_recid));
     ASSERT_REPORT_HAS(cmd_str(CMD_sig));
 
-    // test hash length
+    // test hash length, rejected before the echo
     api_format_send_cmd(cmd_str(CMD_sign), hash_sign3, KEY_STANDARD);
-    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_SIGN_HASH_LEN));
+    ASSERT_REPORT_HAS_NOT(cmd_str(CMD_echo));
 
     api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
-    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_SIGN_HASH_LEN));
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
 
     // test locked
     api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_lock), KEY_STANDARD);
@@ -2313,36 +2440,1178 @@ static void tests_sign(void)
 }
 
 
-static void tests_memory_setup(void)
+// Same result as the former per-entry check: derive from the master, then
+// compare hex strings
+static int checkpub_reference(const char *pubkey, const char *keypath)
 {
-    uint8_t key_00[MEM_PAGE_LEN];
-    uint8_t key_FE[MEM_PAGE_LEN];
-    uint8_t key_FF[MEM_PAGE_LEN];
-    memset(key_00, 0x00, MEM_PAGE_LEN);
-    memset(key_FE, 0xFE, MEM_PAGE_LEN);
-    memset(key_FF, 0xFF, MEM_PAGE_LEN);
+    uint8_t pub_key[33];
+    HDNode node;
+    int ret = DBB_KEY_ABSENT;
+    if (wallet_generate_key(&node, keypath, wallet_get_master(),
+                            wallet_get_chaincode()) != DBB_OK) {
+        return DBB_ERROR;
+    }
+    bitcoin_ecc.ecc_get_public_key33(node.private_key, pub_key, ECC_SECP256k1);
+    if (STREQ(pubkey, utils_uint8_to_hex(pub_key, 33))) {
+        ret = DBB_KEY_PRESENT;
+    }
+    utils_zero(&node, sizeof(node));
+    return ret;
+}
+
+
+static void tests_checkpub_batch(void)
+{
+    char keypaths[COMMANDER_CHECKPUB_MAX][64], pubkeys[COMMANDER_CHECKPUB_MAX][67];
+    const char *kp[COMMANDER_CHECKPUB_MAX], *pk[COMMANDER_CHECKPUB_MAX];
+    uint8_t present[COMMANDER_CHECKPUB_MAX], pub_key[33];
+    const char *edge[] = {
+        "m/44p/0p/0p/1/8", "m/44'/0'/0'/1/8/", "m/44'/0'/0'", "m/44'/0'/0'/1'/8",
+        "m/44'/0'/0'/1/08", "m/0'/4294967295",
+    };
+    const int sizes[] = { 1, 2, 4, 8, 16, 32 };
+    HDNode node;
+    clock_t t;
+    double t_ref, t_batch;
+    int i, n, r, res;
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
 
     api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"key\":\"key\", \"source\":\"create\", \"entropy\":\"entropy_rawH13ucR3\", \"raw\":\"true\", \"filename\":\"c.pdf\"}",
+                        KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
 
-    if (!TEST_LIVE_DEVICE && !TEST_U2FAUTH_HIJACK) {
+    // Mixed accounts and chains in random order, about half of them present
+    for (r = 0; r < 20; r++) {
+        n = 1 + random_uint32(0) % COMMANDER_CHECKPUB_MAX;
+        for (i = 0; i < n; i++) {
+            uint32_t rnd = random_uint32(0);
+            if (i < (int)(sizeof(edge) / sizeof(edge[0])) && r % 2) {
+                snprintf(keypaths[i], sizeof(keypaths[i]), "%s", edge[i]);
+            } else {
+                snprintf(keypaths[i], sizeof(keypaths[i]), "m/44'/0'/%u'/%u/%u", rnd % 2,
+                         (rnd >> 1) % 2, (rnd >> 2) % 8);
+            }
+            memset(pubkeys[i], '0', 66);
+            pubkeys[i][66] = 0;
+            if (rnd & 0x100 && wallet_generate_key(&node, keypaths[i], wallet_get_master(),
+                                                   wallet_get_chaincode()) == DBB_OK) {
+                snprintf(pubkeys[i], sizeof(pubkeys[i]), "%s",
+                         utils_uint8_to_hex(node.public_key, 33));
+                if (rnd & 0x200) {
+                    pubkeys[i][65] = pubkeys[i][65] == 'a' ? 'A' : 'a';// Not lowercase hex
+                }
+            }
+            kp[i] = keypaths[i];
+            pk[i] = pubkeys[i];
+        }
+        res = wallet_check_pubkeys(pk, kp, n, present);
+        for (i = 0; i < n; i++) {
+            if (checkpub_reference(pk[i], kp[i]) == DBB_ERROR) {
+                u_assert_int_eq(res, DBB_ERROR);
+                break;
+            }
+        }
+        if (i == n) {
+            u_assert_int_eq(res, DBB_OK);
+            for (i = 0; i < n; i++) {
+                u_assert_int_eq(present[i], checkpub_reference(pk[i], kp[i]));
+            }
+        }
+    }
+
+    res = wallet_check_pubkeys(pk, kp, 0, present);
+    u_assert_int_eq(res, DBB_ERROR);
+    res = wallet_check_pubkeys(pk, kp, COMMANDER_CHECKPUB_MAX + 1, present);
+    u_assert_int_eq(res, DBB_ERROR);
+
+    // Change outputs of one account, all present
+    for (i = 0; i < COMMANDER_CHECKPUB_MAX; i++) {
+        snprintf(keypaths[i], sizeof(keypaths[i]), "m/44'/0'/0'/1/%i", i);
+        wallet_generate_key(&node, keypaths[i], wallet_get_master(), wallet_get_chaincode());
+        bitcoin_ecc.ecc_get_public_key33(node.private_key, pub_key, ECC_SECP256k1);
+        snprintf(pubkeys[i], sizeof(pubkeys[i]), "%s", utils_uint8_to_hex(pub_key, 33));
+        kp[i] = keypaths[i];
+        pk[i] = pubkeys[i];
+    }
+    utils_zero(&node, sizeof(node));
+    for (r = 0; r < (int)(sizeof(sizes) / sizeof(sizes[0])); r++) {
+        n = sizes[r];
+        t = clock();
+        for (i = 0; i < n; i++) {
+            u_assert_int_eq(checkpub_reference(pk[i], kp[i]), DBB_KEY_PRESENT);
+        }
+        t_ref = (double)(clock() - t) / CLOCKS_PER_SEC;
+        t = clock();
+        res = wallet_check_pubkeys(pk, kp, n, present);
+        t_batch = (double)(clock() - t) / CLOCKS_PER_SEC;
+        u_assert_int_eq(res, DBB_OK);
+        for (i = 0; i < n; i++) {
+            u_assert_int_eq(present[i], DBB_KEY_PRESENT);
+        }
+        u_print_info("checkpub %2i entries: %7.2f ms one by one, %7.2f ms batched\n", n,
+                     t_ref * 1000, t_batch * 1000);
+    }
+
+    api_reset_device();
+}
+
+
+static double tests_wall_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+
+// The item by item wipe that memory_reset_hww() replaces
+static void tests_reset_rewrite(void)
+{
+    uint8_t u2f[MEM_PAGE_LEN];
+    memcpy(u2f, memory_report_master_u2f(), MEM_PAGE_LEN);
+    memory_master_u2f(u2f);
+    memory_random_password(PASSWORD_STAND);
+    memory_random_password(PASSWORD_VERIFY);
+    memory_random_password(PASSWORD_HIDDEN);
+    memory_erase_hww_seed();
+    memory_name(DEVICE_DEFAULT_NAME);
+    memory_write_erased(DEFAULT_erased);
+    memory_write_unlocked(DEFAULT_unlocked);
+    memory_write_ext_flags(DEFAULT_ext_flags);
+    memory_access_err_count(DBB_ACCESS_INITIALIZE);
+    memory_pin_err_count(DBB_ACCESS_INITIALIZE);
+}
+
+
+static void tests_reset_crypto_erase(void)
+{
+    char xpub[112];
+    uint8_t u2f[MEM_PAGE_LEN], aeskey[MEM_PAGE_LEN];
+    uint32_t reads[2], writes[2], writes_rewrite;
+    double t, t_rewrite;
+    int i;
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    // Roughly an ATAES132 page access
+    sham_set_latency(SHAM_LATENCY_EEPROM, 500);
+
+    for (i = 0; i < 2; i++) {
+        api_reset_device();
         api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
-        ASSERT_REPORT_HAS(flag_msg(DBB_ERR_MEM_SETUP));
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_seed),
+                            "{\"source\":\"create\",\"filename\":\"r.pdf\",\"key\":\"key\"}",
+                            KEY_STANDARD);
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/111'", KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        memcpy(xpub, api_read_value(CMD_xpub), sizeof(xpub));
+        memcpy(u2f, memory_report_master_u2f(), MEM_PAGE_LEN);
+        memcpy(aeskey, memory_report_aeskey(PASSWORD_STAND), MEM_PAGE_LEN);
+
+        memory_eeprom_io_count(&reads[0], &writes[0]);
+        t = tests_wall_ms();
+        if (i == 0) {
+            tests_reset_rewrite();
+        } else {
+            memory_reset_hww();
+        }
+        t = tests_wall_ms() - t;
+        memory_eeprom_io_count(&reads[1], &writes[1]);
+        if (i == 0) {
+            writes_rewrite = writes[1] - writes[0];
+            t_rewrite = t;
+        }
+
+        // Wiped, except for the U2F master key
+        u_assert_int_eq(memory_read_erased(), DEFAULT_erased);
+        u_assert_mem_eq(memory_master_hww(NULL), MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        u_assert_mem_eq(memory_master_hww_chaincode(NULL), MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        u_assert_mem_eq(memory_master_hww_entropy(NULL), MEM_PAGE_ERASE, MEM_PAGE_LEN);
+        u_assert_mem_eq(memory_hidden_hww(NULL), MEM_PAGE_ERASE_FE, MEM_PAGE_LEN);
+        u_assert_mem_eq(memory_hidden_hww_chaincode(NULL), MEM_PAGE_ERASE_FE, MEM_PAGE_LEN);
+        u_assert_mem_eq(memory_master_u2f(NULL), u2f, MEM_PAGE_LEN);
+        u_assert_mem_not_eq(memory_report_aeskey(PASSWORD_STAND), aeskey, MEM_PAGE_LEN);
+
+        // Usable again, with records rewritten as needed
+        api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/111'", KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT("\"xpub\":");
+        api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_seed),
+                            "{\"source\":\"create\",\"filename\":\"r.pdf\",\"key\":\"key\"}",
+                            KEY_STANDARD);
+        ASSERT_SUCCESS
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/111'", KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        u_assert_str_not_eq(api_read_value(CMD_xpub), xpub);
     }
 
-    memory_setup();
-    memory_setup(); // run twice
+    u_assert_int_eq(writes[1] - writes[0] < writes_rewrite, 1);
+    u_print_info("reset: %u EEPROM writes %7.2f ms rewriting, %u writes %7.2f ms crypto erase\n",
+                 writes_rewrite, t_rewrite, writes[1] - writes[0], t);
+
+    sham_set_latency(SHAM_LATENCY_EEPROM, 0);
+    api_reset_device();
+}
+
+
+static void tests_sign_session(void)
+{
+    int i, n = 20;
+    clock_t start;
+    double t_off, t_on;
+    char report_off[COMMANDER_REPORT_SIZE], report_account[COMMANDER_REPORT_SIZE];
+
+    char two_inputs[] =
+        "{\"meta\":\"_meta_data_\", \"data\":[{\"hash\":\"c12d791451bb41fd4b5145bcef25f794ca33c0cf4fe9d24f956086c5aa858a9d\", \"keypath\":\"m/44'/0'/0'/1/8\"},{\"hash\":\"3dfc3b1ed349e9b361b31c706fbf055ebf46ae725740f6739e2dfa87d2a98790\", \"keypath\":\"m/44'/0'/0'/0/5\"}]}";
+    char other_account[] =
+        "{\"meta\":\"_meta_data_\", \"data\":[{\"hash\":\"c12d791451bb41fd4b5145bcef25f794ca33c0cf4fe9d24f956086c5aa858a9d\", \"keypath\":\"m/44'/0'/1'/0/3\"}]}";
+
+    api_reset_device();
 
     api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
     ASSERT_SUCCESS
 
-    api_format_send_cmd(cmd_str(CMD_led), "abort", key_00);
-    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
 
-    api_format_send_cmd(cmd_str(CMD_led), "abort", key_FE);
-    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+    char seed[] =
+        "{\"key\":\"key\", \"source\":\"create\", \"entropy\":\"entropy_rawH13ucR3\", \"raw\":\"true\", \"filename\":\"s.pdf\"}";
+    api_format_send_cmd(cmd_str(CMD_seed), seed, KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
 
-    api_format_send_cmd(cmd_str(CMD_led), "abort", key_FF);
-    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // invalid value
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"session\":\"true\"}", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+
+    // session disabled by default
+    start = clock();
+    for (i = 0; i < n; i++) {
+        api_format_send_cmd(cmd_str(CMD_sign), two_inputs, KEY_STANDARD);
+        ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+        api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+        ASSERT_REPORT_HAS(cmd_str(CMD_recid));
+        if (!TEST_LIVE_DEVICE) {
+            u_assert_int_eq(wallet_session_active(), 0);
+        }
+    }
+    t_off = (double)(clock() - start) / CLOCKS_PER_SEC / n;
+    snprintf(report_off, sizeof(report_off), "%s", api_read_decrypted_report());
+
+    api_format_send_cmd(cmd_str(CMD_sign), other_account, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_recid));
+    snprintf(report_account, sizeof(report_account), "%s", api_read_decrypted_report());
+
+    // enable
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"session\":true}", KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // same signatures, only the first command derives the account node
+    start = clock();
+    for (i = 0; i < n; i++) {
+        api_format_send_cmd(cmd_str(CMD_sign), two_inputs, KEY_STANDARD);
+        ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+        api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+        u_assert_str_eq(api_read_decrypted_report(), report_off);
+        if (!TEST_LIVE_DEVICE) {
+            u_assert_int_eq(wallet_session_active(), 1);
+        }
+    }
+    t_on = (double)(clock() - start) / CLOCKS_PER_SEC / n;
+    u_print_info("Sign session latency per 2-input sign: %.2f ms (off)  %.2f ms (on)\n",
+                 t_off * 1000, t_on * 1000);
+
+    // switching account replaces the session node
+    api_format_send_cmd(cmd_str(CMD_sign), other_account, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    u_assert_str_eq(api_read_decrypted_report(), report_account);
+
+    api_format_send_cmd(cmd_str(CMD_sign), two_inputs, KEY_STANDARD);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    u_assert_str_eq(api_read_decrypted_report(), report_off);
+
+    if (!TEST_LIVE_DEVICE) {
+        // wiped by other commands
+        u_assert_int_eq(wallet_session_active(), 1);
+        api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        u_assert_int_eq(wallet_session_active(), 0);
+
+        // wiped by errors
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        u_assert_int_eq(wallet_session_active(), 1);
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'/x", KEY_STANDARD);
+        ASSERT_REPORT_HAS(attr_str(ATTR_error));
+        u_assert_int_eq(wallet_session_active(), 0);
+
+        // wiped by the inactivity timeout
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+        u_assert_int_eq(wallet_session_active(), 1);
+        wallet_session_timeout(WALLET_SESSION_TIMEOUT / 2);
+        u_assert_int_eq(wallet_session_active(), 1);
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+        wallet_session_timeout(WALLET_SESSION_TIMEOUT / 2);
+        u_assert_int_eq(wallet_session_active(), 1);
+        wallet_session_timeout(WALLET_SESSION_TIMEOUT / 2);
+        u_assert_int_eq(wallet_session_active(), 0);
+
+        // the interrupt only marks it expired; the next sign starts over
+        api_format_send_cmd(cmd_str(CMD_sign), two_inputs, KEY_STANDARD);
+        api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+        u_assert_str_eq(api_read_decrypted_report(), report_off);
+        u_assert_int_eq(wallet_session_active(), 1);
+
+        // wiped on USB suspend, by the main loop
+        usb_suspend_action();
+        u_assert_int_eq(wallet_session_active(), 0);
+        wallet_session_idle();
+        u_assert_int_eq(wallet_session_active(), 0);
+    }
+
+    // disable
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"session\":false}", KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_sign), two_inputs, KEY_STANDARD);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    u_assert_str_eq(api_read_decrypted_report(), report_off);
+    if (!TEST_LIVE_DEVICE) {
+        u_assert_int_eq(wallet_session_active(), 0);
+    }
+}
+
+
+// Status fields of `device info`, separated by '|'
+static void api_device_status(char *status, size_t len, uint8_t *key)
+{
+    size_t i;
+    const char *fields[] = { attr_str(ATTR_id), attr_str(ATTR_seeded), attr_str(ATTR_lock),
+                             attr_str(ATTR_bootlock), attr_str(ATTR_U2F), attr_str(ATTR_U2F_hijack)
+                           };
+
+    memset(status, 0, len);
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), key);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+
+    yajl_val json_node = yajl_tree_parse(api_read_decrypted_report(), NULL, 0);
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        const char *path[] = { cmd_str(CMD_device), fields[i], NULL };
+        yajl_val v = yajl_tree_get(json_node, path, yajl_t_any);
+        u_assert(v != NULL);
+        snprintf(status + strlens(status), len - strlens(status), "%s|",
+                 YAJL_IS_STRING(v) ? YAJL_GET_STRING(v) : (YAJL_IS_TRUE(v) ? "true" : "false"));
+    }
+    yajl_tree_free(json_node);
+}
+
+
+// The cached status must match a fresh computation after every command
+// that can change it
+static void api_check_device_status(uint8_t *key)
+{
+    char cached[256], fresh[256];
+    api_device_status(cached, sizeof(cached), key);
+    commander_device_status_invalidate();
+    api_device_status(fresh, sizeof(fresh), key);
+    u_assert_str_eq(cached, fresh);
+}
+
+
+static void tests_device_status(void)
+{
+    char cmd[512], status[256], status_seeded[256];
+    int i, n = 20;
+    int test_u2fauth_hijack = TEST_U2FAUTH_HIJACK;
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    // U2F is disabled below, so use the HWW interface
+    TEST_U2FAUTH_HIJACK = 0;
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+    api_device_status(status, sizeof(status), KEY_STANDARD);
+    u_assert_str_has(status, "|false|false|");
+
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    snprintf(cmd, sizeof(cmd),
+             "{\"source\":\"create\",\"filename\":\"s.pdf\",\"key\":\"%s\"}", tests_pwd);
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+    api_device_status(status_seeded, sizeof(status_seeded), KEY_STANDARD);
+    u_assert_str_has_not(status_seeded, "|false|false|");
+
+    // Reseeding changes the id
+    snprintf(cmd, sizeof(cmd),
+             "{\"source\":\"create\",\"filename\":\"s2.pdf\",\"key\":\"%s\"}", tests_pwd);
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+    api_device_status(status, sizeof(status), KEY_STANDARD);
+    u_assert_str_not_eq(status, status_seeded);
+
+    // Cached vs. computed (seeded wallet)
+    clock_t t = clock();
+    for (i = 0; i < n; i++) {
+        api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    }
+    float t_cached = (float)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (i = 0; i < n; i++) {
+        commander_device_status_invalidate();
+        api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    }
+    float t_fresh = (float)(clock() - t) / CLOCKS_PER_SEC;
+    u_print_info("device info: %0.2f ms (cached)  %0.2f ms (computed)\n",
+                 t_cached * 1000 / n, t_fresh * 1000 / n);
+
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F\":false}", KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+    api_format_send_cmd(cmd_str(CMD_feature_set), "{\"U2F_hijack\":false, \"U2F\":true}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+
+    // Hidden wallet has its own id and is reported as locked
+    snprintf(cmd, sizeof(cmd), "{\"%s\":\"%s\",\"%s\":\"%s\"}", cmd_str(CMD_password),
+             hidden_pwd, cmd_str(CMD_key), hidden_pwd);
+    api_format_send_cmd(cmd_str(CMD_hidden_password), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_HIDDEN);
+    api_check_device_status(KEY_STANDARD);
+    api_device_status(status_seeded, sizeof(status_seeded), KEY_HIDDEN);
+    u_assert_str_not_eq(status, status_seeded);
+
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_lock), KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    api_check_device_status(KEY_STANDARD);
+
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_LOCKED));
+    api_check_device_status(KEY_STANDARD);
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_check_device_status(KEY_STANDARD);
+    api_device_status(status, sizeof(status), KEY_STANDARD);
+    u_assert_str_has(status, "|false|false|");
+    u_assert_str_has(status, "|true|true|");
+
+    TEST_U2FAUTH_HIJACK = test_u2fauth_hijack;
+}
+
+
+static void tests_touch(void)
+{
+    char cmd[512];
+    const char one_input[] =
+        "{\"meta\":\"_meta_data_\", \"data\":[{\"hash\":\"c6fa4c236f59020ec8ffde22f85a78e7f256e94cd975eb5199a4a5cc73e26e4a\", \"keypath\":\"m/44'/0'/0'/1/7\"}]}";
+    const SHAM_TOUCH tap = { 200, 500 };
+    const SHAM_TOUCH none = { 0, 0 };
+    const SHAM_TOUCH hold = { 1000, QTOUCH_TOUCH_TIMEOUT + 100 };
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    snprintf(cmd, sizeof(cmd),
+             "{\"source\":\"create\",\"filename\":\"t.pdf\",\"key\":\"%s\"}", tests_pwd);
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // Sign: a tap aborts, no touch times out, a long touch signs
+    api_format_send_cmd(cmd_str(CMD_sign), one_input, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    sham_touch_script(&tap, 1);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_TOUCH_ABORT));
+    u_assert_int_eq(sham_touch_time(), 700);
+
+    api_format_send_cmd(cmd_str(CMD_sign), one_input, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    sham_touch_script(&none, 1);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_TOUCH_TIMEOUT));
+    u_assert_int_eq(sham_touch_time(), QTOUCH_TOUCH_TIMEOUT_HARD + 25);
+
+    api_format_send_cmd(cmd_str(CMD_sign), one_input, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    sham_touch_script(&hold, 1);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_recid));
+    u_assert_int_eq(sham_touch_time(), 1000 + QTOUCH_TOUCH_TIMEOUT);
+
+    // Lock
+    sham_touch_script(&tap, 1);
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_lock), KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_TOUCH_ABORT));
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    ASSERT_REPORT_HAS("\"lock\":false");
+
+    // Reset
+    sham_touch_script(&none, 1);
+    api_format_send_cmd(cmd_str(CMD_reset), attr_str(ATTR___ERASE__), KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_TOUCH_TIMEOUT));
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    ASSERT_REPORT_HAS("\"seeded\":true");
+    u_assert_int_eq(sham_touch_script_remaining(), 0);
+
+    api_reset_device();
+}
+
+
+// Typical SAM4S draw at 3.3 V (datasheet, peripherals off): mW per power state
+static const double power_model_mw[POWER_STATE_NUM] = {
+    10.0,// POWER_STATE_IDLE, sleep at 30 MHz
+    63.0,// POWER_STATE_ACTIVE, 120 MHz
+    63.0,// POWER_STATE_WAIT, 120 MHz until validated at 30 MHz
+    63.0,// POWER_STATE_CRYPTO, 120 MHz
+};
+
+
+static void tests_power(void)
+{
+    uint8_t log[32], len, i, wait, crypto;
+    POWER_STATS stats;
+    double energy = 0, energy_full = 0;
+    const char one_input[] =
+        "{\"meta\":\"_meta_data_\", \"data\":[{\"hash\":\"c6fa4c236f59020ec8ffde22f85a78e7f256e94cd975eb5199a4a5cc73e26e4a\", \"keypath\":\"m/44'/0'/0'/1/7\"}]}";
+    const SHAM_TOUCH hold = { 100, QTOUCH_TOUCH_TIMEOUT + 100 };
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\",\"filename\":\"p.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // As the firmware main loop
+    power_enter(POWER_STATE_IDLE);
+
+    api_format_send_cmd(cmd_str(CMD_sign), one_input, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+
+    power_stats_reset();
+    sham_touch_script(&hold, 1);
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_recid));
+    power_stats(&stats);
+    len = power_log_read(log, sizeof(log));
+
+    // Commands run at full clock and return to idle, the touch wait runs at the
+    // low clock and is never nested in crypto, and signing follows the touch
+    u_assert_int_eq(len > 0, 1);
+    u_assert_int_eq(log[len - 1], POWER_STATE_IDLE);
+    u_assert_int_eq(power_state(), POWER_STATE_IDLE);
+    for (i = 0, wait = 0, crypto = 0; i < len; i++) {
+        if (log[i] == POWER_STATE_WAIT) {
+            u_assert_int_eq(crypto, 0);
+            u_assert_int_eq(i > 0 && log[i - 1] == POWER_STATE_ACTIVE, 1);
+            u_assert_int_eq(i + 1 < len && log[i + 1] == POWER_STATE_ACTIVE, 1);
+            wait++;
+        }
+        if (log[i] == POWER_STATE_CRYPTO) {
+            u_assert_int_eq(wait, 1);
+            u_assert_int_eq(i + 1 < len && log[i + 1] == POWER_STATE_ACTIVE, 1);
+            crypto++;
+        }
+        if (log[i] == POWER_STATE_IDLE) {
+            u_assert_int_eq(i > 0 && log[i - 1] == POWER_STATE_ACTIVE, 1);
+        }
+    }
+    u_assert_int_eq(wait, 1);
+    u_assert_int_eq(crypto > 0, 1);
+    u_assert_int_eq(stats.transitions, len);
+    u_assert_int_eq(stats.time_us[POWER_STATE_WAIT] >= (100 + QTOUCH_TOUCH_TIMEOUT) * 1000u, 1);
+
+    // Energy per sign, against running everything at full clock. Waits are
+    // simulated device time, computation is measured on the host.
+    for (i = 0; i < POWER_STATE_NUM; i++) {
+        energy += stats.time_us[i] * power_model_mw[i] / 1e6;
+        energy_full += stats.time_us[i] * power_model_mw[POWER_STATE_ACTIVE] / 1e6;
+    }
+    u_print_info("sign: active %u us, crypto %u us, wait %u us; %.2f mJ (%.2f mJ at full clock)\n",
+                 stats.time_us[POWER_STATE_ACTIVE], stats.time_us[POWER_STATE_CRYPTO],
+                 stats.time_us[POWER_STATE_WAIT], energy, energy_full);
+
+    power_enter(POWER_STATE_ACTIVE);
+    api_reset_device();
+}
+
+
+static void tests_backup_audit(void)
+{
+    char cmd[512], fn[32];
+    uint32_t reads0, reads1, writes;
+    int i, n, sizes[] = { 1, 10, 100 };
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    snprintf(cmd, sizeof(cmd), "{\"audit\":\"all\",\"key\":\"key\"}");
+    api_format_send_cmd(cmd_str(CMD_backup), cmd, KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_KEY_MASTER));
+
+    // A U2F-only audit does not need a wallet seed
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"U2F\"}", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+
+    // Old wallet backup
+    snprintf(cmd, sizeof(cmd),
+             "{\"source\":\"create\",\"filename\":\"audit_old.pdf\",\"key\":\"key\"}");
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // Current wallet backups, one with a different key
+    snprintf(cmd, sizeof(cmd),
+             "{\"source\":\"create\",\"filename\":\"audit_1.pdf\",\"key\":\"key\"}");
+    api_format_send_cmd(cmd_str(CMD_seed), cmd, KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"filename\":\"audit_2.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup),
+                        "{\"filename\":\"audit_3.pdf\",\"key\":\"key\",\"source\":\"HWW\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"all\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_old.pdf\",\"HWW\":false,\"U2F\":true}");
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_1.pdf\",\"HWW\":true,\"U2F\":true}");
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_2.pdf\",\"HWW\":true,\"U2F\":true}");
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_3.pdf\",\"HWW\":true,\"U2F\":false}");
+
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"HWW\",\"key\":\"wrong\"}",
+                        KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_1.pdf\",\"HWW\":false}");
+    ASSERT_REPORT_HAS_NOT("true");
+
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"U2F\"}", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    ASSERT_REPORT_HAS("{\"filename\":\"audit_old.pdf\",\"U2F\":true}");
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_HWW));
+
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"HWW\"}", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_SD_KEY));
+    api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"xyz\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+
+    // Per-file check vs. one audit
+    for (n = 0; n < (int)(sizeof(sizes) / sizeof(sizes[0])); n++) {
+        api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+        ASSERT_SUCCESS
+        for (i = 0; i < sizes[n]; i++) {
+            snprintf(cmd, sizeof(cmd), "{\"filename\":\"audit_%i.pdf\",\"key\":\"key\"}", i);
+            api_format_send_cmd(cmd_str(CMD_backup), cmd, KEY_STANDARD);
+            ASSERT_SUCCESS
+        }
+
+        sd_io_count(&reads0, &writes);
+        clock_t t = clock();
+        for (i = 0; i < sizes[n]; i++) {
+            snprintf(fn, sizeof(fn), "audit_%i.pdf", i);
+            snprintf(cmd, sizeof(cmd), "{\"check\":\"%s\",\"source\":\"HWW\",\"key\":\"key\"}",
+                     fn);
+            api_format_send_cmd(cmd_str(CMD_backup), cmd, KEY_STANDARD);
+            ASSERT_SUCCESS
+        }
+        float t_check = (float)(clock() - t) / CLOCKS_PER_SEC;
+        sd_io_count(&reads1, &writes);
+        uint32_t reads_check = reads1 - reads0;
+
+        t = clock();
+        api_format_send_cmd(cmd_str(CMD_backup), "{\"audit\":\"HWW\",\"key\":\"key\"}",
+                            KEY_STANDARD);
+        float t_audit = (float)(clock() - t) / CLOCKS_PER_SEC;
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_false));
+        sd_io_count(&reads0, &writes);
+        u_assert_int_eq(reads_check, sizes[n]);
+        if (sizes[n] > 50) {
+            // The report is limited to SD_FILEBUF_LEN_MAX, as for the file list
+            ASSERT_REPORT_HAS(flag_msg(DBB_WARN_SD_NUM_FILES));
+            u_assert_int_eq(reads0 - reads1 < (uint32_t)sizes[n], 1);
+        } else {
+            ASSERT_REPORT_HAS_NOT(flag_msg(DBB_WARN_SD_NUM_FILES));
+            u_assert_int_eq(reads0 - reads1, sizes[n]);
+        }
+
+        u_print_info("backup audit %3i files: %7.2f ms (check each)  %7.2f ms (audit, %u files read)\n",
+                     sizes[n], t_check * 1000, t_audit * 1000, reads0 - reads1);
+    }
+
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+}
+
+
+static void tests_watermark(void)
+{
+    int cmd, cmds[] = { CMD_password, CMD_seed, CMD_xpub, CMD_sign };
+    size_t i;
+    yajl_val json_node, peaks;
+
+    char one_input[] =
+        "{\"meta\":\"_meta_data_\", \"data\":[{\"hash\":\"c12d791451bb41fd4b5145bcef25f794ca33c0cf4fe9d24f956086c5aa858a9d\", \"keypath\":\"m/44'/0'/0'/1/8\"}]}";
+
+    api_reset_device();
+
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+
+    char seed[] =
+        "{\"key\":\"key\", \"source\":\"create\", \"entropy\":\"entropy_rawH13ucR3\", \"raw\":\"true\", \"filename\":\"w.pdf\"}";
+    api_format_send_cmd(cmd_str(CMD_seed), seed, KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'/0/5", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+
+    api_format_send_cmd(cmd_str(CMD_sign), one_input, KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_echo));
+    api_format_send_cmd(cmd_str(CMD_sign), "", KEY_STANDARD);
+    ASSERT_REPORT_HAS(cmd_str(CMD_recid));
+
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    ASSERT_REPORT_HAS(attr_str(ATTR_watermark));
+
+    json_node = yajl_tree_parse(api_read_decrypted_report(), NULL, 0);
+    const char *path[] = { cmd_str(CMD_device), attr_str(ATTR_watermark), NULL };
+    peaks = yajl_tree_get(json_node, path, yajl_t_object);
+    u_assert(peaks != NULL);
+
+    const char *stack_path[] = { attr_str(ATTR_stack), NULL };
+    u_assert(YAJL_GET_INTEGER(yajl_tree_get(peaks, stack_path, yajl_t_number)) > 0);
+
+    // [stack, heap] per command
+    for (i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+        const char *cmd_path[] = { cmd_str(cmds[i]), NULL };
+        yajl_val peak = yajl_tree_get(peaks, cmd_path, yajl_t_array);
+        u_assert(peak != NULL);
+        u_assert_int_eq(YAJL_GET_ARRAY(peak)->len, 2);
+        u_assert(YAJL_GET_INTEGER(YAJL_GET_ARRAY(peak)->values[0]) > 0);
+#ifdef WATERMARK_HEAP
+        // every command at least allocates its parsed JSON tree
+        u_assert(YAJL_GET_INTEGER(YAJL_GET_ARRAY(peak)->values[1]) > 0);
+#endif
+        if (!TEST_LIVE_DEVICE) {
+            u_assert_int_eq(YAJL_GET_INTEGER(YAJL_GET_ARRAY(peak)->values[0]),
+                            watermark_stack_peak(cmds[i]));
+            u_assert_int_eq(YAJL_GET_INTEGER(YAJL_GET_ARRAY(peak)->values[1]),
+                            watermark_heap_peak(cmds[i]));
+        }
+    }
+    yajl_tree_free(json_node);
+
+    if (!TEST_LIVE_DEVICE) {
+        u_print_info("Peak stack / heap bytes per command:\n");
+        for (cmd = 0; cmd < CMD_NUM; cmd++) {
+            if (watermark_stack_peak(cmd) || watermark_heap_peak(cmd)) {
+                u_print_info("  %-16s %6u %6u\n", cmd_str(cmd),
+                             (unsigned)watermark_stack_peak(cmd), (unsigned)watermark_heap_peak(cmd));
+            }
+        }
+    }
+}
+
+
+static void tests_memory_setup(void)
+{
+    uint8_t key_00[MEM_PAGE_LEN];
+    uint8_t key_FE[MEM_PAGE_LEN];
+    uint8_t key_FF[MEM_PAGE_LEN];
+    memset(key_00, 0x00, MEM_PAGE_LEN);
+    memset(key_FE, 0xFE, MEM_PAGE_LEN);
+    memset(key_FF, 0xFF, MEM_PAGE_LEN);
+
+    api_reset_device();
+
+    if (!TEST_LIVE_DEVICE && !TEST_U2FAUTH_HIJACK) {
+        api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+        ASSERT_REPORT_HAS(flag_msg(DBB_ERR_MEM_SETUP));
+    }
+
+    memory_setup();
+    memory_setup(); // run twice
+
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+
+    api_format_send_cmd(cmd_str(CMD_led), "abort", key_00);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+
+    api_format_send_cmd(cmd_str(CMD_led), "abort", key_FE);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+
+    api_format_send_cmd(cmd_str(CMD_led), "abort", key_FF);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_JSON_PARSE));
+}
+
+
+static void tests_xpub_cache(void)
+{
+    char xpub[112], id[65], keypath[64], pubkey[67];
+    const char *kp[COMMANDER_CHECKPUB_MAX], *pk[COMMANDER_CHECKPUB_MAX];
+    uint8_t present[COMMANDER_CHECKPUB_MAX], entry[MEM_XPUB_CACHE_ENTRY_LEN];
+    uint32_t priv[2], pub[2], reads[2], writes[2], saved = 0;
+    HDNode node;
+    int i;
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\",\"filename\":\"x.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // Fill the cache
+    hdnode_ckd_count(&priv[0], &pub[0]);
+    api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    memcpy(xpub, api_read_value(CMD_xpub), sizeof(xpub));
+    api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    ASSERT_REPORT_HAS("\"id\":\"");
+    snprintf(id, sizeof(id), "%s", strstr(api_read_decrypted_report(), "\"id\":\"") + 6);
+    hdnode_ckd_count(&priv[1], &pub[1]);
+    u_assert_int_eq(priv[1] - priv[0] > 0, 1);
+
+    // Served from the EEPROM after a reboot, without private derivations
+    for (i = 0; i < 2; i++) {
+        memory_setup();
+        wallet_session_clear();
+        hdnode_ckd_count(&priv[0], &pub[0]);
+        api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        u_assert_str_eq(api_read_value(CMD_xpub), xpub);
+        api_format_send_cmd(cmd_str(CMD_device), attr_str(ATTR_info), KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        u_assert_str_has(api_read_decrypted_report(), id);
+        hdnode_ckd_count(&priv[1], &pub[1]);
+        u_assert_int_eq(priv[1] - priv[0], 0);
+        saved += 3 + 2;// m/44'/0'/0' and m/151'/144'
+    }
+
+    // Change addresses checked from the cached account node
+    wallet_generate_key(&node, "m/44'/0'/0'/1/7", wallet_get_master(), wallet_get_chaincode());
+    snprintf(pubkey, sizeof(pubkey), "%s", utils_uint8_to_hex(node.public_key, 33));
+    memory_setup();
+    wallet_session_clear();
+    hdnode_ckd_count(&priv[0], &pub[0]);
+    for (i = 0; i < COMMANDER_CHECKPUB_MAX; i++) {
+        kp[i] = i % 2 ? "m/44'/0'/0'/1/7" : "m/44'/0'/0'/1/6";
+        pk[i] = pubkey;
+    }
+    u_assert_int_eq(wallet_check_pubkeys(pk, kp, COMMANDER_CHECKPUB_MAX, present), DBB_OK);
+    for (i = 0; i < COMMANDER_CHECKPUB_MAX; i++) {
+        u_assert_int_eq(present[i], i % 2 ? DBB_KEY_PRESENT : DBB_KEY_ABSENT);
+    }
+    hdnode_ckd_count(&priv[1], &pub[1]);
+    u_assert_int_eq(priv[1] - priv[0], 0);
+    saved += 3;
+
+    // Invalidated by a hidden password
+    snprintf(keypath, sizeof(keypath), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+             cmd_str(CMD_password), hidden_pwd, cmd_str(CMD_key), hidden_pwd);
+    api_format_send_cmd(cmd_str(CMD_hidden_password), keypath, KEY_STANDARD);
+    ASSERT_SUCCESS
+    memory_setup();
+    wallet_session_clear();
+    hdnode_ckd_count(&priv[0], &pub[0]);
+    api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    u_assert_str_eq(api_read_value(CMD_xpub), xpub);
+    hdnode_ckd_count(&priv[1], &pub[1]);
+    u_assert_int_eq(priv[1] - priv[0] > 0, 1);
+
+    // Invalidated by a new seed
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\",\"filename\":\"x.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+    memory_setup();
+    wallet_session_clear();
+    hdnode_ckd_count(&priv[0], &pub[0]);
+    api_format_send_cmd(cmd_str(CMD_xpub), "m/44'/0'/0'", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    u_assert_str_not_eq(api_read_value(CMD_xpub), xpub);
+    hdnode_ckd_count(&priv[1], &pub[1]);
+    u_assert_int_eq(priv[1] - priv[0] > 0, 1);
+
+    // An identical entry is not rewritten
+    memset(entry, 0, sizeof(entry));
+    memcpy(entry + 1, "m/44'/0'/0'", strlen("m/44'/0'/0'"));
+    u_assert_int_eq(memory_xpub_cache_get(entry), DBB_OK);
+    memory_eeprom_io_count(&reads[0], &writes[0]);
+    u_assert_int_eq(memory_xpub_cache_put(entry), DBB_OK);
+    memory_eeprom_io_count(&reads[1], &writes[1]);
+    u_assert_int_eq(writes[1] - writes[0], 0);
+
+    // At most MEM_XPUB_CACHE_SLOTS entries are written per power cycle
+    memory_setup();
+    wallet_session_clear();
+    for (i = 1; i <= MEM_XPUB_CACHE_SLOTS + 1; i++) {
+        snprintf(keypath, sizeof(keypath), "m/44'/0'/%i'", i);
+        api_format_send_cmd(cmd_str(CMD_xpub), keypath, KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    }
+    memory_setup();
+    wallet_session_clear();
+    for (i = 1; i <= MEM_XPUB_CACHE_SLOTS + 1; i++) {
+        snprintf(keypath, sizeof(keypath), "m/44'/0'/%i'", i);
+        hdnode_ckd_count(&priv[0], &pub[0]);
+        api_format_send_cmd(cmd_str(CMD_xpub), keypath, KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        hdnode_ckd_count(&priv[1], &pub[1]);
+        u_assert_int_eq(priv[1] - priv[0] > 0, i > MEM_XPUB_CACHE_SLOTS);
+    }
+
+    u_print_info("xpub cache: %u private derivations saved across reboots\n", saved);
+
+    api_reset_device();
+}
+
+
+static void tests_batch(void)
+{
+    char xpub[3][112], cmd[COMMANDER_REPORT_SIZE];
+    const char *keypaths[] = { "m/44'/0'/0'", "m/44'/0'/1'", "m/44'/0'/0'/0/5" };
+    const char *items_path[] = { cmd_str(CMD_batch), NULL };
+    const char *code_path[] = { attr_str(ATTR_error), "code", NULL };
+    const char *touch[] = {
+        "{\"sign\":\"\"}", "{\"seed\":{\"source\":\"create\"}}", "{\"backup\":\"erase\"}",
+        "{\"backup\":{\"erase\":\"b.pdf\"}}", "{\"device\":\"lock\"}", "{\"reset\":\"__ERASE__\"}",
+        "{\"batch\":[{\"random\":\"pseudo\"}]}",
+    };
+    yajl_val json_node, items, item;
+    size_t i;
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\",\"filename\":\"b.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+    for (i = 0; i < 3; i++) {
+        api_format_send_cmd(cmd_str(CMD_xpub), keypaths[i], KEY_STANDARD);
+        ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+        snprintf(xpub[i], sizeof(xpub[i]), "%s", api_read_value(CMD_xpub));
+    }
+
+    // Same results as sent one by one, in order
+    snprintf(cmd, sizeof(cmd), "{\"batch\":[{\"device\":\"info\"},{\"xpub\":\"%s\"},"
+             "{\"xpub\":\"%s\"},{\"xpub\":\"%s\"},{\"random\":\"pseudo\"},"
+             "{\"backup\":\"list\"}]}", keypaths[0], keypaths[1], keypaths[2]);
+    api_send_cmd(cmd, KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    json_node = yajl_tree_parse(api_read_decrypted_report(), NULL, 0);
+    items = yajl_tree_get(json_node, items_path, yajl_t_array);
+    u_assert_int_eq(!!items, 1);
+    u_assert_int_eq(items->u.array.len, 6);
+    u_assert_str_eq(items->u.array.values[0]->u.object.keys[0], cmd_str(CMD_device));
+    for (i = 0; i < 3; i++) {
+        const char *path[] = { cmd_str(CMD_xpub), NULL };
+        item = items->u.array.values[i + 1];
+        u_assert_str_eq(YAJL_GET_STRING(yajl_tree_get(item, path, yajl_t_string)), xpub[i]);
+    }
+    u_assert_str_eq(items->u.array.values[4]->u.object.keys[0], cmd_str(CMD_random));
+    u_assert_str_has(api_read_decrypted_report(), "b.pdf");
+    yajl_tree_free(json_node);
+
+    // Touch-gated and nested commands fail alone, the others still run
+    for (i = 0; i < sizeof(touch) / sizeof(touch[0]); i++) {
+        snprintf(cmd, sizeof(cmd), "{\"batch\":[%s,{\"xpub\":\"%s\"}]}", touch[i],
+                 keypaths[0]);
+        api_send_cmd(cmd, KEY_STANDARD);
+        json_node = yajl_tree_parse(api_read_decrypted_report(), NULL, 0);
+        items = yajl_tree_get(json_node, items_path, yajl_t_array);
+        u_assert_int_eq(!!items, 1);
+        u_assert_int_eq(items->u.array.len, 2);
+        item = yajl_tree_get(items->u.array.values[0], code_path, yajl_t_number);
+        u_assert_int_eq(!!item, 1);
+        u_assert_str_eq(YAJL_GET_NUMBER(item), flag_code(DBB_ERR_IO_BATCH_CMD));
+        u_assert_str_has(api_read_decrypted_report(), xpub[0]);
+        yajl_tree_free(json_node);
+    }
+    // Still seeded, with the backup in place
+    api_format_send_cmd(cmd_str(CMD_xpub), keypaths[0], KEY_STANDARD);
+    u_assert_str_eq(api_read_value(CMD_xpub), xpub[0]);
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_list), KEY_STANDARD);
+    ASSERT_REPORT_HAS("b.pdf");
+
+    // Malformed batches
+    api_send_cmd("{\"batch\":[]}", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+    api_send_cmd("{\"batch\":{\"random\":\"pseudo\"}}", KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+    api_send_cmd("{\"batch\":[{\"random\":\"pseudo\",\"name\":\"\"},\"random\"]}",
+                 KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+    ASSERT_REPORT_HAS_NOT(flag_msg(DBB_ERR_IO_BATCH_CMD));
+    snprintf(cmd, sizeof(cmd), "{\"batch\":[");
+    for (i = 0; i <= COMMANDER_BATCH_MAX; i++) {
+        strcat(cmd, i ? ",{\"random\":\"pseudo\"}" : "{\"random\":\"pseudo\"}");
+    }
+    strcat(cmd, "]}");
+    api_send_cmd(cmd, KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_INVALID_CMD));
+
+    // Reports beyond the output buffer
+    snprintf(cmd, sizeof(cmd), "{\"batch\":[");
+    for (i = 0; i < COMMANDER_BATCH_MAX; i++) {
+        strcat(cmd, i ? ",{\"device\":\"info\"}" : "{\"device\":\"info\"}");
+    }
+    strcat(cmd, "]}");
+    api_send_cmd(cmd, KEY_STANDARD);
+    ASSERT_REPORT_HAS(flag_msg(DBB_ERR_IO_BATCH_SIZE));
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_serial));
+
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+}
+
+
+static void tests_arg_schema(void)
+{
+    const struct {
+        const char *command;
+        int flag;
+    } bad[] = {
+        { "{\"seed\":{\"source\":\"create\",\"filename\":\"a b.pdf\",\"key\":\"k\"}}", DBB_ERR_SD_BAD_CHAR },
+        { "{\"seed\":{\"source\":\"create\",\"key\":\"k\"}}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"sign\":{\"data\":[{\"hash\":\"0123\",\"keypath\":\"m/44'/0'/0'/0/0\"}]}}", DBB_ERR_SIGN_HASH_LEN },
+        { "{\"sign\":{\"data\":[{\"hash\":\"x123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\",\"keypath\":\"m/0\"}]}}", DBB_ERR_SIGN_HASH_LEN },
+        { "{\"sign\":{\"data\":[{\"keypath\":\"m/44'/0'/0'/0/0\"}]}}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"sign\":{\"data\":[\"m/0\"]}}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"sign\":{\"data\":[{\"hash\":\"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\",\"keypath\":\"m/0\"}],\"checkpub\":[{\"pubkey\":\"00\",\"keypath\":\"m/0\"}]}}", DBB_ERR_SIGN_PUBKEY_LEN },
+        { "{\"xpub\":\"m/44'/0'/x\"}", DBB_ERR_KEY_CHILD },
+        { "{\"reset\":\"\"}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"bootloader\":{}}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"password\":\"123\"}", DBB_ERR_IO_PASSWORD_LEN },
+        { "{\"hidden_password\":{\"password\":\"123\",\"key\":\"k\"}}", DBB_ERR_IO_PASSWORD_LEN },
+        { "{\"feature_set\":{\"U2F\":\"yes\"}}", DBB_ERR_IO_INVALID_CMD },
+        { "{\"backup\":{\"filename\":\"../b.pdf\",\"key\":\"k\"}}", DBB_ERR_SD_BAD_CHAR },
+        { "{\"verifypass\":{\"ecdh\":\"02\"}}", DBB_ERR_KEY_ECDH_LEN },
+        { "{\"batch\":[{\"name\":\"a b\"}]}", DBB_ERR_SD_BAD_CHAR },
+    };
+    uint32_t reads[2], writes[2], touch_ms, priv[2], pub[2];
+    double t;
+    size_t i;
+
+    if (TEST_LIVE_DEVICE) {
+        return;
+    }
+
+    api_reset_device();
+    api_format_send_cmd(cmd_str(CMD_password), tests_pwd, NULL);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"create\",\"filename\":\"s.pdf\",\"key\":\"key\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS
+
+    // Rejected before any touch, key derivation or EEPROM write
+    sham_set_latency(SHAM_LATENCY_EEPROM, 500);
+    touch_ms = sham_touch_time();
+    memory_eeprom_io_count(&reads[0], &writes[0]);
+    hdnode_ckd_count(&priv[0], &pub[0]);
+    t = tests_wall_ms();
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        api_send_cmd(bad[i].command, KEY_STANDARD);
+        ASSERT_REPORT_HAS(flag_msg(bad[i].flag));
+        ASSERT_REPORT_HAS_NOT(cmd_str(CMD_echo));
+    }
+    t = tests_wall_ms() - t;
+    memory_eeprom_io_count(&reads[1], &writes[1]);
+    hdnode_ckd_count(&priv[1], &pub[1]);
+    u_assert_int_eq(sham_touch_time() - touch_ms, 0);
+    if (!TEST_U2FAUTH_HIJACK) {
+        // Hijacked requests are U2F authentications, which update the counter
+        u_assert_int_eq(writes[1] - writes[0], 0);
+    }
+    u_assert_int_eq(priv[1] - priv[0], 0);
+    u_print_info("malformed requests: %u rejected in %7.2f ms, %u EEPROM reads\n",
+                 (unsigned)(sizeof(bad) / sizeof(bad[0])), t, reads[1] - reads[0]);
+    sham_set_latency(SHAM_LATENCY_EEPROM, 0);
+
+    // Optional and nullable arguments
+    api_send_cmd("{\"name\":null}", KEY_STANDARD);
+    ASSERT_REPORT_HAS_NOT(attr_str(ATTR_error));
+    api_send_cmd("{\"backup\":\"list\"}", KEY_STANDARD);
+    ASSERT_REPORT_HAS("s.pdf");
+
+    api_format_send_cmd(cmd_str(CMD_backup), attr_str(ATTR_erase), KEY_STANDARD);
+    ASSERT_SUCCESS
+    api_reset_device();
 }
 
 
@@ -2350,6 +3619,7 @@ static void run_utests(void)
 {
     u_run_test(tests_memory_setup);// Keep first
     u_run_test(tests_u2f);
+    u_run_test(tests_u2fhid_status);
     u_run_test(tests_echo_tfa);
     u_run_test(tests_name);
     u_run_test(tests_password);
@@ -2357,7 +3627,18 @@ static void run_utests(void)
     u_run_test(tests_device);
     u_run_test(tests_input);
     u_run_test(tests_seed_xpub_backup);
+    u_run_test(tests_backup_audit);
     u_run_test(tests_sign);
+    u_run_test(tests_checkpub_batch);
+    u_run_test(tests_sign_session);
+    u_run_test(tests_watermark);
+    u_run_test(tests_device_status);
+    u_run_test(tests_touch);
+    u_run_test(tests_power);
+    u_run_test(tests_reset_crypto_erase);
+    u_run_test(tests_xpub_cache);
+    u_run_test(tests_batch);
+    u_run_test(tests_arg_schema);
 
     if (!U_TESTS_FAIL) {
         printf("\nALL %i TESTS PASSED\n\n", U_TESTS_RUN);
@@ -0,0 +1,559 @@
+// Copyright 2018 Douglas J. Bakkum, Shift Devices AG
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file or at
+// https://developers.google.com/open-source/licenses/bsd
+
+
+// CTAP2 (FIDO2) over U2FHID_CBOR test.
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "random.h"
+#include "memory.h"
+#include "utils.h"
+#include "sha2.h"
+#include "ecc.h"
+#include "flags.h"
+#include "cbor.h"
+#include "sham.h"
+
+#include "usb.h"
+#include "u2f/u2f.h"
+#include "u2f/u2f_hid.h"
+#include "u2f/ctap2.h"
+#include "u2f/u2f_util_t.h"
+
+
+#define CTAP2_RP_ID          "webauthn.io"
+#define CTAP2_CRED_ID_SIZE   64
+#define CTAP2_MSG_MAX_LEN    COMMANDER_REPORT_SIZE
+
+
+struct U2Fob *device;
+
+static uint8_t cred_id[CTAP2_CRED_ID_SIZE];
+static uint8_t cred_pubkey[U2F_EC_POINT_SIZE];
+
+
+// Requests as sent by a browser for webauthn.io, in the canonical CBOR
+// encoding of the CTAP2 spec: command byte followed by the parameter map.
+// The client data hashes are at MAKE_CREDENTIAL_CDH and GET_ASSERTION_CDH.
+#define MAKE_CREDENTIAL_CDH   5
+#define MAKE_CREDENTIAL_ALG   129// ES256 (-7) in pubKeyCredParams
+static const uint8_t MAKE_CREDENTIAL[] = {
+    0x01, 0xa4, 0x01, 0x58, 0x20, 0xff, 0x16, 0x31, 0xd5, 0x62, 0x33, 0x41,
+    0xab, 0x8d, 0x79, 0x6b, 0xfe, 0xf6, 0x60, 0xee, 0x12, 0xe6, 0xd1, 0xd9,
+    0xe0, 0x02, 0x5c, 0x6b, 0x82, 0xc0, 0x5a, 0x02, 0xc0, 0xe1, 0x04, 0x4c,
+    0x56, 0x02, 0xa2, 0x62, 0x69, 0x64, 0x6b, 0x77, 0x65, 0x62, 0x61, 0x75,
+    0x74, 0x68, 0x6e, 0x2e, 0x69, 0x6f, 0x64, 0x6e, 0x61, 0x6d, 0x65, 0x6b,
+    0x77, 0x65, 0x62, 0x61, 0x75, 0x74, 0x68, 0x6e, 0x2e, 0x69, 0x6f, 0x03,
+    0xa3, 0x62, 0x69, 0x64, 0x50, 0x52, 0xf2, 0x26, 0x65, 0xa6, 0x0c, 0x12,
+    0xd2, 0x89, 0x18, 0x5d, 0x95, 0x0e, 0xe8, 0x81, 0x36, 0x64, 0x6e, 0x61,
+    0x6d, 0x65, 0x65, 0x61, 0x6c, 0x69, 0x63, 0x65, 0x6b, 0x64, 0x69, 0x73,
+    0x70, 0x6c, 0x61, 0x79, 0x4e, 0x61, 0x6d, 0x65, 0x65, 0x61, 0x6c, 0x69,
+    0x63, 0x65, 0x04, 0x82, 0xa2, 0x63, 0x61, 0x6c, 0x67, 0x26, 0x64, 0x74,
+    0x79, 0x70, 0x65, 0x6a, 0x70, 0x75, 0x62, 0x6c, 0x69, 0x63, 0x2d, 0x6b,
+    0x65, 0x79, 0xa2, 0x63, 0x61, 0x6c, 0x67, 0x39, 0x01, 0x00, 0x64, 0x74,
+    0x79, 0x70, 0x65, 0x6a, 0x70, 0x75, 0x62, 0x6c, 0x69, 0x63, 0x2d, 0x6b,
+    0x65, 0x79,
+};
+
+// allowList of three foreign credentials and, last, a placeholder for the
+// credential made by test_MakeCredential().
+#define GET_ASSERTION_CDH     18
+#define GET_ASSERTION_CRED    316
+static const uint8_t GET_ASSERTION[] = {
+    0x02, 0xa4, 0x01, 0x6b, 0x77, 0x65, 0x62, 0x61, 0x75, 0x74, 0x68, 0x6e,
+    0x2e, 0x69, 0x6f, 0x02, 0x58, 0x20, 0xdc, 0x56, 0x63, 0x2c, 0x1a, 0x42,
+    0x84, 0x2c, 0x98, 0xdd, 0xe7, 0x8d, 0x13, 0x51, 0xc5, 0x72, 0xdd, 0x6d,
+    0x11, 0x2c, 0xc4, 0x10, 0x81, 0x37, 0xd3, 0xb3, 0x3a, 0xa5, 0x58, 0x36,
+    0x89, 0xfb, 0x03, 0x84, 0xa2, 0x62, 0x69, 0x64, 0x58, 0x40, 0x09, 0x16,
+    0x6f, 0x6b, 0x11, 0x3d, 0x17, 0x8d, 0x6c, 0x0f, 0xd3, 0x90, 0x1f, 0xf2,
+    0x39, 0xa1, 0xa0, 0x95, 0xf2, 0x0f, 0x93, 0x95, 0x65, 0x0c, 0xf9, 0x38,
+    0x0b, 0x8e, 0xdb, 0x22, 0x4a, 0x6b, 0x24, 0x8a, 0x1e, 0x92, 0x4e, 0x8f,
+    0xd0, 0xae, 0x2e, 0x1a, 0x94, 0x92, 0xa3, 0x30, 0x5f, 0x18, 0x8c, 0xb6,
+    0x10, 0x90, 0x0f, 0x9e, 0x34, 0x7f, 0xae, 0x88, 0x6d, 0xc6, 0x50, 0x77,
+    0x95, 0xec, 0x64, 0x74, 0x79, 0x70, 0x65, 0x6a, 0x70, 0x75, 0x62, 0x6c,
+    0x69, 0x63, 0x2d, 0x6b, 0x65, 0x79, 0xa2, 0x62, 0x69, 0x64, 0x58, 0x40,
+    0x74, 0x5c, 0x4c, 0x3f, 0xcb, 0x2e, 0xb2, 0xc7, 0x3e, 0x14, 0x93, 0x4c,
+    0x86, 0x7e, 0xe0, 0x57, 0xba, 0x72, 0x49, 0x9b, 0xfa, 0x12, 0x1e, 0x83,
+    0x6b, 0x2a, 0xc1, 0x57, 0x26, 0xee, 0x7d, 0x6b, 0x0a, 0xf6, 0xab, 0x13,
+    0xc3, 0x8e, 0x92, 0xca, 0xe0, 0xd1, 0x50, 0x57, 0xb1, 0x59, 0x98, 0x7f,
+    0x94, 0xcc, 0x74, 0x11, 0xd7, 0x17, 0xf1, 0x45, 0x79, 0xb2, 0xaa, 0x10,
+    0x0f, 0xbb, 0xb3, 0x4f, 0x64, 0x74, 0x79, 0x70, 0x65, 0x6a, 0x70, 0x75,
+    0x62, 0x6c, 0x69, 0x63, 0x2d, 0x6b, 0x65, 0x79, 0xa2, 0x62, 0x69, 0x64,
+    0x58, 0x40, 0xa5, 0x93, 0xfe, 0xae, 0xd2, 0x72, 0x48, 0xb7, 0x62, 0xe3,
+    0xab, 0x58, 0x05, 0xf0, 0x76, 0x5a, 0x2b, 0x9c, 0x1d, 0x7e, 0x0f, 0x37,
+    0xc4, 0x49, 0x21, 0xbd, 0x3f, 0x65, 0x64, 0xea, 0xdf, 0x7f, 0x14, 0x2a,
+    0x72, 0x66, 0x8c, 0x47, 0xe2, 0x23, 0xd1, 0x6e, 0xdd, 0x8c, 0x47, 0xb4,
+    0x6a, 0xfc, 0x5b, 0xae, 0xe2, 0x61, 0xf5, 0x3b, 0x26, 0x15, 0x2d, 0x26,
+    0x3b, 0xa8, 0x3b, 0x03, 0x7c, 0xd4, 0x64, 0x74, 0x79, 0x70, 0x65, 0x6a,
+    0x70, 0x75, 0x62, 0x6c, 0x69, 0x63, 0x2d, 0x6b, 0x65, 0x79, 0xa2, 0x62,
+    0x69, 0x64, 0x58, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x74, 0x79, 0x70,
+    0x65, 0x6a, 0x70, 0x75, 0x62, 0x6c, 0x69, 0x63, 0x2d, 0x6b, 0x65, 0x79,
+    0x05, 0xa1, 0x62, 0x75, 0x70, 0xf5,
+};
+
+
+// Sends one CTAP2 request and returns the status byte of the reply
+static uint8_t ctap2_exchange(const uint8_t *req, size_t req_len, uint8_t *rsp,
+                              size_t *rsp_len)
+{
+    uint8_t cmd = 0;
+    int len;
+
+    CHECK_EQ(0, U2Fob_send(device, U2FHID_CBOR, req, req_len));
+    len = U2Fob_recv(device, &cmd, rsp, CTAP2_MSG_MAX_LEN, 30.0);
+    CHECK_GT(len, 0);
+    CHECK_EQ(cmd, U2FHID_CBOR);
+    *rsp_len = len;
+    return rsp[0];
+}
+
+
+// The CBOR map that follows the status byte
+static void ctap2_response(const uint8_t *rsp, size_t rsp_len, CBOR_ITEM *map)
+{
+    CBOR_READER r = { rsp + 1, rsp_len - 1 };
+    CHECK_EQ(DBB_OK, cbor_read(&r, map));
+    CHECK_EQ(map->type, CBOR_MAP);
+    CHECK_EQ(r.len, 0);
+}
+
+
+static void ctap2_field(const CBOR_ITEM *map, int64_t key, uint8_t type, CBOR_ITEM *value)
+{
+    CHECK_EQ(DBB_OK, cbor_map_find(map, key, value));
+    CHECK_EQ(value->type, type);
+}
+
+
+static void ctap2_put_credential(CBOR_WRITER *w, const uint8_t *id)
+{
+    cbor_put_map(w, 2);
+    cbor_put_text(w, "id");
+    cbor_put_bytes(w, id, CTAP2_CRED_ID_SIZE);
+    cbor_put_text(w, "type");
+    cbor_put_text(w, "public-key");
+}
+
+
+// GetAssertion with `foreign` unknown credentials ahead of ours in the allowList
+static size_t ctap2_get_assertion_req(uint8_t *req, size_t size, int foreign)
+{
+    uint8_t id[CTAP2_CRED_ID_SIZE];
+    CBOR_WRITER w;
+    int i;
+
+    req[0] = CTAP2_GET_ASSERTION;
+    cbor_writer_init(&w, req + 1, size - 1);
+    cbor_put_map(&w, 3);
+    cbor_put_uint(&w, CTAP2_GA_RP_ID);
+    cbor_put_text(&w, CTAP2_RP_ID);
+    cbor_put_uint(&w, CTAP2_GA_CLIENT_DATA_HASH);
+    cbor_put_bytes(&w, GET_ASSERTION + GET_ASSERTION_CDH, SHA256_DIGEST_LENGTH);
+    cbor_put_uint(&w, CTAP2_GA_ALLOW_LIST);
+    cbor_put_array(&w, foreign + 1);
+    for (i = 0; i < foreign; i++) {
+        random_bytes(id, sizeof(id), 0);
+        ctap2_put_credential(&w, id);
+    }
+    ctap2_put_credential(&w, cred_id);
+    CHECK_EQ(w.err, 0);
+    return w.len + 1;
+}
+
+
+static void ctap2_verify(const uint8_t *pubkey, const uint8_t *hash, const CBOR_ITEM *der)
+{
+    uint8_t sig[64];
+    CHECK_EQ(0, ecc_der_to_sig(der->p, der->val, sig));
+    CHECK_EQ(0, ecc_verify_digest(pubkey + 1, hash, sig, ECC_SECP256r1));
+}
+
+
+// U2F authenticate for webauthn.io, i.e. appId = sha256(rpId)
+static int u2f_authenticate(uint8_t p1, const uint8_t *key_handle)
+{
+    char req[U2F_NONCE_LENGTH + U2F_APPID_SIZE + 1 + CTAP2_CRED_ID_SIZE];
+    char rsp[4096];
+    size_t rsp_len;
+
+    random_bytes((uint8_t *)req, U2F_NONCE_LENGTH, 0);
+    sha256_Raw((const uint8_t *)CTAP2_RP_ID, strlen(CTAP2_RP_ID),
+               (uint8_t *)req + U2F_NONCE_LENGTH);
+    req[U2F_NONCE_LENGTH + U2F_APPID_SIZE] = CTAP2_CRED_ID_SIZE;
+    memcpy(req + U2F_NONCE_LENGTH + U2F_APPID_SIZE + 1, key_handle, CTAP2_CRED_ID_SIZE);
+    return U2Fob_apdu(device, 0, U2F_AUTHENTICATE, p1, 0, req, sizeof(req), rsp, &rsp_len);
+}
+
+
+static void test_CapFlags(void)
+{
+    uint8_t nonce[U2FHID_INIT_NONCE_SIZE], rsp[64], cmd = 0;
+
+    random_bytes(nonce, sizeof(nonce), 0);
+    CHECK_EQ(0, U2Fob_send(device, U2FHID_INIT, nonce, sizeof(nonce)));
+    CHECK_EQ(U2FHID_INIT_RESP_SIZE, U2Fob_recv(device, &cmd, rsp, sizeof(rsp), 1.0));
+    CHECK_EQ(cmd, U2FHID_INIT);
+    CHECK_EQ(0, memcmp(nonce, rsp, sizeof(nonce)));
+    CHECK_NE((rsp[16] & U2FHID_CAPFLAG_CBOR), 0);
+}
+
+
+static void test_GetInfo(void)
+{
+    uint8_t req = CTAP2_GET_INFO, rsp[CTAP2_MSG_MAX_LEN];
+    size_t rsp_len;
+    CBOR_ITEM map, versions, value;
+    CBOR_READER r;
+    int64_t size;
+    uint64_t i;
+    int fido2 = 0;
+
+    CHECK_EQ(CTAP2_OK, ctap2_exchange(&req, 1, rsp, &rsp_len));
+    ctap2_response(rsp, rsp_len, &map);
+
+    ctap2_field(&map, CTAP2_GET_INFO_VERSIONS, CBOR_ARRAY, &versions);
+    cbor_item_reader(&versions, &r);
+    for (i = 0; i < versions.val; i++) {
+        CHECK_EQ(DBB_OK, cbor_read(&r, &value));
+        fido2 |= cbor_text_eq(&value, "FIDO_2_0");
+    }
+    CHECK_EQ(fido2, 1);
+
+    ctap2_field(&map, CTAP2_GET_INFO_AAGUID, CBOR_BYTES, &value);
+    CHECK_EQ(value.val, CTAP2_AAGUID_SIZE);
+
+    ctap2_field(&map, CTAP2_GET_INFO_OPTIONS, CBOR_MAP, &versions);
+    CHECK_EQ(DBB_OK, cbor_map_find_text(&versions, "rk", &value));
+    CHECK_EQ(value.val, CBOR_FALSE);
+
+    ctap2_field(&map, CTAP2_GET_INFO_MAX_MSG_SIZE, CBOR_UINT, &value);
+    CHECK_EQ(DBB_OK, cbor_int(&value, &size));
+    CHECK_GE(size, 1024);
+}
+
+
+static void test_MakeCredential(void)
+{
+    uint8_t rsp[CTAP2_MSG_MAX_LEN], rp_id_hash[SHA256_DIGEST_LENGTH];
+    uint8_t hash[SHA256_DIGEST_LENGTH], rfu = 0;
+    const uint8_t *auth_data;
+    char pk[U2F_EC_POINT_SIZE];
+    size_t rsp_len, pk_len;
+    CBOR_ITEM map, value, att_stmt, cose, cert;
+    CBOR_READER r;
+    int64_t i;
+    SHA256_CTX ctx;
+
+    uint64_t t = 0;
+    U2Fob_deltaTime(&t);
+
+    CHECK_EQ(CTAP2_OK, ctap2_exchange(MAKE_CREDENTIAL, sizeof(MAKE_CREDENTIAL), rsp,
+                                      &rsp_len));
+    PRINT_INFO("MakeCredential: %lu bytes in %fs", rsp_len, U2Fob_deltaTime(&t));
+    ctap2_response(rsp, rsp_len, &map);
+
+    ctap2_field(&map, CTAP2_MC_RESP_FMT, CBOR_TEXT, &value);
+    CHECK_EQ(1, cbor_text_eq(&value, "fido-u2f"));
+
+    // rpIdHash | flags | signCount | aaguid | credentialIdLength | credentialId |
+    // credentialPublicKey
+    ctap2_field(&map, CTAP2_MC_RESP_AUTH_DATA, CBOR_BYTES, &value);
+    CHECK_GT(value.val, 55 + CTAP2_CRED_ID_SIZE);
+    auth_data = value.p;
+    sha256_Raw((const uint8_t *)CTAP2_RP_ID, strlen(CTAP2_RP_ID), rp_id_hash);
+    CHECK_EQ(0, memcmp(auth_data, rp_id_hash, sizeof(rp_id_hash)));
+    CHECK_EQ(auth_data[32], (CTAP2_FLAG_UP | CTAP2_FLAG_AT));
+    CHECK_EQ(((auth_data[53] << 8) | auth_data[54]), CTAP2_CRED_ID_SIZE);
+    memcpy(cred_id, auth_data + 55, CTAP2_CRED_ID_SIZE);
+
+    r.p = auth_data + 55 + CTAP2_CRED_ID_SIZE;
+    r.len = value.val - 55 - CTAP2_CRED_ID_SIZE;
+    CHECK_EQ(DBB_OK, cbor_read(&r, &cose));
+    CHECK_EQ(r.len, 0);
+    ctap2_field(&cose, 1, CBOR_UINT, &value);
+    CHECK_EQ(value.val, CTAP2_COSE_KTY_EC2);
+    ctap2_field(&cose, 3, CBOR_NEGINT, &value);
+    CHECK_EQ(DBB_OK, cbor_int(&value, &i));
+    CHECK_EQ(i, CTAP2_COSE_ALG_ES256);
+    ctap2_field(&cose, -2, CBOR_BYTES, &value);
+    CHECK_EQ(value.val, 32);
+    cred_pubkey[0] = U2F_UNCOMPRESSED_POINT;
+    memcpy(cred_pubkey + 1, value.p, 32);
+    ctap2_field(&cose, -3, CBOR_BYTES, &value);
+    CHECK_EQ(value.val, 32);
+    memcpy(cred_pubkey + 33, value.p, 32);
+
+    // fido-u2f attestation: the U2F registration signature
+    ctap2_field(&map, CTAP2_MC_RESP_ATT_STMT, CBOR_MAP, &att_stmt);
+    CHECK_EQ(DBB_OK, cbor_map_find_text(&att_stmt, "x5c", &value));
+    CHECK_EQ(value.type, CBOR_ARRAY);
+    CHECK_EQ(value.val, 1);
+    cbor_item_reader(&value, &r);
+    CHECK_EQ(DBB_OK, cbor_read(&r, &cert));
+    CHECK_EQ(cert.type, CBOR_BYTES);
+    CHECK_EQ(getSubjectPublicKey((const char *)cert.p, cert.val, pk, &pk_len), true);
+    CHECK_EQ(pk_len, U2F_EC_POINT_SIZE);
+
+    sha256_Init(&ctx);
+    sha256_Update(&ctx, &rfu, sizeof(rfu));
+    sha256_Update(&ctx, rp_id_hash, sizeof(rp_id_hash));
+    sha256_Update(&ctx, MAKE_CREDENTIAL + MAKE_CREDENTIAL_CDH, SHA256_DIGEST_LENGTH);
+    sha256_Update(&ctx, cred_id, sizeof(cred_id));
+    sha256_Update(&ctx, cred_pubkey, sizeof(cred_pubkey));
+    sha256_Final(hash, &ctx);
+    CHECK_EQ(DBB_OK, cbor_map_find_text(&att_stmt, "sig", &value));
+    CHECK_EQ(value.type, CBOR_BYTES);
+    ctap2_verify((const uint8_t *)pk, hash, &value);
+}
+
+
+// returns ctr
+static uint32_t test_GetAssertion(const uint8_t *req, size_t req_len)
+{
+    uint8_t rsp[CTAP2_MSG_MAX_LEN], hash[SHA256_DIGEST_LENGTH];
+    const uint8_t *auth_data;
+    size_t rsp_len;
+    CBOR_ITEM map, credential, value;
+    SHA256_CTX ctx;
+
+    CHECK_EQ(CTAP2_OK, ctap2_exchange(req, req_len, rsp, &rsp_len));
+    ctap2_response(rsp, rsp_len, &map);
+
+    ctap2_field(&map, CTAP2_GA_RESP_CREDENTIAL, CBOR_MAP, &credential);
+    CHECK_EQ(DBB_OK, cbor_map_find_text(&credential, "id", &value));
+    CHECK_EQ(value.val, CTAP2_CRED_ID_SIZE);
+    CHECK_EQ(0, memcmp(value.p, cred_id, CTAP2_CRED_ID_SIZE));
+
+    ctap2_field(&map, CTAP2_GA_RESP_AUTH_DATA, CBOR_BYTES, &value);
+    CHECK_EQ(value.val, U2F_APPID_SIZE + 1 + U2F_CTR_SIZE);
+    auth_data = value.p;
+    CHECK_EQ(auth_data[32], CTAP2_FLAG_UP);
+
+    sha256_Init(&ctx);
+    sha256_Update(&ctx, auth_data, value.val);
+    sha256_Update(&ctx, req + GET_ASSERTION_CDH, SHA256_DIGEST_LENGTH);
+    sha256_Final(hash, &ctx);
+    ctap2_field(&map, CTAP2_GA_RESP_SIGNATURE, CBOR_BYTES, &value);
+    ctap2_verify(cred_pubkey, hash, &value);
+
+    return ((uint32_t)auth_data[33] << 24) | (auth_data[34] << 16) | (auth_data[35] << 8) |
+           auth_data[36];
+}
+
+
+static void test_Errors(void)
+{
+    uint8_t req[CTAP2_MSG_MAX_LEN], rsp[CTAP2_MSG_MAX_LEN];
+    size_t rsp_len;
+    CBOR_WRITER w;
+
+    // Only foreign credentials in the allowList
+    CHECK_EQ(CTAP2_ERR_NO_CREDENTIALS,
+             ctap2_exchange(GET_ASSERTION, sizeof(GET_ASSERTION), rsp, &rsp_len));
+    CHECK_EQ(rsp_len, 1);
+
+    // {"uv": true}
+    memcpy(req, GET_ASSERTION, sizeof(GET_ASSERTION));
+    memcpy(req + GET_ASSERTION_CRED, cred_id, sizeof(cred_id));
+    req[sizeof(GET_ASSERTION) - 2] = 'v';
+    CHECK_EQ(CTAP2_ERR_UNSUPPORTED_OPTION,
+             ctap2_exchange(req, sizeof(GET_ASSERTION), rsp, &rsp_len));
+
+    // Truncated
+    CHECK_EQ(CTAP2_ERR_INVALID_CBOR,
+             ctap2_exchange(GET_ASSERTION, sizeof(GET_ASSERTION) - 1, rsp, &rsp_len));
+
+    // No clientDataHash (key 1 renamed to an unknown key)
+    memcpy(req, MAKE_CREDENTIAL, sizeof(MAKE_CREDENTIAL));
+    req[2] = 0x06;
+    CHECK_EQ(CTAP2_ERR_MISSING_PARAMETER,
+             ctap2_exchange(req, sizeof(MAKE_CREDENTIAL), rsp, &rsp_len));
+
+    // EdDSA (-8) and RS256 only
+    memcpy(req, MAKE_CREDENTIAL, sizeof(MAKE_CREDENTIAL));
+    req[MAKE_CREDENTIAL_ALG] = 0x27;
+    CHECK_EQ(CTAP2_ERR_UNSUPPORTED_ALGORITHM,
+             ctap2_exchange(req, sizeof(MAKE_CREDENTIAL), rsp, &rsp_len));
+
+    // Our credential in the excludeList
+    memcpy(req, MAKE_CREDENTIAL, sizeof(MAKE_CREDENTIAL));
+    req[1]++;
+    cbor_writer_init(&w, req + sizeof(MAKE_CREDENTIAL), sizeof(req) - sizeof(MAKE_CREDENTIAL));
+    cbor_put_uint(&w, CTAP2_MC_EXCLUDE_LIST);
+    cbor_put_array(&w, 1);
+    ctap2_put_credential(&w, cred_id);
+    CHECK_EQ(w.err, 0);
+    CHECK_EQ(CTAP2_ERR_CREDENTIAL_EXCLUDED,
+             ctap2_exchange(req, sizeof(MAKE_CREDENTIAL) + w.len, rsp, &rsp_len));
+
+    req[0] = 0x07;// authenticatorReset
+    CHECK_EQ(CTAP1_ERR_INVALID_COMMAND, ctap2_exchange(req, 1, rsp, &rsp_len));
+}
+
+
+// Simulated touch button (in-process only)
+static void test_UserPresence(void)
+{
+    const SHAM_TOUCH none = { 0, 0 };
+    uint8_t req[sizeof(GET_ASSERTION)], rsp[CTAP2_MSG_MAX_LEN];
+    size_t rsp_len;
+    CBOR_ITEM map, value;
+
+    memcpy(req, GET_ASSERTION, sizeof(GET_ASSERTION));
+    memcpy(req + GET_ASSERTION_CRED, cred_id, sizeof(cred_id));
+
+    // Not touched
+    sham_touch_script(&none, 1);
+    CHECK_EQ(CTAP2_ERR_OPERATION_DENIED, ctap2_exchange(req, sizeof(req), rsp, &rsp_len));
+    CHECK_EQ(sham_touch_script_remaining(), 0);
+
+    // {"up": false} signs without asking for a touch
+    sham_touch_script(&none, 1);
+    req[sizeof(req) - 1] = 0xf4;
+    CHECK_EQ(CTAP2_OK, ctap2_exchange(req, sizeof(req), rsp, &rsp_len));
+    CHECK_EQ(sham_touch_script_remaining(), 1);
+    ctap2_response(rsp, rsp_len, &map);
+    ctap2_field(&map, CTAP2_GA_RESP_AUTH_DATA, CBOR_BYTES, &value);
+    CHECK_EQ(value.p[32], 0);
+    sham_touch_script(NULL, 0);
+}
+
+
+// The credential is a U2F key handle for appId = sha256(rpId)
+static void test_U2FInterop(void)
+{
+    uint8_t foreign[CTAP2_CRED_ID_SIZE];
+
+    random_bytes(foreign, sizeof(foreign), 0);
+    CHECK_EQ(0x6a80, u2f_authenticate(U2F_AUTH_CHECK_ONLY, foreign));
+    CHECK_EQ(0x6985, u2f_authenticate(U2F_AUTH_CHECK_ONLY, cred_id));
+    CHECK_EQ(0x9000, u2f_authenticate(U2F_AUTH_ENFORCE, cred_id));
+}
+
+
+static double wall_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+
+// A U2F client probes each key handle with a CHECK_ONLY round trip before
+// signing; CTAP2 evaluates the whole allowList in one request.
+static void test_AllowListLatency(void)
+{
+    static const int foreign[] = { 0, 7, 15, 31 };
+    uint8_t req[CTAP2_MSG_MAX_LEN], rsp[CTAP2_MSG_MAX_LEN], id[CTAP2_CRED_ID_SIZE];
+    size_t req_len, rsp_len, k;
+    double t, u2f, ctap2;
+    int i;
+
+    for (k = 0; k < sizeof(foreign) / sizeof(foreign[0]); k++) {
+        t = wall_ms();
+        for (i = 0; i < foreign[k]; i++) {
+            random_bytes(id, sizeof(id), 0);
+            CHECK_EQ(0x6a80, u2f_authenticate(U2F_AUTH_CHECK_ONLY, id));
+        }
+        CHECK_EQ(0x6985, u2f_authenticate(U2F_AUTH_CHECK_ONLY, cred_id));
+        CHECK_EQ(0x9000, u2f_authenticate(U2F_AUTH_ENFORCE, cred_id));
+        u2f = wall_ms() - t;
+
+        req_len = ctap2_get_assertion_req(req, sizeof(req), foreign[k]);
+        t = wall_ms();
+        CHECK_EQ(CTAP2_OK, ctap2_exchange(req, req_len, rsp, &rsp_len));
+        ctap2 = wall_ms() - t;
+
+        PRINT_INFO("allowList of %2d: U2F %2d requests %7.2f ms, CTAP2 1 request (%4lu bytes) %5.2f ms",
+                   foreign[k] + 1, foreign[k] + 2, u2f, req_len, ctap2);
+    }
+}
+
+
+static void run_tests(void)
+{
+    uint8_t req[sizeof(GET_ASSERTION)];
+    uint32_t ctr, ctr2;
+
+    device = U2Fob_create();
+
+    if (U2Fob_open(device) == 0) {
+        CHECK_EQ(0, U2Fob_init(device));
+        PASS(test_CapFlags());
+        PASS(test_GetInfo());
+        PASS(test_MakeCredential());
+
+        memcpy(req, GET_ASSERTION, sizeof(GET_ASSERTION));
+        memcpy(req + GET_ASSERTION_CRED, cred_id, sizeof(cred_id));
+        PASS(ctr = test_GetAssertion(req, sizeof(req)));
+        PASS(ctr2 = test_GetAssertion(req, sizeof(req)));
+        CHECK_EQ(ctr2, ctr + 1);
+
+        PASS(test_Errors());
+        if (!U2Fob_liveDeviceTesting()) {
+            PASS(test_UserPresence());
+        }
+        PASS(test_U2FInterop());
+        PASS(test_AllowListLatency());
+
+        U2Fob_close(device);
+    } else {
+        printf("\n\nNot testing HID API. A device is not connected.\n\n");
+        return;
+    }
+
+    U2Fob_destroy(device);
+    return;
+}
+
+
+uint32_t __stack_chk_guard = 0;
+
+extern void __attribute__((noreturn)) __stack_chk_fail(void);
+void __attribute__((noreturn)) __stack_chk_fail(void)
+{
+    printf("\n\nError: stack smashing detected!\n\n");
+    abort();
+}
+
+
+int main(void)
+{
+
+    srand((unsigned int) time(NULL));
+
+    // Test the C code API
+    U2Fob_testLiveDevice(0);
+    random_init();
+    __stack_chk_guard = random_uint32(0);
+    ecc_context_init();
+    memory_setup();
+    memory_setup(); // run twice
+    printf("\n\nInternal API Result:\n");
+    run_tests();
+    ecc_context_destroy();
+
+    // Live test of the HID API
+#ifndef CONTINUOUS_INTEGRATION
+    U2Fob_testLiveDevice(1);
+    printf("\n\nHID API Result:\n");
+    run_tests();
+#endif
+
+    printf("\nALL TESTS PASSED\n\n");
+    return 0;
+}
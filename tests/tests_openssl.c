@@ -28,12 +28,22 @@
 #include <openssl/sha.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "ecc.h"
 #include "random.h"
 #include "utils.h"
 
 
+// From uECC.h, which cannot be included here because its sha2.h
+// conflicts with the OpenSSL SHA256_CTX definition.
+typedef const struct uECC_Curve_t *uECC_Curve;
+uECC_Curve uECC_secp256r1(void);
+uECC_Curve uECC_secp256k1(void);
+void uECC_inverse_mod_p(uint8_t *result, const uint8_t *input, uECC_Curve curve);
+void uECC_inverse_mod_n(uint8_t *result, const uint8_t *input, uECC_Curve curve);
+
+
 static int run_test(unsigned long max_iterations, EC_GROUP *ecgroup, ecc_curve_id curve)
 {
     uint8_t sig[64], pub_key33[33], pub_key65[65], priv_key[32], msg[256], buffer[1000],
@@ -135,6 +145,119 @@ static int run_test(unsigned long max_iterations, EC_GROUP *ecgroup, ecc_curve_i
 }
 
 
+static void bn_to_bytes32(const BIGNUM *bn, uint8_t *out)
+{
+    memset(out, 0, 32);
+    BN_bn2bin(bn, out + 32 - BN_num_bytes(bn));
+}
+
+
+// Cross-check the uECC modular inversion (mod p and mod n) against OpenSSL
+static int run_test_inverse(unsigned long max_iterations, EC_GROUP *ecgroup,
+                            uECC_Curve curve)
+{
+    uint8_t in[32], out[32], expected[32];
+    unsigned long iterations;
+    int m, err = 0;
+
+    BN_CTX *ctx = BN_CTX_new();
+    BIGNUM *mod[2], *x = BN_new(), *inv = BN_new();
+    mod[0] = BN_new();
+    mod[1] = BN_new();
+    EC_GROUP_get_curve_GFp(ecgroup, mod[0], NULL, NULL, ctx);
+    EC_GROUP_get_order(ecgroup, mod[1], ctx);
+
+    for (m = 0; m < 2 && !err; m++) {
+        for (iterations = 0; iterations < max_iterations; iterations++) {
+            if (iterations == 0) {
+                BN_one(x);
+            } else if (iterations == 1) {
+                BN_copy(x, mod[m]);
+                BN_sub_word(x, 1);
+            } else {
+                random_bytes(in, sizeof(in), 0);
+                BN_bin2bn(in, sizeof(in), x);
+                BN_nnmod(x, x, mod[m], ctx);
+            }
+            if (BN_is_zero(x)) {
+                continue;
+            }
+            bn_to_bytes32(x, in);
+            BN_mod_inverse(inv, x, mod[m], ctx);
+            bn_to_bytes32(inv, expected);
+
+            if (m) {
+                uECC_inverse_mod_n(out, in, curve);
+            } else {
+                uECC_inverse_mod_p(out, in, curve);
+            }
+            if (memcmp(out, expected, sizeof(out))) {
+                printf("inversion mod %s failed\n", m ? "n" : "p");
+                printf("input: %s\n", utils_uint8_to_hex(in, sizeof(in)));
+                err++;
+                break;
+            }
+        }
+    }
+    if (!err) {
+        printf("Passed inversion ... %lu\n", max_iterations);
+    }
+
+    BN_free(mod[0]);
+    BN_free(mod[1]);
+    BN_free(x);
+    BN_free(inv);
+    BN_CTX_free(ctx);
+    return err;
+}
+
+
+// Cross-check the P-256 backend used for U2F against OpenSSL: public keys
+// must match and signatures must verify
+static int run_test_p256(unsigned long max_iterations, EC_GROUP *ecgroup)
+{
+    uint8_t priv_key[32], pub_key65[65], expected[65], hash[32], sig[64], der[72];
+    unsigned long iterations;
+    int der_len, err = 0;
+
+    for (iterations = 0; iterations < max_iterations; iterations++) {
+        EC_KEY *eckey = EC_KEY_new();
+        EC_KEY_set_group(eckey, ecgroup);
+        EC_KEY_generate_key(eckey);
+        bn_to_bytes32(EC_KEY_get0_private_key(eckey), priv_key);
+        EC_POINT_point2oct(ecgroup, EC_KEY_get0_public_key(eckey),
+                           POINT_CONVERSION_UNCOMPRESSED, expected, sizeof(expected), NULL);
+
+        ecc_get_public_key65(priv_key, pub_key65, ECC_SECP256r1);
+        if (memcmp(pub_key65, expected, sizeof(expected))) {
+            printf("P-256 public key mismatch\n");
+            err++;
+        }
+
+        random_bytes(hash, sizeof(hash), 0);
+        if (ecc_sign_digest(priv_key, hash, sig, NULL, ECC_SECP256r1)) {
+            printf("P-256 signing failed\n");
+            err++;
+        }
+        der_len = ecc_sig_to_der(sig, der);
+        if (ECDSA_verify(0, hash, sizeof(hash), der, der_len, eckey) != 1) {
+            printf("P-256 OpenSSL verification failed\n");
+            err++;
+        }
+        EC_KEY_free(eckey);
+
+        if (err) {
+            printf("private key: %s\n", utils_uint8_to_hex(priv_key, sizeof(priv_key)));
+            break;
+        }
+    }
+    if (!err) {
+        printf("Passed P-256 ... %lu\n", max_iterations);
+    }
+    return err;
+}
+
+
 int main(int argc, char *argv[])
 {
     EC_GROUP *ecgroup;
@@ -153,6 +276,7 @@ int main(int argc, char *argv[])
     printf("\nTesting curve secp256k1\n");
     ecgroup = EC_GROUP_new_by_curve_name(NID_secp256k1);
     err += run_test(max_iterations, ecgroup, ECC_SECP256k1);
+    err += run_test_inverse(max_iterations, ecgroup, uECC_secp256k1());
     EC_GROUP_free(ecgroup);
 
 #ifndef ECC_USE_SECP256K1_LIB
@@ -163,6 +287,17 @@ int main(int argc, char *argv[])
     EC_GROUP_free(ecgroup);
 #endif
 
+    // uECC is always built in (U2F verification uses it for secp256r1)
+    printf("\nTesting uECC inversion on curve secp256r1\n");
+    ecgroup = EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1);
+    err += run_test_inverse(max_iterations, ecgroup, uECC_secp256r1());
+    EC_GROUP_free(ecgroup);
+
+    printf("\nTesting P-256 backend\n");
+    ecgroup = EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1);
+    err += run_test_p256(max_iterations, ecgroup);
+    EC_GROUP_free(ecgroup);
+
     bitcoin_ecc.ecc_context_destroy();
     return err;
 }
@@ -0,0 +1,347 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Replays a recorded session of API commands through the in-process
+// device and reports per-command-type latency, heap peak and simulated
+// EEPROM/SD traffic as JSON, for comparing runs against each other.
+//
+// Usage: tests_replay <script> [report.json]
+//
+// Each script line is `<interface> <key> <json command>`:
+//   interface   hww (U2FHID_HWW frames) or u2f (hijacked U2F authenticate)
+//   key         none, std (standard wallet) or hidden (hidden wallet)
+// Blank lines and lines starting with '#' are ignored.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sd.h"
+#include "ecc.h"
+#include "sha2.h"
+#include "utest.h"
+#include "utils.h"
+#include "flags.h"
+#include "random.h"
+#include "memory.h"
+#include "commander.h"
+#include "watermark.h"
+#include "yajl/src/api/yajl_tree.h"
+
+#include "api.h"
+
+
+#define REPLAY_TYPES_MAX    64
+#define REPLAY_TYPE_LEN     32
+#define REPLAY_SAMPLES_MAX  256
+
+
+int U_TESTS_RUN = 0;
+int U_TESTS_FAIL = 0;
+
+
+typedef struct {
+    char name[REPLAY_TYPE_LEN];
+    double ms[REPLAY_SAMPLES_MAX];
+    uint32_t count;
+    uint32_t errors;
+    size_t heap_peak;
+    uint32_t eeprom_reads;
+    uint32_t eeprom_writes;
+    uint32_t sd_reads;
+    uint32_t sd_writes;
+} replay_type;
+
+
+static replay_type replay_types[REPLAY_TYPES_MAX];
+static int replay_num_types = 0;
+
+
+static replay_type *replay_get_type(const char *name)
+{
+    int i;
+    for (i = 0; i < replay_num_types; i++) {
+        if (STREQ(replay_types[i].name, name)) {
+            return &replay_types[i];
+        }
+    }
+    if (replay_num_types == REPLAY_TYPES_MAX) {
+        return NULL;
+    }
+    snprintf(replay_types[replay_num_types].name, REPLAY_TYPE_LEN, "%s", name);
+    return &replay_types[replay_num_types++];
+}
+
+
+// Names a command by its top-level key. Sign commands are split into the
+// echo step (`sign_echo/N`) and the signing step (`sign/N`) by number of inputs.
+static int replay_type_name(const char *command, char *name, size_t name_len)
+{
+    static size_t sign_inputs = 0;
+    yajl_val json_node = yajl_tree_parse(command, NULL, 0);
+
+    if (!json_node || !YAJL_IS_OBJECT(json_node) || json_node->u.object.len == 0) {
+        yajl_tree_free(json_node);
+        return DBB_ERROR;
+    }
+
+    const char *key = json_node->u.object.keys[0];
+    yajl_val value = json_node->u.object.values[0];
+
+    if (STREQ(key, cmd_str(CMD_sign))) {
+        const char *data_path[] = { cmd_str(CMD_data), NULL };
+        yajl_val data = yajl_tree_get(value, data_path, yajl_t_array);
+        if (YAJL_IS_ARRAY(data)) {
+            sign_inputs = data->u.array.len;
+            snprintf(name, name_len, "sign_echo/%zu", sign_inputs);
+        } else {
+            snprintf(name, name_len, "sign/%zu", sign_inputs);
+        }
+    } else {
+        snprintf(name, name_len, "%s", key);
+    }
+
+    yajl_tree_free(json_node);
+    return DBB_OK;
+}
+
+
+static int replay_compare_ms(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+static double replay_percentile(const double *sorted, uint32_t n, int percent)
+{
+    return sorted[(n - 1) * percent / 100];
+}
+
+
+static void replay_report(FILE *out, const char *script, uint32_t commands,
+                          uint32_t errors, size_t heap_peak_total)
+{
+    int i;
+    uint32_t eeprom_reads = 0, eeprom_writes = 0, sd_reads = 0, sd_writes = 0;
+
+    for (i = 0; i < replay_num_types; i++) {
+        eeprom_reads += replay_types[i].eeprom_reads;
+        eeprom_writes += replay_types[i].eeprom_writes;
+        sd_reads += replay_types[i].sd_reads;
+        sd_writes += replay_types[i].sd_writes;
+    }
+
+    fprintf(out, "{\n  \"script\": \"%s\",\n", script);
+    fprintf(out, "  \"commands\": %u,\n  \"errors\": %u,\n", commands, errors);
+    fprintf(out, "  \"heap_peak\": %zu,\n", heap_peak_total);
+    fprintf(out, "  \"eeprom\": {\"reads\": %u, \"writes\": %u},\n", eeprom_reads,
+            eeprom_writes);
+    fprintf(out, "  \"sd\": {\"reads\": %u, \"writes\": %u},\n", sd_reads, sd_writes);
+    fprintf(out, "  \"types\": [");
+    for (i = 0; i < replay_num_types; i++) {
+        replay_type *t = &replay_types[i];
+        uint32_t j, n = MIN(t->count, REPLAY_SAMPLES_MAX);
+        double sum = 0;
+
+        qsort(t->ms, n, sizeof(t->ms[0]), replay_compare_ms);
+        for (j = 0; j < n; j++) {
+            sum += t->ms[j];
+        }
+        fprintf(out, "%s\n    {\"type\": \"%s\", \"count\": %u, \"errors\": %u, ",
+                i ? "," : "", t->name, t->count, t->errors);
+        fprintf(out, "\"ms\": {\"min\": %.3f, \"median\": %.3f, \"p90\": %.3f, "
+                "\"max\": %.3f, \"mean\": %.3f, \"total\": %.3f}, ", t->ms[0],
+                replay_percentile(t->ms, n, 50), replay_percentile(t->ms, n, 90), t->ms[n - 1],
+                sum / n, sum);
+        fprintf(out, "\"heap_peak\": %zu, ", t->heap_peak);
+        fprintf(out, "\"eeprom\": {\"reads\": %u, \"writes\": %u}, ", t->eeprom_reads,
+                t->eeprom_writes);
+        fprintf(out, "\"sd\": {\"reads\": %u, \"writes\": %u}}", t->sd_reads, t->sd_writes);
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+
+static int replay_line(char *line, uint32_t line_num, uint32_t *errors,
+                       size_t *heap_peak_total)
+{
+    char interface[8], key_name[8], type_name[REPLAY_TYPE_LEN];
+    char *command;
+    uint8_t *key;
+    int n = 0;
+    uint32_t eeprom_reads[2], eeprom_writes[2], sd_reads[2], sd_writes[2];
+    size_t heap_base;
+    clock_t t;
+    replay_type *type;
+
+    if (sscanf(line, "%7s %7s %n", interface, key_name, &n) != 2 || !n) {
+        fprintf(stderr, "line %u: expected `<interface> <key> <command>`\n", line_num);
+        return DBB_ERROR;
+    }
+    command = line + n;
+    command[strcspn(command, "\r\n")] = '\0';
+
+    if (STREQ(key_name, "none")) {
+        key = NULL;
+    } else if (STREQ(key_name, "std")) {
+        key = KEY_STANDARD;
+    } else if (STREQ(key_name, "hidden")) {
+        key = KEY_HIDDEN;
+    } else {
+        fprintf(stderr, "line %u: unknown key `%s`\n", line_num, key_name);
+        return DBB_ERROR;
+    }
+
+    if (STREQ(interface, "hww")) {
+        TEST_U2FAUTH_HIJACK = 0;
+    } else if (STREQ(interface, "u2f")) {
+        TEST_U2FAUTH_HIJACK = 1;
+    } else {
+        fprintf(stderr, "line %u: unknown interface `%s`\n", line_num, interface);
+        return DBB_ERROR;
+    }
+
+    if (replay_type_name(command, type_name, sizeof(type_name)) != DBB_OK) {
+        fprintf(stderr, "line %u: invalid command `%s`\n", line_num, command);
+        return DBB_ERROR;
+    }
+    type = replay_get_type(type_name);
+    if (!type) {
+        fprintf(stderr, "line %u: too many command types\n", line_num);
+        return DBB_ERROR;
+    }
+
+    memory_eeprom_io_count(&eeprom_reads[0], &eeprom_writes[0]);
+    sd_io_count(&sd_reads[0], &sd_writes[0]);
+    heap_base = watermark_heap_in_use();
+    watermark_heap_reset();
+
+    t = clock();
+    api_send_cmd(command, key);
+    t = clock() - t;
+
+    memory_eeprom_io_count(&eeprom_reads[1], &eeprom_writes[1]);
+    sd_io_count(&sd_reads[1], &sd_writes[1]);
+
+    if (type->count < REPLAY_SAMPLES_MAX) {
+        type->ms[type->count] = 1000.0 * t / CLOCKS_PER_SEC;
+    }
+    type->count++;
+    type->heap_peak = MAX(type->heap_peak, watermark_heap_window_peak() - heap_base);
+    *heap_peak_total = MAX(*heap_peak_total, watermark_heap_window_peak() - heap_base);
+    type->eeprom_reads += eeprom_reads[1] - eeprom_reads[0];
+    type->eeprom_writes += eeprom_writes[1] - eeprom_writes[0];
+    type->sd_reads += sd_reads[1] - sd_reads[0];
+    type->sd_writes += sd_writes[1] - sd_writes[0];
+
+    if (strstr(api_read_decrypted_report(), attr_str(ATTR_error))) {
+        fprintf(stderr, "line %u: %s\n", line_num, api_read_decrypted_report());
+        type->errors++;
+        (*errors)++;
+    }
+    return DBB_OK;
+}
+
+
+uint32_t __stack_chk_guard = 0;
+
+extern void __attribute__((noreturn)) __stack_chk_fail(void);
+void __attribute__((noreturn)) __stack_chk_fail(void)
+{
+    printf("\n\nError: stack smashing detected!\n\n");
+    abort();
+}
+
+
+int main(int argc, char *argv[])
+{
+    char line[COMMANDER_REPORT_SIZE];
+    uint32_t line_num = 0, commands = 0, errors = 0;
+    size_t heap_peak_total = 0;
+    FILE *script, *out = stdout;
+
+    if (argc < 2 || argc > 3) {
+        printf("Usage: %s <script> [report.json]\n", argv[0]);
+        return 1;
+    }
+
+    script = fopen(argv[1], "r");
+    if (!script) {
+        printf("Cannot open script %s\n", argv[1]);
+        return 1;
+    }
+
+    TEST_LIVE_DEVICE = 0;
+    random_init();
+    __stack_chk_guard = random_uint32(0);
+    ecc_context_init();
+#ifdef ECC_USE_SECP256K1_LIB
+    bitcoin_ecc.ecc_context_init();
+#endif
+    // Fill test aes keys for standard and hidden wallets
+    sha256_Raw((const uint8_t *)tests_pwd, strlens(tests_pwd), KEY_STANDARD);
+    sha256_Raw(KEY_STANDARD, MEM_PAGE_LEN, KEY_STANDARD);
+    sha256_Raw((const uint8_t *)hidden_pwd, strlens(hidden_pwd), KEY_HIDDEN);
+    sha256_Raw(KEY_HIDDEN, MEM_PAGE_LEN, KEY_HIDDEN);
+
+    api_reset_device();
+    memory_setup();
+
+    while (fgets(line, sizeof(line), script)) {
+        line_num++;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (replay_line(line, line_num, &errors, &heap_peak_total) != DBB_OK) {
+            errors++;
+            break;
+        }
+        commands++;
+    }
+    fclose(script);
+
+    if (argc == 3) {
+        out = fopen(argv[2], "w");
+        if (!out) {
+            printf("Cannot open report file %s\n", argv[2]);
+            return 1;
+        }
+    }
+    replay_report(out, argv[1], commands, errors, heap_peak_total);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    ecc_context_destroy();
+#ifdef ECC_USE_SECP256K1_LIB
+    bitcoin_ecc.ecc_context_destroy();
+#endif
+    return errors;
+}
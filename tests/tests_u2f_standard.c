@@ -21,6 +21,7 @@
 #include "sha2.h"
 #include "ecc.h"
 #include "api.h"
+#include "u2f_device.h"
 
 #include "u2f/u2f.h"
 #include "u2f/u2f_util_t.h"
@@ -340,6 +341,105 @@ static void check_CounterUpdate(void)
 }
 
 
+static void u2f_precompute(bool enable)
+{
+    uint32_t flags = memory_report_ext_flags();
+    if (enable) {
+        flags &= ~(MEM_EXT_MASK_U2F_PRECOMPUTE);
+    } else {
+        flags |= MEM_EXT_MASK_U2F_PRECOMPUTE;
+    }
+    memory_write_ext_flags(flags);
+    u2f_device_nonce_pool_clear();
+}
+
+
+static void u2f_idle(void)
+{
+    int i;
+    for (i = 0; i < 8; i++) {
+        u2f_device_idle();
+    }
+}
+
+
+static void check_NoncePool(void)
+{
+    uint8_t n;
+
+    // Idle-time nonce precomputation (feature_set U2F_precompute)
+    // Disabled by default
+    test_Sign(0x9000, false);
+    u2f_idle();
+    CHECK_EQ(u2f_device_nonce_pool_count(), 0);
+
+    // Seeded by the first authentication after enabling
+    u2f_precompute(true);
+    u2f_idle();
+    CHECK_EQ(u2f_device_nonce_pool_count(), 0);
+    test_Sign(0x9000, false);
+    u2f_idle();
+    n = u2f_device_nonce_pool_count();
+    CHECK_NE(n, 0);
+
+    // Each authentication takes one nonce
+    test_Sign(0x9000, false);
+    CHECK_EQ(u2f_device_nonce_pool_count(), n - 1);
+    test_Sign(0x9000, false);
+    CHECK_EQ(u2f_device_nonce_pool_count(), n - 2);
+    u2f_idle();
+    CHECK_EQ(u2f_device_nonce_pool_count(), n);
+
+    // Empty pool falls back to signing with a deterministic nonce
+    while (u2f_device_nonce_pool_count()) {
+        test_Sign(0x9000, false);
+    }
+    test_Sign(0x9000, false);
+
+    // Wiped when the U2F key is reset and when disabled
+    u2f_idle();
+    CHECK_EQ(u2f_device_nonce_pool_count(), n);
+    api_format_send_cmd(cmd_str(CMD_seed),
+                        "{\"source\":\"U2F_load\", \"key\":\"key\", \"filename\":\"u2fcountertest.pdf\"}",
+                        KEY_STANDARD);
+    ASSERT_SUCCESS;
+    CHECK_EQ(u2f_device_nonce_pool_count(), 0);
+    u2f_precompute(false);
+    CHECK_EQ(u2f_device_nonce_pool_count(), 0);
+}
+
+
+#ifndef CONTINUOUS_INTEGRATION
+static void test_Latency(void)
+{
+    int i, n = 10;
+    uint64_t t = 0;
+    double enroll = 0, sign = 0, sign_pool = 0;
+
+    for (i = 0; i < n; i++) {
+        U2Fob_deltaTime(&t);
+        test_Enroll(0x9000, 0);
+        enroll += U2Fob_deltaTime(&t);
+        test_Sign(0x9000, false);
+        sign += U2Fob_deltaTime(&t);
+    }
+
+    u2f_precompute(true);
+    test_Sign(0x9000, false);
+    for (i = 0; i < n; i++) {
+        u2f_idle();
+        U2Fob_deltaTime(&t);
+        test_Sign(0x9000, false);
+        sign_pool += U2Fob_deltaTime(&t);
+    }
+    u2f_precompute(false);
+
+    PRINT_INFO("Latency: register %.2f ms, authenticate %.2f ms (%.2f ms with nonce pool)",
+               enroll * 1000 / n, sign * 1000 / n, sign_pool * 1000 / n);
+}
+#endif
+
+
 static void run_tests(void)
 {
     // Start of tests
@@ -407,6 +507,17 @@ static void run_tests(void)
         // Check if HWW interface updates U2F counter correctly
         PASS(check_CounterUpdate());
 
+        if (!U2Fob_liveDeviceTesting()) {
+            PASS(check_NoncePool());
+        }
+
+#ifndef CONTINUOUS_INTEGRATION
+        // Crypto dominates; the touch button is simulated
+        if (!U2Fob_liveDeviceTesting()) {
+            PASS(test_Latency());
+        }
+#endif
+
     } else {
         PRINT_MESSAGE("\n\nNot testing HID API. A device is not connected.\n\n");
         return;
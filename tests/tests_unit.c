@@ -45,7 +45,19 @@
 #include "sha2.h"
 #include "uECC.h"
 #include "ecc.h"
+#include "p256.h"
+#include "hmac.h"
+#include "rfc6979.h"
 #include "aes.h"
+#include "led.h"
+#include "sham.h"
+#include "touch_state.h"
+#include "crypto_table.h"
+#include "boot_pipeline.h"
+#include "flash.h"
+#ifdef ECC_USE_SECP256K1_LIB
+#include "secp256k1_batch.h"
+#endif
 
 
 int U_TESTS_RUN = 0;
@@ -443,15 +455,22 @@ static void test_bip32_vector_2(void)
     res = uECC_generate_k_rfc6979(k, utils_hex_to_uint8(KEY), buf, 32, &ctx.uECC, uECC_secp256k1()); \
     u_assert_int_eq(res, 1); \
     u_assert_mem_eq(k, utils_hex_to_uint8(K), 32); \
+    memcpy(key, utils_hex_to_uint8(KEY), 32); \
+    rfc6979_init(&rng, key, buf); \
+    rfc6979_next(&rng, k); \
+    u_assert_mem_eq(k, utils_hex_to_uint8(K), 32); \
 } while (0)
 
 
 static void test_rfc6979(void)
 {
-    int res;
+    int res, i, j, N = 2000;
     uint8_t buf[32];
-    uint8_t k[32];
+    uint8_t k[32], key[32], K[32], V[32], data[32 + 1 + 64];
     uint8_t tmp[32 + 32 + 64];
+    RFC6979_STATE rng;
+    clock_t t;
+    double t_generic, t_cached;
 
     SHA256_HashContext ctx = {{&init_SHA256, &update_SHA256, &finish_SHA256, 64, 32, tmp}};
 
@@ -469,6 +488,74 @@ static void test_rfc6979(void)
     test_deterministic("e91671c46231f833a6406ccbea0e3e392c76c167bac1cb013f6f1013980455c2",
                        "There is a computer disease that anybody who works with computers knows about. It's a very serious disease and it interferes completely with the work. The trouble with computers is that you 'play' with them!",
                        "1f4b84c23a86a221d233f2521be018d9318639d5b8bbd6374a8a59232d16ad3d");
+
+    // P-256, RFC6979 A.2.5 (SHA-256)
+    memcpy(key, utils_hex_to_uint8("c9afa9d845ba75166b5c215767b1d6934e50c3db36e89b127b8a622b120f6721"), 32);
+    sha256_Raw((const uint8_t *)"sample", 6, buf);
+    rfc6979_init(&rng, key, buf);
+    rfc6979_next(&rng, k);
+    u_assert_mem_eq(k, utils_hex_to_uint8("a6e3c57dd01abe90086538398355dd4c3b17aa873382b0f24d6129493d8aad60"), 32);
+    res = p256_sign_digest(key, buf, tmp);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(tmp, utils_hex_to_uint8("efd48b2aacb6a8fd1140dd9cd45e81d69d2c877b56aaf991c34d0ea84eaf3716"), 32);
+    sha256_Raw((const uint8_t *)"test", 4, buf);
+    rfc6979_init(&rng, key, buf);
+    rfc6979_next(&rng, k);
+    u_assert_mem_eq(k, utils_hex_to_uint8("d16b6ae827f17175e040871a1c7ec3500192c4c92677336ec2537acaee0008e0"), 32);
+
+    // Rejected candidates continue as RFC6979 3.2 h.3, checked against plain HMAC
+    memset(V, 0x01, 32);
+    memset(K, 0x00, 32);
+    memcpy(data + 33, key, 32);
+    memcpy(data + 65, buf, 32);
+    for (i = 0; i < 2; i++) {
+        memcpy(data, V, 32);
+        data[32] = i;
+        hmac_sha256(K, 32, data, sizeof(data), K);
+        hmac_sha256(K, 32, V, 32, V);
+    }
+    rfc6979_init(&rng, key, buf);
+    for (i = 0; i < 4; i++) {
+        if (i) {
+            memcpy(data, V, 32);
+            data[32] = 0x00;
+            hmac_sha256(K, 32, data, 33, K);
+            hmac_sha256(K, 32, V, 32, V);
+        }
+        hmac_sha256(K, 32, V, 32, V);
+        rfc6979_next(&rng, k);
+        u_assert_mem_eq(k, V, 32);
+    }
+
+    // Same nonces as the generic uECC hash context, without rehashing the key pads
+    for (i = 0; i < 100; i++) {
+        random_bytes(key, 32, 0);
+        random_bytes(buf, 32, 0);
+        uECC_generate_k_rfc6979(k, key, buf, 32, &ctx.uECC, uECC_secp256k1());
+        uECC_sign_deterministic(key, buf, 32, &ctx.uECC, data, uECC_secp256k1());
+        uECC_normalize_signature(data, uECC_secp256k1());
+        rfc6979_init(&rng, key, buf);
+        rfc6979_next(&rng, tmp);
+        u_assert_mem_eq(k, tmp, 32);
+        res = ecc_sign_digest(key, buf, tmp, NULL, ECC_SECP256k1);
+        u_assert_int_eq(res, 0);
+        u_assert_mem_eq(data, tmp, 64);
+    }
+
+    t = clock();
+    for (j = 0; j < N; j++) {
+        uECC_generate_k_rfc6979(k, key, buf, 32, &ctx.uECC, uECC_secp256k1());
+    }
+    t_generic = (double)(clock() - t) / CLOCKS_PER_SEC / N;
+    t = clock();
+    for (j = 0; j < N; j++) {
+        rfc6979_init(&rng, key, buf);
+        rfc6979_next(&rng, k);
+    }
+    t_cached = (double)(clock() - t) / CLOCKS_PER_SEC / N;
+    rfc6979_clear(&rng);
+    u_print_info("RFC6979 nonce per signature: %0.2f us (generic HMAC), %0.2f us (cached pads), %0.2f us saved\n",
+                 t_generic * 1e6, t_cached * 1e6, (t_generic - t_cached) * 1e6);
 }
 
 
@@ -540,9 +627,193 @@ static void test_sign_speed(void)
 }
 
 
+static void test_sign_batch(void)
+{
+    uint8_t keys[20][32], hashes[20][32], sigs[20][64], sig[64], recids[20], recid;
+    size_t i, count, N = 250;
+    int res;
+
+    for (count = 1; count <= 20; count++) {
+        for (i = 0; i < count; i++) {
+            random_bytes(keys[i], 32, 0);
+            random_bytes(hashes[i], 32, 0);
+        }
+
+        // Batch signatures must be identical to signing one by one
+        memset(recids, 0xEE, sizeof(recids));
+        res = bitcoin_ecc.ecc_sign_digests_batch(keys[0], hashes[0], sigs[0], recids, count,
+                ECC_SECP256k1);
+        u_assert_int_eq(res, 0);
+        for (i = 0; i < count; i++) {
+            recid = 0xEE;
+            res = bitcoin_ecc.ecc_sign_digest(keys[i], hashes[i], sig, &recid, ECC_SECP256k1);
+            u_assert_int_eq(res, 0);
+            u_assert_mem_eq(sigs[i], sig, 64);
+            u_assert_int_eq(recids[i], recid);
+        }
+
+        // uECC, which also signs secp256r1 for U2F
+        res = ecc_sign_digests_batch(keys[0], hashes[0], sigs[0], NULL, count, ECC_SECP256r1);
+        u_assert_int_eq(res, 0);
+        for (i = 0; i < count; i++) {
+            res = ecc_sign_digest(keys[i], hashes[i], sig, NULL, ECC_SECP256r1);
+            u_assert_int_eq(res, 0);
+            u_assert_mem_eq(sigs[i], sig, 64);
+        }
+    }
+
+    // Items with an unusable nonce are flagged; the others still share the inversions
+    uint8_t nonces[4][32], failed[4];
+    random_bytes(nonces[0], sizeof(nonces), 0);
+    memset(nonces[1], 0, 32);
+    memset(nonces[2], 0xFF, 32);
+    res = uECC_sign_batch(keys[0], hashes[0], 32, nonces[0], 4, sigs[0], failed,
+                          uECC_secp256k1());
+    u_assert_int_eq(res, 1);
+    u_assert_int_eq(failed[0], 0);
+    u_assert_int_eq(failed[1], 1);
+    u_assert_int_eq(failed[2], 1);
+    u_assert_int_eq(failed[3], 0);
+    for (i = 0; i < 4; i += 3) {
+        res = uECC_sign_with_nonce(keys[i], hashes[i], 32, nonces[i], sig, uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+        u_assert_mem_eq(sigs[i], sig, 64);
+    }
+
+    count = 16;
+    clock_t t = clock();
+    for (i = 0; i < N / count; i++) {
+        res = bitcoin_ecc.ecc_sign_digests_batch(keys[2], hashes[2], sigs[0], recids, count,
+                ECC_SECP256k1);
+        u_assert_int_eq(res, 0);
+    }
+    u_print_info("Batch signing speed: %0.2f sig/s\n",
+                 (N / count) * count / ((float)(clock() - t) / CLOCKS_PER_SEC));
+}
+
+
+#ifdef ECC_USE_SECP256K1_LIB
+#define test_nonce_libsecp256k1(MSG, K) do { \
+    memcpy(msg, utils_hex_to_uint8(MSG), 32); \
+    for (attempt = 0; attempt < 4; attempt++) { \
+        res = secp256k1_nonce_function_rfc6979_state(k, msg, key, NULL, &rng, attempt); \
+        u_assert_int_eq(res, 1); \
+        res = secp256k1_nonce_function_rfc6979(k_lib, msg, key, NULL, NULL, attempt); \
+        u_assert_int_eq(res, 1); \
+        u_assert_mem_eq(k, k_lib, 32); \
+        if (attempt == 0) { \
+            u_assert_mem_eq(k, utils_hex_to_uint8(K), 32); \
+        } \
+    } \
+    rfc6979_clear(&rng); \
+} while (0)
+
+
+static void test_rfc6979_libsecp256k1(void)
+{
+    uint8_t key[32], msg[32], k[32], k_lib[32];
+    unsigned int attempt;
+    RFC6979_STATE rng;
+    int res;
+
+    memcpy(key,
+           utils_hex_to_uint8("cca9fbcc1b41e5a95d369eaa6ddcff73b61a4efaa279cfc6567e8daa39cbaf50"),
+           32);
+    // sha256("sample")
+    test_nonce_libsecp256k1("af2bdbe1aa9b6ec1e2ade1d694f41fc71a831d0268e9891562113d8a62add1bf",
+                            "2df40ca70e639d89528a6b670d9d48d9165fdc0febc0974056bdce192b8e16a3");
+    // Digests >= n are reduced mod n before the nonce is derived
+    test_nonce_libsecp256k1("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff",
+                            "67319f9b18f101d36d666f3f473b47d354159e343f0cc776a6b6d6d9cb8bdbd8");
+    test_nonce_libsecp256k1("fffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364141",
+                            "a914715932d4509a429eacb6059271745c7f85ab7bed721ee3118a6c3455b308");
+}
+
+
+static void test_sign_batch_libsecp256k1(void)
+{
+    uint8_t keys[SECP256K1_SIGN_BATCH_MAX][32], hashes[SECP256K1_SIGN_BATCH_MAX][32];
+    uint8_t sig[64], sig_batch[64];
+    secp256k1_ecdsa_recoverable_signature sigs[SECP256K1_SIGN_BATCH_MAX], single;
+    secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+    size_t i, count, N = 50;
+    int res, recid, recid_batch;
+
+    for (; N > 0; N--) {
+        for (i = 0; i < SECP256K1_SIGN_BATCH_MAX; i++) {
+            random_bytes(keys[i], 32, 0);
+            random_bytes(hashes[i], 32, 0);
+        }
+        // Digests >= n, which the library reduces before deriving the nonce
+        memset(hashes[0], 0xFF, 32);
+        memcpy(hashes[1],
+               utils_hex_to_uint8("fffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364141"),
+               32);
+
+        count = 1 + N % SECP256K1_SIGN_BATCH_MAX;
+        res = secp256k1_ecdsa_sign_recoverable_batch(ctx, sigs, hashes[0], keys[0], count);
+        u_assert_int_eq(res, 1);
+        for (i = 0; i < count; i++) {
+            // Must match the library signer with its own RFC6979 nonce function
+            res = secp256k1_ecdsa_sign_recoverable(ctx, &single, hashes[i], keys[i], NULL, NULL);
+            u_assert_int_eq(res, 1);
+            secp256k1_ecdsa_recoverable_signature_serialize_compact(ctx, sig, &recid, &single);
+            secp256k1_ecdsa_recoverable_signature_serialize_compact(ctx, sig_batch, &recid_batch,
+                    &sigs[i]);
+            u_assert_mem_eq(sig_batch, sig, 64);
+            u_assert_int_eq(recid_batch, recid);
+        }
+    }
+    secp256k1_context_destroy(ctx);
+}
+
+
+static void test_public_ckd_libsecp256k1(void)
+{
+    uint8_t seed[32], tweak[32], pub_uecc[33], pub_lib[33];
+    HDNode parent, priv, pub;
+    uint32_t i;
+    int N = 50;
+
+    for (; N > 0; N--) {
+        random_bytes(seed, sizeof(seed), 0);
+        u_assert_int_eq(hdnode_from_seed(seed, sizeof(seed), &parent), DBB_OK);
+        u_assert_int_eq(hdnode_private_ckd_prime(&parent, N), DBB_OK);
+        i = N % 2 ? (uint32_t)N : random_uint32(0) & 0x7fffffff;
+
+        // pubkey_tweak_add in hdnode_public_ckd() against the private derivation
+        memcpy(&priv, &parent, sizeof(HDNode));
+        memcpy(&pub, &parent, sizeof(HDNode));
+        u_assert_int_eq(hdnode_private_ckd(&priv, i), DBB_OK);
+        u_assert_int_eq(hdnode_public_ckd(&pub, i), DBB_OK);
+        u_assert_mem_eq(pub.public_key, priv.public_key, 33);
+        u_assert_mem_eq(pub.chain_code, priv.chain_code, 32);
+        u_assert_int_eq(pub.fingerprint, priv.fingerprint);
+        u_assert_int_eq(pub.depth, priv.depth);
+        u_assert_int_eq(pub.child_num, priv.child_num);
+
+        // Same tweak through uECC
+        random_bytes(tweak, sizeof(tweak), 0);
+        if (!ecc_isValid(tweak, ECC_SECP256k1)) {
+            continue;
+        }
+        u_assert_int_eq(ecc_generate_public_key(pub_uecc, parent.public_key, tweak,
+                                                ECC_SECP256k1), 1);
+        u_assert_int_eq(libsecp256k1_ecc_generate_public_key(pub_lib, parent.public_key, tweak,
+                        ECC_SECP256k1), 1);
+        u_assert_mem_eq(pub_lib, pub_uecc, 33);
+    }
+
+    // Hardened children need the private key
+    memcpy(&pub, &parent, sizeof(HDNode));
+    u_assert_int_eq(hdnode_public_ckd(&pub, 0x80000000), DBB_ERROR);
+}
+#endif
+
+
 static void test_verify_speed(void)
 {
-    uint8_t sig[64], pub_key33[33], pub_key65[65], msg[256];
+    uint8_t sig[64], pub_key33[33], pub_key65[65], msg[256], hash[32];
     size_t i;
     int res;
 
@@ -588,6 +859,292 @@ static void test_verify_speed(void)
 
     u_print_info("Verifying speed: %0.2f sig/s\n",
                  100.0f / ((float)(clock() - t) / CLOCKS_PER_SEC));
+
+    // uECC directly, as used by the bootloader
+    sha256_Raw(msg, sizeof(msg), hash);
+    t = clock();
+    for (i = 0 ; i < 100; i++) {
+        res = uECC_verify(pub_key65 + 1, hash, sizeof(hash), sig, uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+    }
+    u_print_info("uECC verifying speed (%s): %0.2f sig/s\n",
+                 uECC_GLV_VERIFY ? "GLV, wNAF" : "Shamir's trick",
+                 100.0f / ((float)(clock() - t) / CLOCKS_PER_SEC));
+
+    hash[0] ^= 1;
+    res = uECC_verify(pub_key65 + 1, hash, sizeof(hash), sig, uECC_secp256k1());
+    u_assert_int_eq(res, 0);
+}
+
+
+static void test_uecc_verify(void)
+{
+    uint8_t sig[64], pub_key[64], priv_key[32], hash[32];
+    uint8_t tmp[32 + 32 + 64];
+    size_t i;
+    int res;
+
+    SHA256_HashContext ctx = {{&init_SHA256, &update_SHA256, &finish_SHA256, 64, 32, tmp}};
+
+    for (i = 0; i < 200; i++) {
+        random_bytes(priv_key, sizeof(priv_key), 0);
+        random_bytes(hash, sizeof(hash), 0);
+        if (i == 0) {
+            // scalar u1 = 0
+            memset(hash, 0, sizeof(hash));
+        }
+        if (!uECC_isValid(priv_key, uECC_secp256k1())) {
+            continue;
+        }
+        res = uECC_compute_public_key(priv_key, pub_key, uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+        res = uECC_sign_deterministic(priv_key, hash, sizeof(hash), &ctx.uECC, sig,
+                                      uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+        res = uECC_verify(pub_key, hash, sizeof(hash), sig, uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+
+        // wrong message
+        hash[i % 32] ^= 0x80;
+        res = uECC_verify(pub_key, hash, sizeof(hash), sig, uECC_secp256k1());
+        u_assert_int_eq(res, 0);
+        hash[i % 32] ^= 0x80;
+
+        // wrong key
+        res = uECC_compute_public_key(sig, pub_key, uECC_secp256k1());
+        u_assert_int_eq(res, 1);
+        res = uECC_verify(pub_key, hash, sizeof(hash), sig, uECC_secp256k1());
+        u_assert_int_eq(res, 0);
+    }
+}
+
+
+static void test_p256(void)
+{
+    uint8_t priv_key[32], hash[32], sig[64], sig_uecc[64], pub_key[64], pub_key_uecc[64];
+    uint8_t tmp[32 + 32 + 64];
+    size_t i, N = 100;
+    int res;
+
+    SHA256_HashContext ctx = {{&init_SHA256, &update_SHA256, &finish_SHA256, 64, 32, tmp}};
+
+    // RFC6979 A.2.5 (P-256, SHA-256); s of "sample" is normalized to n - s
+    memcpy(priv_key,
+           utils_hex_to_uint8("c9afa9d845ba75166b5c215767b1d6934e50c3db36e89b127b8a622b120f6721"),
+           32);
+    res = p256_get_public_key(priv_key, pub_key);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(pub_key,
+                    utils_hex_to_uint8("60fed4ba255a9d31c961eb74c6356d68c049b8923b61fa6ce669622e60f29fb67903fe1008b8bc99a41ae9e95628bc64f2f1b20c2d7e9f5177a3c294d4462299"),
+                    64);
+    sha256_Raw((const uint8_t *)"sample", 6, hash);
+    res = p256_sign_digest(priv_key, hash, sig);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(sig,
+                    utils_hex_to_uint8("efd48b2aacb6a8fd1140dd9cd45e81d69d2c877b56aaf991c34d0ea84eaf37160834e36ad29a83bf2bc9385e491d6099c8fdf9d1ed67aa7ea5f51f93782857a9"),
+                    64);
+    sha256_Raw((const uint8_t *)"test", 4, hash);
+    res = p256_sign_digest(priv_key, hash, sig);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(sig,
+                    utils_hex_to_uint8("f1abb023518351cd71d881567b1ea663ed3efcf6c5132b354f28d3b0b7d38367019f4113742a2b14bd25926b49c649155f267e60d3814b4c0cc84250e46f0083"),
+                    64);
+
+    // Digests >= n: the nonce uses the digest as given, the same as uECC
+    memset(hash, 0xff, sizeof(hash));
+    res = p256_sign_digest(priv_key, hash, sig);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(sig,
+                    utils_hex_to_uint8("a38b4bf5013627c24aadc72c653ac4d1afadf8a570960b1c4d066c5cfc60958416a2094352198c79ebcb9e52de2fd3b02ab5667ac88ea519d45aecd1d8864e42"),
+                    64);
+    res = uECC_sign_deterministic(priv_key, hash, sizeof(hash), &ctx.uECC, sig_uecc,
+                                  uECC_secp256r1());
+    u_assert_int_eq(res, 1);
+    uECC_normalize_signature(sig_uecc, uECC_secp256r1());
+    u_assert_mem_eq(sig, sig_uecc, 64);
+    memcpy(hash,
+           utils_hex_to_uint8("ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551"),
+           32);
+    res = p256_sign_digest(priv_key, hash, sig);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(sig,
+                    utils_hex_to_uint8("99d609eef387373fb25ae2c6acdd0b0a83a94bfbe82fdefc3d54b704bcd8a7a74cd3b62fd2ec0a89dd2f2c5ec68dbdee86f8571a7bc8e3a679304452e15d86a7"),
+                    64);
+    res = uECC_sign_deterministic(priv_key, hash, sizeof(hash), &ctx.uECC, sig_uecc,
+                                  uECC_secp256r1());
+    u_assert_int_eq(res, 1);
+    uECC_normalize_signature(sig_uecc, uECC_secp256r1());
+    u_assert_mem_eq(sig, sig_uecc, 64);
+
+    // Key range
+    memset(priv_key, 0, sizeof(priv_key));
+    u_assert_int_eq(p256_is_valid(priv_key), 0);
+    u_assert_int_eq(p256_get_public_key(priv_key, pub_key), 1);
+    u_assert_int_eq(p256_sign_digest(priv_key, hash, sig), 1);
+    priv_key[31] = 1;
+    u_assert_int_eq(p256_is_valid(priv_key), 1);
+    memcpy(priv_key,
+           utils_hex_to_uint8("ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551"),
+           32);
+    u_assert_int_eq(p256_is_valid(priv_key), 0);
+    priv_key[31]--;
+    u_assert_int_eq(p256_is_valid(priv_key), 1);
+
+    // Same keys and signatures as the generic uECC code
+    for (i = 0; i < N; i++) {
+        random_bytes(priv_key, sizeof(priv_key), 0);
+        random_bytes(hash, sizeof(hash), 0);
+        if (i == 0) {
+            memset(priv_key, 0xff, 16);// close to n
+        } else if (i == 1) {
+            memset(priv_key, 0, 31);// small key
+        }
+        u_assert_int_eq(p256_is_valid(priv_key), uECC_isValid(priv_key, uECC_secp256r1()));
+        if (!p256_is_valid(priv_key)) {
+            continue;
+        }
+        res = uECC_compute_public_key(priv_key, pub_key_uecc, uECC_secp256r1());
+        u_assert_int_eq(res, 1);
+        res = p256_get_public_key(priv_key, pub_key);
+        u_assert_int_eq(res, 0);
+        u_assert_mem_eq(pub_key, pub_key_uecc, 64);
+
+        res = uECC_sign_deterministic(priv_key, hash, sizeof(hash), &ctx.uECC, sig_uecc,
+                                      uECC_secp256r1());
+        u_assert_int_eq(res, 1);
+        uECC_normalize_signature(sig_uecc, uECC_secp256r1());
+        res = p256_sign_digest(priv_key, hash, sig);
+        u_assert_int_eq(res, 0);
+        u_assert_mem_eq(sig, sig_uecc, 64);
+        res = uECC_verify(pub_key, hash, sizeof(hash), sig, uECC_secp256r1());
+        u_assert_int_eq(res, 1);
+    }
+
+    // Speed of the U2F operations: public key (register) and signing (both)
+    clock_t t = clock();
+    for (i = 0; i < N; i++) {
+        uECC_compute_public_key(priv_key, pub_key_uecc, uECC_secp256r1());
+        uECC_sign_deterministic(priv_key, hash, sizeof(hash), &ctx.uECC, sig_uecc,
+                                uECC_secp256r1());
+    }
+    float t_uecc = (float)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (i = 0; i < N; i++) {
+        p256_get_public_key(priv_key, pub_key);
+        p256_sign_digest(priv_key, hash, sig);
+    }
+    float t_p256 = (float)(clock() - t) / CLOCKS_PER_SEC;
+    u_print_info("secp256r1 public key + sign: %0.2f ms (uECC)  %0.2f ms (p256)\n",
+                 t_uecc * 1000 / N, t_p256 * 1000 / N);
+}
+
+static void test_p256_nonce(void)
+{
+    uint8_t priv_key[32], hash[32], k[32], sig[64], pub_key[64];
+    p256_nonce nonce;
+    size_t i, N = 100;
+    int res;
+
+    // RFC6979 A.2.5 "sample" with its nonce k
+    memcpy(priv_key,
+           utils_hex_to_uint8("c9afa9d845ba75166b5c215767b1d6934e50c3db36e89b127b8a622b120f6721"),
+           32);
+    memcpy(k, utils_hex_to_uint8("a6e3c57dd01abe90086538398355dd4c3b17aa873382b0f24d6129493d8aad60"),
+           32);
+    res = p256_nonce_precompute(k, &nonce);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(nonce.r,
+                    utils_hex_to_uint8("efd48b2aacb6a8fd1140dd9cd45e81d69d2c877b56aaf991c34d0ea84eaf3716"),
+                    32);
+    sha256_Raw((const uint8_t *)"sample", 6, hash);
+    res = p256_sign_digest_nonce(priv_key, hash, &nonce, sig);
+    u_assert_int_eq(res, 0);
+    u_assert_mem_eq(sig,
+                    utils_hex_to_uint8("efd48b2aacb6a8fd1140dd9cd45e81d69d2c877b56aaf991c34d0ea84eaf37160834e36ad29a83bf2bc9385e491d6099c8fdf9d1ed67aa7ea5f51f93782857a9"),
+                    64);
+
+    // Nonce range
+    memset(k, 0, sizeof(k));
+    u_assert_int_eq(p256_nonce_precompute(k, &nonce), 1);
+    memcpy(k, utils_hex_to_uint8("ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551"),
+           32);
+    u_assert_int_eq(p256_nonce_precompute(k, &nonce), 1);
+
+    for (i = 0; i < N; i++) {
+        random_bytes(priv_key, sizeof(priv_key), 0);
+        random_bytes(hash, sizeof(hash), 0);
+        random_bytes(k, sizeof(k), 0);
+        if (!p256_is_valid(priv_key) || p256_nonce_precompute(k, &nonce)) {
+            continue;
+        }
+        res = p256_get_public_key(priv_key, pub_key);
+        u_assert_int_eq(res, 0);
+        res = p256_sign_digest_nonce(priv_key, hash, &nonce, sig);
+        u_assert_int_eq(res, 0);
+        u_assert_mem_eq(sig, nonce.r, 32);
+        res = uECC_verify(pub_key, hash, sizeof(hash), sig, uECC_secp256r1());
+        u_assert_int_eq(res, 1);
+    }
+
+    // Speed of the precomputation (idle) and of the remaining signing step
+    clock_t t = clock();
+    for (i = 0; i < N; i++) {
+        p256_nonce_precompute(k, &nonce);
+    }
+    float t_pre = (float)(clock() - t) / CLOCKS_PER_SEC;
+    t = clock();
+    for (i = 0; i < N; i++) {
+        p256_sign_digest_nonce(priv_key, hash, &nonce, sig);
+    }
+    float t_sign = (float)(clock() - t) / CLOCKS_PER_SEC;
+    u_print_info("secp256r1 nonce precompute: %0.3f ms  sign: %0.3f ms\n",
+                 t_pre * 1000 / N, t_sign * 1000 / N);
+}
+
+
+
+static void test_inverse_speed(void)
+{
+    uint8_t x[32], inv[32], tmp[32];
+    size_t i, N = 2000;
+
+    memcpy(x, utils_hex_to_uint8("c55ece858b0ddd5263f96810fe14437cd3b5e1fbd7c6a2ec1e031f05e86d8bd5"),
+           32);
+
+    clock_t t = clock();
+
+    for (i = 0 ; i < N; i++) {
+        uECC_inverse_mod_p(inv, x, uECC_secp256k1());
+        uECC_inverse_mod_p(tmp, inv, uECC_secp256k1());
+        u_assert_mem_eq(tmp, x, 32);
+        uECC_inverse_mod_n(inv, x, uECC_secp256k1());
+        uECC_inverse_mod_n(tmp, inv, uECC_secp256k1());
+        u_assert_mem_eq(tmp, x, 32);
+        x[i % 32] ^= inv[31];
+    }
+
+    u_print_info("Inversion speed (%s): %0.2f inv/s\n",
+                 uECC_SAFEGCD_INVERSE_secp256k1 ? "safegcd" : "binary euclid",
+                 N * 4 / ((float)(clock() - t) / CLOCKS_PER_SEC));
+
+    // 0 has no inverse and maps to 0
+    memset(x, 0, sizeof(x));
+    uECC_inverse_mod_n(inv, x, uECC_secp256k1());
+    u_assert_mem_eq(inv, x, 32);
+
+    // (n - 1)^-1 = n - 1
+    memcpy(x, utils_hex_to_uint8("fffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364140"),
+           32);
+    uECC_inverse_mod_n(inv, x, uECC_secp256k1());
+    u_assert_mem_eq(inv, x, 32);
+
+    // 2^-1 mod p = (p + 1) / 2
+    memset(x, 0, sizeof(x));
+    x[31] = 2;
+    uECC_inverse_mod_p(inv, x, uECC_secp256k1());
+    u_assert_mem_eq(inv,
+                    utils_hex_to_uint8("7fffffffffffffffffffffffffffffffffffffffffffffffffffffff7ffffe18"),
+                    32);
 }
 
 
@@ -962,6 +1519,446 @@ static void test_buffer_overflow(void)
 }
 
 
+// Plays the queued LED pattern on a simulated SysTick and records the
+// timeline as (level, duration) segments. Returns the number of segments.
+static int led_simulate(uint16_t tick_ms, uint8_t *levels, uint16_t *durations, int max)
+{
+    int n = 0;
+    uint32_t t = 0;
+
+    levels[0] = led_is_on();
+    durations[0] = 0;
+    while (led_busy() && t < 60000) {
+        led_tick(tick_ms);
+        t += tick_ms;
+        durations[n] += tick_ms;
+        if (led_is_on() != levels[n] && n + 1 < max) {
+            n++;
+            levels[n] = led_is_on();
+            durations[n] = 0;
+        }
+    }
+    return n + 1;
+}
+
+
+static void test_led_pattern(void)
+{
+    uint8_t levels[32], code;
+    uint16_t durations[32];
+    int i, n;
+
+    // Blink: 300 ms on, then off
+    led_blink();
+    u_assert_int_eq(led_busy(), 1);
+    u_assert_int_eq(led_is_on(), 1);
+    n = led_simulate(25, levels, durations, 32);
+    u_assert_int_eq(n, 2);
+    u_assert_int_eq(levels[0], 1);
+    u_assert_int_eq(durations[0], 300);
+    u_assert_int_eq(levels[1], 0);
+    u_assert_int_eq(led_busy(), 0);
+
+    // Abort: off 300, on 100, off 100, on 100, off
+    led_on();
+    led_abort();
+    n = led_simulate(25, levels, durations, 32);
+    u_assert_int_eq(n, 5);
+    u_assert_int_eq(levels[0], 0);
+    u_assert_int_eq(durations[0], 300);
+    for (i = 1; i < 4; i++) {
+        u_assert_int_eq(levels[i], i % 2);
+        u_assert_int_eq(durations[i], 100);
+    }
+    u_assert_int_eq(levels[4], 0);
+
+    // Pairing code: pause, code x (300 on, 300 off), pause
+    for (code = 1; code <= LED_MAX_CODE_BLINKS; code++) {
+        led_code(&code, 1);
+        n = led_simulate(25, levels, durations, 32);
+        u_assert_int_eq(n, 2 * code + 1);
+        u_assert_int_eq(levels[0], 0);
+        u_assert_int_eq(durations[0], 500);
+        for (i = 1; i < n - 1; i++) {
+            u_assert_int_eq(levels[i], i % 2);
+            u_assert_int_eq(durations[i], 300);
+        }
+        u_assert_int_eq(levels[n - 1], 0);
+        u_assert_int_eq(durations[n - 1], 300 + 500);
+    }
+
+    // Ticks that do not divide the step durations
+    led_blink();
+    n = led_simulate(40, levels, durations, 32);
+    u_assert_int_eq(n, 2);
+    u_assert_int_eq(durations[0], 320);
+
+    // Direct control stops a pattern
+    code = LED_MAX_CODE_BLINKS;
+    led_code(&code, 1);
+    led_tick(600);
+    u_assert_int_eq(led_is_on(), 1);
+    led_off();
+    u_assert_int_eq(led_busy(), 0);
+    led_tick(300);
+    u_assert_int_eq(led_is_on(), 0);
+
+    // Pairing: queueing the longest code returns right away. The pairing
+    // command itself still waits in touch_button_press() during playback.
+    clock_t t = clock();
+    for (i = 0; i < LED_MAX_BLINK_SETS; i++) {
+        led_code(&code, 1);
+    }
+    float t_queue = (float)(clock() - t) / CLOCKS_PER_SEC;
+    n = led_simulate(25, levels, durations, 32);
+    uint32_t t_play = 0;
+    for (i = 0; i < n; i++) {
+        t_play += durations[i];
+    }
+    u_print_info("LED pairing code: %u ms playback per set, led_code() takes %0.4f ms\n",
+                 (unsigned)t_play, t_queue * 1000 / LED_MAX_BLINK_SETS);
+}
+
+
+static void test_touch_state(void)
+{
+    TOUCH_STATE state;
+    int i;
+
+    u_assert_int_eq(touch_state_start(&state, 0xff, QTOUCH_TOUCH_THRESH), DBB_ERROR);
+
+    // Sensor noise below the threshold is not a touch
+    u_assert_int_eq(touch_state_start(&state, DBB_TOUCH_SHORT, QTOUCH_TOUCH_THRESH), DBB_OK);
+    for (i = 0; i < 10; i++) {
+        u_assert_int_eq(touch_state_step(&state, 25, QTOUCH_TOUCH_THRESH), TOUCH_EVENT_NONE);
+    }
+    u_assert_int_eq(state.state, TOUCH_STATE_WAIT);
+    u_assert_int_eq(touch_state_step(&state, 25, QTOUCH_TOUCH_THRESH + 1), TOUCH_EVENT_NONE);
+    u_assert_int_eq(state.state, TOUCH_STATE_PRESSED);
+    // Hysteresis: released below half the threshold
+    u_assert_int_eq(touch_state_step(&state, 25, QTOUCH_TOUCH_THRESH / 2), TOUCH_EVENT_NONE);
+    u_assert_int_eq(touch_state_step(&state, 25, 0), TOUCH_EVENT_PRESS);
+    u_assert_int_eq(state.result, DBB_TOUCHED);
+    u_assert_int_eq(touch_state_step(&state, 25, 0), TOUCH_EVENT_PRESS);
+
+    // Scripted sensor
+    {
+        static const struct {
+            uint8_t type;
+            SHAM_TOUCH touch;
+            uint8_t result;
+            uint32_t time_ms;
+        } cases[] = {
+            { DBB_TOUCH_LONG, { 500, 4000 }, DBB_TOUCHED, 500 + QTOUCH_TOUCH_TIMEOUT },
+            { DBB_TOUCH_LONG, { 500, 1000 }, DBB_ERR_TOUCH_ABORT, 1500 },
+            { DBB_TOUCH_LONG, { 0, 0 }, DBB_ERR_TOUCH_TIMEOUT, QTOUCH_TOUCH_TIMEOUT_HARD + 25 },
+            { DBB_TOUCH_LONG_BLINK, { 5000, 4000 }, DBB_TOUCHED, 5000 + QTOUCH_TOUCH_TIMEOUT },
+            { DBB_TOUCH_SHORT, { 100, 200 }, DBB_TOUCHED, 300 },
+            { DBB_TOUCH_SHORT, { 100, 5000 }, DBB_ERR_TOUCH_ABORT, 100 + QTOUCH_TOUCH_TIMEOUT },
+            { DBB_TOUCH_TIMEOUT, { 1000, 100 }, DBB_TOUCHED, 1000 },
+            { DBB_TOUCH_TIMEOUT, { 0, 0 }, DBB_ERR_TOUCH_TIMEOUT, QTOUCH_TOUCH_TIMEOUT },
+            { DBB_TOUCH_TIMEOUT, { 4000, 100 }, DBB_ERR_TOUCH_TIMEOUT, QTOUCH_TOUCH_TIMEOUT },
+            { DBB_TOUCH_REJECT_TIMEOUT, { 1000, 100 }, DBB_ERR_TOUCH_ABORT, 1000 },
+            { DBB_TOUCH_REJECT_TIMEOUT, { 0, 0 }, DBB_ERR_TOUCH_TIMEOUT, QTOUCH_TOUCH_TIMEOUT },
+        };
+        for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+            sham_touch_script(&cases[i].touch, 1);
+            u_assert_int_eq(touch_button_press(cases[i].type), cases[i].result);
+            u_assert_int_eq(sham_touch_time(), cases[i].time_ms);
+            u_assert_int_eq(sham_touch_script_remaining(), 0);
+            led_off();
+        }
+    }
+
+    // The timeout starts after the LED pattern, e.g. the pairing code
+    {
+        uint8_t code = LED_MAX_CODE_BLINKS;
+        SHAM_TOUCH none = { 0, 0 };
+        uint32_t pattern_ms = 0;
+        uint8_t levels[32];
+        uint16_t durations[32];
+        int n;
+
+        led_code(&code, 1);
+        n = led_simulate(25, levels, durations, 32);
+        for (i = 0; i < n; i++) {
+            pattern_ms += durations[i];
+        }
+        led_code(&code, 1);
+        sham_touch_script(&none, 1);
+        u_assert_int_eq(touch_button_press(DBB_TOUCH_REJECT_TIMEOUT), DBB_ERR_TOUCH_TIMEOUT);
+        // Within one tick
+        u_assert_int_eq(sham_touch_time() + 25 >= pattern_ms + QTOUCH_TOUCH_TIMEOUT, 1);
+        u_assert_int_eq(sham_touch_time() <= pattern_ms + QTOUCH_TOUCH_TIMEOUT, 1);
+    }
+
+    // Without a script the touch is accepted
+    u_assert_int_eq(touch_button_press(DBB_TOUCH_LONG), DBB_TOUCHED);
+    u_assert_int_eq(touch_button_press(DBB_TOUCH_SHORT), DBB_TOUCHED);
+    led_off();
+}
+
+
+static void test_crypto_table(void)
+{
+    // Simulated flash: the bootloader image with its crypto region, and the
+    // crypto pin from the firmware image
+    static uint8_t boot[FLASH_BOOT_LEN];
+    uint8_t pin[FLASH_APP_CRYPTO_PIN_LEN], hash[64], hash_table[64];
+    uint8_t *region = boot + (FLASH_CRYPTO_START - FLASH_BOOT_START);
+    const uint8_t msg[] = "abc";
+    const CRYPTO_TABLE *table;
+    SHA256_CTX ctx256;
+    SHA512_CTX ctx512;
+    CRYPTO_TABLE bad;
+    uint32_t i;
+
+    // Region ends before the 32 bytes of factory entropy
+    u_assert_int_eq(FLASH_CRYPTO_START + FLASH_CRYPTO_LEN, FLASH_BOOT_START + FLASH_BOOT_LEN - 32);
+
+    memset(boot, 0xff, sizeof(boot));
+    memcpy(region, &crypto_table, sizeof(crypto_table));
+    for (i = sizeof(crypto_table); i < FLASH_CRYPTO_LEN; i++) {
+        region[i] = i;
+    }
+    sha256_Raw(region, FLASH_CRYPTO_LEN, pin);
+
+    // Bootloader: pinned firmware on the region it was built against
+    u_assert_int_eq(crypto_region_verify(region, FLASH_CRYPTO_LEN, pin), DBB_OK);
+
+    // Firmware: calls through the table match the linked copy
+    table = crypto_table_get(region);
+    u_assert_int_eq(table != NULL, 1);
+    table->sha256_Raw(msg, sizeof(msg) - 1, hash_table);
+    sha256_Raw(msg, sizeof(msg) - 1, hash);
+    u_assert_mem_eq(hash, hash_table, SHA256_DIGEST_LENGTH);
+    table->sha256_Init(&ctx256);
+    table->sha256_Update(&ctx256, msg, sizeof(msg) - 1);
+    table->sha256_Final(hash_table, &ctx256);
+    u_assert_mem_eq(hash, hash_table, SHA256_DIGEST_LENGTH);
+    table->sha512_Raw(msg, sizeof(msg) - 1, hash_table);
+    sha512_Raw(msg, sizeof(msg) - 1, hash);
+    u_assert_mem_eq(hash, hash_table, SHA512_DIGEST_LENGTH);
+    table->sha512_Init(&ctx512);
+    table->sha512_Update(&ctx512, msg, sizeof(msg) - 1);
+    table->sha512_Final(hash_table, &ctx512);
+    u_assert_mem_eq(hash, hash_table, SHA512_DIGEST_LENGTH);
+
+    // Different region code than the firmware was pinned to
+    region[FLASH_CRYPTO_LEN - 1] ^= 1;
+    u_assert_int_eq(crypto_region_verify(region, FLASH_CRYPTO_LEN, pin), DBB_ERROR);
+    region[FLASH_CRYPTO_LEN - 1] ^= 1;
+
+    // Incompatible table
+    memcpy(&bad, &crypto_table, sizeof(bad));
+    bad.version++;
+    memcpy(region, &bad, sizeof(bad));
+    u_assert_int_eq(crypto_table_get(region) == NULL, 1);
+    sha256_Raw(region, FLASH_CRYPTO_LEN, pin);
+    u_assert_int_eq(crypto_region_verify(region, FLASH_CRYPTO_LEN, pin), DBB_ERROR);
+
+    // Bootloader without a crypto region
+    memset(region, 0xff, FLASH_CRYPTO_LEN);
+    u_assert_int_eq(crypto_table_get(region) == NULL, 1);
+    u_assert_int_eq(crypto_region_verify(region, FLASH_CRYPTO_LEN, pin), DBB_ERROR);
+
+    // Firmware that links its own copy boots on any bootloader
+    memset(pin, 0xff, sizeof(pin));
+    u_assert_int_eq(crypto_region_verify(region, FLASH_CRYPTO_LEN, pin), DBB_OK);
+}
+
+
+// Host flash simulator for the bootloader firmware write. Times are in 100 us
+// ticks: USB full speed moves one 64-byte HID packet per 1 ms frame into two
+// endpoint banks; programming a 512-byte page takes 1.5 ms with the CPU stalled
+// (interrupts off); erasing 4 kB takes 10 ms; SHA256 runs at about 1.6 MB/s.
+#define SIM_FRAME           10
+#define SIM_PACKET          64
+#define SIM_FIFO            (2 * SIM_PACKET)
+#define SIM_REPORT          (FLASH_BOOT_OP_LEN + FLASH_BOOT_CHUNK_LEN)
+#define SIM_REPLY           50// 256-byte reply (4 frames) and host turnaround
+#define SIM_PAGE_PROGRAM    15
+#define SIM_ERASE_CHUNK     100
+#define SIM_HASH_CHUNK      25
+
+static uint8_t sim_flash[FLASH_APP_LEN];
+static BOOT_PIPELINE sim_pipeline;
+
+
+// NOR flash: programming only clears bits
+static uint8_t sim_program_page(uint32_t offset, const uint8_t *page)
+{
+    uint32_t i;
+    for (i = 0; i < IFLASH0_PAGE_SIZE; i++) {
+        sim_flash[offset + i] &= page[i];
+    }
+    return !memcmp(sim_flash + offset, page, IFLASH0_PAGE_SIZE);
+}
+
+
+// Erase, write and verify the hash, as py/load_firmware.py. Returns the time
+// in ticks. 'pipelined' uses OP_WRITE_PIPELINED and the streamed hash; otherwise
+// each chunk is programmed before the reply and the hash re-reads the flash.
+static uint32_t sim_upgrade(const uint8_t *fw, uint8_t pipelined,
+                            uint8_t hash[SHA256_DIGEST_LENGTH])
+{
+    uint32_t t, sent = 0, fifo = 0, received = 0, offset, crc;
+    uint32_t stall = 0, hashing = 0, reply = 0, page_pending = 0, replied = 0;
+    uint8_t chunk = 0, page_ok = 1, hashed;
+    const uint8_t *page;
+
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+    t = FLASH_BOOT_CHUNK_NUM * SIM_ERASE_CHUNK;
+    boot_pipeline_reset(&sim_pipeline);
+
+    while (replied < FLASH_BOOT_CHUNK_NUM || boot_pipeline_pending(&sim_pipeline) ||
+            stall || hashing) {
+        t++;
+
+        // Host
+        if (chunk < FLASH_BOOT_CHUNK_NUM && !reply && sent < SIM_REPORT &&
+                t % SIM_FRAME == 0 && fifo < SIM_FIFO) {
+            uint32_t n = MIN(SIM_PACKET, SIM_REPORT - sent);
+            sent += n;
+            fifo += n;
+        }
+        if (reply && --reply == 0) {
+            replied++;
+            chunk++;
+            sent = 0;
+        }
+
+        // Flash busy: nothing else runs
+        if (stall) {
+            if (--stall == 0) {
+                hashed = sim_pipeline.hashed;
+                boot_pipeline_page_done(&sim_pipeline, page_ok);
+                if (pipelined && sim_pipeline.hashed != hashed) {
+                    hashing = SIM_HASH_CHUNK;
+                }
+                page_pending--;
+                if (!pipelined && !page_pending) {
+                    reply = SIM_REPLY;
+                }
+            }
+            continue;
+        }
+
+        // USB interrupt
+        received += fifo;
+        fifo = 0;
+        if (received == SIM_REPORT) {
+            received = 0;
+            if (boot_pipeline_push(&sim_pipeline, chunk, fw + chunk * FLASH_BOOT_CHUNK_LEN,
+                                   &crc) != DBB_OK ||
+                    crc != utils_crc32(fw + chunk * FLASH_BOOT_CHUNK_LEN, FLASH_BOOT_CHUNK_LEN)) {
+                return 0;// Never busy with one chunk per round trip
+            }
+            if (pipelined) {
+                reply = SIM_REPLY;
+            } else {
+                page_pending = FLASH_BOOT_PAGES_PER_CHUNK;
+            }
+        }
+
+        // Main loop (or the synchronous write in the interrupt)
+        if (hashing) {
+            hashing--;
+            continue;
+        }
+        if ((page = boot_pipeline_page(&sim_pipeline, &offset))) {
+            page_ok = sim_program_page(offset, page);
+            stall = SIM_PAGE_PROGRAM;
+            if (pipelined) {
+                page_pending++;
+            }
+        }
+    }
+
+    // OP_VERIFY
+    t += SIM_REPORT / SIM_PACKET * SIM_FRAME + SIM_REPLY;
+    if (pipelined) {
+        boot_pipeline_hash(&sim_pipeline, sim_flash, hash);
+        t += (FLASH_BOOT_CHUNK_NUM - sim_pipeline.hashed) * SIM_HASH_CHUNK;
+    } else {
+        sha256_Raw(sim_flash, FLASH_APP_LEN, hash);
+        t += FLASH_BOOT_CHUNK_NUM * SIM_HASH_CHUNK;
+    }
+    return t;
+}
+
+
+static void test_boot_pipeline(void)
+{
+    static uint8_t fw[FLASH_APP_LEN];
+    uint8_t hash[SHA256_DIGEST_LENGTH], hash_fw[SHA256_DIGEST_LENGTH];
+    uint32_t offset, crc, t_sync, t_pipelined;
+    const uint8_t *page;
+    int i;
+
+    u_assert_int_eq(utils_crc32((const uint8_t *)"123456789", 9), 0xcbf43926);
+
+    random_bytes(fw, sizeof(fw), 0);
+    memset(fw + sizeof(fw) - 3 * FLASH_BOOT_CHUNK_LEN, 0xff, 3 * FLASH_BOOT_CHUNK_LEN);
+    sha256_Raw(fw, sizeof(fw), hash_fw);
+
+    // Two buffers, then busy until a chunk is programmed
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+    boot_pipeline_reset(&sim_pipeline);
+    u_assert_int_eq(boot_pipeline_page(&sim_pipeline, &offset) == NULL, 1);
+    u_assert_int_eq(boot_pipeline_push(&sim_pipeline, 0, fw, &crc), DBB_OK);
+    u_assert_int_eq(crc, utils_crc32(fw, FLASH_BOOT_CHUNK_LEN));
+    u_assert_int_eq(boot_pipeline_push(&sim_pipeline, 1, fw + FLASH_BOOT_CHUNK_LEN, &crc),
+                    DBB_OK);
+    u_assert_int_eq(boot_pipeline_push(&sim_pipeline, 2, fw, &crc), DBB_ERROR);
+    u_assert_int_eq(boot_pipeline_pending(&sim_pipeline), 2);
+    for (i = 0; i < FLASH_BOOT_PAGES_PER_CHUNK; i++) {
+        page = boot_pipeline_page(&sim_pipeline, &offset);
+        u_assert_int_eq(offset, i * IFLASH0_PAGE_SIZE);
+        boot_pipeline_page_done(&sim_pipeline, sim_program_page(offset, page));
+    }
+    u_assert_int_eq(boot_pipeline_pending(&sim_pipeline), 1);
+    u_assert_int_eq(sim_pipeline.hashed, 1);
+
+    // Chunk 1 fails to program: left out of the streamed hash
+    page = boot_pipeline_page(&sim_pipeline, &offset);
+    u_assert_int_eq(offset, FLASH_BOOT_CHUNK_LEN);
+    boot_pipeline_page_done(&sim_pipeline, 0);
+    while ((page = boot_pipeline_page(&sim_pipeline, &offset))) {
+        boot_pipeline_page_done(&sim_pipeline, sim_program_page(offset, page));
+    }
+    u_assert_int_eq(sim_pipeline.hashed, 1);
+    boot_pipeline_hash(&sim_pipeline, sim_flash, hash);
+    sha256_Raw(sim_flash, FLASH_APP_LEN, hash_fw);
+    u_assert_mem_eq(hash, hash_fw, SHA256_DIGEST_LENGTH);
+
+    // Rewriting a streamed chunk restarts the stream
+    u_assert_int_eq(boot_pipeline_push(&sim_pipeline, 0, fw, &crc), DBB_OK);
+    while ((page = boot_pipeline_page(&sim_pipeline, &offset))) {
+        boot_pipeline_page_done(&sim_pipeline, sim_program_page(offset, page));
+    }
+    u_assert_int_eq(sim_pipeline.hashed, 0);
+    boot_pipeline_hash(&sim_pipeline, sim_flash, hash);
+    u_assert_mem_eq(hash, hash_fw, SHA256_DIGEST_LENGTH);
+
+    // Full upgrade, before and after
+    sha256_Raw(fw, sizeof(fw), hash_fw);
+    t_sync = sim_upgrade(fw, 0, hash);
+    u_assert_int_eq(t_sync != 0, 1);
+    u_assert_mem_eq(hash, hash_fw, SHA256_DIGEST_LENGTH);
+    u_assert_mem_eq(sim_flash, fw, sizeof(fw));
+    t_pipelined = sim_upgrade(fw, 1, hash);
+    u_assert_int_eq(t_pipelined != 0, 1);
+    u_assert_mem_eq(hash, hash_fw, SHA256_DIGEST_LENGTH);
+    u_assert_mem_eq(sim_flash, fw, sizeof(fw));
+    u_assert_int_eq(sim_pipeline.hashed, FLASH_BOOT_CHUNK_NUM);
+    u_assert_int_eq(t_pipelined < t_sync, 1);
+
+    u_print_info("Firmware upgrade (simulated): %u ms synchronous, %u ms pipelined\n",
+                 t_sync / 10, t_pipelined / 10);
+}
+
+
 static void test_utils(void)
 {
     // hex conversion
@@ -1080,7 +2077,12 @@ int main(void)
     random_init();
 
     u_run_test(test_sign_speed);
+    u_run_test(test_sign_batch);
     u_run_test(test_verify_speed);
+    u_run_test(test_uecc_verify);
+    u_run_test(test_p256);
+    u_run_test(test_p256_nonce);
+    u_run_test(test_inverse_speed);
     u_run_test(test_ecdh);
     u_run_test(test_ecc_sig_to_der);
     u_run_test(test_bip32_vector_1);
@@ -1093,6 +2095,10 @@ int main(void)
     u_run_test(test_aes_cbc);
     u_run_test(test_buffer_overflow);
     u_run_test(test_utils);
+    u_run_test(test_led_pattern);
+    u_run_test(test_touch_state);
+    u_run_test(test_crypto_table);
+    u_run_test(test_boot_pipeline);
 
     // unit tests for secp256k1 rfc6979 are in tests_secp256k1.c
     u_run_test(test_rfc6979);
@@ -1100,6 +2106,9 @@ int main(void)
 #ifdef ECC_USE_SECP256K1_LIB
     // recoverable signature not implemented for uECC
     u_run_test(test_recoverable_signature);
+    u_run_test(test_sign_batch_libsecp256k1);
+    u_run_test(test_rfc6979_libsecp256k1);
+    u_run_test(test_public_ckd_libsecp256k1);
 #endif
 
     if (!U_TESTS_FAIL) {
@@ -0,0 +1,369 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// hidapi implementation that talks to the virtual device daemon instead of
+// USB hardware. Build as a shared library and LD_PRELOAD it into an unchanged
+// hidapi client (py/send_command.py, tests_api in live mode, ...).
+//
+// Enumeration always reports the two interfaces of one Digital Bitbox. Each
+// opened interface gets its own connection to the daemon.
+
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "hidapi.h"
+#include "virtual_device.h"
+
+
+#define VIRTUAL_PATH_HWW  "virtual:hww"
+#define VIRTUAL_PATH_U2F  "virtual:u2f"
+
+
+struct hid_device_ {
+    int fd;
+    uint8_t iface;
+    int blocking;
+};
+
+
+static const struct {
+    const char *path;
+    int interface_number;
+    unsigned short usage_page;
+} virtual_interfaces[VIRTUAL_INTERFACE_NUM] = {
+    { VIRTUAL_PATH_HWW, VIRTUAL_INTERFACE_HWW, 0xffff },
+    { VIRTUAL_PATH_U2F, VIRTUAL_INTERFACE_U2F, 0xf1d0 },
+};
+
+
+static const char *virtual_socket_path(void)
+{
+    const char *path = getenv(VIRTUAL_SOCKET_ENV);
+    return path ? path : VIRTUAL_SOCKET_DEFAULT;
+}
+
+
+static wchar_t *virtual_wcsdup(const wchar_t *s)
+{
+    wchar_t *d = malloc((wcslen(s) + 1) * sizeof(wchar_t));
+    if (d) {
+        wcscpy(d, s);
+    }
+    return d;
+}
+
+
+static int virtual_copy_string(wchar_t *string, size_t maxlen, const wchar_t *value)
+{
+    if (!string || !maxlen) {
+        return -1;
+    }
+    wcsncpy(string, value, maxlen);
+    string[maxlen - 1] = L'\0';
+    return 0;
+}
+
+
+int HID_API_EXPORT hid_init(void)
+{
+    return 0;
+}
+
+
+int HID_API_EXPORT hid_exit(void)
+{
+    return 0;
+}
+
+
+struct hid_device_info HID_API_EXPORT *hid_enumerate(unsigned short vendor_id,
+        unsigned short product_id)
+{
+    struct hid_device_info *root = NULL, **next = &root;
+    int i;
+
+    if ((vendor_id && vendor_id != VIRTUAL_VENDOR_ID) ||
+            (product_id && product_id != VIRTUAL_PRODUCT_ID)) {
+        return NULL;
+    }
+    if (access(virtual_socket_path(), F_OK) != 0) {
+        return NULL;// Daemon not running
+    }
+
+    for (i = 0; i < VIRTUAL_INTERFACE_NUM; i++) {
+        struct hid_device_info *dev = calloc(1, sizeof(*dev));
+        if (!dev) {
+            break;
+        }
+        dev->path = strdup(virtual_interfaces[i].path);
+        dev->vendor_id = VIRTUAL_VENDOR_ID;
+        dev->product_id = VIRTUAL_PRODUCT_ID;
+        dev->serial_number = virtual_wcsdup(L"virtual");
+        dev->release_number = 0;
+        dev->manufacturer_string = virtual_wcsdup(L"Digital Bitbox");
+        dev->product_string = virtual_wcsdup(L"Digital Bitbox (virtual)");
+        dev->usage_page = virtual_interfaces[i].usage_page;
+        dev->usage = 1;
+        dev->interface_number = virtual_interfaces[i].interface_number;
+        *next = dev;
+        next = &dev->next;
+    }
+    return root;
+}
+
+
+void HID_API_EXPORT hid_free_enumeration(struct hid_device_info *devs)
+{
+    while (devs) {
+        struct hid_device_info *next = devs->next;
+        free(devs->path);
+        free(devs->serial_number);
+        free(devs->manufacturer_string);
+        free(devs->product_string);
+        free(devs);
+        devs = next;
+    }
+}
+
+
+HID_API_EXPORT hid_device *hid_open_path(const char *path)
+{
+    struct sockaddr_un addr;
+    hid_device *dev;
+    int i, fd;
+
+    for (i = 0; i < VIRTUAL_INTERFACE_NUM; i++) {
+        if (path && !strcmp(path, virtual_interfaces[i].path)) {
+            break;
+        }
+    }
+    if (i == VIRTUAL_INTERFACE_NUM) {
+        return NULL;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, virtual_socket_path(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    dev = calloc(1, sizeof(*dev));
+    if (!dev) {
+        close(fd);
+        return NULL;
+    }
+    dev->fd = fd;
+    dev->iface = virtual_interfaces[i].interface_number;
+    dev->blocking = 1;
+    return dev;
+}
+
+
+HID_API_EXPORT hid_device *hid_open(unsigned short vendor_id, unsigned short product_id,
+                                    const wchar_t *serial_number)
+{
+    (void) serial_number;
+    if ((vendor_id && vendor_id != VIRTUAL_VENDOR_ID) ||
+            (product_id && product_id != VIRTUAL_PRODUCT_ID)) {
+        return NULL;
+    }
+    return hid_open_path(VIRTUAL_PATH_HWW);
+}
+
+
+// The first byte is the report ID (always 0 for the Digital Bitbox)
+int HID_API_EXPORT hid_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+    uint8_t record[VIRTUAL_RECORD_SIZE];
+    size_t sent = 0;
+
+    if (!dev || !data || length < 1) {
+        return -1;
+    }
+    memset(record, 0, sizeof(record));
+    record[0] = dev->iface;
+    memcpy(record + 1, data + 1,
+           length - 1 < USB_REPORT_SIZE ? length - 1 : USB_REPORT_SIZE);
+
+    while (sent < sizeof(record)) {
+        ssize_t n = write(dev->fd, record + sent, sizeof(record) - sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+    return length;
+}
+
+
+int HID_API_EXPORT hid_read_timeout(hid_device *dev, unsigned char *data, size_t length,
+                                    int milliseconds)
+{
+    uint8_t record[VIRTUAL_RECORD_SIZE];
+    size_t got = 0;
+    struct pollfd pfd;
+
+    if (!dev || !data) {
+        return -1;
+    }
+
+    pfd.fd = dev->fd;
+    pfd.events = POLLIN;
+    while (got < sizeof(record)) {
+        // Only the start of a record may time out
+        int res = poll(&pfd, 1, got ? -1 : milliseconds);
+        ssize_t n;
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            return -1;
+        }
+        if (res == 0) {
+            return 0;
+        }
+        n = read(dev->fd, record + got, sizeof(record) - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+    }
+
+    if (length > USB_REPORT_SIZE) {
+        length = USB_REPORT_SIZE;
+    }
+    memcpy(data, record + 1, length);
+    return length;
+}
+
+
+int HID_API_EXPORT hid_read(hid_device *dev, unsigned char *data, size_t length)
+{
+    return hid_read_timeout(dev, data, length, dev && dev->blocking ? -1 : 0);
+}
+
+
+int HID_API_EXPORT hid_set_nonblocking(hid_device *dev, int nonblock)
+{
+    if (!dev) {
+        return -1;
+    }
+    dev->blocking = !nonblock;
+    return 0;
+}
+
+
+int HID_API_EXPORT hid_send_feature_report(hid_device *dev, const unsigned char *data,
+        size_t length)
+{
+    (void) dev;
+    (void) data;
+    (void) length;
+    return -1;
+}
+
+
+int HID_API_EXPORT hid_get_feature_report(hid_device *dev, unsigned char *data,
+        size_t length)
+{
+    (void) dev;
+    (void) data;
+    (void) length;
+    return -1;
+}
+
+
+void HID_API_EXPORT hid_close(hid_device *dev)
+{
+    if (!dev) {
+        return;
+    }
+    close(dev->fd);
+    free(dev);
+}
+
+
+int HID_API_EXPORT_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string,
+        size_t maxlen)
+{
+    (void) dev;
+    return virtual_copy_string(string, maxlen, L"Digital Bitbox");
+}
+
+
+int HID_API_EXPORT_CALL hid_get_product_string(hid_device *dev, wchar_t *string,
+        size_t maxlen)
+{
+    (void) dev;
+    return virtual_copy_string(string, maxlen, L"Digital Bitbox (virtual)");
+}
+
+
+int HID_API_EXPORT_CALL hid_get_serial_number_string(hid_device *dev, wchar_t *string,
+        size_t maxlen)
+{
+    (void) dev;
+    return virtual_copy_string(string, maxlen, L"virtual");
+}
+
+
+int HID_API_EXPORT_CALL hid_get_indexed_string(hid_device *dev, int string_index,
+        wchar_t *string, size_t maxlen)
+{
+    (void) dev;
+    (void) string_index;
+    (void) string;
+    (void) maxlen;
+    return -1;
+}
+
+
+HID_API_EXPORT const wchar_t *HID_API_CALL hid_error(hid_device *dev)
+{
+    (void) dev;
+    return NULL;
+}
@@ -0,0 +1,358 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Virtual Digital Bitbox: runs the test build of the firmware as a daemon
+// on a UNIX socket. Clients use the hidapi shim (libhidapi_virtual.so), e.g.
+//
+//     ./virtual_device -t 500 &
+//     LD_PRELOAD=./libhidapi_virtual.so python py/send_command.py
+//
+// Options:
+//     -p <path>  socket path (default $DBB_VIRTUAL_SOCKET or /tmp/dbb_virtual.sock)
+//     -d <dir>   working directory; the SD card is the tests/digitalbitbox folder in it
+//     -t <ms>    touch button latency
+//     -e <us>    ATAES132 EEPROM access latency
+//     -s <ms>    SD card file access latency
+//
+// Frames from all clients are processed one at a time, as on the device.
+
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "ecc.h"
+#include "sham.h"
+#include "flags.h"
+#include "led.h"
+#include "memory.h"
+#include "random.h"
+#include "usb.h"
+#include "u2f_device.h"
+#include "wallet.h"
+#include "virtual_device.h"
+
+
+#define VIRTUAL_CLIENTS_MAX   16
+#define VIRTUAL_TIMEOUT_MS    40// u2f_device_timeout() period, as usb_process()
+
+
+typedef struct {
+    int fd;
+    uint8_t record[VIRTUAL_RECORD_SIZE];
+    size_t len;
+} virtual_client;
+
+
+static virtual_client clients[VIRTUAL_CLIENTS_MAX];
+static virtual_client *u2f_client = NULL;// Last client to send a U2F report
+static volatile sig_atomic_t virtual_quit = 0;
+
+
+uint32_t __stack_chk_guard = 0;
+
+extern void __attribute__((noreturn)) __stack_chk_fail(void);
+void __attribute__((noreturn)) __stack_chk_fail(void)
+{
+    printf("\n\nError: stack smashing detected!\n\n");
+    abort();
+}
+
+
+static void virtual_signal(int sig)
+{
+    (void) sig;
+    virtual_quit = 1;
+}
+
+
+static int virtual_write_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return DBB_ERROR;
+        }
+        data += n;
+        len -= n;
+    }
+    return DBB_OK;
+}
+
+
+static uint32_t virtual_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+// Sends the queued replies to the client, or drops them if there is none
+static int virtual_flush(virtual_client *c, uint8_t interface)
+{
+    uint8_t reply[VIRTUAL_RECORD_SIZE];
+    uint8_t *report;
+    int ret = DBB_OK;
+
+    reply[0] = interface;
+    while ((report = usb_reply_queue_read())) {
+        if (!c || ret != DBB_OK) {
+            continue;
+        }
+        memcpy(reply + 1, report, USB_REPORT_SIZE);
+        ret = virtual_write_all(c->fd, reply, sizeof(reply));
+    }
+    return ret;
+}
+
+
+// Runs one received report through the USB layer and sends the replies
+static int virtual_process(virtual_client *c)
+{
+    if (c->record[0] == VIRTUAL_INTERFACE_HWW) {
+        usb_hww_report(c->record + 1);
+    } else if (c->record[0] == VIRTUAL_INTERFACE_U2F) {
+        u2f_client = c;
+        usb_u2f_report(c->record + 1);
+    } else {
+        return DBB_ERROR;
+    }
+    return virtual_flush(c, c->record[0]);
+}
+
+
+static void virtual_close(virtual_client *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+    if (u2f_client == c) {
+        u2f_client = NULL;
+    }
+    virtual_flush(NULL, 0);
+}
+
+
+// Runs the periodic work for every VIRTUAL_TIMEOUT_MS period that has passed,
+// busy or not, and returns the time left until the next period
+static int virtual_tick(uint32_t *last_ms)
+{
+    uint32_t elapsed = virtual_now_ms() - *last_ms;
+    while (elapsed >= VIRTUAL_TIMEOUT_MS) {
+        u2f_device_timeout();
+        wallet_session_timeout(VIRTUAL_TIMEOUT_MS);
+        led_tick(VIRTUAL_TIMEOUT_MS);
+        // A U2F timeout error goes to the client whose message timed out
+        if (virtual_flush(u2f_client, VIRTUAL_INTERFACE_U2F) != DBB_OK) {
+            virtual_close(u2f_client);
+        }
+        *last_ms += VIRTUAL_TIMEOUT_MS;
+        elapsed -= VIRTUAL_TIMEOUT_MS;
+    }
+    wallet_session_idle();
+    return VIRTUAL_TIMEOUT_MS - elapsed;
+}
+
+
+static int virtual_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(fd, VIRTUAL_CLIENTS_MAX) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+static void virtual_serve(int listen_fd)
+{
+    struct pollfd fds[VIRTUAL_CLIENTS_MAX + 1];
+    uint32_t last_ms = virtual_now_ms();
+    int i, n, wait_ms;
+
+    while (!virtual_quit) {
+        wait_ms = virtual_tick(&last_ms);
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (i = 0; i < VIRTUAL_CLIENTS_MAX; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        n = poll(fds, VIRTUAL_CLIENTS_MAX + 1, wait_ms);
+        if (n < 0 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+        if (n <= 0) {
+            u2f_device_idle();
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            for (i = 0; fd >= 0 && i < VIRTUAL_CLIENTS_MAX; i++) {
+                if (clients[i].fd < 0) {
+                    clients[i].fd = fd;
+                    clients[i].len = 0;
+                    break;
+                }
+            }
+            if (fd >= 0 && i == VIRTUAL_CLIENTS_MAX) {
+                close(fd);// Too many clients
+            }
+        }
+
+        for (i = 0; i < VIRTUAL_CLIENTS_MAX; i++) {
+            virtual_client *c = &clients[i];
+            ssize_t len;
+            if (c->fd < 0 || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            len = read(c->fd, c->record + c->len, sizeof(c->record) - c->len);
+            if (len <= 0) {
+                virtual_close(c);
+                continue;
+            }
+            c->len += len;
+            if (c->len == sizeof(c->record)) {
+                c->len = 0;
+                if (virtual_process(c) != DBB_OK) {
+                    virtual_close(c);
+                }
+            }
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *path = getenv(VIRTUAL_SOCKET_ENV);
+    int i, opt, listen_fd;
+
+    if (!path) {
+        path = VIRTUAL_SOCKET_DEFAULT;
+    }
+
+    while ((opt = getopt(argc, argv, "p:d:t:e:s:")) != -1) {
+        switch (opt) {
+            case 'p':
+                path = optarg;
+                break;
+            case 'd':
+                if (chdir(optarg) < 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                sham_set_latency(SHAM_LATENCY_TOUCH, strtoul(optarg, NULL, 10) * 1000);
+                break;
+            case 'e':
+                sham_set_latency(SHAM_LATENCY_EEPROM, strtoul(optarg, NULL, 10));
+                break;
+            case 's':
+                sham_set_latency(SHAM_LATENCY_SD, strtoul(optarg, NULL, 10) * 1000);
+                break;
+            default:
+                printf("Usage: %s [-p socket] [-d dir] [-t touch_ms] [-e eeprom_us] "
+                       "[-s sd_ms]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // SD card folder
+    mkdir("tests", 0700);
+    mkdir("tests/digitalbitbox", 0700);
+
+    random_init();
+    __stack_chk_guard = random_uint32(0);
+    ecc_context_init();
+#ifdef ECC_USE_SECP256K1_LIB
+    bitcoin_ecc.ecc_context_init();
+#endif
+    memory_setup();
+    usb_hww_enable();
+    usb_u2f_enable();
+
+    for (i = 0; i < VIRTUAL_CLIENTS_MAX; i++) {
+        clients[i].fd = -1;
+    }
+    signal(SIGINT, virtual_signal);
+    signal(SIGTERM, virtual_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = virtual_listen(path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    printf("Virtual Digital Bitbox listening on %s\n", path);
+    fflush(stdout);
+
+    virtual_serve(listen_fd);
+
+    for (i = 0; i < VIRTUAL_CLIENTS_MAX; i++) {
+        if (clients[i].fd >= 0) {
+            virtual_close(&clients[i]);
+        }
+    }
+    close(listen_fd);
+    unlink(path);
+
+    ecc_context_destroy();
+#ifdef ECC_USE_SECP256K1_LIB
+    bitcoin_ecc.ecc_context_destroy();
+#endif
+    return 0;
+}
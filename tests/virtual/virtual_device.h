@@ -0,0 +1,55 @@
+/*
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015-2018 Douglas J. Bakkum
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+// Wire format between the virtual device daemon and the hidapi shim.
+//
+// Both directions carry fixed size records over a UNIX stream socket:
+// one interface byte followed by one 64-byte USB report.
+
+
+#ifndef _VIRTUAL_DEVICE_H_
+#define _VIRTUAL_DEVICE_H_
+
+
+#include "usb.h"
+
+
+#define VIRTUAL_SOCKET_ENV      "DBB_VIRTUAL_SOCKET"
+#define VIRTUAL_SOCKET_DEFAULT  "/tmp/dbb_virtual.sock"
+#define VIRTUAL_RECORD_SIZE     (1 + USB_REPORT_SIZE)
+#define VIRTUAL_VENDOR_ID       0x03eb
+#define VIRTUAL_PRODUCT_ID      0x2402
+
+
+typedef enum VIRTUAL_INTERFACE {
+    VIRTUAL_INTERFACE_HWW,
+    VIRTUAL_INTERFACE_U2F,
+    VIRTUAL_INTERFACE_NUM
+} VIRTUAL_INTERFACE;
+
+
+#endif